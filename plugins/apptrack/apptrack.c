@@ -50,51 +50,59 @@ OHM_IMPORTABLE(void, app_query,       (pid_t *pid,
                                        const char **argv0,
                                        const char **group));
 
+OHM_IMPORTABLE(int, add_watch, (DBusBusType type, const char *name,
+                                void (*handler)(const char *, const char *,
+                                                const char *, void *),
+                                void *data));
+OHM_IMPORTABLE(int, del_watch, (DBusBusType type, const char *name,
+                                void (*handler)(const char *, const char *,
+                                                const char *, void *),
+                                void *data));
+
 
 static DBusConnection *bus;
 static GHashTable     *clients;
 static int             nclient;
 
 
+static void client_unregister(const char *id);
+
+
+/********************
+ * client_name_changed
+ ********************/
+static void
+client_name_changed(const char *name, const char *before, const char *after,
+                    void *data)
+{
+    (void)data;
+
+    if (before != NULL && before[0] && (!after || !after[0]))
+        client_unregister(name);
+}
+
+
 /********************
  * client_track_name
  ********************/
 static void
 client_track_name(const char *name, int track)
 {
-    char       filter[1024];
-    DBusError  error;
-
-    snprintf(filter, sizeof(filter),
-             "type='signal',"
-             "sender='org.freedesktop.DBus',interface='org.freedesktop.DBus',"
-             "member='NameOwnerChanged',path='/org/freedesktop/DBus',"
-             "arg0='%s',arg1='%s',arg2=''", name, name);
-    
     /*
      * Notes:
-     *   We block when adding filters, to minimize (= eliminate ?) the time
-     *   window for the client to crash after it has let us know about itself
-     *   but before we managed to install the filter. According to the docs
-     *   we do not re-enter the main loop and all other messages than the
-     *   reply to AddMatch will get queued and processed once we're back in the
-     *   main loop. On the watch removal path we do not care about errors and
-     *   we do not want to block either.
+     *   The dbus plugin demultiplexes NameOwnerChanged for all plugins,
+     *   we just register a watch for the client with it. The match rule
+     *   is sent to the bus right away but we do not block waiting for the
+     *   reply; a client crashing before the bus daemon has processed it
+     *   could slip through just like it could with a blocking AddMatch.
      */
 
     if (track) {
-        dbus_error_init(&error);
-
-        dbus_bus_add_match(bus, filter, &error);
-
-        if (dbus_error_is_set(&error)) {
-            OHM_ERROR("apptrack: failed to add match rule \"%s\": %s", filter,
-                      error.message);
-            dbus_error_free(&error);
-        }
+        if (!add_watch(DBUS_BUS_SYSTEM, name, client_name_changed, NULL))
+            OHM_ERROR("apptrack: failed to add watch for client %s", name);
     }
     else
-        dbus_bus_remove_match(bus, filter, NULL);
+        del_watch(DBUS_BUS_SYSTEM, name, client_name_changed, NULL);
 }
 
 
@@ -287,34 +295,6 @@ app_change_cb(pid_t pid, const char *binary, const char *argv0,
 }
 
 
-/********************
- * name_owner_changed
- ********************/
-static DBusHandlerResult
-name_owner_changed(DBusConnection *conn, DBusMessage *msg, void *user_data)
-{
-    const char *sender, *before, *after;
-
-    (void)conn;
-    (void)user_data;
-
-    if (!dbus_message_is_signal(msg,
-                                "org.freedesktop.DBus", "NameOwnerChanged") ||
-        !dbus_message_get_args(msg, NULL,
-                               DBUS_TYPE_STRING, &sender,
-                               DBUS_TYPE_STRING, &before,
-                               DBUS_TYPE_STRING, &after,
-                               DBUS_TYPE_INVALID))
-        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
-    
-    if (sender != NULL && before != NULL)
-        if (!after || !after[0])
-            client_unregister(sender);
-    
-    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
-}
-
-
 /********************
  * plugin_init
  ********************/
@@ -330,11 +310,6 @@ plugin_init(OhmPlugin *plugin)
 
     dbus_connection_setup_with_g_main(bus, NULL);
 
-    if (!dbus_connection_add_filter(bus, name_owner_changed, NULL, NULL)) {
-        OHM_ERROR("apptrack: failed to add filter for NameOwnerChanged");
-        exit(1);
-    }
-    
     clients = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
     if (clients == NULL) {
         OHM_ERROR("apptrack: failed to create client table");
@@ -345,6 +320,19 @@ plugin_init(OhmPlugin *plugin)
 }
 
 
+/********************
+ * client_untrack
+ ********************/
+static void
+client_untrack(gpointer key, gpointer value, gpointer data)
+{
+    (void)value;
+    (void)data;
+
+    client_track_name((const char *)key, FALSE);
+}
+
+
 /********************
  * plugin_exit
  ********************/
@@ -354,9 +342,9 @@ plugin_exit(OhmPlugin *plugin)
     (void)plugin;
     
     app_unsubscribe(app_change_cb, NULL);
-    dbus_connection_remove_filter(bus, name_owner_changed, NULL);
 
     if (clients != NULL) {
+        g_hash_table_foreach(clients, client_untrack, NULL);
         g_hash_table_destroy(clients);
 
         clients = NULL;
@@ -374,10 +362,12 @@ OHM_PLUGIN_DESCRIPTION("apptrack", "0.0.1", "krisztian.litkey@nokia.com",
                        OHM_LICENSE_LGPL,
                        plugin_init, plugin_exit, NULL);
 
-OHM_PLUGIN_REQUIRES_METHODS(apptrack, 3,
+OHM_PLUGIN_REQUIRES_METHODS(apptrack, 5,
    OHM_IMPORT("cgroups.app_subscribe"  , app_subscribe),
    OHM_IMPORT("cgroups.app_unsubscribe", app_unsubscribe),
-   OHM_IMPORT("cgroups.app_query"      , app_query)
+   OHM_IMPORT("cgroups.app_query"      , app_query),
+   OHM_IMPORT("dbus.add_watch"         , add_watch),
+   OHM_IMPORT("dbus.del_watch"         , del_watch)
 );
 
 
@@ -49,51 +49,65 @@ void auth_creds_exit(OhmPlugin *plugin)
     (void)plugin;
 }
 
-int auth_creds_check(pid_t pid, void *request, char *err, int len)
+auth_creds_t *auth_creds_get(pid_t pid)
+{
+#ifdef HAVE_CREDS
+    return (auth_creds_t *)creds_gettask(pid);
+#else
+    static int dummy;
+
+    (void)pid;
+
+    return (auth_creds_t *)&dummy;
+#endif
+}
+
+void auth_creds_put(auth_creds_t *creds)
+{
+#ifdef HAVE_CREDS
+    if (creds != NULL)
+        creds_free((creds_t)creds);
+#else
+    (void)creds;
+#endif
+}
+
+int auth_creds_match(auth_creds_t *creds, void *request, char *err, int len)
 {
 #ifdef HAVE_CREDS
     char    **pattern = (char **)request;
-    creds_t   creds;
     int       i;
     char      match[256];
     int       match_len;
     int       success;
 
-    if ((creds = creds_gettask(pid)) == NULL) {
-        snprintf(err, len, "Failed to read credentials "
-                 "for task (pid %u)", pid);
-        success = FALSE;
-    }
-    else {
-        success = TRUE;
-        snprintf(err, len, "OK");
-
-        for (i = 0;  pattern[i]; i++) {
-            match_len = creds_find(creds, pattern[i], match,sizeof(match));
-
-            if (match_len < 0) {
-                snprintf(err,len, "No matching credential for %s", pattern[i]);
-                success =  FALSE;
-                break;
-            }
-
-            if (match_len >= (int)sizeof(match)) {
-                snprintf(err, len, "Internal buffer overflow");
-                success = FALSE;
-                break;
-            }
-
-            OHM_DEBUG(DBG_CREDS, "found matching credential %s "
-                      "for pattern %s", pattern[i], match);
+    success = TRUE;
+    snprintf(err, len, "OK");
+
+    for (i = 0;  pattern[i]; i++) {
+        match_len = creds_find((creds_t)creds, pattern[i],
+                               match, sizeof(match));
+
+        if (match_len < 0) {
+            snprintf(err,len, "No matching credential for %s", pattern[i]);
+            success =  FALSE;
+            break;
         }
-    
-        creds_free(creds);
+
+        if (match_len >= (int)sizeof(match)) {
+            snprintf(err, len, "Internal buffer overflow");
+            success = FALSE;
+            break;
+        }
+
+        OHM_DEBUG(DBG_CREDS, "found matching credential %s "
+                  "for pattern %s", pattern[i], match);
     }
 
     return success;
     
 #else
-    (void) pid;
+    (void)creds;
     (void)request;
 
     snprintf(err, len, "OK (default acceptance: creds are not available)");
@@ -102,6 +116,24 @@ int auth_creds_check(pid_t pid, void *request, char *err, int len)
 #endif
 }
 
+int auth_creds_check(pid_t pid, void *request, char *err, int len)
+{
+    auth_creds_t *creds;
+    int           success;
+
+    if ((creds = auth_creds_get(pid)) == NULL) {
+        snprintf(err, len, "Failed to read credentials "
+                 "for task (pid %u)", pid);
+        return FALSE;
+    }
+
+    success = auth_creds_match(creds, request, err, len);
+
+    auth_creds_put(creds);
+
+    return success;
+}
+
 char *auth_creds_request_dump(void *request, char *buf, int len)
 {
     char **list = (char **)request;
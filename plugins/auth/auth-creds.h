@@ -26,9 +26,16 @@ USA.
 /* hack to avoid multiple includes */
 typedef struct _OhmPlugin OhmPlugin;
 
+/* the credentials of a task, looked up once for several checks */
+typedef struct auth_creds_s auth_creds_t;
+
 void  auth_creds_init(OhmPlugin *);
 void  auth_creds_exit(OhmPlugin *);
 
+auth_creds_t *auth_creds_get(pid_t);
+void          auth_creds_put(auth_creds_t *);
+int           auth_creds_match(auth_creds_t *, void *, char *,int);
+
 int   auth_creds_check(pid_t, void *, char *,int);
 char *auth_creds_request_dump(void *, char *,int);
 
@@ -25,6 +25,8 @@ USA.
 #include <stdarg.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <glib.h>
 
@@ -35,6 +37,8 @@ USA.
 
 #define MAX_CREDS 16
 
+#define DEFAULT_CACHE_SIZE 64   /* processes */
+
 
 typedef enum {
     request_unknown = 0,
@@ -47,6 +51,7 @@ typedef struct req_s {
     pid_t         pid;
     req_type_t    type;
     char         *adump;
+    char         *policy;       /* request type and arguments, cache key */
     union {
         char *creds[MAX_CREDS + 1];
     }             args; 
@@ -56,17 +61,62 @@ typedef struct req_s {
     }             cb;
 } req_t;
 
+/*
+ * cached verdicts of a process. The start time tells apart the processes
+ * that reuse a pid; exec, uid/gid changes and the exit of the process are
+ * notified by the cgroups plugin (proc connector) and drop the entry.
+ */
+typedef struct {
+    pid_t        pid;
+    uint64_t     start;         /* start time in clock ticks after boot */
+    GHashTable  *verdicts;      /* policy -> verdict_t */
+} proc_entry_t;
+
+typedef struct {
+    int   success;
+    char *errmsg;
+} verdict_t;
+
 
-static req_t     *reqlist;
+static req_t      *reqlist;     /* pid known, waiting for the idle batch */
+static req_t     **reqtail = &reqlist;
+static guint       idle_id;
+static GHashTable *dbus_queries;/* D-Bus address -> req_t list */
+
+static GHashTable *cache;       /* pid -> proc_entry_t */
+static int         cache_size = DEFAULT_CACHE_SIZE;
+static int         watching;
+
+static struct {
+    unsigned int hits;
+    unsigned int misses;
+    unsigned int lookups;       /* credential lookups */
+} stats;
+
+OHM_IMPORTABLE(void, proc_watch, (void (*callback)(pid_t, void *),
+                                  void *user_data));
+OHM_IMPORTABLE(void, proc_unwatch, (void (*callback)(pid_t, void *),
+                                    void *user_data));
 
 
 static req_t *create_request(char *, void *, auth_request_cb_t, void *);
 static void   destroy_request(req_t *);
-static void   authorize_request(req_t *);
+static void   queue_request(req_t *);
+static void   authorize_pending(void);
+static void   authorize_request(req_t *, proc_entry_t *,
+                                auth_creds_t **, int *);
 
 static gboolean idle_callback(gpointer);
 static void dbus_callback(pid_t, const char *, void *);
 
+static proc_entry_t *cache_lookup(pid_t);
+static void          cache_insert(proc_entry_t *, const char *, int, char *);
+static void          cache_purge(gpointer);
+static void          verdict_free(gpointer);
+static int           cache_watch(void);
+static void          process_changed(pid_t, void *);
+static uint64_t      process_start_time(pid_t);
+
 
 /*! \addtogroup pubif
  *  Functions
@@ -75,12 +125,58 @@ static void dbus_callback(pid_t, const char *, void *);
 
 void auth_request_init(OhmPlugin *plugin)
 {
-    (void)plugin;
+    const char *param;
+    char       *end;
+
+    if ((param = ohm_plugin_get_param(plugin, "verdict-cache")) != NULL) {
+        if (!strcmp(param, "no"))
+            cache_size = 0;
+        else {
+            cache_size = strtol(param, &end, 10);
+
+            if (*end != '\0' || cache_size < 0) {
+                OHM_ERROR("auth: invalid verdict-cache value '%s'", param);
+                cache_size = DEFAULT_CACHE_SIZE;
+            }
+        }
+    }
+
+    dbus_queries = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                         g_free, NULL);
+    cache = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                  NULL, cache_purge);
+
+    OHM_INFO("auth: verdict cache %s (%d processes)",
+             cache_size ? "enabled" : "disabled", cache_size);
 }
 
 void auth_request_exit(OhmPlugin *plugin)
 {
     (void)plugin;
+
+    if (idle_id) {
+        g_source_remove(idle_id);
+        idle_id = 0;
+    }
+
+    if (watching) {
+        proc_unwatch(process_changed, NULL);
+        watching = FALSE;
+    }
+
+    OHM_INFO("auth: verdict cache: %u hits, %u misses, "
+             "%u credential lookups", stats.hits, stats.misses,
+             stats.lookups);
+
+    if (cache != NULL) {
+        g_hash_table_destroy(cache);
+        cache = NULL;
+    }
+
+    if (dbus_queries != NULL) {
+        g_hash_table_destroy(dbus_queries);
+        dbus_queries = NULL;
+    }
 }
 
 
@@ -90,7 +186,9 @@ int auth_request(char *id_type , void *id,
                      
 {
     req_t *request;
+    req_t *pending;
     char  *dbusad;
+    char  *query;
     uintptr_t id_p;
 
     if (!id_type || !id || !req_type || !req || !cb) {
@@ -110,17 +208,30 @@ int auth_request(char *id_type , void *id,
         request->pid = (pid_t) id_p;
         OHM_DEBUG(DBG_REQ, "%s('%s',%u, %u, '%s',<%s>, %p,%p)", __FUNCTION__,
                   id_type,request->pid, req_type,request->adump, cb,data);
-        if (g_idle_add(idle_callback, request) == 0) {
-            OHM_ERROR("auth: failed to add idle callback");
-            return EIO;
-        }
+        queue_request(request);
     }
     else if (!strcmp(id_type, "dbus")) {
         dbusad = (char *)id;
         OHM_DEBUG(DBG_REQ, "%s('%s','%s', '%s',<%s>, %p,%p)", __FUNCTION__,
                   id_type,dbusad, req_type,request->adump, cb,data);
-        if (dbusif_pid_query("system", dbusad, dbus_callback, request) != 0) {
+
+        /* one pid query for all the pending requests of a peer */
+        if ((pending = g_hash_table_lookup(dbus_queries, dbusad)) != NULL) {
+            while (pending->next != NULL)
+                pending = pending->next;
+            pending->next = request;
+            OHM_DEBUG(DBG_REQ, "pid query for %s already pending", dbusad);
+            return 0;
+        }
+
+        g_hash_table_insert(dbus_queries, g_strdup(dbusad), request);
+        query = g_strdup(dbusad);
+
+        if (dbusif_pid_query("system", dbusad, dbus_callback, query) != 0) {
             OHM_ERROR("auth: can't query pid for D-Bus address %s", dbusad);
+            g_hash_table_remove(dbus_queries, dbusad);
+            g_free(query);
+            destroy_request(request);
             return EIO;
         }
     }
@@ -134,6 +245,15 @@ int auth_request(char *id_type , void *id,
     return 0;
 }
 
+void auth_request_flush(void)
+{
+    if (cache != NULL) {
+        OHM_DEBUG(DBG_REQ, "flushing %u cached process(es)",
+                  g_hash_table_size(cache));
+        g_hash_table_remove_all(cache);
+    }
+}
+
 
 
 /*!
@@ -147,14 +267,11 @@ static req_t *create_request(char *req_type, void *args,
 #define ARG_DUMP_LENGTH 128
 
     req_t       *req = NULL;
-    req_t       *last;
     req_type_t   type;
     char       **list;
+    char        *joined;
     int          i;
 
-    for (last = (req_t *)&reqlist;  last->next;   last = last->next)
-        ;
-
     if (!strcmp(req_type, "creds"))
         type = request_creds;
     else {
@@ -166,7 +283,6 @@ static req_t *create_request(char *req_type, void *args,
     if (type != request_unknown && (req = malloc(sizeof(req_t))) != NULL) {
         memset(req, 0, sizeof(req_t));
 
-        req->next  = last->next;
         req->type  = type;
         req->adump = malloc(ARG_DUMP_LENGTH);
 
@@ -176,6 +292,9 @@ static req_t *create_request(char *req_type, void *args,
             auth_creds_request_dump(args, req->adump, ARG_DUMP_LENGTH);
             for (list = (char **)args, i = 0;  i < MAX_CREDS && list[i];  i++)
                 req->args.creds[i] = strdup(list[i]);
+            joined      = g_strjoinv(",", req->args.creds);
+            req->policy = g_strconcat(req_type, ":", joined, NULL);
+            g_free(joined);
             break;
 
         default: /* should never get here */
@@ -186,8 +305,6 @@ static req_t *create_request(char *req_type, void *args,
         req->cb.func = func;
         req->cb.data = data;
         
-        last->next = req;
-        
         OHM_DEBUG(DBG_REQ, "Auth request created");
     }
     
@@ -199,90 +316,325 @@ static req_t *create_request(char *req_type, void *args,
 
 static void destroy_request(req_t *request)
 {
-    req_t *prev;
     int    i;
 
     if (request != NULL) {
-        for (prev = (req_t *)&reqlist;  prev->next;  prev = prev->next) {
-            if (prev->next == request) {
-                OHM_DEBUG(DBG_REQ, "Auth request will be destroyed");
+        OHM_DEBUG(DBG_REQ, "Auth request will be destroyed");
 
-                prev->next = request->next;
-                
-                free(request->adump);
+        free(request->adump);
+        g_free(request->policy);
 
-                switch (request->type) {
+        switch (request->type) {
                     
-                case request_creds:
-                    for (i = 0;  i < MAX_CREDS && request->args.creds[i]; i++)
-                        free(request->args.creds[i]);
-                    break;
+        case request_creds:
+            for (i = 0;  i < MAX_CREDS && request->args.creds[i]; i++)
+                free(request->args.creds[i]);
+            break;
                              
-                default:
-                    break;
-                }
+        default:
+            break;
+        }
                                 
-                free(request);
+        free(request);
+    }
+}
+
+static void queue_request(req_t *request)
+{
+    request->next = NULL;
 
-                return;
+    *reqtail = request;
+    reqtail  = &request->next;
+
+    if (!idle_id)
+        idle_id = g_idle_add(idle_callback, NULL);
+}
+
+/*
+ * authorize everything queued; the requests of the same process share
+ * a single lookup of the credentials
+ */
+static void authorize_pending(void)
+{
+    req_t         *list;
+    req_t         *request;
+    req_t        **prev;
+    proc_entry_t  *proc;
+    auth_creds_t  *creds;
+    int            loaded;
+    pid_t          pid;
+
+    list    = reqlist;
+    reqlist = NULL;
+    reqtail = &reqlist;
+
+    while (list != NULL) {
+        pid    = list->pid;
+        proc   = cache_lookup(pid);
+        creds  = NULL;
+        loaded = FALSE;
+
+        for (prev = &list;  (request = *prev) != NULL;  ) {
+            if (request->pid != pid)
+                prev = &request->next;
+            else {
+                *prev = request->next;
+                authorize_request(request, proc, &creds, &loaded);
             }
         }
+
+        auth_creds_put(creds);
     }
 }
 
-static void authorize_request(req_t *request)
+static void authorize_request(req_t *request, proc_entry_t *proc,
+                              auth_creds_t **creds, int *loaded)
 {
-    int   success;
-    char  errbuf[256];
+    verdict_t *verdict;
+    int        success;
+    char       errbuf[256];
+
+    OHM_DEBUG(DBG_REQ, "authorize request for pid %u", request->pid);
+
+    switch (request->type) {
+
+    case request_creds:
+        if (proc != NULL &&
+            (verdict = g_hash_table_lookup(proc->verdicts, request->policy)))
+        {
+            stats.hits++;
+            success = verdict->success;
+            snprintf(errbuf, sizeof(errbuf), "%s", verdict->errmsg);
+            OHM_DEBUG(DBG_REQ, "cached verdict for pid %u", request->pid);
+        }
+        else {
+            stats.misses++;
 
-    if (request != NULL) {
-        OHM_DEBUG(DBG_REQ, "authorize request for pid %u", request->pid);
+            if (!*loaded) {
+                stats.lookups++;
+                *creds  = auth_creds_get(request->pid);
+                *loaded = TRUE;
+            }
 
-        switch (request->type) {
+            if (*creds == NULL) {
+                snprintf(errbuf, sizeof(errbuf), "Failed to read credentials "
+                         "for task (pid %u)", request->pid);
+                success = FALSE;
+            }
+            else {
+                success = auth_creds_match(*creds, request->args.creds,
+                                           errbuf, sizeof(errbuf));
+                if (proc != NULL)
+                    cache_insert(proc, request->policy, success, errbuf);
+            }
+        }
 
-        case request_creds:
-            success = auth_creds_check(request->pid, request->args.creds,
-                                       errbuf, sizeof(errbuf));
-            request->cb.func(success, errbuf, request->cb.data);
-            destroy_request(request);
-            break;
+        request->cb.func(success, errbuf, request->cb.data);
+        break;
 
-        default:
-            OHM_DEBUG(DBG_REQ, "%s(): illegal request type %d",
-                      __FUNCTION__, request->type);
-            break;
-        }
+    default:
+        OHM_DEBUG(DBG_REQ, "%s(): illegal request type %d",
+                  __FUNCTION__, request->type);
+        break;
     }
+
+    destroy_request(request);
 }
 
 
 static gboolean idle_callback(gpointer data)
 {
-    req_t *request = (req_t *)data;
+    (void)data;
+
+    idle_id = 0;
 
-    authorize_request(request);
+    authorize_pending();
 
     return FALSE;
 }
 
 static void dbus_callback(pid_t pid, const char *err, void *data)
 {
-    req_t *request = (req_t *)data;
-
-    if (pid > 0) {
-        request->pid = pid;
+    char  *dbusad = (char *)data;
+    req_t *request;
+    req_t *next;
+    char  *key;
 
-        authorize_request(request);
-    }
+    if (dbus_queries == NULL ||
+        !g_hash_table_lookup_extended(dbus_queries, dbusad,
+                                      (gpointer *)&key, (gpointer *)&request))
+        request = NULL;
     else {
-        if (!err)
-            OHM_DEBUG(DBG_REQ, "D-Bus PID query failed");
-        else
-            OHM_DEBUG(DBG_REQ, "D-Bus PID query failed. reason: %s", err);
+        g_hash_table_steal(dbus_queries, dbusad);
+        g_free(key);
+    }
+
+    g_free(dbusad);
+
+    for (;  request != NULL;  request = next) {
+        next = request->next;
+
+        if (pid > 0) {
+            request->pid = pid;
+            queue_request(request);
+        }
+        else {
+            if (!err)
+                OHM_DEBUG(DBG_REQ, "D-Bus PID query failed");
+            else
+                OHM_DEBUG(DBG_REQ, "D-Bus PID query failed. reason: %s", err);
 
             request->cb.func(FALSE, err, request->cb.data);
             destroy_request(request);
+        }
+    }
+
+    /* the pid is known now, don't wait for the idle callback */
+    if (pid > 0)
+        authorize_pending();
+}
+
+
+static proc_entry_t *cache_lookup(pid_t pid)
+{
+    proc_entry_t   *proc;
+    GHashTableIter  it;
+    gpointer        key;
+    uint64_t        start;
+
+    if (!cache_size || !cache_watch())
+        return NULL;
+
+    if ((start = process_start_time(pid)) == 0)
+        return NULL;
+
+    if ((proc = g_hash_table_lookup(cache, GINT_TO_POINTER(pid))) != NULL) {
+        if (proc->start == start)
+            return proc;
+
+        /* the pid was reused by a process we were not told about */
+        g_hash_table_remove(cache, GINT_TO_POINTER(pid));
     }
+
+    if ((int)g_hash_table_size(cache) >= cache_size) {
+        g_hash_table_iter_init(&it, cache);
+        if (g_hash_table_iter_next(&it, &key, NULL))
+            g_hash_table_iter_remove(&it);
+    }
+
+    if ((proc = malloc(sizeof(proc_entry_t))) == NULL)
+        return NULL;
+
+    proc->pid      = pid;
+    proc->start    = start;
+    proc->verdicts = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                           g_free, verdict_free);
+
+    g_hash_table_insert(cache, GINT_TO_POINTER(pid), proc);
+
+    return proc;
+}
+
+static void cache_insert(proc_entry_t *proc, const char *policy,
+                         int success, char *errmsg)
+{
+    verdict_t *verdict;
+
+    if ((verdict = malloc(sizeof(verdict_t))) == NULL)
+        return;
+
+    verdict->success = success;
+    verdict->errmsg  = g_strdup(errmsg);
+
+    g_hash_table_replace(proc->verdicts, g_strdup(policy), verdict);
+}
+
+static void cache_purge(gpointer data)
+{
+    proc_entry_t *proc = (proc_entry_t *)data;
+
+    g_hash_table_destroy(proc->verdicts);
+    free(proc);
+}
+
+static void verdict_free(gpointer data)
+{
+    verdict_t *verdict = (verdict_t *)data;
+
+    g_free(verdict->errmsg);
+    free(verdict);
+}
+
+/*
+ * the cached verdicts are only safe to use if we hear about the exec's
+ * and the exits; without the cgroups plugin the cache stays unused
+ */
+static int cache_watch(void)
+{
+    char *signature;
+
+    if (watching)
+        return TRUE;
+
+    signature = (char *)proc_watch_SIGNATURE;
+    if (!ohm_module_find_method("cgroups.proc_watch",
+                                &signature, (void *)&proc_watch))
+        return FALSE;
+
+    signature = (char *)proc_unwatch_SIGNATURE;
+    if (!ohm_module_find_method("cgroups.proc_unwatch",
+                                &signature, (void *)&proc_unwatch))
+        return FALSE;
+
+    proc_watch(process_changed, NULL);
+    watching = TRUE;
+
+    OHM_INFO("auth: caching verdicts, watching process changes");
+
+    return TRUE;
+}
+
+static void process_changed(pid_t pid, void *data)
+{
+    (void)data;
+
+    if (cache == NULL)
+        return;
+
+    if (pid == 0)                       /* process events were lost */
+        g_hash_table_remove_all(cache);
+    else
+        g_hash_table_remove(cache, GINT_TO_POINTER(pid));
+}
+
+static uint64_t process_start_time(pid_t pid)
+{
+    char  path[64];
+    char  buf[512];
+    char *p;
+    int   fd, len, i;
+
+    snprintf(path, sizeof(path), "/proc/%u/stat", pid);
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return 0;
+
+    len = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+
+    if (len <= 0)
+        return 0;
+
+    buf[len] = '\0';
+
+    /* starttime is the 22nd field, the 20th after the (comm) */
+    if ((p = strrchr(buf, ')')) == NULL)
+        return 0;
+
+    for (i = 0;  i < 20 && p != NULL;  i++)
+        p = strchr(p + 1, ' ');
+
+    return p ? strtoull(p + 1, NULL, 10) : 0;
 }
 
 
@@ -30,6 +30,7 @@ void auth_request_init(OhmPlugin *);
 void auth_request_exit(OhmPlugin *);
 
 int auth_request(char *,void *, char *,void *, auth_request_cb_t,void *);
+void auth_request_flush(void);
 
 
 #endif /* __OHM_AUTH_REQUEST_H__ */
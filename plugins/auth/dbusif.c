@@ -47,6 +47,12 @@ static void session_bus_init(const char *);
 static void session_bus_cleanup();
 
 static void pid_queried(DBusPendingCall *, void *);
+static void pid_cached(const char *, pid_t, void *);
+static int  shared_cache(void);
+
+OHM_IMPORTABLE(int, query_pid, (DBusBusType type, const char *name,
+                                void (*cb)(const char *, pid_t, void *),
+                                void *data));
 
 
 
@@ -142,6 +148,26 @@ int dbusif_pid_query(char *bustype, char *addr,
     if ((query = malloc(sizeof(query_t))) == NULL)
         return ENOMEM;
 
+    if (conn == sys_conn && shared_cache()) {
+        memset(query, 0, sizeof(query_t));
+        query->bus  = strdup(bustype);
+        query->addr = strdup(addr);
+        query->cb.func = func;
+        query->cb.data = data;
+
+        if (query_pid(DBUS_BUS_SYSTEM, addr, pid_cached, query)) {
+            OHM_DEBUG(DBG_DBUS, "quering PID for address %s on %s bus "
+                      "(shared cache)", query->addr, query->bus);
+            return 0;
+        }
+
+        free(query->bus);
+        free(query->addr);
+        free(query);
+
+        return EIO;
+    }
+
     do {
         memset(query, 0, sizeof(query_t));
         query->bus  = strdup(bustype);
@@ -325,6 +351,56 @@ static void pid_queried(DBusPendingCall *pend, void *data)
 }
 
 
+static int shared_cache(void)
+{
+    static int  checked;
+    char       *signature;
+
+    /*
+     * If the dbus plugin is around, system bus PID queries go through
+     * its cache which is shared with the other plugins and is kept up
+     * to date by following NameOwnerChanged. The dbus plugin might be
+     * loaded after us so look it up on the first query.
+     */
+    if (!checked) {
+        checked   = TRUE;
+        signature = (char *)query_pid_SIGNATURE;
+
+        ohm_module_find_method("dbus.query_pid", &signature,
+                               (void *)&query_pid);
+
+        if (query_pid != NULL)
+            OHM_INFO("auth: using shared D-Bus PID cache");
+    }
+
+    return query_pid != NULL;
+}
+
+
+static void pid_cached(const char *addr, pid_t pid, void *data)
+{
+    query_t *query = (query_t *)data;
+    char    *error;
+
+    (void)addr;
+
+    if (pid > 0) {
+        OHM_DEBUG(DBG_DBUS, "pid query succeeded: %s -> %u", query->addr, pid);
+        error = "OK";
+    }
+    else {
+        OHM_DEBUG(DBG_DBUS, "pid query for %s failed", query->addr);
+        error = "NameHasNoOwner";
+    }
+
+    query->cb.func(pid, error, query->cb.data);
+
+    free(query->bus);
+    free(query->addr);
+    free(query);
+}
+
+
 /* 
  * Local Variables:
  * c-basic-offset: 4
@@ -35,6 +35,8 @@ static const char *OHM_VAR(auth_request,_SIGNATURE) =
     "int(char *id_type,void *id, char *req_type,void *req, "
          "auth_request_cb_t callback, void *data)";
 
+static const char *OHM_VAR(auth_request_flush,_SIGNATURE) = "void(void)";
+
 int DBG_REQ, DBG_DBUS, DBG_CREDS;
 
 OHM_DEBUG_PLUGIN(auth,
@@ -80,8 +82,9 @@ OHM_PLUGIN_PROVIDES(
     "maemo.auth"
 );
 
-OHM_PLUGIN_PROVIDES_METHODS(auth, 1,
-    OHM_EXPORT(auth_request, "request")
+OHM_PLUGIN_PROVIDES_METHODS(auth, 2,
+    OHM_EXPORT(auth_request, "request"),
+    OHM_EXPORT(auth_request_flush, "flush")
 );
 
 /* 
@@ -27,14 +27,9 @@ USA.
 static void  bus_init(void);
 static void  bus_exit(void);
 static int   bus_query_pid(backlight_context_t *, const char *, DBusMessage *);
-static void  cache_create(void);
-static void  cache_destroy(void);
-static pid_t cache_lookup(const char *);
-static int   cache_insert(const char *, pid_t);
-static void  cache_delete(const char *);
 
 int  backlight_request(backlight_context_t *, pid_t, DBusMessage *);
-void continue_request(DBusPendingCall *, void *);
+void complete_request(const char *, pid_t, void *);
 
 
 
@@ -60,7 +55,6 @@ mce_init(backlight_context_t *ctx, OhmPlugin *plugin)
     else
         ctx->fact = (OhmFact *)facts->data;
 
-    cache_create();
     bus_init();
 }
 
@@ -74,7 +68,6 @@ mce_exit(backlight_context_t *ctx)
     ctx->fact = NULL;
     
     bus_exit();
-    cache_destroy();
 }
 
 
@@ -166,7 +159,6 @@ mce_send_reply(DBusMessage *msg, int decision)
 typedef struct {
     backlight_context_t *ctx;
     DBusMessage         *req;
-    const char          *client;
 } qry_data_t;
 
 
@@ -191,8 +183,8 @@ mce_display_req(DBusConnection *c, DBusMessage *msg, void *data)
 
     OHM_DEBUG(DBG_REQUEST, "received %s request", dbus_message_get_member(msg));
 
-    pid = cache_lookup(client);
-    
+    pid = ctx->lookup_pid(DBUS_BUS_SYSTEM, client);
+
     if (pid != 0)
         backlight_request(ctx, pid, msg);
     else
@@ -206,42 +198,24 @@ mce_display_req(DBusConnection *c, DBusMessage *msg, void *data)
  * complete_request
  ********************/
 void
-complete_request(DBusPendingCall *pending, void *user_data)
+complete_request(const char *client, pid_t pid, void *user_data)
 {
     qry_data_t          *qry = (qry_data_t *)user_data;
     backlight_context_t *ctx;
-    DBusMessage         *req, *reply;
-    const char          *client;
-    dbus_uint32_t        pid;
+    DBusMessage         *req;
 
-    ctx    = qry->ctx;
-    req    = qry->req;
-    client = qry->client;
+    ctx = qry->ctx;
+    req = qry->req;
     FREE(qry);
 
-    reply = dbus_pending_call_steal_reply(pending);
-    
-    if (reply == NULL ||
-        dbus_message_get_type(reply) == DBUS_MESSAGE_TYPE_ERROR) {
-        OHM_ERROR("backlight: failed to get D-Bus pid query reply.");
-        goto unref_out;
-    }
-    
-    if (!dbus_message_get_args(reply, NULL, DBUS_TYPE_UINT32, &pid,
-                               DBUS_TYPE_INVALID)) {
-        OHM_ERROR("backlight: invalid D-Bus pid query reply.");
-        goto unref_out;
+    if (pid == 0)
+        OHM_ERROR("backlight: failed to query pid of client %s.", client);
+    else {
+        OHM_DEBUG(DBG_REQUEST, "pid of client %s is %d", client, pid);
+        backlight_request(ctx, pid, req);
     }
-    
-    OHM_DEBUG(DBG_REQUEST, "pid of client %s is %d", client, pid);
 
-    cache_insert(client, pid);
-    backlight_request(ctx, (pid_t)pid, req);
-    
- unref_out:
     dbus_message_unref(req);
-    dbus_message_unref(reply);
-    dbus_pending_call_unref(pending);
 }
 
 
@@ -344,14 +318,7 @@ bus_exit(void)
 static int
 bus_query_pid(backlight_context_t *ctx, const char *client, DBusMessage *req)
 {
-    const char *service   = "org.freedesktop.DBus";
-    const char *path      = "/org/freedesktop/DBus";
-    const char *interface = "org.freedesktop.DBus";
-    const char *member    = "GetConnectionUnixProcessID";
-
-    qry_data_t      *qry  = NULL;
-    DBusMessage     *msg  = NULL;
-    DBusPendingCall *pending;
+    qry_data_t *qry;
 
     OHM_DEBUG(DBG_REQUEST, "querying D-Bus for pid of client %s", client);
 
@@ -360,215 +327,17 @@ bus_query_pid(backlight_context_t *ctx, const char *client, DBusMessage *req)
         return FALSE;
     }
 
-    qry->ctx    = ctx;
-    qry->req    = dbus_message_ref(req);
-    qry->client = client;
-    
-    msg = dbus_message_new_method_call(service, path, interface, member);
+    qry->ctx = ctx;
+    qry->req = dbus_message_ref(req);
 
-    if (msg == NULL || !dbus_message_append_args(msg, DBUS_TYPE_STRING, &client,
-                                                 DBUS_TYPE_INVALID)) {
-        OHM_ERROR("backlight: failed to create D-Bus message.");
-        goto fail;
-    }
-
-    if (!dbus_connection_send_with_reply(bus, msg, &pending, 2 * 1000) ||
-        !dbus_pending_call_set_notify(pending, complete_request, qry, NULL)) {
-        OHM_ERROR("backlight: failed to send D-Bus message.");
-        goto fail;
-    }
-
-    dbus_message_unref(msg);
-
-    return TRUE;
-    
-    
- fail:
-    if (qry) {
+    if (!ctx->query_pid(DBUS_BUS_SYSTEM, client, complete_request, qry)) {
+        OHM_ERROR("backlight: failed to query pid of client %s.", client);
         dbus_message_unref(qry->req);
         FREE(qry);
-    }
-
-    dbus_message_unref(msg);
-
-    return FALSE;
-}
-
-
-/*****************************************************************************
- *                       *** D-BUS client pid cache ***                     *
- *****************************************************************************/
-
-#define CACHE_GC_TIMER (60 * 60)              /* cache GC interval in secs */
-#define CACHE_MAX_IDLE (60 * 60)              /* cache entry max idle age */
-
-static GHashTable *cache;                     /* client pid cache */
-static guint       cache_timer;               /* cache GC timer */
-
-typedef struct timespec timestamp_t;
-
-typedef struct {
-    char            *client;                  /* dbus client address */
-    pid_t            pid;                     /* client pid */
-    time_t           stamp;                   /* cache timestamp */
-} cache_entry_t;
-
-
-/********************
- * free_cache_entry
- ********************/
-static void
-free_cache_entry(gpointer data)
-{
-    cache_entry_t *entry = (cache_entry_t *)data;
-
-    if (entry != NULL) {
-        FREE(entry->client);
-        FREE(entry);
-    }
-}
-
-
-/********************
- * current_timestamp
- ********************/
-static inline time_t
-current_timestamp(void)
-{
-    struct timespec now;
-
-    clock_gettime(CLOCK_MONOTONIC, &now);
-    return now.tv_sec;
-}
-
-
-/********************
- * cache_gc_entry
- ********************/
-gboolean
-cache_gc_entry(gpointer keyp, gpointer valuep, gpointer user_data)
-{
-    cache_entry_t *entry = (cache_entry_t *)valuep;
-    time_t         limit = (time_t)user_data;
-
-    (void)keyp;
-
-    return (entry->stamp + CACHE_MAX_IDLE < limit);
-}
-
-
-/********************
- * cache_gc
- ********************/
-gboolean
-cache_gc(gpointer data)
-{
-    time_t now;
-    
-    (void)data;
-
-    now = current_timestamp();
-    g_hash_table_foreach_remove(cache, cache_gc_entry, (gpointer)now);
-    
-    return TRUE;
-}
-
-
-/********************
- * cache_create
- ********************/
-static void
-cache_create(void)
-{
-    cache = g_hash_table_new_full(g_str_hash, g_str_equal,
-                                  NULL, free_cache_entry);
-    
-    if (cache == NULL) {
-        OHM_ERROR("backlight: failed to create D-BUS address cache.");
-        exit(1);
-    }
-    
-    cache_timer = g_timeout_add_seconds(CACHE_GC_TIMER, cache_gc, NULL);
-}
-
-
-/********************
- * cache_destroy
- ********************/
-static void
-cache_destroy(void)
-{
-    if (cache_timer) {
-        g_source_remove(cache_timer);
-        cache_timer = 0;
-    }
-    
-    if (cache != NULL) {
-        g_hash_table_destroy(cache);
-        cache = NULL;
-    }
-}
-
-
-/********************
- * cache_lookup
- ********************/
-static pid_t
-cache_lookup(const char *client)
-{
-    cache_entry_t *entry;
-    pid_t          pid;
-
-    if ((entry = g_hash_table_lookup(cache, client)) != NULL) {
-        pid = entry->pid;
-        entry->stamp = current_timestamp();
-    }
-    else
-        pid = 0;
-    
-    return pid;
-}
-
-
-/********************
- * cache_insert
- ********************/
-static int
-cache_insert(const char *client, pid_t pid)
-{
-    cache_entry_t *entry;
-
-    if (ALLOC_OBJ(entry) != NULL) {
-        entry->pid    = pid;
-        entry->client = STRDUP(client);
-        
-        if (entry->client == NULL) {
-            OHM_ERROR("backlight: failed to allocate cache entry.");
-            free_cache_entry(entry);
-
-            return FALSE;
-        }
-        
-        g_hash_table_insert(cache, entry->client, entry);
-        entry->stamp = current_timestamp();
-
-        return TRUE;
-    }
-    else {
-        OHM_ERROR("backlight: failed to allocate cache entry.");
-
         return FALSE;
     }
-}
-
 
-/********************
- * cache_delete
- ********************/
-static void
-cache_delete(const char *client)
-{
-    g_hash_table_remove(cache, client);
+    return TRUE;
 }
 
 
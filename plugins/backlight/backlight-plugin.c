@@ -39,6 +39,10 @@ OHM_IMPORTABLE(GObject *, signaling_register  , (gchar *uri, gchar **interested)
 OHM_IMPORTABLE(gboolean , signaling_unregister, (GObject *ep));
 OHM_IMPORTABLE(int, resolve, (char *goal, char **locals));
 OHM_IMPORTABLE(int, process_info, (pid_t pid, char **group, char **binary));
+OHM_IMPORTABLE(pid_t, lookup_pid, (DBusBusType type, const char *name));
+OHM_IMPORTABLE(int, query_pid, (DBusBusType type, const char *name,
+                                void (*cb)(const char *, pid_t, void *),
+                                void *data));
 
 static void select_driver(backlight_context_t *, OhmPlugin *);
 
@@ -81,6 +85,8 @@ plugin_init(OhmPlugin *plugin)
 
     context.resolve      = resolve;
     context.process_info = process_info;
+    context.lookup_pid   = lookup_pid;
+    context.query_pid    = query_pid;
     
     BACKLIGHT_SAVE_STATE(&context, "off");
 
@@ -155,11 +161,13 @@ EXPORT OHM_PLUGIN_DESCRIPTION(PLUGIN_NAME,
                        plugin_init, plugin_exit, NULL);
 
 
-EXPORT OHM_PLUGIN_REQUIRES_METHODS(PLUGIN_PREFIX, 4, 
+EXPORT OHM_PLUGIN_REQUIRES_METHODS(PLUGIN_PREFIX, 6, 
     OHM_IMPORT("signaling.register_enforcement_point"  , signaling_register),
     OHM_IMPORT("signaling.unregister_enforcement_point", signaling_unregister),
     OHM_IMPORT("dres.resolve"                          , resolve),
-    OHM_IMPORT("cgroups.process_info"                  , process_info)
+    OHM_IMPORT("cgroups.process_info"                  , process_info),
+    OHM_IMPORT("dbus.lookup_pid"                       , lookup_pid),
+    OHM_IMPORT("dbus.query_pid"                        , query_pid)
 );
 
 EXPORT OHM_PLUGIN_DBUS_METHODS(
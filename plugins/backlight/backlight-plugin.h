@@ -29,6 +29,7 @@ USA.
 #include <ohm/ohm-fact.h>
 
 #include <glib.h>
+#include <dbus/dbus.h>
 
 
 #ifndef TRUE
@@ -94,6 +95,10 @@ struct backlight_context_s {
     char               *state;                 /* current backlight state */
     int               (*resolve)(char *, char **);
     int               (*process_info)(pid_t, char **, char **);
+    pid_t             (*lookup_pid)(DBusBusType, const char *);
+    int               (*query_pid)(DBusBusType, const char *,
+                                   void (*)(const char *, pid_t, void *),
+                                   void *);
 };
 
 
@@ -238,6 +238,33 @@ OHM_EXPORTABLE(void, cgrp_app_unsubscribe,
 }
 
 
+/********************
+ * cgrp_proc_watch
+ ********************/
+OHM_EXPORTABLE(void, cgrp_proc_watch,
+               (void (*callback)(pid_t, void *), void *user_data))
+{
+    /*
+     * callback gets the pid of every process that exits, execs or changes
+     * its credentials, or 0 if events may have been lost, in which case
+     * nothing known about any process can be trusted any more
+     */
+    if (ctx != NULL)
+        proc_watch(ctx, callback, user_data);
+}
+
+
+/********************
+ * cgrp_proc_unwatch
+ ********************/
+OHM_EXPORTABLE(void, cgrp_proc_unwatch,
+               (void (*callback)(pid_t, void *), void *user_data))
+{
+    if (ctx != NULL)
+        proc_unwatch(ctx, callback, user_data);
+}
+
+
 /********************
  * cgrp_app_query
  ********************/
@@ -371,10 +398,12 @@ OHM_PLUGIN_REQUIRES_METHODS(PLUGIN_PREFIX, 5,
    OHM_IMPORT("dres.register_method"  , register_method),
    OHM_IMPORT("dres.unregister_method", unregister_method));
 
-OHM_PLUGIN_PROVIDES_METHODS(cgroups, 4,
+OHM_PLUGIN_PROVIDES_METHODS(cgroups, 6,
     OHM_EXPORT(cgrp_process_info   , "process_info"),
     OHM_EXPORT(cgrp_app_subscribe  , "app_subscribe"),
     OHM_EXPORT(cgrp_app_unsubscribe, "app_unsubscribe"),
+    OHM_EXPORT(cgrp_proc_watch     , "proc_watch"),
+    OHM_EXPORT(cgrp_proc_unwatch   , "proc_unwatch"),
     OHM_EXPORT(cgrp_app_query      , "app_query"));
 
 
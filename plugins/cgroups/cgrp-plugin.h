@@ -675,6 +675,7 @@ typedef struct {
     cgrp_process_t   *active_process;       /* currently active process */
     cgrp_group_t     *active_group;         /* currently active group */
     list_hook_t       procsubscr;           /* event subscribers */
+    list_hook_t       procwatch;            /* identity change watchers */
 
     OhmFactStore     *store;                /* ohm factstore */
     GObject          *sigconn;              /* policy signaling interface */
@@ -753,6 +754,8 @@ void procattr_dump(cgrp_proc_attr_t *);
 
 void proc_notify(cgrp_context_t *,
                  void (*)(cgrp_context_t *, int, pid_t, void *), void *);
+void proc_watch(cgrp_context_t *, void (*)(pid_t, void *), void *);
+void proc_unwatch(cgrp_context_t *, void (*)(pid_t, void *), void *);
 
 int  process_track_add(cgrp_process_t *, const char *, int);
 int  process_track_del(cgrp_process_t *, const char *, int);
@@ -63,10 +63,11 @@ static int         proc_unsubscribe(void);
 static inline void proc_dump_event (struct proc_event *event);
 static int         proc_request    (enum proc_cn_mcast_op req);
 
-static int  netlink_create(void);
+static int  netlink_create(cgrp_context_t *ctx);
 static void netlink_close (void);
 static int  netlink_setup(cgrp_context_t *ctx);
-static void netlink_cleanup(void);
+static void netlink_cleanup(cgrp_context_t *ctx);
+static void netlink_enobufs(int enable);
 static int netlink_delayed_setup(cgrp_context_t *ctx, int timeout);
 
 static struct proc_event *proc_recv(unsigned char *buf, size_t bufsize,
@@ -78,6 +79,7 @@ static gboolean netlink_cb(GIOChannel *chnl, GIOCondition mask, gpointer data);
 static void subscr_init(cgrp_context_t *ctx);
 static void subscr_exit(cgrp_context_t *ctx);
 static void subscr_notify(cgrp_context_t *ctx, int what, pid_t pid);
+static void watch_notify(cgrp_context_t *ctx, pid_t pid);
 
 
 typedef struct {
@@ -86,6 +88,12 @@ typedef struct {
     void         *data;
 } proc_handler_t;
 
+typedef struct {
+    list_hook_t   hook;
+    void        (*cb)(pid_t, void *);
+    void         *data;
+} proc_watch_t;
+
 
 /********************
  * proc_init
@@ -129,7 +137,7 @@ proc_exit(cgrp_context_t *ctx)
 
     subscr_exit(ctx);
 
-    netlink_cleanup();
+    netlink_cleanup(ctx);
 
     proc_hash_foreach(ctx, remove_process, NULL);
 
@@ -287,6 +295,8 @@ proc_recv(unsigned char *buf, size_t bufsize, int block)
     size_t              size;
     int                 flags;
 
+    errno = 0;
+
     if (bufsize < EVENT_BUF_SIZE)
         return NULL;
     
@@ -334,7 +344,7 @@ proc_recv(unsigned char *buf, size_t bufsize, int block)
     }
 
     if (n < 0) {
-        if (errno != EAGAIN)
+        if (errno != EAGAIN && errno != ENOBUFS)
             OHM_ERROR("cgrp: failed to receive netlink process event (%d: %s)",
                       errno, strerror(errno));
     }
@@ -540,8 +550,35 @@ netlink_cb(GIOChannel *chnl, GIOCondition mask, gpointer data)
                 continue;
             }
 
+            /* the process is gone or may have changed its credentials */
+            switch (event.any.type) {
+            case CGRP_EVENT_EXIT:
+                if (event.any.pid != event.any.tgid)
+                    break;
+                /* fall through */
+            case CGRP_EVENT_EXEC:
+            case CGRP_EVENT_UID:
+            case CGRP_EVENT_GID:
+                watch_notify(ctx, event.any.tgid);
+                break;
+            default:
+                break;
+            }
+
             classify_event(ctx, &event);
         }
+
+        if (errno == ENOBUFS) {
+            /*
+             * the socket buffer overran and some events are lost, so the
+             * watchers can't trust anything they have seen up to now
+             */
+            OHM_INFO("cgrp: netlink socket overrun, process events lost");
+            watch_notify(ctx, 0);
+
+            /* the socket is fine, we'll be called again for the rest */
+            return TRUE;
+        }
     }
     
     if (mask & G_IO_HUP) {
@@ -564,7 +601,7 @@ netlink_cb(GIOChannel *chnl, GIOCondition mask, gpointer data)
          * close netlink socket and try to set it up again after a timeout
          */
 
-        netlink_cleanup();
+        netlink_cleanup(ctx);
         errno = 0;
         netlink_delayed_setup(ctx, SETUP_RETRY_DELAY);
         
@@ -579,9 +616,8 @@ netlink_cb(GIOChannel *chnl, GIOCondition mask, gpointer data)
  * netlink_create
  ********************/
 static int
-netlink_create(void)
+netlink_create(cgrp_context_t *ctx)
 {
-    unsigned int val;
     struct sockaddr_nl addr;
 
     if ((sock = socket(PF_NETLINK, SOCK_DGRAM, NETLINK_CONNECTOR)) < 0) {
@@ -605,10 +641,8 @@ netlink_create(void)
         goto fail;
     }
 
-    val = 1;
-    if (!setsockopt(sock, SOL_NETLINK, NETLINK_NO_ENOBUFS, &val, sizeof(val))) {
-        OHM_INFO("cgrp: disable netlink ENOBUFS notifications");
-    }
+    /* overruns only matter to the watchers, see proc_watch */
+    netlink_enobufs(!list_empty(&ctx->procwatch));
 
     return TRUE;
 
@@ -634,13 +668,37 @@ netlink_close(void)
 }
 
 
+/********************
+ * netlink_enobufs
+ ********************/
+static void
+netlink_enobufs(int enable)
+{
+    int val = enable ? 0 : 1;
+
+    /*
+     * Without watchers lost events have always been silently ignored.
+     * The watchers need to know about them to flush their caches.
+     */
+    if (sock < 0)
+        return;
+
+    if (setsockopt(sock, SOL_NETLINK, NETLINK_NO_ENOBUFS, &val, sizeof(val)))
+        OHM_ERROR("cgrp: failed to %s netlink ENOBUFS notifications",
+                  enable ? "enable" : "disable");
+    else
+        OHM_INFO("cgrp: %s netlink ENOBUFS notifications",
+                 enable ? "enable" : "disable");
+}
+
+
 /********************
  * netlink_setup
  ********************/
 static int
 netlink_setup(cgrp_context_t *ctx)
 {
-    if (netlink_create()) {
+    if (netlink_create(ctx)) {
         if (proc_subscribe(ctx))
             return TRUE;
 
@@ -655,7 +713,7 @@ netlink_setup(cgrp_context_t *ctx)
  * netlink_cleanup
  ********************/
 static void
-netlink_cleanup(void)
+netlink_cleanup(cgrp_context_t *ctx)
 {
     if (setup_timer != 0) {
         g_source_remove(setup_timer);
@@ -664,6 +722,9 @@ netlink_cleanup(void)
 
     proc_unsubscribe();
     netlink_close();
+
+    /* no events until we are back, the watchers can't trust their caches */
+    watch_notify(ctx, 0);
 }
 
 
@@ -675,7 +736,7 @@ delayed_setup(gpointer data)
 {
     cgrp_context_t *ctx = (cgrp_context_t *)data;
 
-    if (!netlink_create())
+    if (!netlink_create(ctx))
         return TRUE;                            /* retry again */
     
     if (!proc_subscribe(ctx)) {
@@ -684,6 +745,9 @@ delayed_setup(gpointer data)
     }
         
     process_scan_proc(ctx);
+
+    /* whatever happened while we were disconnected went unnoticed */
+    watch_notify(ctx, 0);
     
     setup_timer = 0;
 
@@ -1674,6 +1738,7 @@ static void
 subscr_init(cgrp_context_t *ctx)
 {
     list_init(&ctx->procsubscr);
+    list_init(&ctx->procwatch);
 }
 
 
@@ -1686,11 +1751,19 @@ subscr_exit(cgrp_context_t *ctx)
     proc_handler_t *handler;
     list_hook_t    *p, *n;
     
+    proc_watch_t   *watch;
+    
     list_foreach(&ctx->procsubscr, p, n) {
         handler = list_entry(p, proc_handler_t, hook);
         list_delete(&handler->hook);
         FREE(handler);
     }
+
+    list_foreach(&ctx->procwatch, p, n) {
+        watch = list_entry(p, proc_watch_t, hook);
+        list_delete(&watch->hook);
+        FREE(watch);
+    }
 }
 
 
@@ -1732,6 +1805,68 @@ proc_notify(cgrp_context_t *ctx,
 }
 
 
+/********************
+ * watch_notify
+ ********************/
+static void
+watch_notify(cgrp_context_t *ctx, pid_t pid)
+{
+    proc_watch_t *watch;
+    list_hook_t  *p, *n;
+    
+    list_foreach(&ctx->procwatch, p, n) {
+        watch = list_entry(p, proc_watch_t, hook);
+        watch->cb(pid, watch->data);
+    }
+}
+
+
+/********************
+ * proc_watch
+ ********************/
+void
+proc_watch(cgrp_context_t *ctx, void (*cb)(pid_t, void *), void *data)
+{
+    proc_watch_t *watch;
+
+    if (ALLOC_OBJ(watch) == NULL) {
+        OHM_ERROR("cgrp: failed to allocate process watch");
+        return;
+    }
+
+    watch->cb   = cb;
+    watch->data = data;
+    
+    if (list_empty(&ctx->procwatch))
+        netlink_enobufs(TRUE);
+
+    list_append(&ctx->procwatch, &watch->hook);
+}
+
+
+/********************
+ * proc_unwatch
+ ********************/
+void
+proc_unwatch(cgrp_context_t *ctx, void (*cb)(pid_t, void *), void *data)
+{
+    proc_watch_t *watch;
+    list_hook_t  *p, *n;
+    
+    list_foreach(&ctx->procwatch, p, n) {
+        watch = list_entry(p, proc_watch_t, hook);
+
+        if (watch->cb == cb && watch->data == data) {
+            list_delete(&watch->hook);
+            FREE(watch);
+        }
+    }
+
+    if (list_empty(&ctx->procwatch))
+        netlink_enobufs(FALSE);
+}
+
+
 /* 
  * Local Variables:
  * c-basic-offset: 4
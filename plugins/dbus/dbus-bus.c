@@ -92,6 +92,7 @@ bus_create(DBusBusType type)
     if (ALLOC_OBJ(bus) != NULL) {
         bus->type = type;
         list_init(&bus->notify);
+        list_init(&bus->unmatch);
     }
     
     return bus;
@@ -120,6 +121,16 @@ bus_destroy(bus_t *bus)
             bus->watches = NULL;
         }
 
+        if (bus->pids) {
+            hash_table_destroy(bus->pids);
+            bus->pids = NULL;
+        }
+
+        if (bus->matches) {
+            hash_table_destroy(bus->matches);
+            bus->matches = NULL;
+        }
+
         bus_disconnect(bus);
 
         FREE(bus);
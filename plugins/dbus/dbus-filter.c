@@ -0,0 +1,241 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+#include <stdio.h>
+#include <time.h>
+
+#include "dbus-plugin.h"
+
+/*
+ * This is the only D-BUS filter we install on a bus. Every incoming
+ * message is counted here; signals are looked up once by their member
+ * and routed to the name owner watches and to the signal handlers.
+ * Method calls reach us through the registered object paths instead.
+ */
+
+int dispatch_timing;                           /* whether to time handlers */
+
+static uint64_t  stats_start;                  /* when stats were reset */
+static atom_t    name_owner_changed;           /* NameOwnerChanged */
+
+static DBusHandlerResult bus_dispatch(DBusConnection *c, DBusMessage *msg,
+                                      void *data);
+static int  filter_add(bus_t *bus);
+static void filter_del(bus_t *bus);
+static void session_bus_event(bus_t *bus, int event, void *data);
+
+
+/********************
+ * filter_init
+ ********************/
+int
+filter_init(void)
+{
+    bus_t *system, *session;
+
+    atom_set(&name_owner_changed, "NameOwnerChanged");
+    stats_start = stat_time();
+
+    system = bus_by_type(DBUS_BUS_SYSTEM);
+
+    if (system != NULL && !filter_add(system)) {
+        OHM_ERROR("dbus: failed to add dispatcher for system bus");
+        filter_exit();
+        return FALSE;
+    }
+
+    session = bus_by_type(DBUS_BUS_SESSION);
+
+    if (session != NULL) {
+        if (!bus_watch_add(session, session_bus_event, NULL)) {
+            OHM_ERROR("dbus: failed to install session bus watch");
+            filter_exit();
+            return FALSE;
+        }
+
+        if (session->conn != NULL)
+            filter_add(session);
+    }
+
+    return TRUE;
+}
+
+
+/********************
+ * filter_exit
+ ********************/
+void
+filter_exit(void)
+{
+    bus_t *system, *session;
+
+    system  = bus_by_type(DBUS_BUS_SYSTEM);
+    session = bus_by_type(DBUS_BUS_SESSION);
+
+    if (system != NULL)
+        filter_del(system);
+
+    if (session != NULL) {
+        filter_del(session);
+        bus_watch_del(session, session_bus_event, NULL);
+    }
+}
+
+
+/********************
+ * filter_add
+ ********************/
+static int
+filter_add(bus_t *bus)
+{
+    if (bus->conn == NULL)
+        return FALSE;
+
+    if (bus->filter == bus->conn)
+        return TRUE;
+
+    if (!dbus_connection_add_filter(bus->conn, bus_dispatch, bus, NULL))
+        return FALSE;
+
+    bus->filter = bus->conn;
+    return TRUE;
+}
+
+
+/********************
+ * filter_del
+ ********************/
+static void
+filter_del(bus_t *bus)
+{
+    if (bus->filter != NULL && bus->filter == bus->conn)
+        dbus_connection_remove_filter(bus->conn, bus_dispatch, bus);
+
+    bus->filter = NULL;
+}
+
+
+/********************
+ * bus_dispatch
+ ********************/
+static DBusHandlerResult
+bus_dispatch(DBusConnection *c, DBusMessage *msg, void *data)
+{
+    bus_t  *bus = (bus_t *)data;
+    atom_t  member;
+
+    (void)c;
+
+    bus->nmsg++;
+
+    if (dbus_message_get_type(msg) != DBUS_MESSAGE_TYPE_SIGNAL)
+        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+    bus->nsignal++;
+
+    atom_init(&member, dbus_message_get_member(msg));
+
+    if (member.name == NULL)
+        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+    if (atom_equal(&member, &name_owner_changed))
+        watch_dispatch(bus, msg);
+
+    signal_dispatch(bus, msg, &member);
+
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;     /* let through to others */
+}
+
+
+/********************
+ * stat_time
+ ********************/
+uint64_t
+stat_time(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000;
+}
+
+
+/********************
+ * filter_stats
+ ********************/
+void
+filter_stats(int reset)
+{
+    bus_t    *buses[2];
+    uint64_t  elapsed;
+    double    secs;
+    int       i;
+
+    buses[0] = bus_by_type(DBUS_BUS_SYSTEM);
+    buses[1] = bus_by_type(DBUS_BUS_SESSION);
+
+    if (reset) {
+        for (i = 0; i < 2; i++) {
+            if (buses[i] != NULL)
+                buses[i]->nmsg = buses[i]->nsignal = 0;
+        }
+        stats_start = stat_time();
+        return;
+    }
+
+    elapsed = stat_time() - stats_start;
+    secs    = elapsed ? elapsed / 1000000.0 : 1.0;
+
+    printf("statistics for the past %.1f seconds, handler timing is %s\n",
+           elapsed / 1000000.0, dispatch_timing ? "on" : "off");
+
+    for (i = 0; i < 2; i++) {
+        if (buses[i] == NULL)
+            continue;
+
+        printf("%s bus: %lu messages (%.1f/s), %lu signals (%.1f/s)\n",
+               i == 0 ? "system" : "session",
+               buses[i]->nmsg, buses[i]->nmsg / secs,
+               buses[i]->nsignal, buses[i]->nsignal / secs);
+    }
+}
+
+
+/********************
+ * session_bus_event
+ ********************/
+static void
+session_bus_event(bus_t *bus, int event, void *data)
+{
+    (void)data;
+
+    if (event == BUS_EVENT_CONNECTED)
+        filter_add(bus);
+}
+
+
+/* 
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
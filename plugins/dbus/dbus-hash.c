@@ -103,6 +103,77 @@ hash_table_foreach(hash_table_t *ht, GHFunc callback, void *data)
     g_hash_table_foreach(ht, callback, data);
 }
 
+
+/*
+ * atom tables (hash tables keyed by atom_t, using the precomputed hashes)
+ */
+
+static guint
+atom_key_hash(gconstpointer key)
+{
+    return ((const atom_t *)key)->hash;
+}
+
+
+static gboolean
+atom_key_equal(gconstpointer a, gconstpointer b)
+{
+    return atom_equal((const atom_t *)a, (const atom_t *)b);
+}
+
+
+/********************
+ * atom_table_create
+ ********************/
+hash_table_t *
+atom_table_create(void (*value_free)(void *))
+{
+    return g_hash_table_new_full(atom_key_hash, atom_key_equal,
+                                 NULL, value_free);
+}
+
+
+/********************
+ * atom_table_insert
+ ********************/
+int
+atom_table_insert(hash_table_t *ht, atom_t *key, void *value)
+{
+    g_hash_table_insert(ht, key, value);
+    return TRUE;
+}
+
+
+/********************
+ * atom_table_lookup
+ ********************/
+void *
+atom_table_lookup(hash_table_t *ht, const atom_t *key)
+{
+    return g_hash_table_lookup(ht, key);
+}
+
+
+/********************
+ * atom_table_remove
+ ********************/
+int
+atom_table_remove(hash_table_t *ht, const atom_t *key)
+{
+    return g_hash_table_remove(ht, key);
+}
+
+
+/********************
+ * atom_set
+ ********************/
+void
+atom_set(atom_t *atom, const char *name)
+{
+    atom_init(atom, name ? g_intern_string(name) : NULL);
+}
+
+
 /* 
  * Local Variables:
  * c-basic-offset: 4
@@ -0,0 +1,360 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+#include "dbus-plugin.h"
+
+/*
+ * Match rules are reference counted per bus, so identical rules from
+ * different handlers or plugins end up on the bus only once. AddMatch is
+ * sent right away without waiting for the reply; errors are logged when
+ * the reply arrives. RemoveMatch is batched: rules that lose their last
+ * user are only removed from an idle callback, so a rule that is dropped
+ * and added back in the same main loop iteration never leaves the bus.
+ * All rules are resent when a bus (re)connects.
+ */
+
+typedef struct {
+    char        *rule;                         /* match rule */
+    int          refcnt;                       /* number of users */
+    int          installed;                    /* whether AddMatch was sent */
+    list_hook_t  hook;                         /* to removal queue */
+} match_t;
+
+
+static guint flush_id;                         /* idle removal source */
+
+static void match_purge(void *ptr);
+static void match_send(bus_t *bus, const char *method, const char *rule);
+static void match_schedule_flush(void);
+static void session_bus_event(bus_t *bus, int event, void *data);
+
+
+/********************
+ * match_init
+ ********************/
+int
+match_init(void)
+{
+    bus_t *system, *session;
+
+    system  = bus_by_type(DBUS_BUS_SYSTEM);
+    session = bus_by_type(DBUS_BUS_SESSION);
+
+    if (system != NULL) {
+        if ((system->matches = hash_table_create(NULL, match_purge)) == NULL) {
+            OHM_ERROR("dbus: failed to create match rule tables");
+            match_exit();
+            return FALSE;
+        }
+    }
+
+    if (session != NULL) {
+        if ((session->matches = hash_table_create(NULL, match_purge)) == NULL){
+            OHM_ERROR("dbus: failed to create match rule tables");
+            match_exit();
+            return FALSE;
+        }
+
+        if (!bus_watch_add(session, session_bus_event, NULL)) {
+            OHM_ERROR("dbus: failed to install session bus watch");
+            match_exit();
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+
+/********************
+ * match_exit
+ ********************/
+void
+match_exit(void)
+{
+    bus_t *system, *session;
+
+    if (flush_id != 0) {
+        g_source_remove(flush_id);
+        flush_id = 0;
+    }
+
+    system  = bus_by_type(DBUS_BUS_SYSTEM);
+    session = bus_by_type(DBUS_BUS_SESSION);
+
+    if (system != NULL && system->matches != NULL) {
+        hash_table_destroy(system->matches);
+        system->matches = NULL;
+    }
+
+    if (session != NULL) {
+        bus_watch_del(session, session_bus_event, NULL);
+
+        if (session->matches != NULL) {
+            hash_table_destroy(session->matches);
+            session->matches = NULL;
+        }
+    }
+}
+
+
+/********************
+ * match_add
+ ********************/
+int
+match_add(bus_t *bus, const char *rule)
+{
+    match_t *match;
+
+    if (bus->matches == NULL)
+        return FALSE;
+
+    if ((match = hash_table_lookup(bus->matches, rule)) != NULL) {
+        if (match->refcnt++ == 0)
+            list_delete(&match->hook);         /* revived before removal */
+        return TRUE;
+    }
+
+    if (ALLOC_OBJ(match) == NULL)
+        return FALSE;
+
+    list_init(&match->hook);
+    match->refcnt = 1;
+
+    if ((match->rule = STRDUP(rule)) == NULL) {
+        FREE(match);
+        return FALSE;
+    }
+
+    hash_table_insert(bus->matches, match->rule, match);
+
+    if (bus->conn != NULL) {
+        match_send(bus, "AddMatch", match->rule);
+        match->installed = TRUE;
+    }
+
+    return TRUE;
+}
+
+
+/********************
+ * match_del
+ ********************/
+int
+match_del(bus_t *bus, const char *rule)
+{
+    match_t *match;
+
+    if (bus->matches == NULL ||
+        (match = hash_table_lookup(bus->matches, rule)) == NULL ||
+        match->refcnt <= 0)
+        return FALSE;
+
+    if (--match->refcnt == 0) {
+        list_append(&bus->unmatch, &match->hook);
+        match_schedule_flush();
+    }
+
+    return TRUE;
+}
+
+
+/********************
+ * match_reply
+ ********************/
+static void
+match_reply(DBusPendingCall *pending, void *data)
+{
+    const char  *rule = (const char *)data;
+    DBusMessage *reply;
+    const char  *error;
+
+    if ((reply = dbus_pending_call_steal_reply(pending)) == NULL)
+        return;
+
+    if (dbus_message_get_type(reply) == DBUS_MESSAGE_TYPE_ERROR) {
+        if (!dbus_message_get_args(reply, NULL,
+                                   DBUS_TYPE_STRING, &error,
+                                   DBUS_TYPE_INVALID))
+            error = dbus_message_get_error_name(reply);
+
+        OHM_ERROR("dbus: failed to add match \"%s\" (%s)", rule,
+                  error ? error : "unknown error");
+    }
+
+    dbus_message_unref(reply);
+}
+
+
+/********************
+ * match_send
+ ********************/
+static void
+match_send(bus_t *bus, const char *method, const char *rule)
+{
+    DBusMessage     *msg;
+    DBusPendingCall *pending;
+    char            *data;
+
+    msg = dbus_message_new_method_call(DBUS_SERVICE_DBUS, DBUS_PATH_DBUS,
+                                       DBUS_INTERFACE_DBUS, method);
+
+    if (msg == NULL ||
+        !dbus_message_append_args(msg, DBUS_TYPE_STRING, &rule,
+                                  DBUS_TYPE_INVALID))
+        goto fail;
+
+    /* we only care about AddMatch failures, just like libdbus */
+    if (strcmp(method, "AddMatch")) {
+        dbus_message_set_no_reply(msg, TRUE);
+        if (!dbus_connection_send(bus->conn, msg, NULL))
+            goto fail;
+    }
+    else {
+        if (!dbus_connection_send_with_reply(bus->conn, msg, &pending, -1) ||
+            pending == NULL)
+            goto fail;
+
+        if ((data = STRDUP(rule)) == NULL ||
+            !dbus_pending_call_set_notify(pending, match_reply, data, free))
+            FREE(data);
+
+        dbus_pending_call_unref(pending);
+    }
+
+    dbus_message_unref(msg);
+    return;
+
+ fail:
+    OHM_ERROR("dbus: failed to send %s \"%s\"", method, rule);
+    if (msg != NULL)
+        dbus_message_unref(msg);
+}
+
+
+/********************
+ * match_flush_bus
+ ********************/
+static void
+match_flush_bus(bus_t *bus)
+{
+    match_t     *match;
+    list_hook_t *p, *n;
+
+    list_foreach(&bus->unmatch, p, n) {
+        match = list_entry(p, match_t, hook);
+        list_delete(&match->hook);
+
+        if (match->installed && bus->conn != NULL)
+            match_send(bus, "RemoveMatch", match->rule);
+
+        hash_table_remove(bus->matches, match->rule);
+    }
+}
+
+
+/********************
+ * match_flush
+ ********************/
+static gboolean
+match_flush(gpointer data)
+{
+    bus_t *bus;
+
+    (void)data;
+
+    flush_id = 0;
+
+    if ((bus = bus_by_type(DBUS_BUS_SYSTEM)) != NULL)
+        match_flush_bus(bus);
+    if ((bus = bus_by_type(DBUS_BUS_SESSION)) != NULL)
+        match_flush_bus(bus);
+
+    return FALSE;
+}
+
+
+/********************
+ * match_schedule_flush
+ ********************/
+static void
+match_schedule_flush(void)
+{
+    if (flush_id == 0)
+        flush_id = g_idle_add(match_flush, NULL);
+}
+
+
+/********************
+ * match_purge
+ ********************/
+static void
+match_purge(void *ptr)
+{
+    match_t *match = (match_t *)ptr;
+
+    if (match) {
+        list_delete(&match->hook);
+        FREE(match->rule);
+        FREE(match);
+    }
+}
+
+
+/********************
+ * replay_match
+ ********************/
+static void
+replay_match(gpointer key, gpointer value, gpointer data)
+{
+    match_t *match = (match_t *)value;
+    bus_t   *bus   = (bus_t *)data;
+
+    (void)key;
+
+    if (match->refcnt > 0) {
+        match_send(bus, "AddMatch", match->rule);
+        match->installed = TRUE;
+    }
+    else
+        match->installed = FALSE;       /* not on this connection */
+}
+
+
+/********************
+ * session_bus_event
+ ********************/
+static void
+session_bus_event(bus_t *bus, int event, void *data)
+{
+    (void)data;
+
+    if (event == BUS_EVENT_CONNECTED && bus->matches != NULL)
+        hash_table_foreach(bus->matches, replay_match, bus);
+}
+
+
+/* 
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
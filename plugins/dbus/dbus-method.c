@@ -27,15 +27,23 @@ extern int DBG_METHOD;                         /* debug flag for methods */
 typedef struct {
     char         *path;                        /* object path */
     bus_t        *bus;                         /* bus this object is on */
-    hash_table_t *methods;                     /* object method table */
+    hash_table_t *methods;                     /* methods by member */
 } object_t;
 
 typedef struct {
-    char                          *interface;
-    char                          *member;
-    char                          *signature;
+    atom_t       member;                       /* method name */
+    list_hook_t  methods;                      /* methods, most specific 1st */
+} mlist_t;
+
+typedef struct {
+    atom_t                         interface;  /* interface, if any */
+    atom_t                         member;     /* method name */
+    atom_t                         signature;  /* signature, if any */
+    int                            rank;       /* how specific we are */
     DBusObjectPathMessageFunction  handler;
     void                          *data;
+    handler_stat_t                 stat;       /* dispatching statistics */
+    list_hook_t                    hook;       /* more methods by this name */
 } method_t;
 
 
@@ -46,6 +54,8 @@ static int       object_register(object_t *object);
 static void      object_unregister(object_t *object);
 static void      object_purge(void *);
 
+static void mlist_purge(void *);
+
 static void session_bus_event(bus_t *, int, void *);
 
 
@@ -117,35 +127,89 @@ method_exit(void)
 
 
 /********************
- * method_key
+ * method_purge
  ********************/
-static inline char *
-method_key(char *buf, size_t size,
-           const char *interface, const char *member, const char *signature)
+static void
+method_purge(method_t *method)
 {
-    snprintf(buf, size, "%s.%s/%s",
-             interface ? interface : "",
-             member    ? member    : "",
-             signature ? signature : "");
-    return buf;
+    FREE(method);
 }
 
 
 /********************
- * method_purge
+ * mlist_add
+ ********************/
+static mlist_t *
+mlist_add(object_t *object, const char *member)
+{
+    mlist_t *mlist;
+
+    if (ALLOC_OBJ(mlist) == NULL)
+        return NULL;
+
+    list_init(&mlist->methods);
+    atom_set(&mlist->member, member);
+
+    if (!atom_table_insert(object->methods, &mlist->member, mlist)) {
+        FREE(mlist);
+        return NULL;
+    }
+
+    return mlist;
+}
+
+
+/********************
+ * mlist_purge
  ********************/
 static void
-method_purge(method_t *method)
+mlist_purge(void *ptr)
 {
-#define MEMBER_FREE(member) if ((method)->member) FREE((method)->member)
+    mlist_t     *mlist = (mlist_t *)ptr;
+    method_t    *method;
+    list_hook_t *p, *n;
+
+    if (mlist) {
+        list_foreach(&mlist->methods, p, n) {
+            method = list_entry(p, method_t, hook);
+            list_delete(&method->hook);
+            method_purge(method);
+        }
 
-    MEMBER_FREE(interface);
-    MEMBER_FREE(member);
-    MEMBER_FREE(signature);
-    
-    FREE(method);
+        FREE(mlist);
+    }
+}
+
+
+/********************
+ * mlist_insert
+ ********************/
+static int
+mlist_insert(mlist_t *mlist, method_t *method)
+{
+    method_t    *m;
+    list_hook_t *p, *n;
+
+    list_foreach(&mlist->methods, p, n) {
+        m = list_entry(p, method_t, hook);
+
+        if (atom_equal(&m->interface, &method->interface) &&
+            atom_equal(&m->signature, &method->signature))
+            return FALSE;
+    }
+
+    /* keep more specific methods in front of the less specific ones */
+    list_foreach(&mlist->methods, p, n) {
+        m = list_entry(p, method_t, hook);
 
-#undef METHOD_FREE
+        if (m->rank < method->rank) {
+            list_insert_before(&m->hook, &method->hook);
+            return TRUE;
+        }
+    }
+
+    list_append(&mlist->methods, &method->hook);
+    return TRUE;
 }
 
 
@@ -159,41 +223,38 @@ method_add(DBusBusType type, const char *path, const char *interface,
 {
     bus_t    *bus;
     object_t *object;
+    mlist_t  *mlist;
     method_t *method;
-    char      key_buf[1024];
-    char     *key = NULL;
 
-    if ((bus = bus_by_type(type)) == NULL)
+    if ((bus = bus_by_type(type)) == NULL || member == NULL)
         return FALSE;
     
     if (ALLOC_OBJ(method) == NULL)
         goto failed;
 
-    method->interface = interface ? STRDUP(interface) : NULL;
-    method->member    = STRDUP(member);
-    method->signature = signature ? STRDUP(signature) : NULL;
-    method->handler   = handler;
-    method->data      = data;
+    list_init(&method->hook);
+    atom_set(&method->interface, interface);
+    atom_set(&method->member, member);
+    atom_set(&method->signature, signature);
+    method->rank    = (interface ? 2 : 0) + (signature ? 1 : 0);
+    method->handler = handler;
+    method->data    = data;
     
-    method_key(key_buf, sizeof(key_buf), interface, member, signature);
-    key = key_buf;
-
     if ((object = object_lookup(bus, path)) == NULL) {
         if ((object = object_add(bus, path)) == NULL)
             goto failed;
     }
-    else
-        if (hash_table_lookup(object->methods, key) != NULL)
-            goto failed;
-            
-    if ((key = STRDUP(key)) == NULL)
-        goto failed;
 
-    if (!hash_table_insert(object->methods, key, method))
+    if ((mlist = atom_table_lookup(object->methods, &method->member)) == NULL)
+        if ((mlist = mlist_add(object, member)) == NULL)
+            goto failed;
+    
+    if (!mlist_insert(mlist, method))
         goto failed;
     
-    OHM_DEBUG(DBG_METHOD,
-              "registered handler %p for %s:%s", handler, path, key);
+    OHM_DEBUG(DBG_METHOD, "registered handler %p for %s:%s.%s(%s)", handler,
+              path, interface ? interface : "*", member,
+              signature ? signature : "*");
 
     return TRUE;
     
@@ -212,38 +273,59 @@ method_del(DBusBusType type, const char *path, const char *interface,
            const char *member, const char *signature,
            DBusObjectPathMessageFunction handler, void *data)
 {
-    bus_t    *bus;
-    object_t *object;
-    method_t *method;
-    char      key[1024];
-
-    if ((bus = bus_by_type(type)) == NULL)
+    bus_t       *bus;
+    object_t    *object;
+    mlist_t     *mlist;
+    method_t    *method;
+    list_hook_t *p, *n;
+    atom_t       iatom, matom, satom;
+
+    if ((bus = bus_by_type(type)) == NULL || member == NULL)
         return FALSE;
 
-    method_key(key, sizeof(key), interface, member, signature);
+    atom_init(&iatom, interface);
+    atom_init(&matom, member);
+    atom_init(&satom, signature);
     
-    if ((object = object_lookup(bus, path))                == NULL ||
-        (method = hash_table_lookup(object->methods, key)) == NULL)
+    if ((object = object_lookup(bus, path))                  == NULL ||
+        (mlist  = atom_table_lookup(object->methods, &matom)) == NULL)
         return FALSE;
     
-    if (method->handler != handler || method->data != data) {
-        OHM_WARNING("dbus: %s:%s has handler %p instead of %p",
-                    path, key, method->handler, handler);
-        return FALSE;
-    }
+    list_foreach(&mlist->methods, p, n) {
+        method = list_entry(p, method_t, hook);
 
-    hash_table_remove(object->methods, key);
-    
-    OHM_DEBUG(DBG_METHOD,
-              "unregistered handler %p for %s:%s", method->handler, path, key);
+        if (!atom_equal(&method->interface, &iatom) ||
+            !atom_equal(&method->signature, &satom))
+            continue;
 
-    if (hash_table_empty(object->methods)) {
-        OHM_DEBUG(DBG_METHOD, "object %s became empty, destroying it", path);
-        object_unregister(object);
-        object_del(object);
+        if (method->handler != handler || method->data != data) {
+            OHM_WARNING("dbus: %s:%s.%s(%s) has handler %p instead of %p",
+                        path, interface ? interface : "*", member,
+                        signature ? signature : "*", method->handler, handler);
+            return FALSE;
+        }
+
+        list_delete(&method->hook);
+        method_purge(method);
+
+        OHM_DEBUG(DBG_METHOD, "unregistered handler %p for %s:%s.%s(%s)",
+                  handler, path, interface ? interface : "*", member,
+                  signature ? signature : "*");
+
+        if (list_empty(&mlist->methods))
+            atom_table_remove(object->methods, &mlist->member);
+
+        if (hash_table_empty(object->methods)) {
+            OHM_DEBUG(DBG_METHOD, "object %s became empty, destroying it",
+                      path);
+            object_unregister(object);
+            object_del(object);
+        }
+
+        return TRUE;
     }
 
-    return TRUE;
+    return FALSE;
 }
 
 
@@ -253,46 +335,115 @@ method_del(DBusBusType type, const char *path, const char *interface,
 DBusHandlerResult
 method_dispatch(DBusConnection *c, DBusMessage *msg, void *data)
 {
-    const char *path      = dbus_message_get_path(msg);
-    const char *interface = dbus_message_get_interface(msg);
-    const char *member    = dbus_message_get_member(msg);
-    const char *signature = dbus_message_get_signature(msg);
-    const char *sender    = dbus_message_get_sender(msg);
-    bus_t      *bus       = bus_by_connection(c);
-    object_t   *object    = (object_t *)data;
-    method_t   *method;
-    char        key[1024];
-
-    if (bus == NULL)
+    object_t          *object = (object_t *)data;
+    mlist_t           *mlist;
+    method_t          *method;
+    list_hook_t       *p, *n;
+    atom_t             interface, member, signature;
+    uint64_t           start;
+    DBusHandlerResult  result;
+
+    atom_init(&member, dbus_message_get_member(msg));
+
+    if (member.name == NULL)
         return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
-    
+
+    atom_init(&interface, dbus_message_get_interface(msg));
+    atom_init(&signature, dbus_message_get_signature(msg));
+
     OHM_DEBUG(DBG_METHOD, "got method call %s.%s(%s) for %s from %s",
-              interface, member, signature, path ? path : NULL, sender);
+              interface.name, member.name, signature.name, object->path,
+              dbus_message_get_sender(msg));
 
-    method_key(key, sizeof(key), interface, member, signature);
-    if ((method = hash_table_lookup(object->methods, key)) != NULL) {
-        OHM_DEBUG(DBG_METHOD,
-                  "routing to handler %p (%s)", method->handler, key);
-        return method->handler(c, msg, method->data);
-    }
+    if ((mlist = atom_table_lookup(object->methods, &member)) == NULL)
+        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
-    method_key(key, sizeof(key), interface, member, NULL);
-    if ((method = hash_table_lookup(object->methods, key)) != NULL) {
-        OHM_DEBUG(DBG_METHOD,
-                  "routing to handler %p (%s)", method->handler, key);
-        return method->handler(c, msg, method->data);
-    }
+    list_foreach(&mlist->methods, p, n) {
+        method = list_entry(p, method_t, hook);
+
+        if (atom_matches(&method->interface, &interface) &&
+            atom_matches(&method->signature, &signature)) {
+            OHM_DEBUG(DBG_METHOD, "routing to handler %p (%s.%s(%s))",
+                      method->handler,
+                      method->interface.name ? method->interface.name : "*",
+                      member.name,
+                      method->signature.name ? method->signature.name : "*");
 
-    if ((method = hash_table_lookup(object->methods, member)) != NULL) {
-        OHM_DEBUG(DBG_METHOD,
-                  "routing to handler %p (%s)", method->handler, member);
-        return method->handler(c, msg, method->data);
+            start  = stat_begin();
+            result = method->handler(c, msg, method->data);
+            stat_end(&method->stat, start);
+
+            return result;
+        }
     }
 
     return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 }
 
 
+/********************
+ * mlist_stats
+ ********************/
+static void
+mlist_stats(gpointer key, gpointer value, gpointer data)
+{
+    mlist_t     *mlist = (mlist_t *)value;
+    int          reset = *(int *)data;
+    method_t    *method;
+    list_hook_t *p, *n;
+
+    (void)key;
+
+    list_foreach(&mlist->methods, p, n) {
+        method = list_entry(p, method_t, hook);
+
+        if (reset) {
+            memset(&method->stat, 0, sizeof(method->stat));
+            continue;
+        }
+
+        printf("  method %s.%s(%s) -> %p: %lu calls",
+               method->interface.name ? method->interface.name : "*",
+               mlist->member.name,
+               method->signature.name ? method->signature.name : "*",
+               method->handler, method->stat.calls);
+        if (method->stat.calls > 0 && method->stat.total > 0)
+            printf(", avg %llu us, max %llu us",
+                   (unsigned long long)(method->stat.total/method->stat.calls),
+                   (unsigned long long)method->stat.max);
+        printf("\n");
+    }
+}
+
+
+/********************
+ * object_stats
+ ********************/
+static void
+object_stats(gpointer key, gpointer value, gpointer data)
+{
+    object_t *object = (object_t *)value;
+
+    (void)key;
+
+    if (!*(int *)data)
+        printf("  object %s:\n", object->path);
+
+    hash_table_foreach(object->methods, mlist_stats, data);
+}
+
+
+/********************
+ * method_stats
+ ********************/
+void
+method_stats(bus_t *bus, int reset)
+{
+    if (bus->objects != NULL)
+        hash_table_foreach(bus->objects, object_stats, &reset);
+}
+
+
 /********************
  * object_add
  ********************/
@@ -309,7 +460,7 @@ object_add(bus_t *bus, const char *path)
     if ((object->path = STRDUP(path)) == NULL)
         goto failed;
     
-    if ((object->methods = hash_table_create(NULL, object_purge)) == NULL)
+    if ((object->methods = atom_table_create(mlist_purge)) == NULL)
         goto failed;
     
     if (!hash_table_insert(bus->objects, object->path, object))
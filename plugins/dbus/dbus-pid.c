@@ -0,0 +1,472 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+#include <stdio.h>
+
+#include "dbus-plugin.h"
+
+extern int DBG_METHOD;
+
+/*
+ * A shared cache of the PIDs of bus peers. Entries are keyed by bus name
+ * and dropped when the name changes owner or goes away (we watch each
+ * cached name with the name owner watches). Concurrent queries for a name
+ * share a single GetConnectionUnixProcessID call.
+ *
+ * Callbacks are always called asynchronously, for cache hits from an idle
+ * callback. pid_lookup can be used to check the cache synchronously.
+ */
+
+#define PID_QUERY_TIMEOUT (5 * 1000)
+
+typedef struct {
+    char            *name;                     /* bus name */
+    bus_t           *bus;                      /* bus it is on */
+    pid_t            pid;                      /* pid, 0 if not known yet */
+    int              stale;                    /* invalidated while queried */
+    DBusPendingCall *pending;                  /* in-flight query, if any */
+    list_hook_t      waiters;                  /* queued callbacks */
+} pidentry_t;
+
+typedef struct {
+    pid_query_cb_t   cb;                       /* callback to call */
+    void            *data;                     /* opaque callback data */
+    char            *name;                     /* for cache hits */
+    pid_t            pid;                      /* for cache hits */
+    list_hook_t      hook;
+} pidwait_t;
+
+
+static struct {
+    unsigned long hits;                        /* answered from the cache */
+    unsigned long misses;                      /* needed a query */
+    unsigned long shared;                      /* joined an in-flight query */
+    unsigned long failed;                      /* failed queries */
+    unsigned long invalidated;                 /* entries invalidated */
+} stats;
+
+static list_hook_t deliveries;                 /* queued cache hits */
+static guint       delivery_id;                /* idle delivery source */
+
+static void pidentry_purge(void *ptr);
+static void pidentry_del(pidentry_t *entry);
+static void pid_name_changed(const char *name, const char *before,
+                             const char *after, void *data);
+static void pid_reply(DBusPendingCall *pending, void *data);
+
+
+/********************
+ * pid_init
+ ********************/
+int
+pid_init(void)
+{
+    bus_t *bus;
+    int    i;
+
+    list_init(&deliveries);
+
+    for (i = 0; i < 2; i++) {
+        bus = bus_by_type(i == 0 ? DBUS_BUS_SYSTEM : DBUS_BUS_SESSION);
+
+        if (bus == NULL)
+            continue;
+
+        if ((bus->pids = hash_table_create(NULL, pidentry_purge)) == NULL) {
+            OHM_ERROR("dbus: failed to create PID cache");
+            pid_exit();
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+
+/********************
+ * pid_exit
+ ********************/
+void
+pid_exit(void)
+{
+    bus_t       *bus;
+    pidwait_t   *w;
+    list_hook_t *p, *n;
+    int          i;
+
+    if (delivery_id != 0) {
+        g_source_remove(delivery_id);
+        delivery_id = 0;
+    }
+
+    if (deliveries.next != NULL) {
+        list_foreach(&deliveries, p, n) {
+            w = list_entry(p, pidwait_t, hook);
+            list_delete(&w->hook);
+            FREE(w->name);
+            FREE(w);
+        }
+    }
+
+    for (i = 0; i < 2; i++) {
+        bus = bus_by_type(i == 0 ? DBUS_BUS_SYSTEM : DBUS_BUS_SESSION);
+
+        if (bus != NULL && bus->pids != NULL) {
+            hash_table_destroy(bus->pids);
+            bus->pids = NULL;
+        }
+    }
+}
+
+
+/********************
+ * pid_lookup
+ ********************/
+pid_t
+pid_lookup(bus_t *bus, const char *name)
+{
+    pidentry_t *entry;
+
+    if (bus->pids == NULL || name == NULL ||
+        (entry = hash_table_lookup(bus->pids, name)) == NULL ||
+        entry->pid == 0)
+        return 0;
+
+    stats.hits++;
+    return entry->pid;
+}
+
+
+/********************
+ * pid_deliver
+ ********************/
+static gboolean
+pid_deliver(gpointer data)
+{
+    pidwait_t   *w;
+    list_hook_t *p, *n;
+
+    (void)data;
+
+    delivery_id = 0;
+
+    list_foreach(&deliveries, p, n) {
+        w = list_entry(p, pidwait_t, hook);
+        list_delete(&w->hook);
+
+        w->cb(w->name, w->pid, w->data);
+
+        FREE(w->name);
+        FREE(w);
+    }
+
+    return FALSE;
+}
+
+
+/********************
+ * pid_send_query
+ ********************/
+static int
+pid_send_query(pidentry_t *entry)
+{
+    bus_t       *bus  = entry->bus;
+    const char  *name = entry->name;
+    DBusMessage *msg;
+    int          success;
+
+    if (bus->conn == NULL)
+        return FALSE;
+
+    msg = dbus_message_new_method_call(DBUS_SERVICE_DBUS, DBUS_PATH_DBUS,
+                                       DBUS_INTERFACE_DBUS,
+                                       "GetConnectionUnixProcessID");
+    if (msg == NULL)
+        return FALSE;
+
+    success =
+        dbus_message_append_args(msg, DBUS_TYPE_STRING, &name,
+                                 DBUS_TYPE_INVALID) &&
+        dbus_connection_send_with_reply(bus->conn, msg, &entry->pending,
+                                        PID_QUERY_TIMEOUT) &&
+        entry->pending != NULL &&
+        dbus_pending_call_set_notify(entry->pending, pid_reply, entry, NULL);
+
+    dbus_message_unref(msg);
+
+    if (!success && entry->pending != NULL) {
+        dbus_pending_call_cancel(entry->pending);
+        dbus_pending_call_unref(entry->pending);
+        entry->pending = NULL;
+    }
+
+    return success;
+}
+
+
+/********************
+ * pid_query
+ ********************/
+int
+pid_query(bus_t *bus, const char *name, pid_query_cb_t cb, void *data)
+{
+    pidentry_t *entry;
+    pidwait_t  *w;
+
+    if (bus->pids == NULL || name == NULL || cb == NULL)
+        return FALSE;
+
+    if (ALLOC_OBJ(w) == NULL)
+        return FALSE;
+
+    list_init(&w->hook);
+    w->cb   = cb;
+    w->data = data;
+
+    if ((entry = hash_table_lookup(bus->pids, name)) != NULL) {
+        if (entry->pid != 0) {
+            stats.hits++;
+
+            if ((w->name = STRDUP(name)) == NULL) {
+                FREE(w);
+                return FALSE;
+            }
+            w->pid = entry->pid;
+
+            list_append(&deliveries, &w->hook);
+            if (delivery_id == 0)
+                delivery_id = g_idle_add(pid_deliver, NULL);
+        }
+        else {
+            stats.shared++;
+            list_append(&entry->waiters, &w->hook);
+        }
+
+        return TRUE;
+    }
+
+    stats.misses++;
+
+    if (ALLOC_OBJ(entry) == NULL) {
+        FREE(w);
+        return FALSE;
+    }
+
+    list_init(&entry->waiters);
+    entry->bus = bus;
+
+    if ((entry->name = STRDUP(name)) == NULL) {
+        FREE(entry);
+        FREE(w);
+        return FALSE;
+    }
+
+    if (!pid_send_query(entry)) {
+        OHM_ERROR("dbus: failed to query the PID of %s", name);
+        stats.failed++;
+        FREE(entry->name);
+        FREE(entry);
+        FREE(w);
+        return FALSE;
+    }
+
+    list_append(&entry->waiters, &w->hook);
+    hash_table_insert(bus->pids, entry->name, entry);
+    watch_add(bus->type, entry->name, pid_name_changed, bus);
+
+    OHM_DEBUG(DBG_METHOD, "querying PID of %s", name);
+
+    return TRUE;
+}
+
+
+/********************
+ * pid_reply
+ ********************/
+static void
+pid_reply(DBusPendingCall *pending, void *data)
+{
+    pidentry_t    *entry = (pidentry_t *)data;
+    DBusMessage   *reply;
+    dbus_uint32_t  pid;
+    pidwait_t     *w;
+    list_hook_t   *p, *n;
+
+    pid = 0;
+
+    if ((reply = dbus_pending_call_steal_reply(pending)) != NULL) {
+        if (dbus_message_get_type(reply) != DBUS_MESSAGE_TYPE_ERROR &&
+            !dbus_message_get_args(reply, NULL,
+                                   DBUS_TYPE_UINT32, &pid,
+                                   DBUS_TYPE_INVALID))
+            pid = 0;
+        dbus_message_unref(reply);
+    }
+
+    dbus_pending_call_unref(entry->pending);
+    entry->pending = NULL;
+
+    if (pid == 0)
+        stats.failed++;
+
+    OHM_DEBUG(DBG_METHOD, "PID of %s is %u", entry->name, pid);
+
+    entry->pid = (pid_t)pid;
+
+    list_foreach(&entry->waiters, p, n) {
+        w = list_entry(p, pidwait_t, hook);
+        list_delete(&w->hook);
+
+        w->cb(entry->name, entry->pid, w->data);
+
+        FREE(w);
+    }
+
+    /* don't cache failures or answers for names that have changed owner */
+    if (entry->pid == 0 || entry->stale)
+        pidentry_del(entry);
+}
+
+
+/********************
+ * pid_name_changed
+ ********************/
+static void
+pid_name_changed(const char *name, const char *before, const char *after,
+                 void *data)
+{
+    bus_t      *bus = (bus_t *)data;
+    pidentry_t *entry;
+
+    (void)before;
+    (void)after;
+
+    if (bus->pids == NULL ||
+        (entry = hash_table_lookup(bus->pids, name)) == NULL)
+        return;
+
+    OHM_DEBUG(DBG_METHOD, "%s changed owner, invalidating its PID", name);
+
+    stats.invalidated++;
+
+    if (entry->pending != NULL)
+        entry->stale = TRUE;
+    else
+        pidentry_del(entry);
+}
+
+
+/********************
+ * pidentry_del
+ ********************/
+static void
+pidentry_del(pidentry_t *entry)
+{
+    bus_t *bus = entry->bus;
+
+    watch_del(bus->type, entry->name, pid_name_changed, bus);
+    hash_table_remove(bus->pids, entry->name);
+}
+
+
+/********************
+ * pidentry_purge
+ ********************/
+static void
+pidentry_purge(void *ptr)
+{
+    pidentry_t  *entry = (pidentry_t *)ptr;
+    pidwait_t   *w;
+    list_hook_t *p, *n;
+
+    if (entry == NULL)
+        return;
+
+    if (entry->pending != NULL) {
+        dbus_pending_call_cancel(entry->pending);
+        dbus_pending_call_unref(entry->pending);
+    }
+
+    list_foreach(&entry->waiters, p, n) {
+        w = list_entry(p, pidwait_t, hook);
+        list_delete(&w->hook);
+        FREE(w);
+    }
+
+    FREE(entry->name);
+    FREE(entry);
+}
+
+
+/********************
+ * count_entry
+ ********************/
+static void
+count_entry(gpointer key, gpointer value, gpointer data)
+{
+    pidentry_t *entry = (pidentry_t *)value;
+    int        *cnt   = (int *)data;
+
+    (void)key;
+
+    if (entry->pid != 0)
+        cnt[0]++;
+    else
+        cnt[1]++;
+}
+
+
+/********************
+ * pid_stats
+ ********************/
+void
+pid_stats(int reset)
+{
+    bus_t *bus;
+    int    cnt[2], i;
+
+    if (reset) {
+        memset(&stats, 0, sizeof(stats));
+        return;
+    }
+
+    cnt[0] = cnt[1] = 0;
+
+    for (i = 0; i < 2; i++) {
+        bus = bus_by_type(i == 0 ? DBUS_BUS_SYSTEM : DBUS_BUS_SESSION);
+
+        if (bus != NULL && bus->pids != NULL)
+            hash_table_foreach(bus->pids, count_entry, cnt);
+    }
+
+    printf("PID cache: %d entries, %d queries in flight\n", cnt[0], cnt[1]);
+    printf("  %lu hits, %lu misses, %lu shared queries, %lu failed, "
+           "%lu invalidated\n", stats.hits, stats.misses, stats.shared,
+           stats.failed, stats.invalidated);
+}
+
+
+/* 
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
@@ -18,6 +18,7 @@ USA.
 *************************************************************************/
 
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <glib-object.h>
 
@@ -25,6 +26,8 @@ USA.
 
 static OhmPlugin *dbus_plugin;                /* this plugin */
 
+OHM_IMPORTABLE(int, add_command, (char *name, void (*handler)(char *)));
+
 /* debug flags */
 int DBG_SIGNAL, DBG_METHOD;
 
@@ -36,6 +39,7 @@ OHM_DEBUG_PLUGIN(dbus,
 static void plugin_exit(OhmPlugin *plugin);
 static DBusHandlerResult session_bus_up(DBusConnection *c,
                                         DBusMessage *msg, void *data);
+static gboolean console_init(gpointer data);
 
 
 /********************
@@ -52,9 +56,12 @@ plugin_init(OhmPlugin *plugin)
     OHM_INFO("dbus: initializing...");
 
     retval += dbus_bus_init() * 1;
+    retval += match_init()    * 32;
     retval += watch_init()    * 2;
     retval += method_init()   * 4;
     retval += signal_init()   * 8;
+    retval += filter_init()   * 16;
+    retval += pid_init()      * 64;
 
     if (!retval) {
         OHM_ERROR("dbus ERROR: 0x%04x", retval);
@@ -71,6 +78,8 @@ plugin_init(OhmPlugin *plugin)
     }
 
     dbus_plugin = plugin;
+
+    g_idle_add(console_init, NULL);
 }
 
 
@@ -86,9 +95,12 @@ plugin_exit(OhmPlugin *plugin)
                "com.nokia.policy", "NewSession", "s", NULL,
                session_bus_up, NULL);
     
+    pid_exit();
+    filter_exit();
     signal_exit();
     method_exit();
     watch_exit();
+    match_exit();
     dbus_bus_exit();
 
     dbus_plugin = NULL;
@@ -129,6 +141,79 @@ session_bus_up(DBusConnection *c, DBusMessage *msg, void *data)
 
 
 
+/********************
+ * console_stats
+ ********************/
+static void
+console_stats(int reset)
+{
+    bus_t *bus;
+    int    i;
+
+    filter_stats(reset);
+    pid_stats(reset);
+
+    for (i = 0; i < 2; i++) {
+        bus = bus_by_type(i == 0 ? DBUS_BUS_SYSTEM : DBUS_BUS_SESSION);
+
+        if (bus == NULL)
+            continue;
+
+        if (!reset)
+            printf("%s bus handlers:\n", i == 0 ? "system" : "session");
+
+        watch_stats(bus, reset);
+        signal_stats(bus, reset);
+        method_stats(bus, reset);
+    }
+}
+
+
+/********************
+ * console_command
+ ********************/
+static void
+console_command(char *command)
+{
+    if (!strcmp(command, "help")) {
+        printf("dbus help              show this help\n");
+        printf("dbus stats             show dispatching statistics\n");
+        printf("dbus stats reset       reset dispatching statistics\n");
+        printf("dbus timing <on|off>   turn handler timing on or off\n");
+    }
+    else if (!strcmp(command, "stats"))
+        console_stats(FALSE);
+    else if (!strcmp(command, "stats reset"))
+        console_stats(TRUE);
+    else if (!strcmp(command, "timing on"))
+        dispatch_timing = TRUE;
+    else if (!strcmp(command, "timing off"))
+        dispatch_timing = FALSE;
+    else
+        printf("unknown dbus command \"%s\"\n", command);
+}
+
+
+/********************
+ * console_init
+ ********************/
+static gboolean
+console_init(gpointer data)
+{
+    char *signature = (char *)add_command_SIGNATURE;
+
+    (void)data;
+
+    if (ohm_module_find_method("dres.add_command", &signature,
+                               (void *)&add_command))
+        add_command("dbus", console_command);
+    else
+        OHM_INFO("dbus: console command extensions not available");
+
+    return FALSE;
+}
+
+
 
 /*****************************************************************************
  *                           *** public plugin API ***                       *
@@ -246,6 +331,64 @@ OHM_EXPORTABLE(int, del_watch, (DBusBusType type,
 }
 
 
+/********************
+ * add_match
+ ********************/
+OHM_EXPORTABLE(int, add_match, (DBusBusType type, const char *rule))
+{
+    bus_t *bus;
+
+    if ((bus = bus_by_type(type)) == NULL)
+        return FALSE;
+
+    return match_add(bus, rule);
+}
+
+
+/********************
+ * del_match
+ ********************/
+OHM_EXPORTABLE(int, del_match, (DBusBusType type, const char *rule))
+{
+    bus_t *bus;
+
+    if ((bus = bus_by_type(type)) == NULL)
+        return FALSE;
+
+    return match_del(bus, rule);
+}
+
+
+/********************
+ * lookup_pid
+ ********************/
+OHM_EXPORTABLE(pid_t, lookup_pid, (DBusBusType type, const char *name))
+{
+    bus_t *bus;
+
+    if ((bus = bus_by_type(type)) == NULL)
+        return 0;
+
+    return pid_lookup(bus, name);
+}
+
+
+/********************
+ * query_pid
+ ********************/
+OHM_EXPORTABLE(int, query_pid, (DBusBusType type, const char *name,
+                                void (*cb)(const char *, pid_t, void *),
+                                void *data))
+{
+    bus_t *bus;
+
+    if ((bus = bus_by_type(type)) == NULL)
+        return FALSE;
+
+    return pid_query(bus, name, cb, data);
+}
+
+
 /*****************************************************************************
  *                            *** OHM plugin glue ***                        *
  *****************************************************************************/
@@ -256,13 +399,17 @@ OHM_PLUGIN_DESCRIPTION(PLUGIN_NAME,
                        OHM_LICENSE_LGPL, /* OHM_LICENSE_LGPL */
                        plugin_init, plugin_exit, NULL);
 
-OHM_PLUGIN_PROVIDES_METHODS(PLUGIN_PREFIX, 6,
+OHM_PLUGIN_PROVIDES_METHODS(PLUGIN_PREFIX, 10,
                             OHM_EXPORT(add_method, "add_method"),
                             OHM_EXPORT(del_method, "del_method"),
                             OHM_EXPORT(add_signal, "add_signal"),
                             OHM_EXPORT(del_signal, "del_signal"),
                             OHM_EXPORT(add_watch , "add_watch"),
-                            OHM_EXPORT(del_watch , "del_watch")
+                            OHM_EXPORT(del_watch , "del_watch"),
+                            OHM_EXPORT(add_match , "add_match"),
+                            OHM_EXPORT(del_match , "del_match"),
+                            OHM_EXPORT(lookup_pid, "lookup_pid"),
+                            OHM_EXPORT(query_pid , "query_pid")
 #if 0
                             OHM_EXPORT(register_name, "register_name"),
                             OHM_EXPORT(release_name , "release_name")
@@ -25,6 +25,10 @@ USA.
 #include <ohm/ohm-plugin-log.h>
 #include <ohm/ohm-plugin-debug.h>
 
+#include <string.h>
+#include <stdint.h>
+#include <sys/types.h>
+
 #include <glib.h>
 #include <dbus/dbus.h>
 
@@ -37,16 +41,49 @@ USA.
 
 typedef GHashTable hash_table_t;
 
+
+/*
+ * interned names
+ *
+ * Interfaces, members, signatures, paths and senders we dispatch on are
+ * interned when a handler is registered and their hashes are computed
+ * only once. A NULL name is a wildcard that matches anything.
+ */
+
+typedef struct {
+    const char *name;                      /* interned name or NULL */
+    guint       hash;                      /* hash of name */
+} atom_t;
+
 typedef struct {
     DBusBusType     type;                  /* DBUS_BUS_{SYSTEM, SESSION} */
     DBusConnection *conn;                  /* connection if it is up */
     hash_table_t   *watches;               /* watched names */
     hash_table_t   *objects;               /* exported objects */
     hash_table_t   *signals;               /* signals we listen for */
+    hash_table_t   *matches;               /* match rules we have added */
+    hash_table_t   *pids;                  /* cached PIDs of peers */
+    list_hook_t     unmatch;               /* match rules to remove */
     list_hook_t     notify;                /* bus event watchers */
+    DBusConnection *filter;                /* connection we filter on */
+    unsigned long   nmsg;                  /* messages seen by our filter */
+    unsigned long   nsignal;               /* signals seen by our filter */
 } bus_t;
 
 
+/*
+ * dispatching statistics of a single handler
+ */
+
+typedef struct {
+    unsigned long calls;                   /* number of invocations */
+    uint64_t      total;                   /* total time spent (usecs) */
+    uint64_t      max;                     /* longest invocation (usecs) */
+} handler_stat_t;
+
+extern int dispatch_timing;                /* whether to time handlers */
+
+
 enum {
     BUS_EVENT_CONNECTED = 1,               /* bus connection is up */
 };
@@ -65,6 +102,21 @@ int bus_watch_del(bus_t *bus,
 
 
 
+/* dbus-match.c */
+int  match_init(void);
+void match_exit(void);
+int  match_add(bus_t *bus, const char *rule);
+int  match_del(bus_t *bus, const char *rule);
+
+/* dbus-pid.c */
+typedef void (*pid_query_cb_t)(const char *name, pid_t pid, void *data);
+
+int   pid_init(void);
+void  pid_exit(void);
+pid_t pid_lookup(bus_t *bus, const char *name);
+int   pid_query(bus_t *bus, const char *name, pid_query_cb_t cb, void *data);
+void  pid_stats(int reset);
+
 /* dbus-method.c */
 int  method_init(void);
 void method_exit(void);
@@ -78,6 +130,7 @@ int method_del(DBusBusType type, const char *path, const char *interface,
                DBusObjectPathMessageFunction handler, void *data);
 
 void method_bus_up(bus_t *bus);
+void method_stats(bus_t *bus, int reset);
 
 /* dbus-signal.c */
 int  signal_init(void);
@@ -92,6 +145,8 @@ int signal_del(DBusBusType type, const char *path, const char *interface,
                DBusObjectPathMessageFunction handler, void *data);
 
 void signal_bus_up(bus_t *bus);
+void signal_dispatch(bus_t *bus, DBusMessage *msg, const atom_t *member);
+void signal_stats(bus_t *bus, int reset);
 
 /* dbus-watch.c */
 int  watch_init(void);
@@ -105,6 +160,43 @@ int watch_del(DBusBusType type, const char *name,
               void *data);
 
 void watch_bus_up(bus_t *bus);
+void watch_dispatch(bus_t *bus, DBusMessage *msg);
+void watch_stats(bus_t *bus, int reset);
+
+/* dbus-filter.c */
+int  filter_init(void);
+void filter_exit(void);
+void filter_stats(int reset);
+uint64_t stat_time(void);
+
+
+/********************
+ * stat_begin
+ ********************/
+static inline uint64_t
+stat_begin(void)
+{
+    return dispatch_timing ? stat_time() : 0;
+}
+
+
+/********************
+ * stat_end
+ ********************/
+static inline void
+stat_end(handler_stat_t *stat, uint64_t start)
+{
+    uint64_t diff;
+
+    stat->calls++;
+
+    if (dispatch_timing && start) {
+        diff = stat_time() - start;
+        stat->total += diff;
+        if (diff > stat->max)
+            stat->max = diff;
+    }
+}
 
 
 /*
@@ -121,6 +213,63 @@ int hash_table_unhash(hash_table_t *ht, const char *key);
 int hash_table_empty(hash_table_t *ht);
 void hash_table_foreach(hash_table_t *ht, GHFunc callback, void *data);
 
+hash_table_t *atom_table_create(void (*value_free)(void *));
+int atom_table_insert(hash_table_t *ht, atom_t *key, void *value);
+void *atom_table_lookup(hash_table_t *ht, const atom_t *key);
+int atom_table_remove(hash_table_t *ht, const atom_t *key);
+
+void atom_set(atom_t *atom, const char *name);
+
+
+/********************
+ * atom_hash
+ ********************/
+static inline guint
+atom_hash(const char *name)
+{
+    return name ? g_str_hash(name) : 0;
+}
+
+
+/********************
+ * atom_init
+ ********************/
+static inline void
+atom_init(atom_t *atom, const char *name)
+{
+    atom->name = name;
+    atom->hash = atom_hash(name);
+}
+
+
+/********************
+ * atom_equal
+ ********************/
+static inline int
+atom_equal(const atom_t *a, const atom_t *b)
+{
+    if (a->name == b->name)
+        return TRUE;
+
+    if (a->name == NULL || b->name == NULL || a->hash != b->hash)
+        return FALSE;
+
+    return !strcmp(a->name, b->name);
+}
+
+
+/********************
+ * atom_matches
+ ********************/
+static inline int
+atom_matches(const atom_t *pattern, const atom_t *atom)
+{
+    if (pattern->name == NULL || atom->name == NULL)
+        return TRUE;
+
+    return atom_equal(pattern, atom);
+}
+
 
 
 
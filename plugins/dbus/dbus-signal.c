@@ -27,13 +27,26 @@ extern int DBG_SIGNAL;                         /* debug flag for signals */
 
 
 /*
- * a list of signal handlers (with the same hash key)
+ * signal handlers by member, the only thing we hash on when dispatching
  */
 
 typedef struct {
-    char        *key;                          /* signal lookup key */
+    atom_t       member;                       /* signal name */
+    list_hook_t  lists;                        /* siglists by interface */
+    int          busy;                         /* being dispatched */
+} sigmember_t;
+
+
+/*
+ * a list of signal handlers (with the same interface and member)
+ */
+
+typedef struct {
+    atom_t       interface;                    /* interface or NULL for any */
     char        *rule;                         /* signal D-BUS match rule */
+    sigmember_t *member;                       /* member we belong to */
     list_hook_t  signals;                      /* signal handlers */
+    list_hook_t  hook;                         /* more siglists by member */
 } siglist_t;
 
 
@@ -42,30 +55,29 @@ typedef struct {
  */
 
 typedef struct {
-    char                          *signature;  /* expected signature if any */
-    char                          *path;       /* expected path if any */
-    char                          *sender;     /* expected sender if any */
+    atom_t                         signature;  /* expected signature if any */
+    atom_t                         path;       /* expected path if any */
+    atom_t                         sender;     /* expected sender if any */
     DBusObjectPathMessageFunction  handler;    /* signal handler */
     void                          *data;       /* opaque handler data */
+    handler_stat_t                 stat;       /* dispatching statistics */
+    int                            dead;       /* deleted while dispatching */
     list_hook_t                    hook;       /* more handlers */
 } signal_t;
 
 
-static int signal_add_filter(bus_t *bus);
-static void signal_del_filter(bus_t *bus);
-static DBusHandlerResult signal_dispatch(DBusConnection *c, DBusMessage *msg,
-                                         void *data);
-
-static siglist_t *siglist_add(bus_t *bus, const char *key, const char *rule);
-static int        siglist_del(bus_t *bus, siglist_t *siglist);
-static siglist_t *siglist_lookup(bus_t *bus, const char *key);
-static void siglist_purge(void *ptr);
+static siglist_t *siglist_add(bus_t *bus, const char *interface,
+                              const char *member, const char *rule);
+static void       siglist_del(bus_t *bus, siglist_t *siglist);
+static siglist_t *siglist_lookup(bus_t *bus, const atom_t *interface,
+                                 const atom_t *member);
+static void siglist_purge(siglist_t *siglist);
+static void sigmember_purge(void *ptr);
+static void sigmember_reap(bus_t *bus, sigmember_t *sm);
 
 static void siglist_add_match(bus_t *bus, siglist_t *siglist);
 static void siglist_del_match(bus_t *bus, siglist_t *siglist);
 
-static void session_bus_event(bus_t *, int, void *);
-
 
 /********************
  * signal_init
@@ -78,38 +90,26 @@ signal_init(void)
     system  = bus_by_type(DBUS_BUS_SYSTEM);
 
     if (system != NULL) {
-        system->signals  = hash_table_create(NULL, siglist_purge);
+        system->signals  = atom_table_create(sigmember_purge);
         
         if (system->signals == NULL) {
             OHM_ERROR("dbus: failed to create signal tables");
             signal_exit();
             return FALSE;
         }
-        
-        if (!signal_add_filter(system)) {
-            OHM_ERROR("dbus: failed to add signal dispatcher for system bus");
-            signal_exit();
-            return FALSE;
-        }
     }
 
 #if 1
     session = bus_by_type(DBUS_BUS_SESSION);
 
     if (session != NULL) {
-        session->signals = hash_table_create(NULL, siglist_purge);
+        session->signals = atom_table_create(sigmember_purge);
 
         if (session->signals == NULL) {
             OHM_ERROR("dbus: failed to create signal tables");
             signal_exit();
             return FALSE;
         }
-
-        if (!bus_watch_add(session, session_bus_event, NULL)) {
-            OHM_ERROR("dbus: failed to install session bus watch");
-            signal_exit();
-            return FALSE;
-        }
     }
 #endif
 
@@ -129,8 +129,6 @@ signal_exit(void)
     session = bus_by_type(DBUS_BUS_SESSION);
 
     if (system != NULL) {
-        signal_del_filter(system);
-
         if (system->signals) {
             hash_table_destroy(system->signals);
             system->signals = NULL;
@@ -138,10 +136,6 @@ signal_exit(void)
     }
     
     if (session != NULL) {
-        signal_del_filter(session);
-
-        bus_watch_del(session, session_bus_event, NULL);
-
         if (session->signals) {
             hash_table_destroy(session->signals);
             session->signals = NULL;
@@ -150,46 +144,6 @@ signal_exit(void)
 }
 
 
-/********************
- * signal_add_filter
- ********************/
-static int
-signal_add_filter(bus_t *bus)
-{
-    if (bus->conn == NULL)
-        return FALSE;
-    
-    return dbus_connection_add_filter(bus->conn, signal_dispatch, NULL, NULL);
-}
-
-
-/********************
- * signal_del_filter
- ********************/
-void
-signal_del_filter(bus_t *bus)
-{
-    if (bus == NULL || bus->conn == NULL)
-        return;
-    
-    dbus_connection_remove_filter(bus->conn, signal_dispatch, NULL);
-}
-
-
-/********************
- * signal_key
- ********************/
-static inline char *
-signal_key(char *buf, size_t size, const char *interface, const char *member)
-{
-    snprintf(buf, size, "%s.%s",
-             interface ? interface : "",
-             member    ? member    : "");
-    
-    return buf;
-}
-
-
 /********************
  * signal_rule
  ********************/
@@ -232,13 +186,13 @@ signal_rule(char *buf, size_t size,
  * signal_matches
  ********************/
 static inline int
-signal_matches(signal_t *sig, const char *signature, const char *path,
-               const char *sender)
+signal_matches(signal_t *sig, const atom_t *signature, const atom_t *path,
+               const atom_t *sender)
 {
-
-#define MATCHES(field) (!sig->field || !field || !strcmp(sig->field, field))
-    return MATCHES(signature) && MATCHES(path) && MATCHES(sender);
-#undef MATCHES
+    return
+        atom_matches(&sig->signature, signature) &&
+        atom_matches(&sig->path     , path)      &&
+        atom_matches(&sig->sender   , sender);
 }
 
 
@@ -248,12 +202,7 @@ signal_matches(signal_t *sig, const char *signature, const char *path,
 static void
 signal_purge(signal_t *sig)
 {
-    if (sig) {
-        FREE(sig->signature);
-        FREE(sig->path);
-        FREE(sig->sender);
-        FREE(sig);
-    }
+    FREE(sig);
 }
 
 
@@ -268,7 +217,8 @@ signal_add(DBusBusType type, const char *path, const char *interface,
     bus_t      *bus;
     signal_t   *sig;
     siglist_t  *siglist;
-    char        key[1024], rule[1024];
+    atom_t      iatom, matom;
+    char        rule[1024];
 
     if ((bus = bus_by_type(type)) == NULL)
         return FALSE;
@@ -277,17 +227,21 @@ signal_add(DBusBusType type, const char *path, const char *interface,
         return FALSE;
     
     list_init(&sig->hook);
-    sig->signature = signature ? STRDUP(signature) : NULL;
-    sig->path      = path      ? STRDUP(path)      : NULL;
-    sig->sender    = sender    ? STRDUP(sender)    : NULL;
-    sig->handler   = handler;
-    sig->data      = data;
-
-    signal_key(key, sizeof(key), interface, member);
-    signal_rule(rule, sizeof(rule), interface, member, path);
+    atom_set(&sig->signature, signature);
+    atom_set(&sig->path, path);
+    atom_set(&sig->sender, sender);
+    sig->handler = handler;
+    sig->data    = data;
+
+    atom_init(&iatom, interface);
+    atom_init(&matom, member ? member : "");
+
+    if ((siglist = siglist_lookup(bus, &iatom, &matom)) == NULL) {
+        signal_rule(rule, sizeof(rule), interface, member, path);
+        siglist = siglist_add(bus, interface, member, rule);
+    }
 
-    if ((siglist = siglist_lookup(bus, key))    == NULL &&
-        (siglist = siglist_add(bus, key, rule)) == NULL) {
+    if (siglist == NULL) {
         signal_purge(sig);
         OHM_WARNING("dbus: error setting the signal match");
         return FALSE;
@@ -310,21 +264,32 @@ signal_del(DBusBusType type, const char *path, const char *interface,
     siglist_t   *siglist;
     signal_t    *sig;
     list_hook_t *p, *n;
-    char         key[1024];
-
-    (void)sender;
+    atom_t       iatom, matom, satom, patom, sndatom;
 
     if ((bus = bus_by_type(type)) == NULL)
         return FALSE;
 
-    signal_key(key, sizeof(key), interface, member);
+    atom_init(&iatom, interface);
+    atom_init(&matom, member ? member : "");
+    atom_init(&satom, signature);
+    atom_init(&patom, path);
+    atom_init(&sndatom, sender);
 
-    if ((siglist = siglist_lookup(bus, key)) != NULL) {
+    if ((siglist = siglist_lookup(bus, &iatom, &matom)) != NULL) {
         list_foreach(&siglist->signals, p, n) {
             sig = list_entry(p, signal_t, hook);
 
-            if (signal_matches(sig, signature, path, sender) &&
+            if (sig->dead)
+                continue;
+
+            if (signal_matches(sig, &satom, &patom, &sndatom) &&
                 sig->handler == handler && sig->data == data) {
+
+                if (siglist->member->busy) {   /* reaped after dispatching */
+                    sig->dead = TRUE;
+                    return TRUE;
+                }
+
                 list_delete(&sig->hook);
                 signal_purge(sig);
                 
@@ -343,61 +308,149 @@ signal_del(DBusBusType type, const char *path, const char *interface,
 /********************
  * signal_dispatch
  ********************/
-static void
-signal_dispatch_handle(bus_t *bus,
-                       DBusConnection *c,
-                       DBusMessage *msg,
-                       const char *key,
-                       const char *path,
-                       const char *interface,
-                       const char *member,
-                       const char *signature,
-                       const char *sender)
+void
+signal_dispatch(bus_t *bus, DBusMessage *msg, const atom_t *member)
 {
+    sigmember_t  *sm;
     siglist_t    *siglist;
     signal_t     *sig;
-    list_hook_t  *p, *n;
+    list_hook_t  *lp, *ln, *sp, *sn;
+    atom_t        interface, signature, path, sender;
+    uint64_t      start;
 
-    if ((siglist = siglist_lookup(bus, key)) != NULL) {
-        list_foreach(&siglist->signals, p, n) {
-            sig = list_entry(p, signal_t, hook);
+    if ((sm = atom_table_lookup(bus->signals, member)) == NULL)
+        return;
+
+    atom_init(&interface, dbus_message_get_interface(msg));
+    atom_init(&signature, dbus_message_get_signature(msg));
+    atom_init(&path     , dbus_message_get_path(msg));
+    atom_init(&sender   , dbus_message_get_sender(msg));
+
+    /*
+     * Notes: siglists with an interface are in front of the wildcard ones,
+     *     so handlers are called in the same order as they used to be when
+     *     we looked up first "interface.member" then ".member".
+     *
+     *     Handlers are allowed to remove themselves or any other handler
+     *     for this member. Until we're done these are only marked dead.
+     */
 
-            if (signal_matches(sig, signature, path, sender)) {
-                OHM_DEBUG(DBG_SIGNAL, "routing signal %s.%s(%s) from %s/%s to handler %s (%p)",
-                          interface, member, signature, sender, path ? path : "-",
-                          key, sig->handler);
+    sm->busy++;
 
-                if (sig->handler(c, msg, sig->data))
-                    OHM_DEBUG(DBG_SIGNAL, "signal handled by %s", key);
+    list_foreach(&sm->lists, lp, ln) {
+        siglist = list_entry(lp, siglist_t, hook);
+
+        if (!atom_matches(&siglist->interface, &interface))
+            continue;
+
+        list_foreach(&siglist->signals, sp, sn) {
+            sig = list_entry(sp, signal_t, hook);
+
+            if (sig->dead)
+                continue;
+
+            if (signal_matches(sig, &signature, &path, &sender)) {
+                OHM_DEBUG(DBG_SIGNAL, "routing signal %s.%s(%s) from %s/%s "
+                          "to handler %p", interface.name, member->name,
+                          signature.name, sender.name,
+                          path.name ? path.name : "-", sig->handler);
+
+                start = stat_begin();
+
+                if (sig->handler(bus->conn, msg, sig->data))
+                    OHM_DEBUG(DBG_SIGNAL, "signal handled by %p",
+                              sig->handler);
+
+                stat_end(&sig->stat, start);
             }
         }
     }
+
+    if (--sm->busy == 0)
+        sigmember_reap(bus, sm);
 }
 
-static DBusHandlerResult
-signal_dispatch(DBusConnection *c, DBusMessage *msg, void *data)
+
+/********************
+ * sigmember_reap
+ ********************/
+static void
+sigmember_reap(bus_t *bus, sigmember_t *sm)
 {
-    const char   *path      = dbus_message_get_path(msg);
-    const char   *interface = dbus_message_get_interface(msg);
-    const char   *member    = dbus_message_get_member(msg);
-    const char   *signature = dbus_message_get_signature(msg);
-    const char   *sender    = dbus_message_get_sender(msg);
-    bus_t        *bus       = bus_by_connection(c);
+    siglist_t   *siglist;
+    signal_t    *sig;
+    list_hook_t *lp, *ln, *sp, *sn;
 
-    char          key[1024];
+    list_foreach(&sm->lists, lp, ln) {
+        siglist = list_entry(lp, siglist_t, hook);
 
-    (void)data;
+        list_foreach(&siglist->signals, sp, sn) {
+            sig = list_entry(sp, signal_t, hook);
+            if (sig->dead) {
+                list_delete(&sig->hook);
+                signal_purge(sig);
+            }
+        }
 
-    if (bus == NULL)
-        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+        /* like siglist_del but sm must stay valid until we're done */
+        if (list_empty(&siglist->signals)) {
+            siglist_del_match(bus, siglist);
+            list_delete(&siglist->hook);
+            siglist_purge(siglist);
+        }
+    }
 
-    signal_key(key, sizeof(key), interface, member);
-    signal_dispatch_handle(bus, c, msg, key, path, interface, member, signature, sender);
+    if (list_empty(&sm->lists))
+        atom_table_remove(bus->signals, &sm->member);
+}
+
+
+/********************
+ * sigmember_stats
+ ********************/
+static void
+sigmember_stats(gpointer key, gpointer value, gpointer data)
+{
+    sigmember_t *sm    = (sigmember_t *)value;
+    int          reset = *(int *)data;
+    siglist_t   *siglist;
+    signal_t    *sig;
+    list_hook_t *lp, *ln, *sp, *sn;
+
+    (void)key;
+
+    list_foreach(&sm->lists, lp, ln) {
+        siglist = list_entry(lp, siglist_t, hook);
+
+        list_foreach(&siglist->signals, sp, sn) {
+            sig = list_entry(sp, signal_t, hook);
+
+            if (reset) {
+                memset(&sig->stat, 0, sizeof(sig->stat));
+                continue;
+            }
 
-    signal_key(key, sizeof(key), NULL, member);
-    signal_dispatch_handle(bus, c, msg, key, path, interface, member, signature, sender);
+            printf("  signal %s.%s -> %p: %lu calls",
+                   siglist->interface.name ? siglist->interface.name : "*",
+                   sm->member.name, sig->handler, sig->stat.calls);
+            if (sig->stat.calls > 0 && sig->stat.total > 0)
+                printf(", avg %llu us, max %llu us",
+                       (unsigned long long)(sig->stat.total / sig->stat.calls),
+                       (unsigned long long)sig->stat.max);
+            printf("\n");
+        }
+    }
+}
 
-    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;     /* let through to others */
+
+/********************
+ * signal_stats
+ ********************/
+void
+signal_stats(bus_t *bus, int reset)
+{
+    if (bus->signals != NULL)
+        hash_table_foreach(bus->signals, sigmember_stats, &reset);
 }
 
 
@@ -405,36 +458,80 @@ signal_dispatch(DBusConnection *c, DBusMessage *msg, void *data)
  * siglist_add
  ********************/
 static siglist_t *
-siglist_add(bus_t *bus, const char *key, const char *rule)
+siglist_add(bus_t *bus, const char *interface, const char *member,
+            const char *rule)
 {
-    siglist_t *siglist;
+    sigmember_t *sm;
+    siglist_t   *siglist, *l;
+    list_hook_t *p, *n;
+    atom_t       matom;
+
+    atom_init(&matom, member ? member : "");
+
+    if ((sm = atom_table_lookup(bus->signals, &matom)) == NULL) {
+        if (ALLOC_OBJ(sm) == NULL)
+            return NULL;
+
+        list_init(&sm->lists);
+        atom_set(&sm->member, matom.name);
+
+        if (!atom_table_insert(bus->signals, &sm->member, sm)) {
+            FREE(sm);
+            return NULL;
+        }
+    }
 
     if (ALLOC_OBJ(siglist) == NULL)
-        return NULL;
+        goto fail;
 
     list_init(&siglist->signals);
-
-    if ((siglist->key  = STRDUP(key))  == NULL ||
-        (siglist->rule = STRDUP(rule)) == NULL ||
-        !hash_table_insert(bus->signals, siglist->key, siglist)) {
-        siglist_purge(siglist);
-        return NULL;
+    list_init(&siglist->hook);
+    atom_set(&siglist->interface, interface);
+    siglist->member = sm;
+
+    if ((siglist->rule = STRDUP(rule)) == NULL)
+        goto fail;
+
+    if (interface != NULL) {
+        list_foreach(&sm->lists, p, n) {
+            l = list_entry(p, siglist_t, hook);
+            if (l->interface.name == NULL) {
+                list_insert_before(&l->hook, &siglist->hook);
+                break;
+            }
+        }
     }
 
+    if (list_empty(&siglist->hook))
+        list_append(&sm->lists, &siglist->hook);
+
     siglist_add_match(bus, siglist);
 
     return siglist;
+
+ fail:
+    if (siglist)
+        siglist_purge(siglist);
+    if (list_empty(&sm->lists))
+        atom_table_remove(bus->signals, &sm->member);
+    return NULL;
 }
 
 
 /********************
  * siglist_del
  ********************/
-static int
+static void
 siglist_del(bus_t *bus, siglist_t *siglist)
 {
+    sigmember_t *sm = siglist->member;
+
     siglist_del_match(bus, siglist);
-    return hash_table_remove(bus->signals, siglist->key);
+    list_delete(&siglist->hook);
+    siglist_purge(siglist);
+
+    if (list_empty(&sm->lists))
+        atom_table_remove(bus->signals, &sm->member);
 }
 
 
@@ -442,9 +539,23 @@ siglist_del(bus_t *bus, siglist_t *siglist)
  * siglist_lookup
  ********************/
 static siglist_t *
-siglist_lookup(bus_t *bus, const char *key)
+siglist_lookup(bus_t *bus, const atom_t *interface, const atom_t *member)
 {
-    return hash_table_lookup(bus->signals, key);
+    sigmember_t *sm;
+    siglist_t   *siglist;
+    list_hook_t *p, *n;
+
+    if ((sm = atom_table_lookup(bus->signals, member)) == NULL)
+        return NULL;
+
+    list_foreach(&sm->lists, p, n) {
+        siglist = list_entry(p, siglist_t, hook);
+
+        if (atom_equal(&siglist->interface, interface))
+            return siglist;
+    }
+
+    return NULL;
 }
 
 
@@ -452,9 +563,8 @@ siglist_lookup(bus_t *bus, const char *key)
  * siglist_purge
  ********************/
 static void
-siglist_purge(void *ptr)
+siglist_purge(siglist_t *siglist)
 {
-    siglist_t   *siglist = (siglist_t *)ptr;
     list_hook_t *p, *n;
     signal_t    *sig;
 
@@ -465,7 +575,6 @@ siglist_purge(void *ptr)
             signal_purge(sig);
         }
 
-        FREE(siglist->key);
         FREE(siglist->rule);
         FREE(siglist);
     }
@@ -473,54 +582,45 @@ siglist_purge(void *ptr)
 
 
 /********************
- * siglist_add_match
+ * sigmember_purge
  ********************/
-void
-siglist_add_match(bus_t *bus, siglist_t *siglist)
+static void
+sigmember_purge(void *ptr)
 {
-    if (bus->conn)
-        dbus_bus_add_match(bus->conn, siglist->rule, NULL);
-}
+    sigmember_t *sm = (sigmember_t *)ptr;
+    siglist_t   *siglist;
+    list_hook_t *p, *n;
 
+    if (sm) {
+        list_foreach(&sm->lists, p, n) {
+            siglist = list_entry(p, siglist_t, hook);
+            list_delete(&siglist->hook);
+            siglist_purge(siglist);
+        }
 
-/********************
- * siglist_del_match
- ********************/
-void
-siglist_del_match(bus_t *bus, siglist_t *siglist)
-{
-    if (bus->conn && siglist->rule)
-        dbus_bus_remove_match(bus->conn, siglist->rule, NULL);
+        FREE(sm);
+    }
 }
 
 
 /********************
- * add_match
+ * siglist_add_match
  ********************/
-static void
-add_match(gpointer key, gpointer value, gpointer data)
+void
+siglist_add_match(bus_t *bus, siglist_t *siglist)
 {
-    siglist_t *siglist = (siglist_t *)value;
-    bus_t     *bus     = (bus_t *)data;
-
-    (void)key;
-
-    siglist_add_match(bus, siglist);
+    match_add(bus, siglist->rule);
 }
 
 
 /********************
- * session_bus_event
+ * siglist_del_match
  ********************/
-static void
-session_bus_event(bus_t *bus, int event, void *data)
+void
+siglist_del_match(bus_t *bus, siglist_t *siglist)
 {
-    (void)data;
-    
-    if (event == BUS_EVENT_CONNECTED) {
-        signal_add_filter(bus);
-        hash_table_foreach(bus->signals, add_match, bus);
-    }
+    if (siglist->rule)
+        match_del(bus, siglist->rule);
 }
 
 
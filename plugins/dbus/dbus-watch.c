@@ -27,12 +27,16 @@ USA.
 typedef struct {
     char        *name;
     list_hook_t  watches;
+    int          busy;                         /* being dispatched */
+    int          dead;                         /* deleted while busy */
 } watchlist_t;
 
 typedef struct {
-    void       (*handler)(const char *, const char *, const char *, void *);
-    void        *data;
-    list_hook_t  hook;
+    void          (*handler)(const char *, const char *, const char *, void *);
+    void           *data;
+    handler_stat_t  stat;
+    int             dead;                      /* deleted while dispatching */
+    list_hook_t     hook;
 } watch_t;
 
 
@@ -40,12 +44,9 @@ static watchlist_t *watchlist_add(bus_t *bus, const char *name);
 static int watchlist_del(bus_t *bus, watchlist_t *watchlist);
 static watchlist_t *watchlist_lookup(bus_t *bus, const char *name);
 static void watchlist_purge(void *ptr);
-static int watchlist_add_filter(bus_t *bus);
-static void watchlist_del_filter(bus_t *bus);
 static int watchlist_add_match(bus_t *bus, watchlist_t *watchlist);
 static int watchlist_del_match(bus_t *bus, watchlist_t *watchlist);
-
-static void session_bus_event(bus_t *bus, int event, void *data);
+static void watchlist_reap(bus_t *bus, watchlist_t *watchlist);
 
 
 /********************
@@ -67,12 +68,6 @@ watch_init(void)
         return FALSE;
     }
 
-    if (!watchlist_add_filter(system)) {
-        OHM_ERROR("dbus: failed to add watch dispatcher for system bus");
-        watch_exit();
-        return FALSE;
-    }
-
 #if 1
     if ((session = bus_by_type(DBUS_BUS_SESSION)) == NULL)
         return FALSE;
@@ -84,12 +79,6 @@ watch_init(void)
         watch_exit();
         return FALSE;
     }
-
-    if (!bus_watch_add(session, session_bus_event, NULL)) {
-        OHM_ERROR("dbus: failed to install session bus watch");
-        watch_exit();
-        return FALSE;
-    }
 #endif
     
     return TRUE;
@@ -108,15 +97,12 @@ watch_exit(void)
     session = bus_by_type(DBUS_BUS_SESSION);
 
     if (system != NULL) {
-        watchlist_del_filter(system);
         if (system->watches) {
             hash_table_destroy(system->watches);
             system->watches = NULL;
         }
     }
     if (session != NULL) {
-        watchlist_del_filter(session);
-        bus_watch_del(session, session_bus_event, NULL);
         if (session->watches) {
             hash_table_destroy(session->watches);
             session->watches = NULL;
@@ -187,7 +173,14 @@ watch_del(DBusBusType type, const char *name,
     if ((watchlist = watchlist_lookup(bus, name)) != NULL) {
         list_foreach(&watchlist->watches, p, n) {
             watch = list_entry(p, watch_t, hook);
+            if (watch->dead)
+                continue;
             if (watch->handler == handler && watch->data == data) {
+
+                if (watchlist->busy) {       /* reaped after dispatching */
+                    watch->dead = TRUE;
+                    return TRUE;
+                }
                 
                 list_delete(&watch->hook);
                 watch_purge(watch);
@@ -227,7 +220,6 @@ watchlist_add(bus_t *bus, const char *name)
 
  failed:
     watchlist_purge(watchlist);
-    FREE(watchlist);
     return NULL;
 }
 
@@ -239,6 +231,12 @@ static int
 watchlist_del(bus_t *bus, watchlist_t *watchlist)
 {
     watchlist_del_match(bus, watchlist);
+
+    if (watchlist->busy) {                 /* freed once dispatching is done */
+        watchlist->dead = TRUE;
+        return hash_table_unhash(bus->watches, watchlist->name);
+    }
+
     return hash_table_remove(bus->watches, watchlist->name);
 }
 
@@ -271,6 +269,7 @@ watchlist_purge(void *ptr)
         }
 
         FREE(watchlist->name);
+        FREE(watchlist);
     }
 }
 
@@ -298,22 +297,10 @@ watch_rule(char *buf, size_t size, const char *name)
 static int
 watchlist_add_match(bus_t *bus, watchlist_t *watchlist)
 {
-    DBusError err;
-    char      rule[1024];
-
-    if (!bus->conn)
-        return TRUE;                         /* will retry once connected */
+    char rule[1024];
 
     watch_rule(rule, sizeof(rule), watchlist->name);
-    dbus_bus_add_match(bus->conn, rule, &err);
-
-    if (dbus_error_is_set(&err)) {
-        OHM_ERROR("dbus: failed to add match \"%s\" (%s)", rule, err.message);
-        dbus_error_free(&err);
-        return FALSE;
-    }
-
-    return TRUE;
+    return match_add(bus, rule);
 }
 
 
@@ -325,35 +312,27 @@ watchlist_del_match(bus_t *bus, watchlist_t *watchlist)
 {
     char rule[1024];
 
-    if (!bus->conn)
-        return TRUE;
-
     watch_rule(rule, sizeof(rule), watchlist->name);
-    dbus_bus_remove_match(bus->conn, rule, NULL);
-
-    return TRUE;
+    return match_del(bus, rule);
 }
 
 
 /********************
  * watch_dispatch
  ********************/
-static DBusHandlerResult
-watch_dispatch(DBusConnection *c, DBusMessage *msg, void *data)
+void
+watch_dispatch(bus_t *bus, DBusMessage *msg)
 {
     DBusError    err;
-    bus_t       *bus;
     const char  *name, *previous, *current;
     watchlist_t *watchlist;
     watch_t     *watch;
     list_hook_t *p, *n;
+    uint64_t     start;
 
-    (void)data;
-
-    if ((bus = bus_by_connection(c)) == NULL ||
-        !dbus_message_is_signal(msg,
+    if (!dbus_message_is_signal(msg,
                                 "org.freedesktop.DBus", "NameOwnerChanged"))
-        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+        return;
     
     dbus_error_init(&err);
     if (!dbus_message_get_args(msg, &err,
@@ -364,71 +343,95 @@ watch_dispatch(DBusConnection *c, DBusMessage *msg, void *data)
         OHM_ERROR("dbus: failed to parse NameOwnerChanged signal (%s)",
                   dbus_error_is_set(&err) ? err.message : "unknown error");
         dbus_error_free(&err);
-        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+        return;
     }
 
-    if ((watchlist = watchlist_lookup(bus, name)) != NULL) {
-        list_foreach(&watchlist->watches, p, n) {
-            watch = list_entry(p, watch_t, hook);
-            watch->handler(name, previous, current, watch->data);
-        }
-    }
-    
-    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
-}
+    if ((watchlist = watchlist_lookup(bus, name)) == NULL)
+        return;
 
+    /* handlers are allowed to remove themselves (and the watchlist) */
+    watchlist->busy++;
 
-/********************
- * watchlist_add_filter
- ********************/
-static int
-watchlist_add_filter(bus_t *bus)
-{
-    if (bus->conn == NULL)
-        return FALSE;
+    list_foreach(&watchlist->watches, p, n) {
+        watch = list_entry(p, watch_t, hook);
+        if (watch->dead)
+            continue;
+        start = stat_begin();
+        watch->handler(name, previous, current, watch->data);
+        stat_end(&watch->stat, start);
+    }
 
-    return dbus_connection_add_filter(bus->conn, watch_dispatch, NULL, NULL);
+    if (--watchlist->busy == 0) {
+        if (watchlist->dead)
+            watchlist_purge(watchlist);
+        else
+            watchlist_reap(bus, watchlist);
+    }
 }
 
 
 /********************
- * watchlist_del_filter
+ * watchlist_reap
  ********************/
 static void
-watchlist_del_filter(bus_t *bus)
+watchlist_reap(bus_t *bus, watchlist_t *watchlist)
 {
-    if (bus->conn != NULL)
-        dbus_connection_remove_filter(bus->conn, watch_dispatch, NULL);
+    watch_t     *watch;
+    list_hook_t *p, *n;
+
+    list_foreach(&watchlist->watches, p, n) {
+        watch = list_entry(p, watch_t, hook);
+        if (watch->dead) {
+            list_delete(&watch->hook);
+            watch_purge(watch);
+        }
+    }
+
+    if (list_empty(&watchlist->watches))
+        watchlist_del(bus, watchlist);
 }
 
 
 /********************
- * add_match
+ * watchlist_stats
  ********************/
 static void
-add_match(gpointer key, gpointer value, gpointer data)
+watchlist_stats(gpointer key, gpointer value, gpointer data)
 {
     watchlist_t *watchlist = (watchlist_t *)value;
-    bus_t       *bus       = (bus_t *)data;
-    
+    int          reset     = *(int *)data;
+    watch_t     *watch;
+    list_hook_t *p, *n;
+
     (void)key;
 
-    watchlist_add_match(bus, watchlist);
+    list_foreach(&watchlist->watches, p, n) {
+        watch = list_entry(p, watch_t, hook);
+
+        if (reset) {
+            memset(&watch->stat, 0, sizeof(watch->stat));
+            continue;
+        }
+
+        printf("  watch %s -> %p: %lu calls", watchlist->name,
+               watch->handler, watch->stat.calls);
+        if (watch->stat.calls > 0 && watch->stat.total > 0)
+            printf(", avg %llu us, max %llu us",
+                   (unsigned long long)(watch->stat.total / watch->stat.calls),
+                   (unsigned long long)watch->stat.max);
+        printf("\n");
+    }
 }
 
 
 /********************
- * session_bus_event
+ * watch_stats
  ********************/
-static void
-session_bus_event(bus_t *bus, int event, void *data)
+void
+watch_stats(bus_t *bus, int reset)
 {
-    (void)data;
-    
-    if (event == BUS_EVENT_CONNECTED) {
-        watchlist_add_filter(bus);
-        hash_table_foreach(bus->watches, add_match, bus);
-    }
+    if (bus->watches != NULL)
+        hash_table_foreach(bus->watches, watchlist_stats, &reset);
 }
 
 
@@ -79,6 +79,21 @@ list_append(list_hook_t *list, list_hook_t *elem)
 }
 
 
+/********************
+ * list_insert_before
+ ********************/
+static inline void
+list_insert_before(list_hook_t *next, list_hook_t *elem)
+{
+    list_hook_t *prev = next->prev;
+
+    prev->next = elem;
+    elem->prev = prev;
+    elem->next = next;
+    next->prev = elem;
+}
+
+
 /********************
  * list_delete
  ********************/
@@ -69,6 +69,12 @@ OHM_IMPORTABLE(fsif_entry_t *, get_entry, (char           *name,
 
 OHM_IMPORTABLE(int, destroy_factstore_entry, (fsif_entry_t *fact));
 
+OHM_IMPORTABLE(int, add_index, (char *factname, char *fldname));
+
+OHM_IMPORTABLE(int, begin_batch, (void));
+
+OHM_IMPORTABLE(int, commit_batch, (void));
+
 int fsif_add_factstore_entry(char *name,
                              fsif_field_t *fldlist)
 {
@@ -102,6 +108,21 @@ int fsif_destroy_factstore_entry(fsif_entry_t *fact)
     return destroy_factstore_entry(fact);
 }
 
+int fsif_add_index(char *factname, char *fldname)
+{
+    return add_index(factname, fldname);
+}
+
+int fsif_begin_batch(void)
+{
+    return begin_batch();
+}
+
+int fsif_commit_batch(void)
+{
+    return commit_batch();
+}
+
 
 static void plugin_init(OhmPlugin *plugin)
 {
@@ -134,12 +155,15 @@ OHM_PLUGIN_PROVIDES_METHODS(delay, 2,
     OHM_EXPORT(delay_cancel   , "delay_cancel")
 );
 
-OHM_PLUGIN_REQUIRES_METHODS(delay, 5,
+OHM_PLUGIN_REQUIRES_METHODS(delay, 8,
     OHM_IMPORT("fsif.add_factstore_entry", add_factstore_entry),
     OHM_IMPORT("fsif.get_field_by_entry", get_field_by_entry),
     OHM_IMPORT("fsif.set_field_by_entry", set_field_by_entry),
     OHM_IMPORT("fsif.get_entry", get_entry),
-    OHM_IMPORT("fsif.destroy_factstore_entry", destroy_factstore_entry)
+    OHM_IMPORT("fsif.destroy_factstore_entry", destroy_factstore_entry),
+    OHM_IMPORT("fsif.add_index", add_index),
+    OHM_IMPORT("fsif.begin_batch", begin_batch),
+    OHM_IMPORT("fsif.commit_batch", commit_batch)
 );
 
 OHM_PLUGIN_DESCRIPTION("delay",
@@ -53,6 +53,12 @@ fsif_entry_t * fsif_get_entry(char           *name,
 
 int fsif_destroy_factstore_entry(fsif_entry_t *fact);
 
+int fsif_add_index(char *factname, char *fldname);
+
+int fsif_begin_batch(void);
+
+int fsif_commit_batch(void);
+
 
 #endif /* __OHM_DELAY_H__ */
 
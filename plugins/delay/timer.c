@@ -31,6 +31,9 @@ static int  timer_event_cb(void *);
 static void timer_init(OhmPlugin *plugin)
 {
     (void)plugin;
+
+    if (!fsif_add_index(FACTSTORE_TIMER, TIMER_ID))
+        OHM_ERROR("delay: failed to index %s by %s", FACTSTORE_TIMER, TIMER_ID);
 }
 
 static int timer_add(char *id, unsigned int delay, char *cb_name,
@@ -71,25 +74,34 @@ static int timer_restart(fsif_entry_t *entry, unsigned int delay,
                          char *cb_name, delay_cb_t cb, char *argt, void **argv)
 {
     fsif_value_t id;
+    char         idbuf[256];
+    int          success;
 
     if (!entry || !cb_name || !cb || !argt)
-        goto fail;
+        return FALSE;
 
     fsif_get_field_by_entry(entry, fldtype_string, TIMER_ID, &id);
 
     if (id.string == NULL)
-        goto fail;
+        return FALSE;
+
+    /* the id goes away with the entry */
+    snprintf(idbuf, sizeof(idbuf), "%s", id.string);
+
+    /*
+     * the state change of the old entry is dropped by fsif when the
+     * entry is destroyed within the same batch
+     */
+    fsif_begin_batch();
 
     cancel_timer_event_by_entry(entry);
 
-    if (!fsif_destroy_factstore_entry(entry) ||
-        !timer_add(id.string, delay, cb_name, cb, argt, argv))
-        goto fail;
-        
-    return TRUE;
+    success = fsif_destroy_factstore_entry(entry) &&
+              timer_add(idbuf, delay, cb_name, cb, argt, argv);
 
- fail:
-    return FALSE;
+    fsif_commit_batch();
+        
+    return success;
 }
 
 static int timer_stop(fsif_entry_t *entry)
@@ -0,0 +1,318 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <dlfcn.h>
+
+#include <glib.h>
+
+#include <ohm/ohm-plugin-log.h>
+#include <ohm/ohm-plugin-debug.h>
+
+#include "fsif-profile.h"
+
+extern int DBG_FS;
+
+typedef struct {
+    const char *plugin;                 /* interned */
+    const char *fact;                   /* interned */
+    uint64_t    count[profile_max];
+    uint64_t    nsec[profile_max];
+} profile_stat_t;
+
+static const char *op_names[profile_max] = {
+    [profile_lookup] = "lookups",
+    [profile_read]   = "reads",
+    [profile_write]  = "writes",
+    [profile_watch]  = "watches",
+};
+
+int fsif_profiling;
+
+static GHashTable *stats;               /* "plugin fact" -> profile_stat_t */
+static GHashTable *callers;             /* address -> interned plugin name */
+
+
+static GList *sort_stats(void);
+
+
+/********************
+ * profile_init
+ ********************/
+void profile_init(int enabled)
+{
+    stats   = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    callers = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    fsif_profiling = enabled;
+}
+
+
+/********************
+ * profile_exit
+ ********************/
+void profile_exit(void)
+{
+    fsif_profiling = FALSE;
+
+    if (stats != NULL) {
+        g_hash_table_destroy(stats);
+        stats = NULL;
+    }
+
+    if (callers != NULL) {
+        g_hash_table_destroy(callers);
+        callers = NULL;
+    }
+}
+
+
+/********************
+ * profile_reset
+ ********************/
+void profile_reset(void)
+{
+    if (stats != NULL)
+        g_hash_table_remove_all(stats);
+}
+
+
+/********************
+ * profile_start
+ ********************/
+void profile_start(profile_sample_t *s)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    s->start = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+/********************
+ * caller_name
+ ********************/
+static const char *caller_name(void *address)
+{
+    const char *name;
+    const char *base;
+    char        buf[256];
+    char       *p;
+    Dl_info     info;
+
+    if ((name = g_hash_table_lookup(callers, address)) != NULL)
+        return name;
+
+    if (!dladdr(address, &info) || info.dli_fname == NULL)
+        name = g_intern_string("unknown");
+    else {
+        /* /usr/lib/ohm/libohm_resource.so -> resource */
+        base = strrchr(info.dli_fname, '/');
+        base = base ? base + 1 : info.dli_fname;
+
+        if (!strncmp(base, "libohm_", 7))
+            base += 7;
+
+        snprintf(buf, sizeof(buf), "%s", base);
+
+        if ((p = strstr(buf, ".so")) != NULL)
+            *p = '\0';
+
+        name = g_intern_string(buf);
+    }
+
+    g_hash_table_insert(callers, address, (gpointer)name);
+
+    return name;
+}
+
+
+/********************
+ * profile_stop
+ ********************/
+void profile_stop(profile_sample_t *s, profile_op_e op, const char *factname,
+                  void *caller)
+{
+    struct timespec  ts;
+    uint64_t         now;
+    const char      *plugin;
+    profile_stat_t  *st;
+    char             key[512];
+
+    if (stats == NULL || op >= profile_max)
+        return;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    now = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+
+    plugin   = caller_name(caller);
+    factname = factname ? factname : "<none>";
+
+    snprintf(key, sizeof(key), "%s %s", plugin, factname);
+
+    if ((st = g_hash_table_lookup(stats, key)) == NULL) {
+        st = g_new0(profile_stat_t, 1);
+        st->plugin = plugin;
+        st->fact   = g_intern_string(factname);
+
+        g_hash_table_insert(stats, g_strdup(key), st);
+    }
+
+    st->count[op]++;
+    st->nsec[op] += now - s->start;
+}
+
+
+/********************
+ * profile_dump
+ ********************/
+int profile_dump(const char *path)
+{
+    FILE *fp;
+
+    if (path == NULL || (fp = fopen(path, "w")) == NULL)
+        return FALSE;
+
+    profile_print_json(fp);
+    fclose(fp);
+
+    OHM_DEBUG(DBG_FS, "factstore profile dumped to %s", path);
+
+    return TRUE;
+}
+
+
+/********************
+ * sort_stats
+ ********************/
+static gint compare_stats(gconstpointer a, gconstpointer b)
+{
+    const profile_stat_t *s1 = a;
+    const profile_stat_t *s2 = b;
+    uint64_t              t1, t2;
+    int                   i;
+
+    for (i = 0, t1 = t2 = 0;  i < profile_max;  i++) {
+        t1 += s1->nsec[i];
+        t2 += s2->nsec[i];
+    }
+
+    return t1 < t2 ? 1 : (t1 > t2 ? -1 : 0);
+}
+
+static GList *sort_stats(void)
+{
+    GList *list;
+
+    if (stats == NULL)
+        return NULL;
+
+    list = g_hash_table_get_values(stats);
+
+    return g_list_sort(list, compare_stats);
+}
+
+
+/********************
+ * profile_print_table
+ ********************/
+void profile_print_table(FILE *fp)
+{
+    GList          *list, *l;
+    profile_stat_t *st;
+    uint64_t        total;
+    int             i;
+
+    fprintf(fp, "profiling is %s\n", fsif_profiling ? "on" : "off");
+    fprintf(fp, "%-12s %-48s %10s %10s %10s %10s %12s\n",
+            "plugin", "fact", op_names[profile_lookup],
+            op_names[profile_read], op_names[profile_write],
+            op_names[profile_watch], "time (us)");
+
+    list = sort_stats();
+
+    for (l = list;  l != NULL;  l = l->next) {
+        st = l->data;
+
+        for (i = 0, total = 0;  i < profile_max;  i++)
+            total += st->nsec[i];
+
+        fprintf(fp, "%-12s %-48s %10llu %10llu %10llu %10llu %12llu\n",
+                st->plugin, st->fact,
+                (unsigned long long)st->count[profile_lookup],
+                (unsigned long long)st->count[profile_read],
+                (unsigned long long)st->count[profile_write],
+                (unsigned long long)st->count[profile_watch],
+                (unsigned long long)(total / 1000));
+    }
+
+    g_list_free(list);
+}
+
+
+/********************
+ * profile_print_json
+ ********************/
+void profile_print_json(FILE *fp)
+{
+    GList          *list, *l;
+    profile_stat_t *st;
+    int             i;
+
+    list = sort_stats();
+
+    fprintf(fp, "{\n  \"enabled\": %s,\n  \"entries\": [",
+            fsif_profiling ? "true" : "false");
+
+    for (l = list;  l != NULL;  l = l->next) {
+        st = l->data;
+
+        fprintf(fp, "%s\n    { \"plugin\": \"%s\", \"fact\": \"%s\"",
+                l == list ? "" : ",", st->plugin, st->fact);
+
+        for (i = 0;  i < profile_max;  i++) {
+            fprintf(fp, ", \"%s\": %llu, \"%s_us\": %llu",
+                    op_names[i], (unsigned long long)st->count[i],
+                    op_names[i], (unsigned long long)(st->nsec[i] / 1000));
+        }
+
+        fprintf(fp, " }");
+    }
+
+    fprintf(fp, "%s]\n}\n", list ? "\n  " : "");
+
+    g_list_free(list);
+}
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
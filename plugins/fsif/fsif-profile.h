@@ -0,0 +1,79 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+#ifndef __OHM_FSIF_PROFILE_H__
+#define __OHM_FSIF_PROFILE_H__
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * Factstore access profiler. The exported entry points of fsif and the
+ * watch dispatching account each access to the calling plugin and the
+ * fact it touched. Calls are attributed to the shared object containing
+ * the return address (or the watch callback), so clients need no changes.
+ */
+
+typedef enum {
+    profile_lookup = 0,         /* looking up facts by name */
+    profile_read,               /* reading fields */
+    profile_write,              /* adding, removing or writing facts */
+    profile_watch,              /* watch callbacks */
+    profile_max
+} profile_op_e;
+
+typedef struct {
+    uint64_t  start;            /* 0 if profiling was disabled */
+} profile_sample_t;
+
+extern int fsif_profiling;
+
+void profile_init(int enabled);
+void profile_exit(void);
+void profile_reset(void);
+void profile_start(profile_sample_t *);
+void profile_stop(profile_sample_t *, profile_op_e, const char *, void *);
+void profile_print_table(FILE *);
+void profile_print_json(FILE *);
+int  profile_dump(const char *path);
+
+#define PROFILE_START(s) do {                                           \
+        if (fsif_profiling)                                             \
+            profile_start(&(s));                                        \
+        else                                                            \
+            (s).start = 0;                                              \
+    } while (0)
+
+#define PROFILE_STOP(s, op, factname, caller) do {                      \
+        if ((s).start)                                                  \
+            profile_stop(&(s), (op), (factname), (caller));             \
+    } while (0)
+
+#define PROFILE_CALLER() __builtin_return_address(0)
+
+
+#endif /* __OHM_FSIF_PROFILE_H__ */
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
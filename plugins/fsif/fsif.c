@@ -29,11 +29,13 @@ USA.
 #include <string.h>
 #include <stdarg.h>
 #include <errno.h>
+#include <sys/socket.h>
 #include <glib.h>
 
 #include <ohm/ohm-fact.h>
 
 #include "fsif.h"
+#include "fsif-profile.h"
 
 /* debug flags */
 int DBG_FS;
@@ -53,36 +55,153 @@ typedef enum {
 #error "unmatching enumerations fact_watch_insert and watch_type_e"
 #endif
 
+/*
+ * Watches are indexed by the quark of the fact name. Field watches are
+ * further indexed by the quark of the watched field, watches for any
+ * field are kept on a separate list. The selectors of field watches are
+ * compiled to field quarks and typed constants when the watch is added.
+ */
+typedef struct {
+    GQuark                 field;
+    fsif_fldtype_t         type;
+    fsif_value_t           value;
+} watch_selector_t;
+
 typedef struct watch_fact_s {
-    struct watch_fact_s   *next;
+    GQuark                 factq;
     char                  *factname;
-    struct watch_entry_s  *entries;
+    struct watch_entry_s  *entries;     /* fact watches or any field */
+    GHashTable            *fields;      /* field quark -> entry list */
 } watch_fact_t;
 
 typedef struct watch_entry_s {
     struct watch_entry_s  *next;
     int                    id;
-    fsif_field_t          *selist;
+    watch_selector_t      *selist;
     char                  *fldname;
     union {
         fsif_field_watch_cb_t  field_watch;
         fsif_fact_watch_cb_t   fact_watch;
     }                      callback;
     void                  *usrdata;
+    int                    deferred;
 } watch_entry_t;
 
+/*
+ * Deferred field watches. Their updates are queued instead of being
+ * delivered from within the updated signal. Repeated updates of the same
+ * field of the same fact collapse to a single queued item and the watch
+ * is called from an idle callback with the value the field has by then.
+ */
+typedef struct deferred_s {
+    struct deferred_s     *next;
+    watch_entry_t         *wentry;
+    OhmFact               *fact;        /* referenced */
+    GQuark                 field;
+} deferred_t;
+
+typedef struct {
+    GHashTable            *items;       /* deferred_t -> deferred_t */
+    deferred_t            *first;       /* in order of first update */
+    deferred_t           **last;
+    guint                  srcid;
+} deferred_queue_t;
+
+/*
+ * Secondary indexes on (fact name, field). Each index maps the value of
+ * the field to the facts having that value and every indexed fact to its
+ * current bucket, so that the index can be maintained from the inserted,
+ * removed and updated signals of the factstore.
+ */
+typedef enum {
+    key_string = 0,
+    key_number,
+    key_floating,
+} index_key_e;
+
+typedef struct {
+    index_key_e            kind;
+    union {
+        char              *string;
+        guint64            number;
+        double             floating;
+    }                      v;
+} index_key_t;
+
+typedef struct {
+    index_key_t            key;         /* owns key.v.string */
+    GSList                *facts;
+} index_bucket_t;
+
+typedef struct fact_index_s {
+    struct fact_index_s   *next;
+    GQuark                 field;
+    char                  *fldname;
+    GHashTable            *buckets;     /* index_key_t -> index_bucket_t */
+    GHashTable            *facts;       /* OhmFact -> index_bucket_t */
+} fact_index_t;
+
+/*
+ * Batched updates. While a batch is open field updates are only recorded,
+ * the last value of each field winning. At commit the changes are applied
+ * within a single factstore transaction and the field watches are called
+ * once per changed field of each fact after all the changes are in place.
+ */
+typedef struct batch_field_s {
+    struct batch_field_s  *next;
+    GQuark                 field;
+    GValue                *value;
+} batch_field_t;
+
+typedef struct batch_fact_s {
+    struct batch_fact_s   *next;
+    OhmFact               *fact;
+    batch_field_t         *fields;
+    int                    removed;
+} batch_fact_t;
+
+typedef struct batch_dispatch_s {
+    struct batch_dispatch_s *outer;     /* commit being dispatched */
+    batch_fact_t            *facts;
+} batch_dispatch_t;
+
+typedef struct {
+    int                    depth;
+    int                    applying;
+    GHashTable            *facts;       /* OhmFact -> batch_fact_t */
+    batch_fact_t          *first;       /* in order of first update */
+    batch_fact_t         **last;
+    batch_dispatch_t      *dispatching; /* commits being dispatched */
+} batch_t;
+
 static OhmFactStore  *fs;
 static int            watch_id = 1;
-static watch_fact_t  *wfact_inserts;
-static watch_fact_t  *wfact_removes;
-static watch_fact_t  *wfact_updates;
+static batch_t        batch;
+static deferred_queue_t deferred;
+static GHashTable    *indexes;          /* fact name quark -> fact_index_t */
+static GHashTable    *wfact_inserts;
+static GHashTable    *wfact_removes;
+static GHashTable    *wfact_updates;
 
 static OhmFact      *find_entry(char *, fsif_field_t *);
 static int           matching_entry(OhmFact *, fsif_field_t *);
+static guint         key_hash(gconstpointer);
+static gboolean      key_equal(gconstpointer, gconstpointer);
+static int           selector_key(fsif_field_t *, index_key_t *);
+static void          free_bucket(gpointer);
+static fact_index_t *find_index(const char *, fsif_field_t *, fsif_field_t **);
+static void          index_add(fact_index_t *, OhmFact *, GValue *);
+static void          index_del(fact_index_t *, OhmFact *);
+static void          index_fact(OhmFact *, GQuark, GValue *);
+static void          unindex_fact(OhmFact *);
 static int           get_field(OhmFact *, fsif_fldtype_t, char *, fsif_value_t *);
+static GValue       *field_value(fsif_fldtype_t, char *, fsif_value_t *);
 static void          set_field(OhmFact *, fsif_fldtype_t, char *, fsif_value_t *);
 static watch_fact_t *find_watch(char *, watch_type_e);
-static fsif_field_t *copy_selector(fsif_field_t *);
+static watch_fact_t *create_watch(char *, watch_type_e);
+static watch_selector_t *compile_selector(fsif_field_t *);
+static int           matching_selector(OhmFact *, watch_selector_t *);
+static int           value_to_field(GValue *, fsif_field_t *);
 #if 0
 static void          free_selector(fsif_field_t *);
 #endif
@@ -95,7 +214,19 @@ static char         *print_value(fsif_fldtype_t, void *, char *, int);
 static void          inserted_cb(void *, OhmFact *);
 static void          removed_cb(void *, OhmFact *);
 static void          updated_cb(void *, OhmFact *, GQuark, gpointer);
+static void          dispatch_update(OhmFact *, GQuark, GValue *);
+static int           fsif_begin_batch(void);
+static int           fsif_commit_batch(void);
+static void          batch_set(OhmFact *, GQuark, GValue *);
+static void          batch_forget(OhmFact *);
+static void          defer_update(watch_entry_t *, OhmFact *, GQuark);
+static void          deferred_forget(OhmFact *);
+static void          deferred_purge(void);
 static char         *time_str(unsigned long long, char *, int);
+static const char   *entry_name(fsif_entry_t *);
+static GValue       *profiled_get(fsif_entry_t *, fsif_fldhandle_t *, void *);
+static void          profile_console_open(const char *);
+static void          profile_console_close(void);
 
 static guint         updated_id;
 static guint         inserted_id;
@@ -107,7 +238,7 @@ static guint         removed_id;
  ********************/
 static void plugin_init(OhmPlugin *plugin)
 {
-    (void)plugin;
+    const char *param;
 
     if (!OHM_DEBUG_INIT(fsif))
         OHM_WARNING("fsif: failed to register for debugging");
@@ -124,6 +255,12 @@ static void plugin_init(OhmPlugin *plugin)
 
     removed_id  = g_signal_connect(G_OBJECT(fs), "removed" ,
                                    G_CALLBACK(removed_cb) , NULL);
+
+    param = ohm_plugin_get_param(plugin, "profile");
+    profile_init(param != NULL && !strcmp(param, "yes"));
+
+    if ((param = ohm_plugin_get_param(plugin, "profile-console")) != NULL)
+        profile_console_open(param);
 }
 
 
@@ -148,6 +285,10 @@ static void plugin_exit(OhmPlugin *plugin)
         g_signal_handler_disconnect(G_OBJECT(fs), removed_id);
         removed_id = 0;
     }
+
+    deferred_purge();
+    profile_console_close();
+    profile_exit();
 }
 
 
@@ -161,6 +302,7 @@ static int fsif_add_factstore_entry(char           *name,
 {
     OhmFact      *fact;
     fsif_field_t *fld;
+    GValue       *gv;
 
     if (!name || !fldlist) {
         OHM_ERROR("fsif: [%s] invalid arument", __FUNCTION__);
@@ -172,8 +314,14 @@ static int fsif_add_factstore_entry(char           *name,
         return FALSE;
     }
 
+    /*
+     * The fact is not in the factstore yet, so its fields are set directly
+     * even within a batch. Batched values would only show up at commit,
+     * after the fact has been inserted without them.
+     */
     for (fld = fldlist;   fld->type != fldtype_invalid;   fld++) {
-        set_field(fact, fld->type, fld->name, &fld->value);
+        if ((gv = field_value(fld->type, fld->name, &fld->value)) != NULL)
+            ohm_fact_set(fact, fld->name, gv);
     }
 
     if (ohm_fact_store_insert(fs, fact))
@@ -234,6 +382,8 @@ static int fsif_update_factstore_entry(char         *name,
         return FALSE;
     }
 
+    fsif_begin_batch();
+
     for (fld = fldlist;   fld->type != fldtype_invalid;   fld++) {
         set_field(fact, fld->type, fld->name, &fld->value);
 
@@ -244,6 +394,8 @@ static int fsif_update_factstore_entry(char         *name,
                   name, selstr, fld->name, valstr);
     }
 
+    fsif_commit_batch();
+
     return TRUE;
 }
 
@@ -309,6 +461,152 @@ static void fsif_set_field_by_entry(fsif_entry_t *entry,
 }
 
 
+static int fsif_begin_batch(void)
+{
+    if (batch.facts == NULL) {
+        if ((batch.facts = g_hash_table_new(NULL, NULL)) == NULL)
+            return FALSE;
+        batch.last = &batch.first;
+    }
+
+    batch.depth++;
+
+    return TRUE;
+}
+
+
+static int fsif_commit_batch(void)
+{
+    batch_dispatch_t  d;
+    batch_fact_t     *bf;
+    batch_field_t    *bfld;
+    int               nfact, nfield;
+
+    if (batch.depth <= 0) {
+        OHM_ERROR("fsif: [%s] no open batch", __FUNCTION__);
+        return FALSE;
+    }
+
+    if (--batch.depth > 0)
+        return TRUE;
+
+    /*
+     * Detach the recorded changes first, watches called below might
+     * open batches of their own.
+     */
+    d.facts     = batch.first;
+    batch.first = NULL;
+    batch.last  = &batch.first;
+    g_hash_table_remove_all(batch.facts);
+
+    if (d.facts == NULL)
+        return TRUE;
+
+    d.outer           = batch.dispatching;
+    batch.dispatching = &d;
+
+    nfact = nfield = 0;
+
+    ohm_fact_store_transaction_push(fs);
+    batch.applying = TRUE;
+
+    for (bf = d.facts;  bf != NULL;  bf = bf->next, nfact++) {
+        for (bfld = bf->fields;  bfld != NULL;  bfld = bfld->next, nfield++) {
+            ohm_fact_set(bf->fact, g_quark_to_string(bfld->field),
+                         bfld->value);
+            bfld->value = NULL;             /* owned by the fact now */
+        }
+    }
+
+    batch.applying = FALSE;
+    ohm_fact_store_transaction_pop(fs, FALSE);
+
+    OHM_DEBUG(DBG_FS, "batch of %d fields in %d facts committed",
+              nfield, nfact);
+
+    while ((bf = d.facts) != NULL) {
+        while ((bfld = bf->fields) != NULL) {
+            if (!bf->removed)
+                dispatch_update(bf->fact, bfld->field,
+                                ohm_structure_qget(OHM_STRUCTURE(bf->fact),
+                                                   bfld->field));
+            bf->fields = bfld->next;
+            free(bfld);
+        }
+
+        d.facts = bf->next;
+        g_object_unref(bf->fact);
+        free(bf);
+    }
+
+    batch.dispatching = d.outer;
+
+    return TRUE;
+}
+
+
+static int fsif_register_schema(char             *factname,
+                                fsif_fldhandle_t *handles)
+{
+    fsif_fldhandle_t *h;
+
+    if (factname == NULL || handles == NULL)
+        return FALSE;
+
+    for (h = handles;  h->type != fldtype_invalid;  h++) {
+        if (h->name == NULL) {
+            OHM_ERROR("fsif: [%s] unnamed field in schema of %s",
+                      __FUNCTION__, factname);
+            return FALSE;
+        }
+
+        h->name         = g_intern_string(h->name);
+        h->quark        = g_quark_from_string(h->name);
+        h->profiling    = &fsif_profiling;
+        h->profiled_get = profiled_get;
+    }
+
+    OHM_DEBUG(DBG_FS, "schema of %d fields registered for '%s'",
+              (int)(h - handles), factname);
+
+    return TRUE;
+}
+
+
+static void fsif_set_field_by_handle(fsif_entry_t     *entry,
+                                     fsif_fldhandle_t *h,
+                                     fsif_value_t     *vptr)
+{
+    GValue *gv;
+
+    if (entry == NULL || h == NULL || h->quark == 0 || vptr == NULL)
+        return;
+
+    if (h->type == fldtype_string && (h->flags & FSIF_FLD_STATIC)) {
+        if ((gv = g_new0(GValue, 1)) == NULL)
+            return;
+        g_value_init(gv, G_TYPE_STRING);
+        g_value_set_static_string(gv, g_intern_string(vptr->string));
+    }
+    else {
+        switch (h->type) {
+        case fldtype_string:   gv = ohm_value_from_string(vptr->string);    break;
+        case fldtype_integer:  gv = ohm_value_from_int(vptr->integer);      break;
+        case fldtype_unsignd:  gv = ohm_value_from_unsigned(vptr->unsignd); break;
+        case fldtype_floating: gv = ohm_value_from_double(vptr->floating);  break;
+        case fldtype_time:     gv = ohm_value_from_time(vptr->time);        break;
+        case fldtype_pointer:  gv = ohm_value_from_pointer(vptr->pointer);  break;
+        default:               return;
+        }
+    }
+
+    if (batch.depth > 0)
+        batch_set(entry, h->quark, gv);
+    else
+        ohm_fact_set(entry, h->name, gv);
+}
+
+
 static int fsif_get_field_by_name(const char     *name,
                                  fsif_fldtype_t  type,
                                  char           *field,
@@ -350,30 +648,22 @@ static int fsif_add_fact_watch(char                 *factname,
                                void                 *usrdata)
 {
     watch_fact_t   *wfact;
-    watch_fact_t  **wfact_head;
     watch_entry_t  *wentry;
 
     if (!factname || !callback)
         return -1;
 
     switch(type) {
-    case fact_watch_insert:    wfact_head = &wfact_inserts;    break;
-    case fact_watch_remove:    wfact_head = &wfact_removes;    break;
-    default:                   return -1;
+    case fact_watch_insert:
+    case fact_watch_remove:
+        break;
+    default:
+        return -1;
     }
 
-
-    if ((wfact = find_watch(factname, type)) == NULL) {
-        if ((wfact = malloc(sizeof(*wfact))) == NULL)
-            return -1;
-        else {
-            memset(wfact, 0, sizeof(*wfact));
-            wfact->next     = *wfact_head;
-            wfact->factname = strdup(factname);
-
-            *wfact_head = wfact;
-        }
-    }
+    if ((wfact = find_watch(factname, (watch_type_e)type)) == NULL &&
+        (wfact = create_watch(factname, (watch_type_e)type)) == NULL)
+        return -1;
 
     if ((wentry = malloc(sizeof(*wentry))) == NULL)
         return -1;
@@ -393,175 +683,528 @@ static int fsif_add_fact_watch(char                 *factname,
     return wentry->id;
 }
 
-static int fsif_add_field_watch(char                  *factname,
-                                fsif_field_t          *selist,
-                                char                  *fldname,
-                                fsif_field_watch_cb_t  callback,
-                                void                  *usrdata)
+static int new_field_watch(char                  *factname,
+                           fsif_field_t          *selist,
+                           char                  *fldname,
+                           fsif_field_watch_cb_t  callback,
+                           void                  *usrdata,
+                           int                    deferred)
 {
-    watch_fact_t  *wfact;
-    watch_entry_t *wentry;
+    watch_fact_t   *wfact;
+    watch_entry_t  *wentry;
+    watch_entry_t **whead;
+    gpointer        fldq;
 
     if (!factname || !callback)
         return -1;
 
-    if ((wfact = find_watch(factname, watch_update)) == NULL) {
-        if ((wfact = malloc(sizeof(*wfact))) == NULL)
-            return -1;
-        else {
-            memset(wfact, 0, sizeof(*wfact));
-            wfact->next     = wfact_updates;
-            wfact->factname = strdup(factname);
-
-            wfact_updates = wfact;
-        }
-    }
+    if ((wfact = find_watch(factname, watch_update)) == NULL &&
+        (wfact = create_watch(factname, watch_update)) == NULL)
+        return -1;
 
     if ((wentry = malloc(sizeof(*wentry))) == NULL)
         return -1;
     else {
         memset(wentry, 0, sizeof(*wentry));
-        wentry->next                 = wfact->entries;
         wentry->id                   = watch_id++;
-        wentry->selist               = copy_selector(selist);
+        wentry->selist               = compile_selector(selist);
         wentry->fldname              = fldname ? strdup(fldname) : NULL;
         wentry->callback.field_watch = callback;
         wentry->usrdata              = usrdata;
+        wentry->deferred             = deferred;
 
-        wfact->entries = wentry;
+        if (fldname == NULL) {
+            wentry->next   = wfact->entries;
+            wfact->entries = wentry;
+        }
+        else {
+            fldq  = GUINT_TO_POINTER(g_quark_from_string(fldname));
+            whead = g_hash_table_lookup(wfact->fields, fldq);
+
+            if (whead == NULL) {
+                if ((whead = malloc(sizeof(*whead))) == NULL) {
+                    free(wentry->fldname);
+                    free(wentry->selist);
+                    free(wentry);
+                    return -1;
+                }
+                *whead = NULL;
+                g_hash_table_insert(wfact->fields, fldq, whead);
+            }
+
+            wentry->next = *whead;
+            *whead       = wentry;
+        }
     }
 
-    OHM_DEBUG(DBG_FS, "field watch point %d added for '%s%s%s'", wentry->id,
+    OHM_DEBUG(DBG_FS, "%sfield watch point %d added for '%s%s%s'",
+              deferred ? "deferred " : "", wentry->id,
               factname, fldname?":":"", fldname?fldname:"");
 
     return wentry->id;
 }
 
-/*!
- * @}
- */
+static int fsif_add_field_watch(char                  *factname,
+                                fsif_field_t          *selist,
+                                char                  *fldname,
+                                fsif_field_watch_cb_t  callback,
+                                void                  *usrdata)
+{
+    return new_field_watch(factname, selist, fldname, callback, usrdata,
+                           FALSE);
+}
 
+static int fsif_add_deferred_field_watch(char                  *factname,
+                                         fsif_field_t          *selist,
+                                         char                  *fldname,
+                                         fsif_field_watch_cb_t  callback,
+                                         void                  *usrdata)
+{
+    return new_field_watch(factname, selist, fldname, callback, usrdata,
+                           TRUE);
+}
 
-static OhmFact *find_entry(char            *name,
-                           fsif_field_t    *selist)
+static int fsif_add_index(char *factname,
+                          char *fldname)
 {
-    OhmFact            *fact;
-    GSList             *list;
+    fact_index_t *head;
+    fact_index_t *idx;
+    GQuark        factq;
+    GQuark        fldq;
+    GSList       *list;
+    OhmFact      *fact;
 
-    for (list  = ohm_fact_store_get_facts_by_name(fs, name);
+    if (!factname || !fldname)
+        return FALSE;
+
+    if (indexes == NULL && (indexes = g_hash_table_new(NULL, NULL)) == NULL)
+        return FALSE;
+
+    factq = g_quark_from_string(factname);
+    fldq  = g_quark_from_string(fldname);
+    head  = g_hash_table_lookup(indexes, GUINT_TO_POINTER(factq));
+
+    for (idx = head;  idx != NULL;  idx = idx->next) {
+        if (idx->field == fldq)
+            return TRUE;
+    }
+
+    if ((idx = malloc(sizeof(*idx))) == NULL)
+        return FALSE;
+
+    memset(idx, 0, sizeof(*idx));
+    idx->field   = fldq;
+    idx->fldname = strdup(fldname);
+    idx->buckets = g_hash_table_new_full(key_hash, key_equal,
+                                         NULL, free_bucket);
+    idx->facts   = g_hash_table_new(NULL, NULL);
+    idx->next    = head;
+
+    g_hash_table_insert(indexes, GUINT_TO_POINTER(factq), idx);
+
+    for (list  = ohm_fact_store_get_facts_by_name(fs, factname);
          list != NULL;
          list  = g_slist_next(list))
     {
         fact = (OhmFact *)list->data;
-
-        if (matching_entry(fact, selist))
-            return fact;
+        index_add(idx, fact, ohm_structure_qget(OHM_STRUCTURE(fact), fldq));
     }
 
-    return NULL;
+    OHM_DEBUG(DBG_FS, "index added for '%s:%s'", factname, fldname);
+
+    return TRUE;
 }
 
-static int matching_entry(OhmFact      *fact,
-                          fsif_field_t *selist)
-{
-    fsif_field_t       *se;
-    fsif_value_t        value;
+/*!
+ * @}
+ */
 
-    if (selist == NULL)
-        return TRUE;
 
-    for (se = selist;   se->type != fldtype_invalid;   se++) {
-        switch (se->type) {
+static guint key_hash(gconstpointer ptr)
+{
+    const index_key_t *key = (const index_key_t *)ptr;
 
-        case fldtype_string:
-            get_field(fact, fldtype_string, se->name, &value);
-            if (value.string == NULL || strcmp(value.string, se->value.string))
-                return FALSE;
-            break;
+    switch (key->kind) {
+    case key_string:   return g_str_hash(key->v.string);
+    case key_number:   return (guint)(key->v.number ^ (key->v.number >> 32));
+    case key_floating: return g_double_hash(&key->v.floating);
+    default:           return 0;
+    }
+}
 
-        case fldtype_integer:
-            get_field(fact, fldtype_integer, se->name, &value);
-            if (value.integer != se->value.integer)
-                return FALSE;
-            break;
 
-        case fldtype_unsignd:
-            get_field(fact, fldtype_unsignd, se->name, &value);
-            if (value.unsignd != se->value.unsignd)
-                return FALSE;
-            break;
+static gboolean key_equal(gconstpointer ptr1, gconstpointer ptr2)
+{
+    const index_key_t *key1 = (const index_key_t *)ptr1;
+    const index_key_t *key2 = (const index_key_t *)ptr2;
 
-        case fldtype_floating:
-            get_field(fact, fldtype_floating, se->name, &value);
-            if (value.floating != se->value.floating)
-                return FALSE;
-            break;
+    if (key1->kind != key2->kind)
+        return FALSE;
 
-        case fldtype_time:
-            get_field(fact, fldtype_time, se->name, &value);
-            if (value.time != se->value.time)
-                return FALSE;
-            break;
+    switch (key1->kind) {
+    case key_string:   return !strcmp(key1->v.string, key2->v.string);
+    case key_number:   return key1->v.number == key2->v.number;
+    case key_floating: return key1->v.floating == key2->v.floating;
+    default:           return FALSE;
+    }
+}
 
-        case fldtype_pointer:
-            get_field(fact, fldtype_pointer, se->name, &value);
-            if (value.pointer != se->value.pointer)
-                return FALSE;
-            break;
 
-        default:
+static int value_key(GValue *gv, index_key_t *key)
+{
+    switch (G_VALUE_TYPE(gv)) {
+    case G_TYPE_STRING:
+        if ((key->v.string = (char *)g_value_get_string(gv)) == NULL)
             return FALSE;
-        } /* switch type */
-    } /* for se */
+        key->kind = key_string;
+        break;
+    case G_TYPE_LONG:
+        key->kind     = key_number;
+        key->v.number = (guint64)g_value_get_long(gv);
+        break;
+    case G_TYPE_INT:
+        key->kind     = key_number;
+        key->v.number = (guint64)(long)g_value_get_int(gv);
+        break;
+    case G_TYPE_ULONG:
+        key->kind     = key_number;
+        key->v.number = (guint64)g_value_get_ulong(gv);
+        break;
+    case G_TYPE_UINT64:
+        key->kind     = key_number;
+        key->v.number = g_value_get_uint64(gv);
+        break;
+    case G_TYPE_POINTER:
+        key->kind     = key_number;
+        key->v.number = (guint64)(gsize)g_value_get_pointer(gv);
+        break;
+    case G_TYPE_DOUBLE:
+        key->kind       = key_floating;
+        key->v.floating = g_value_get_double(gv);
+        break;
+    default:
+        return FALSE;
+    }
 
     return TRUE;
 }
 
-static int get_field(OhmFact           *fact,
-                     fsif_fldtype_t     type,
-                     char              *name,
-                     fsif_value_t      *vptr)
-{
-    GValue  *gv;
-
-    if (!fact || !name || !(gv = ohm_fact_get(fact, name))) {
-        OHM_ERROR("fsif: [%s] Cant find field %s",
-                  __FUNCTION__, name?name:"<null>");
-        goto return_empty_value;
-    }
-
-    switch (type) {
 
+static int selector_key(fsif_field_t *se, index_key_t *key)
+{
+    switch (se->type) {
     case fldtype_string:
-        if (G_VALUE_TYPE(gv) != G_TYPE_STRING)
-            goto type_mismatch;
-        else
-            vptr->string = (char*) g_value_get_string(gv);
+        if ((key->v.string = se->value.string) == NULL)
+            return FALSE;
+        key->kind = key_string;
         break;
-
     case fldtype_integer:
-        switch (G_VALUE_TYPE(gv)) {
-        case G_TYPE_LONG: vptr->integer = g_value_get_long(gv); break;
-        case G_TYPE_INT:  vptr->integer = g_value_get_int(gv);  break;
-        default:          goto type_mismatch;
-        }
+        key->kind     = key_number;
+        key->v.number = (guint64)se->value.integer;
         break;
-
     case fldtype_unsignd:
-        if (G_VALUE_TYPE(gv) != G_TYPE_ULONG)
-            goto type_mismatch;
-        else
-            vptr->unsignd = g_value_get_ulong(gv);
+        key->kind     = key_number;
+        key->v.number = (guint64)se->value.unsignd;
+        break;
+    case fldtype_time:
+        key->kind     = key_number;
+        key->v.number = se->value.time;
+        break;
+    case fldtype_pointer:
+        key->kind     = key_number;
+        key->v.number = (guint64)(gsize)se->value.pointer;
         break;
-
     case fldtype_floating:
-        if (G_VALUE_TYPE(gv) != G_TYPE_DOUBLE)
-            goto type_mismatch;
-        else
-            vptr->floating = g_value_get_double(gv);
+        key->kind       = key_floating;
+        key->v.floating = se->value.floating;
         break;
-
-    case fldtype_time:
+    default:
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+static void free_bucket(gpointer ptr)
+{
+    index_bucket_t *bucket = (index_bucket_t *)ptr;
+
+    if (bucket->key.kind == key_string)
+        free(bucket->key.v.string);
+
+    g_slist_free(bucket->facts);
+    free(bucket);
+}
+
+
+static fact_index_t *find_index(const char     *name,
+                                fsif_field_t   *selist,
+                                fsif_field_t  **sep)
+{
+    fact_index_t *head;
+    fact_index_t *idx;
+    fsif_field_t *se;
+    GQuark        factq, fldq;
+
+    if (indexes == NULL || selist == NULL || name == NULL)
+        return NULL;
+
+    if ((factq = g_quark_try_string(name)) == 0)
+        return NULL;
+
+    if ((head = g_hash_table_lookup(indexes, GUINT_TO_POINTER(factq))) == NULL)
+        return NULL;
+
+    for (se = selist;  se->type != fldtype_invalid;  se++) {
+        if ((fldq = g_quark_try_string(se->name)) == 0)
+            continue;
+
+        for (idx = head;  idx != NULL;  idx = idx->next) {
+            if (idx->field == fldq) {
+                *sep = se;
+                return idx;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+
+static void index_add(fact_index_t *idx, OhmFact *fact, GValue *gv)
+{
+    index_bucket_t *bucket;
+    index_key_t     key;
+
+    index_del(idx, fact);
+
+    if (gv == NULL || !value_key(gv, &key))
+        return;
+
+    if ((bucket = g_hash_table_lookup(idx->buckets, &key)) == NULL) {
+        if ((bucket = malloc(sizeof(*bucket))) == NULL) {
+            OHM_ERROR("fsif: failed to allocate index bucket");
+            return;
+        }
+
+        memset(bucket, 0, sizeof(*bucket));
+        bucket->key = key;
+
+        if (key.kind == key_string &&
+            (bucket->key.v.string = strdup(key.v.string)) == NULL) {
+            free(bucket);
+            return;
+        }
+
+        g_hash_table_insert(idx->buckets, &bucket->key, bucket);
+    }
+
+    bucket->facts = g_slist_prepend(bucket->facts, fact);
+    g_hash_table_insert(idx->facts, fact, bucket);
+}
+
+
+static void index_del(fact_index_t *idx, OhmFact *fact)
+{
+    index_bucket_t *bucket;
+
+    if ((bucket = g_hash_table_lookup(idx->facts, fact)) == NULL)
+        return;
+
+    g_hash_table_remove(idx->facts, fact);
+    bucket->facts = g_slist_remove(bucket->facts, fact);
+
+    if (bucket->facts == NULL)
+        g_hash_table_remove(idx->buckets, &bucket->key);
+}
+
+
+static fact_index_t *fact_indexes(OhmFact *fact)
+{
+    const char *name;
+    GQuark      factq;
+
+    if (indexes == NULL)
+        return NULL;
+
+    name = ohm_structure_get_name(OHM_STRUCTURE(fact));
+
+    if (name == NULL || (factq = g_quark_try_string(name)) == 0)
+        return NULL;
+
+    return g_hash_table_lookup(indexes, GUINT_TO_POINTER(factq));
+}
+
+
+/*
+ * Put a fact to its indexes. If fldq is given only the index on that
+ * field is updated, to the given new value.
+ */
+static void index_fact(OhmFact *fact, GQuark fldq, GValue *gv)
+{
+    fact_index_t *idx;
+
+    for (idx = fact_indexes(fact);  idx != NULL;  idx = idx->next) {
+        if (fldq == 0)
+            index_add(idx, fact, ohm_structure_qget(OHM_STRUCTURE(fact),
+                                                    idx->field));
+        else if (idx->field == fldq)
+            index_add(idx, fact, gv);
+    }
+}
+
+
+static void unindex_fact(OhmFact *fact)
+{
+    fact_index_t *idx;
+
+    for (idx = fact_indexes(fact);  idx != NULL;  idx = idx->next)
+        index_del(idx, fact);
+}
+
+
+static OhmFact *find_entry(char            *name,
+                           fsif_field_t    *selist)
+{
+    OhmFact            *fact;
+    GSList             *list;
+    fact_index_t       *idx;
+    fsif_field_t       *se;
+    index_bucket_t     *bucket;
+    index_key_t         key;
+
+    if ((idx = find_index(name, selist, &se)) != NULL) {
+        if (!selector_key(se, &key))
+            return NULL;
+
+        if ((bucket = g_hash_table_lookup(idx->buckets, &key)) == NULL)
+            return NULL;
+
+        for (list = bucket->facts;  list != NULL;  list = g_slist_next(list)) {
+            fact = (OhmFact *)list->data;
+
+            if (matching_entry(fact, selist))
+                return fact;
+        }
+
+        return NULL;
+    }
+
+    for (list  = ohm_fact_store_get_facts_by_name(fs, name);
+         list != NULL;
+         list  = g_slist_next(list))
+    {
+        fact = (OhmFact *)list->data;
+
+        if (matching_entry(fact, selist))
+            return fact;
+    }
+
+    return NULL;
+}
+
+static int matching_entry(OhmFact      *fact,
+                          fsif_field_t *selist)
+{
+    fsif_field_t       *se;
+    fsif_value_t        value;
+
+    if (selist == NULL)
+        return TRUE;
+
+    for (se = selist;   se->type != fldtype_invalid;   se++) {
+        switch (se->type) {
+
+        case fldtype_string:
+            get_field(fact, fldtype_string, se->name, &value);
+            if (value.string == NULL || strcmp(value.string, se->value.string))
+                return FALSE;
+            break;
+
+        case fldtype_integer:
+            get_field(fact, fldtype_integer, se->name, &value);
+            if (value.integer != se->value.integer)
+                return FALSE;
+            break;
+
+        case fldtype_unsignd:
+            get_field(fact, fldtype_unsignd, se->name, &value);
+            if (value.unsignd != se->value.unsignd)
+                return FALSE;
+            break;
+
+        case fldtype_floating:
+            get_field(fact, fldtype_floating, se->name, &value);
+            if (value.floating != se->value.floating)
+                return FALSE;
+            break;
+
+        case fldtype_time:
+            get_field(fact, fldtype_time, se->name, &value);
+            if (value.time != se->value.time)
+                return FALSE;
+            break;
+
+        case fldtype_pointer:
+            get_field(fact, fldtype_pointer, se->name, &value);
+            if (value.pointer != se->value.pointer)
+                return FALSE;
+            break;
+
+        default:
+            return FALSE;
+        } /* switch type */
+    } /* for se */
+
+    return TRUE;
+}
+
+static int get_field(OhmFact           *fact,
+                     fsif_fldtype_t     type,
+                     char              *name,
+                     fsif_value_t      *vptr)
+{
+    GValue  *gv;
+
+    if (!fact || !name || !(gv = ohm_fact_get(fact, name))) {
+        OHM_ERROR("fsif: [%s] Cant find field %s",
+                  __FUNCTION__, name?name:"<null>");
+        goto return_empty_value;
+    }
+
+    switch (type) {
+
+    case fldtype_string:
+        if (G_VALUE_TYPE(gv) != G_TYPE_STRING)
+            goto type_mismatch;
+        else
+            vptr->string = (char*) g_value_get_string(gv);
+        break;
+
+    case fldtype_integer:
+        switch (G_VALUE_TYPE(gv)) {
+        case G_TYPE_LONG: vptr->integer = g_value_get_long(gv); break;
+        case G_TYPE_INT:  vptr->integer = g_value_get_int(gv);  break;
+        default:          goto type_mismatch;
+        }
+        break;
+
+    case fldtype_unsignd:
+        if (G_VALUE_TYPE(gv) != G_TYPE_ULONG)
+            goto type_mismatch;
+        else
+            vptr->unsignd = g_value_get_ulong(gv);
+        break;
+
+    case fldtype_floating:
+        if (G_VALUE_TYPE(gv) != G_TYPE_DOUBLE)
+            goto type_mismatch;
+        else
+            vptr->floating = g_value_get_double(gv);
+        break;
+
+    case fldtype_time:
         if (G_VALUE_TYPE(gv) != G_TYPE_UINT64)
             goto type_mismatch;
         else
@@ -600,10 +1243,9 @@ static int get_field(OhmFact           *fact,
 }
 
 
-static void set_field(OhmFact          *fact,
-                      fsif_fldtype_t    type,
-                      char             *name,
-                      fsif_value_t     *vptr)
+static GValue *field_value(fsif_fldtype_t    type,
+                           char             *name,
+                           fsif_value_t     *vptr)
 {
     GValue       *gv;
 
@@ -614,47 +1256,192 @@ static void set_field(OhmFact          *fact,
     case fldtype_floating:  gv = ohm_value_from_double(vptr->floating);    break;
     case fldtype_time:      gv = ohm_value_from_time(vptr->time);          break;
     case fldtype_pointer:   gv = ohm_value_from_pointer(vptr->pointer);    break;
-    default:          OHM_ERROR("fsif: invalid type for %s", name); return;
+    default:          OHM_ERROR("fsif: invalid type for %s", name); return NULL;
     }
 
-    ohm_fact_set(fact, name, gv);
+    return gv;
 }
 
-static watch_fact_t *find_watch(char           *name,
-                                watch_type_e    type)
+
+static void set_field(OhmFact          *fact,
+                      fsif_fldtype_t    type,
+                      char             *name,
+                      fsif_value_t     *vptr)
+{
+    GValue       *gv;
+
+    if ((gv = field_value(type, name, vptr)) == NULL)
+        return;
+
+    if (batch.depth > 0)
+        batch_set(fact, g_quark_from_string(name), gv);
+    else
+        ohm_fact_set(fact, name, gv);
+}
+
+
+static void free_value(GValue *gv)
+{
+    if (gv != NULL) {
+        g_value_unset(gv);
+        g_free(gv);
+    }
+}
+
+
+static void batch_set(OhmFact *fact, GQuark field, GValue *gv)
 {
-    watch_fact_t *wfact;
+    batch_fact_t   *bf;
+    batch_field_t  *bfld;
+    batch_field_t **tail;
+    const char     *name;
 
-    if (name != NULL) {
+    if ((bf = g_hash_table_lookup(batch.facts, fact)) == NULL) {
+        if ((bf = malloc(sizeof(*bf))) == NULL)
+            goto fail;
 
-        switch (type) {
-        case watch_insert:   wfact = wfact_inserts;   break;
-        case watch_remove:   wfact = wfact_removes;   break;
-        case watch_update:   wfact = wfact_updates;   break;
-        default:             return NULL;
+        memset(bf, 0, sizeof(*bf));
+        bf->fact = g_object_ref(fact);
+
+        *batch.last = bf;
+        batch.last  = &bf->next;
+
+        g_hash_table_insert(batch.facts, fact, bf);
+    }
+
+    for (tail = &bf->fields;  *tail != NULL;  tail = &(*tail)->next) {
+        if ((*tail)->field == field) {
+            free_value((*tail)->value);
+            (*tail)->value = gv;
+            return;
         }
+    }
+
+    if ((bfld = malloc(sizeof(*bfld))) == NULL)
+        goto fail;
 
-        while (wfact != NULL) {
+    bfld->next  = NULL;
+    bfld->field = field;
+    bfld->value = gv;
+
+    *tail = bfld;
+
+    return;
+
+ fail:
+    name = g_quark_to_string(field);
+    OHM_ERROR("fsif: failed to batch update of field %s, setting it", name);
+    ohm_fact_set(fact, name, gv);
+}
 
-            if (!strcmp(name, wfact->factname))
-                return wfact;
 
-            wfact = wfact->next;
+/*
+ * Forget the pending changes of a fact that is removed from the
+ * factstore while a batch is open or being dispatched.
+ */
+static void batch_forget(OhmFact *fact)
+{
+    batch_dispatch_t  *d;
+    batch_fact_t      *bf, **prev;
+    batch_field_t     *bfld;
+
+    for (d = batch.dispatching;  d != NULL;  d = d->outer) {
+        for (bf = d->facts;  bf != NULL;  bf = bf->next) {
+            if (bf->fact == fact)
+                bf->removed = TRUE;
         }
     }
 
-    return NULL;
+    if (batch.facts == NULL ||
+        (bf = g_hash_table_lookup(batch.facts, fact)) == NULL)
+        return;
+
+    g_hash_table_remove(batch.facts, fact);
+
+    for (prev = &batch.first;  *prev != NULL;  prev = &(*prev)->next) {
+        if (*prev == bf) {
+            *prev = bf->next;
+            break;
+        }
+    }
+
+    if (batch.last == &bf->next)
+        batch.last = prev;
+
+    while ((bfld = bf->fields) != NULL) {
+        bf->fields = bfld->next;
+        free_value(bfld->value);
+        free(bfld);
+    }
+
+    g_object_unref(bf->fact);
+    free(bf);
+}
+
+static GHashTable **watch_table(watch_type_e type)
+{
+    switch (type) {
+    case watch_insert:   return &wfact_inserts;
+    case watch_remove:   return &wfact_removes;
+    case watch_update:   return &wfact_updates;
+    default:             return NULL;
+    }
 }
 
 
-static fsif_field_t *copy_selector(fsif_field_t *selist)
+static watch_fact_t *find_watch(char           *name,
+                                watch_type_e    type)
 {
-    fsif_field_t  *cplist;
-    fsif_field_t  *last;
-    fsif_field_t  *se;
-    fsif_field_t  *cp;
-    int            dim;
-    int            len;
+    GHashTable **table;
+    GQuark       factq;
+
+    if (name == NULL || (table = watch_table(type)) == NULL || *table == NULL)
+        return NULL;
+
+    /* a fact name that has never been seen can't have any watches */
+    if ((factq = g_quark_try_string(name)) == 0)
+        return NULL;
+
+    return g_hash_table_lookup(*table, GUINT_TO_POINTER(factq));
+}
+
+
+static watch_fact_t *create_watch(char           *name,
+                                  watch_type_e    type)
+{
+    GHashTable   **table;
+    watch_fact_t  *wfact;
+
+    if ((table = watch_table(type)) == NULL)
+        return NULL;
+
+    if (*table == NULL && (*table = g_hash_table_new(NULL, NULL)) == NULL)
+        return NULL;
+
+    if ((wfact = malloc(sizeof(*wfact))) == NULL)
+        return NULL;
+
+    memset(wfact, 0, sizeof(*wfact));
+    wfact->factq    = g_quark_from_string(name);
+    wfact->factname = strdup(name);
+
+    if (type == watch_update)
+        wfact->fields = g_hash_table_new(NULL, NULL);
+
+    g_hash_table_insert(*table, GUINT_TO_POINTER(wfact->factq), wfact);
+
+    return wfact;
+}
+
+
+static watch_selector_t *compile_selector(fsif_field_t *selist)
+{
+    watch_selector_t *cplist;
+    fsif_field_t     *last;
+    fsif_field_t     *se;
+    watch_selector_t *cp;
+    int               dim;
+    int               len;
 
     if (selist == NULL)
         cplist = NULL;
@@ -663,14 +1450,14 @@ static fsif_field_t *copy_selector(fsif_field_t *selist)
             ;
 
         dim = (last - selist) + 1;
-        len = dim * sizeof(fsif_field_t);
+        len = dim * sizeof(watch_selector_t);
 
         if ((cplist = malloc(len)) != NULL) {
             memset(cplist, 0, len);
 
             for (se = selist, cp = cplist;    se < last;    se++, cp++) {
-                cp->type = se->type;
-                cp->name = strdup(se->name);
+                cp->field = g_quark_from_string(se->name);
+                cp->type  = se->type;
 
                 switch (se->type) {
 
@@ -690,26 +1477,94 @@ static fsif_field_t *copy_selector(fsif_field_t *selist)
                     cp->value.floating = se->value.floating;
                     break;
 
-                case fldtype_time:
-                    cp->value.time = se->value.time;
-                    break;
+                case fldtype_time:
+                    cp->value.time = se->value.time;
+                    break;
+
+                case fldtype_pointer:
+                    cp->value.pointer = se->value.pointer;
+                    break;
+
+                default:
+                    OHM_ERROR("fsif: [%s] unsupported type", __FUNCTION__);
+                    memset(&cp->value, 0, sizeof(cp->value));
+                    break;
+                } /* switch */
+            } /* for */
+        }
+    }
+
+    return cplist;
+}
+
+
+static int matching_selector(OhmFact          *fact,
+                             watch_selector_t *selist)
+{
+    watch_selector_t *se;
+    GValue           *gv;
+    const char       *str;
+    long              integer;
+
+    if (selist == NULL)
+        return TRUE;
+
+    for (se = selist;   se->type != fldtype_invalid;   se++) {
+        if ((gv = ohm_structure_qget(OHM_STRUCTURE(fact), se->field)) == NULL)
+            return FALSE;
+
+        switch (se->type) {
+
+        case fldtype_string:
+            if (G_VALUE_TYPE(gv) != G_TYPE_STRING                  ||
+                (str = g_value_get_string(gv)) == NULL             ||
+                strcmp(str, se->value.string)                        )
+                return FALSE;
+            break;
+
+        case fldtype_integer:
+            switch (G_VALUE_TYPE(gv)) {
+            case G_TYPE_LONG: integer = g_value_get_long(gv); break;
+            case G_TYPE_INT:  integer = g_value_get_int(gv);  break;
+            default:          return FALSE;
+            }
+            if (integer != se->value.integer)
+                return FALSE;
+            break;
+
+        case fldtype_unsignd:
+            if (G_VALUE_TYPE(gv) != G_TYPE_ULONG                   ||
+                g_value_get_ulong(gv) != se->value.unsignd           )
+                return FALSE;
+            break;
+
+        case fldtype_floating:
+            if (G_VALUE_TYPE(gv) != G_TYPE_DOUBLE                  ||
+                g_value_get_double(gv) != se->value.floating         )
+                return FALSE;
+            break;
+
+        case fldtype_time:
+            if (G_VALUE_TYPE(gv) != G_TYPE_UINT64                  ||
+                g_value_get_uint64(gv) != se->value.time             )
+                return FALSE;
+            break;
 
-                case fldtype_pointer:
-                    cp->value.pointer = se->value.pointer;
-                    break;
+        case fldtype_pointer:
+            if (G_VALUE_TYPE(gv) != G_TYPE_POINTER                 ||
+                g_value_get_pointer(gv) != se->value.pointer         )
+                return FALSE;
+            break;
 
-                default:
-                    OHM_ERROR("fsif: [%s] unsupported type", __FUNCTION__);
-                    memset(&cp->value, 0, sizeof(cp->value));
-                    break;
-                } /* switch */
-            } /* for */
-        }
-    }
+        default:
+            return FALSE;
+        } /* switch type */
+    } /* for se */
 
-    return cplist;
+    return TRUE;
 }
 
+
 #if 0
 static void free_selector(fsif_field_t *selist)
 {
@@ -849,6 +1704,8 @@ static void inserted_cb(void    *data,
         return;
     }
 
+    index_fact(fact, 0, NULL);
+
     name = (char *)ohm_structure_get_name(OHM_STRUCTURE(fact));
 
     if ((wfact = find_watch(name, watch_insert)) != NULL) {
@@ -856,9 +1713,13 @@ static void inserted_cb(void    *data,
         OHM_DEBUG(DBG_FS, "fact watch point: fact '%s' inserted", name);
 
         for (wentry = wfact->entries;  wentry != NULL;  wentry = wentry->next){
+            profile_sample_t ps;
 
+            PROFILE_START(ps);
             wentry->callback.fact_watch(fact, name, fact_watch_insert,
                                         wentry->usrdata); 
+            PROFILE_STOP(ps, profile_watch, name,
+                         (void *)wentry->callback.fact_watch);
         } /* for */
     } /* if find_watch */
 }
@@ -878,6 +1739,10 @@ static void removed_cb(void    *data,
         return;
     }
 
+    unindex_fact(fact);
+    batch_forget(fact);
+    deferred_forget(fact);
+
     name = (char *)ohm_structure_get_name(OHM_STRUCTURE(fact));
 
     if ((wfact = find_watch(name, watch_remove)) != NULL) {
@@ -885,14 +1750,68 @@ static void removed_cb(void    *data,
         OHM_DEBUG(DBG_FS, "fact watch point: fact '%s' removed", name);
 
         for (wentry = wfact->entries;  wentry != NULL;  wentry = wentry->next){
+            profile_sample_t ps;
 
+            PROFILE_START(ps);
             wentry->callback.fact_watch(fact, name, fact_watch_remove,
                                         wentry->usrdata); 
+            PROFILE_STOP(ps, profile_watch, name,
+                         (void *)wentry->callback.fact_watch);
         } /* for */
     } /* if find_watch */
 }
 
 
+static int value_to_field(GValue       *gval,
+                          fsif_field_t *fld)
+{
+    switch (G_VALUE_TYPE(gval)) {
+
+    case G_TYPE_STRING:
+        fld->type = fldtype_string;
+        fld->value.string = (char *)g_value_get_string(gval);
+        break;
+
+    case G_TYPE_LONG:
+        fld->type = fldtype_integer;
+        fld->value.integer = g_value_get_long(gval);
+        break;
+
+    case G_TYPE_INT:
+        fld->type = fldtype_integer;
+        fld->value.integer = g_value_get_int(gval);
+        break;
+
+    case G_TYPE_ULONG:
+        fld->type = fldtype_unsignd;
+        fld->value.unsignd = g_value_get_ulong(gval);
+        break;
+
+    case G_TYPE_DOUBLE:
+        fld->type = fldtype_floating;
+        fld->value.floating = g_value_get_double(gval);
+        break;
+
+    case G_TYPE_UINT64:
+        fld->type = fldtype_time;
+        fld->value.time = g_value_get_uint64(gval);
+        break;
+
+    case G_TYPE_POINTER:
+        fld->type = fldtype_pointer;
+        fld->value.pointer = g_value_get_pointer(gval);
+        break;
+
+    default:
+        OHM_ERROR("fsif: [%s] Unsupported data type (%d) for field '%s'",
+                  __FUNCTION__, (int)G_VALUE_TYPE(gval), fld->name);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+
 static void updated_cb(void    *data,
                        OhmFact *fact,
                        GQuark   fldquark,
@@ -900,85 +1819,250 @@ static void updated_cb(void    *data,
 {
     (void)data;
 
-    GValue        *gval = (GValue *)value;
-    char          *name;
-    watch_fact_t  *wfact;
-    watch_entry_t *wentry;
-    fsif_field_t   fld;
-    char           valb[256];
-    char          *valstr;
-
     if (fact == NULL) {
         OHM_ERROR("fsif: %s() called with null fact pointer",__FUNCTION__);
         return;
     }
 
-    name = (char *)ohm_structure_get_name(OHM_STRUCTURE(fact));
-
-    if (value != NULL && (wfact = find_watch(name, watch_update)) != NULL) {
+    index_fact(fact, fldquark, (GValue *)value);
 
-        for (wentry = wfact->entries;  wentry != NULL;  wentry = wentry->next){
-
-            fld.name = (char *)g_quark_to_string(fldquark);
+    /* watches of batched updates are called once the batch is applied */
+    if (!batch.applying)
+        dispatch_update(fact, fldquark, (GValue *)value);
+}
 
-            if (matching_entry(fact, wentry->selist) &&
-                (!wentry->fldname || !strcmp(fld.name, wentry->fldname))) {
 
-                switch (G_VALUE_TYPE(gval)) {
+static void dispatch_update(OhmFact *fact,
+                            GQuark   fldquark,
+                            GValue  *gval)
+{
+    char           *name;
+    watch_fact_t   *wfact;
+    watch_entry_t **whead;
+    watch_entry_t  *lists[2];
+    watch_entry_t  *wentry;
+    fsif_field_t    fld;
+    int             converted;
+    int             i;
+    profile_sample_t ps;
+    char            valb[256];
+    char           *valstr;
+
+    if (gval == NULL || wfact_updates == NULL)
+        return;
 
-                case G_TYPE_STRING:
-                    fld.type = fldtype_string;
-                    fld.value.string = (char *)g_value_get_string(gval);
-                    break;
+    name = (char *)ohm_structure_get_name(OHM_STRUCTURE(fact));
 
-                case G_TYPE_LONG:
-                    fld.type = fldtype_integer;
-                    fld.value.integer = g_value_get_long(gval);
-                    break;
+    if ((wfact = find_watch(name, watch_update)) == NULL)
+        return;
 
-                case G_TYPE_INT:
-                    fld.type = fldtype_integer;
-                    fld.value.integer = g_value_get_int(gval);
-                    break;
+    whead    = g_hash_table_lookup(wfact->fields, GUINT_TO_POINTER(fldquark));
+    lists[0] = whead ? *whead : NULL;
+    lists[1] = wfact->entries;
 
-                case G_TYPE_ULONG:
-                    fld.type = fldtype_unsignd;
-                    fld.value.unsignd = g_value_get_ulong(gval);
-                    break;
+    converted = FALSE;
+    fld.name  = (char *)g_quark_to_string(fldquark);
 
-                case G_TYPE_DOUBLE:
-                    fld.type = fldtype_floating;
-                    fld.value.floating = g_value_get_double(gval);
-                    break;
+    for (i = 0;  i < 2;  i++) {
+        for (wentry = lists[i];  wentry != NULL;  wentry = wentry->next) {
 
-                case G_TYPE_UINT64:
-                    fld.type = fldtype_time;
-                    fld.value.time = g_value_get_uint64(gval);
-                    break;
+            if (!matching_selector(fact, wentry->selist))
+                continue;
 
-                case G_TYPE_POINTER:
-                    fld.type = fldtype_pointer;
-                    fld.value.pointer = g_value_get_pointer(gval);
-                    break;
+            if (wentry->deferred) {
+                defer_update(wentry, fact, fldquark);
+                continue;
+            }
 
-                default:
-                    OHM_ERROR("fsif: [%s] Unsupported data type (%d) "
-                              "for field '%s'",
-                              __FUNCTION__, G_VALUE_TYPE(gval), fld.name);
+            if (!converted) {
+                if (!value_to_field(gval, &fld))
                     return;
-                }
 
                 valstr = print_value(fld.type, (void *)&fld.value,
                                      valb, sizeof(valb)); 
                 OHM_DEBUG(DBG_FS, "field watch point: field '%s:%s' "
                           "changed to '%s'", name, fld.name, valstr);
 
-                wentry->callback.field_watch(fact, name, &fld,wentry->usrdata);
+                converted = TRUE;
+            }
+
+            PROFILE_START(ps);
+            wentry->callback.field_watch(fact, name, &fld, wentry->usrdata);
+            PROFILE_STOP(ps, profile_watch, name,
+                         (void *)wentry->callback.field_watch);
+        } /* for wentry */
+    } /* for i */
+}
 
-                return;
-            } /* if matching_entry */
-        } /* for */
-    } /* if find_watch */
+
+static const char *entry_name(fsif_entry_t *entry)
+{
+    if (entry == NULL)
+        return NULL;
+
+    return ohm_structure_get_name(OHM_STRUCTURE(entry));
+}
+
+
+static GValue *profiled_get(fsif_entry_t     *entry,
+                            fsif_fldhandle_t *h,
+                            void             *caller)
+{
+    profile_sample_t  ps;
+    GValue           *gv;
+
+    PROFILE_START(ps);
+    gv = ohm_structure_qget(OHM_STRUCTURE(entry), h->quark);
+    PROFILE_STOP(ps, profile_read, entry_name(entry), caller);
+
+    return gv;
+}
+
+
+static guint deferred_hash(gconstpointer ptr)
+{
+    const deferred_t *d = ptr;
+
+    return GPOINTER_TO_UINT(d->wentry) ^ GPOINTER_TO_UINT(d->fact) ^
+        (guint)d->field;
+}
+
+static gboolean deferred_equal(gconstpointer ptr1, gconstpointer ptr2)
+{
+    const deferred_t *d1 = ptr1;
+    const deferred_t *d2 = ptr2;
+
+    return d1->wentry == d2->wentry && d1->fact == d2->fact &&
+        d1->field == d2->field;
+}
+
+static gboolean deferred_dispatch(gpointer data)
+{
+    deferred_t    *list;
+    deferred_t    *d;
+    watch_entry_t *wentry;
+    char          *name;
+    GValue        *gval;
+    fsif_field_t   fld;
+    profile_sample_t ps;
+
+    (void)data;
+
+    /* detach the queue, the watches may queue further updates */
+    list             = deferred.first;
+    deferred.first   = NULL;
+    deferred.last    = &deferred.first;
+    deferred.srcid   = 0;
+
+    g_hash_table_remove_all(deferred.items);
+
+    while ((d = list) != NULL) {
+        list   = d->next;
+        wentry = d->wentry;
+        name   = (char *)ohm_structure_get_name(OHM_STRUCTURE(d->fact));
+        gval   = ohm_structure_qget(OHM_STRUCTURE(d->fact), d->field);
+
+        fld.name = (char *)g_quark_to_string(d->field);
+
+        if (gval != NULL && value_to_field(gval, &fld)) {
+            OHM_DEBUG(DBG_FS, "deferred field watch point %d: field '%s:%s'",
+                      wentry->id, name, fld.name);
+
+            PROFILE_START(ps);
+            wentry->callback.field_watch(d->fact, name, &fld, wentry->usrdata);
+            PROFILE_STOP(ps, profile_watch, name,
+                         (void *)wentry->callback.field_watch);
+        }
+
+        g_object_unref(d->fact);
+        free(d);
+    }
+
+    return FALSE;
+}
+
+static void defer_update(watch_entry_t *wentry, OhmFact *fact, GQuark field)
+{
+    deferred_t  key;
+    deferred_t *d;
+
+    if (deferred.items == NULL) {
+        deferred.items = g_hash_table_new(deferred_hash, deferred_equal);
+        deferred.last  = &deferred.first;
+
+        if (deferred.items == NULL)
+            return;
+    }
+
+    key.wentry = wentry;
+    key.fact   = fact;
+    key.field  = field;
+
+    if (g_hash_table_lookup(deferred.items, &key) != NULL)
+        return;                 /* already queued, it gets the final value */
+
+    if ((d = malloc(sizeof(*d))) == NULL) {
+        OHM_ERROR("fsif: failed to queue deferred field update");
+        return;
+    }
+
+    d->next   = NULL;
+    d->wentry = wentry;
+    d->fact   = g_object_ref(fact);
+    d->field  = field;
+
+    *deferred.last = d;
+    deferred.last  = &d->next;
+
+    g_hash_table_insert(deferred.items, d, d);
+
+    if (!deferred.srcid)
+        deferred.srcid = g_idle_add(deferred_dispatch, NULL);
+}
+
+static void deferred_forget(OhmFact *fact)
+{
+    deferred_t **dp;
+    deferred_t  *d;
+
+    if (deferred.first == NULL)
+        return;
+
+    for (dp = &deferred.first;  (d = *dp) != NULL;  ) {
+        if (d->fact != fact)
+            dp = &d->next;
+        else {
+            *dp = d->next;
+            g_hash_table_remove(deferred.items, d);
+            g_object_unref(d->fact);
+            free(d);
+        }
+    }
+
+    deferred.last = dp;
+}
+
+static void deferred_purge(void)
+{
+    deferred_t *d;
+
+    if (deferred.srcid) {
+        g_source_remove(deferred.srcid);
+        deferred.srcid = 0;
+    }
+
+    while ((d = deferred.first) != NULL) {
+        deferred.first = d->next;
+        g_object_unref(d->fact);
+        free(d);
+    }
+
+    deferred.last = &deferred.first;
+
+    if (deferred.items != NULL) {
+        g_hash_table_destroy(deferred.items);
+        deferred.items = NULL;
+    }
 }
 
 
@@ -1012,7 +2096,14 @@ static char *time_str(unsigned long long    t,
  ****************************/
 OHM_EXPORTABLE(int, add_factstore_entry, (char *name, fsif_field_t *fldlist))
 {
-    return fsif_add_factstore_entry(name, fldlist);
+    profile_sample_t  ps;
+    int               result;
+
+    PROFILE_START(ps);
+    result = fsif_add_factstore_entry(name, fldlist);
+    PROFILE_STOP(ps, profile_write, name, PROFILE_CALLER());
+
+    return result;
 }
 
 
@@ -1021,7 +2112,14 @@ OHM_EXPORTABLE(int, add_factstore_entry, (char *name, fsif_field_t *fldlist))
  ****************************/
 OHM_EXPORTABLE(int, delete_factstore_entry, (char *name, fsif_field_t *selist))
 {
-    return fsif_delete_factstore_entry(name, selist);
+    profile_sample_t  ps;
+    int               result;
+
+    PROFILE_START(ps);
+    result = fsif_delete_factstore_entry(name, selist);
+    PROFILE_STOP(ps, profile_write, name, PROFILE_CALLER());
+
+    return result;
 }
 
 
@@ -1032,7 +2130,14 @@ OHM_EXPORTABLE(int, update_factstore_entry, (char *name,
                                              fsif_field_t *selist,
                                              fsif_field_t *fldlist))
 {
-    return fsif_update_factstore_entry(name, selist, fldlist);
+    profile_sample_t  ps;
+    int               result;
+
+    PROFILE_START(ps);
+    result = fsif_update_factstore_entry(name, selist, fldlist);
+    PROFILE_STOP(ps, profile_write, name, PROFILE_CALLER());
+
+    return result;
 }
 
 
@@ -1041,7 +2146,16 @@ OHM_EXPORTABLE(int, update_factstore_entry, (char *name,
  ****************************/
 OHM_EXPORTABLE(int, destroy_factstore_entry, (fsif_entry_t *fact))
 {
-    return fsif_destroy_factstore_entry(fact);
+    profile_sample_t  ps;
+    const char       *name;
+    int               result;
+
+    PROFILE_START(ps);
+    name   = ps.start ? g_intern_string(entry_name(fact)) : NULL;
+    result = fsif_destroy_factstore_entry(fact);
+    PROFILE_STOP(ps, profile_write, name, PROFILE_CALLER());
+
+    return result;
 }
 
 
@@ -1051,7 +2165,14 @@ OHM_EXPORTABLE(int, destroy_factstore_entry, (fsif_entry_t *fact))
 OHM_EXPORTABLE(fsif_entry_t *, get_entry, (char           *name,
                                            fsif_field_t   *selist))
 {
-    return fsif_get_entry(name, selist);
+    profile_sample_t  ps;
+    fsif_entry_t     *result;
+
+    PROFILE_START(ps);
+    result = fsif_get_entry(name, selist);
+    PROFILE_STOP(ps, profile_lookup, name, PROFILE_CALLER());
+
+    return result;
 }
 
 /****************************
@@ -1062,7 +2183,14 @@ OHM_EXPORTABLE(int, get_field_by_entry, (fsif_entry_t *entry,
                                          char *name,
                                          fsif_value_t *vptr))
 {
-    return fsif_get_field_by_entry(entry, type, name, vptr);
+    profile_sample_t  ps;
+    int               result;
+
+    PROFILE_START(ps);
+    result = fsif_get_field_by_entry(entry, type, name, vptr);
+    PROFILE_STOP(ps, profile_read, entry_name(entry), PROFILE_CALLER());
+
+    return result;
 }
 
 
@@ -1074,7 +2202,14 @@ OHM_EXPORTABLE(int, get_field_by_name, (const char *name,
                                         char *field,
                                         fsif_value_t *vptr))
 {
-    return fsif_get_field_by_name(name, type, field, vptr);
+    profile_sample_t  ps;
+    int               result;
+
+    PROFILE_START(ps);
+    result = fsif_get_field_by_name(name, type, field, vptr);
+    PROFILE_STOP(ps, profile_read, name, PROFILE_CALLER());
+
+    return result;
 }
 
 
@@ -1083,7 +2218,14 @@ OHM_EXPORTABLE(int, get_field_by_name, (const char *name,
  ****************************/
 OHM_EXPORTABLE(GSList*, get_entries_by_name, (const char *name))
 {
-    return fsif_get_entries_by_name(name);
+    profile_sample_t  ps;
+    GSList           *result;
+
+    PROFILE_START(ps);
+    result = fsif_get_entries_by_name(name);
+    PROFILE_STOP(ps, profile_lookup, name, PROFILE_CALLER());
+
+    return result;
 }
 
 
@@ -1092,7 +2234,11 @@ OHM_EXPORTABLE(void, set_field_by_entry, (fsif_entry_t *entry,
                                           char *name,
                                           fsif_value_t *vptr))
 {
+    profile_sample_t  ps;
+
+    PROFILE_START(ps);
     fsif_set_field_by_entry(entry, type, name, vptr);
+    PROFILE_STOP(ps, profile_write, entry_name(entry), PROFILE_CALLER());
 }
 
 
@@ -1121,6 +2267,206 @@ OHM_EXPORTABLE(int, add_field_watch, (char                  *factname,
 }
 
 
+/****************************
+ * add_deferred_field_watch
+ ****************************/
+OHM_EXPORTABLE(int, add_deferred_field_watch, (char                  *factname,
+                                               fsif_field_t          *selist,
+                                               char                  *fldname,
+                                               fsif_field_watch_cb_t  callback,
+                                               void                  *usrdata))
+{
+    return fsif_add_deferred_field_watch(factname, selist, fldname,
+                                         callback, usrdata);
+}
+
+
+/****************************
+ * begin_batch
+ ****************************/
+OHM_EXPORTABLE(int, begin_batch, (void))
+{
+    return fsif_begin_batch();
+}
+
+
+/****************************
+ * commit_batch
+ ****************************/
+OHM_EXPORTABLE(int, commit_batch, (void))
+{
+    return fsif_commit_batch();
+}
+
+
+/****************************
+ * register_schema
+ ****************************/
+OHM_EXPORTABLE(int, register_schema, (char             *factname,
+                                      fsif_fldhandle_t *handles))
+{
+    return fsif_register_schema(factname, handles);
+}
+
+
+/****************************
+ * set_field_by_handle
+ ****************************/
+OHM_EXPORTABLE(void, set_field_by_handle, (fsif_entry_t     *entry,
+                                           fsif_fldhandle_t *handle,
+                                           fsif_value_t     *vptr))
+{
+    profile_sample_t  ps;
+
+    PROFILE_START(ps);
+    fsif_set_field_by_handle(entry, handle, vptr);
+    PROFILE_STOP(ps, profile_write, entry_name(entry), PROFILE_CALLER());
+}
+
+
+/****************************
+ * add_index
+ ****************************/
+OHM_EXPORTABLE(int, add_index, (char *factname, char *fldname))
+{
+    return fsif_add_index(factname, fldname);
+}
+
+
+/*****************************************************************************
+ *                          *** profiler console ***                         *
+ *****************************************************************************/
+
+OHM_IMPORTABLE(int, console_open, (char *address,
+                                   void (*opened)(int, struct sockaddr *, int),
+                                   void (*closed)(int),
+                                   void (*input)(int, char *, void *),
+                                   void  *data, int multiple));
+OHM_IMPORTABLE(int, console_close, (int id));
+OHM_IMPORTABLE(int, console_write, (int id, char *buf, size_t size));
+OHM_IMPORTABLE(int, console_printf, (int id, char *fmt, ...));
+
+static int profile_console = -1;
+
+static void console_opened(int id, struct sockaddr *peer, int peerlen)
+{
+    (void)peer;
+    (void)peerlen;
+
+    console_printf(id, "fsif factstore profiler, type 'help' for help\n");
+    console_printf(id, "fsif> ");
+}
+
+static void console_closed(int id)
+{
+    (void)id;
+}
+
+static void console_input(int id, char *input, void *data)
+{
+    char    buf[256];
+    char   *cmd, *arg;
+    char   *out;
+    size_t  size;
+    FILE   *fp;
+
+    (void)data;
+
+    snprintf(buf, sizeof(buf), "%s", input);
+    cmd = g_strstrip(buf);
+
+    if ((arg = strchr(cmd, ' ')) != NULL) {
+        *arg++ = '\0';
+        arg    = g_strstrip(arg);
+    }
+
+    if (!cmd[0])
+        ;
+    else if (!strcmp(cmd, "help")) {
+        console_printf(id, "on            start profiling\n");
+        console_printf(id, "off           stop profiling\n");
+        console_printf(id, "show          show the collected statistics\n");
+        console_printf(id, "json          show the statistics as JSON\n");
+        console_printf(id, "dump <file>   save the statistics as JSON\n");
+        console_printf(id, "reset         clear the statistics\n");
+    }
+    else if (!strcmp(cmd, "on"))
+        fsif_profiling = TRUE;
+    else if (!strcmp(cmd, "off"))
+        fsif_profiling = FALSE;
+    else if (!strcmp(cmd, "reset"))
+        profile_reset();
+    else if (!strcmp(cmd, "show") || !strcmp(cmd, "json")) {
+        if ((fp = open_memstream(&out, &size)) != NULL) {
+            if (cmd[0] == 's')
+                profile_print_table(fp);
+            else
+                profile_print_json(fp);
+            fclose(fp);
+
+            console_write(id, out, size);
+            free(out);
+        }
+    }
+    else if (!strcmp(cmd, "dump")) {
+        if (arg == NULL || !arg[0])
+            console_printf(id, "usage: dump <file>\n");
+        else if (!profile_dump(arg))
+            console_printf(id, "failed to write %s: %s\n", arg,
+                           strerror(errno));
+    }
+    else
+        console_printf(id, "unknown command '%s'\n", cmd);
+
+    console_printf(id, "fsif> ");
+}
+
+static void profile_console_open(const char *address)
+{
+    char *signature;
+
+    /* the console is optional, look it up instead of requiring it */
+    signature = (char *)console_open_SIGNATURE;
+    ohm_module_find_method("console.open", &signature, (void *)&console_open);
+    signature = (char *)console_close_SIGNATURE;
+    ohm_module_find_method("console.close", &signature,(void *)&console_close);
+    signature = (char *)console_write_SIGNATURE;
+    ohm_module_find_method("console.write", &signature,(void *)&console_write);
+    signature = (char *)console_printf_SIGNATURE;
+    ohm_module_find_method("console.printf",&signature,(void*)&console_printf);
+
+    if (!console_open || !console_close || !console_write || !console_printf) {
+        OHM_WARNING("fsif: no console plugin, profiler console disabled");
+        return;
+    }
+
+    profile_console = console_open((char *)address, console_opened,
+                                   console_closed, console_input, NULL, FALSE);
+
+    if (profile_console < 0)
+        OHM_ERROR("fsif: failed to open profiler console at %s", address);
+    else
+        OHM_INFO("fsif: profiler console at %s", address);
+}
+
+static void profile_console_close(void)
+{
+    if (profile_console >= 0) {
+        console_close(profile_console);
+        profile_console = -1;
+    }
+}
+
+
+/****************************
+ * dump_profile
+ ****************************/
+OHM_EXPORTABLE(int, dump_profile, (const char *path))
+{
+    return profile_dump(path);
+}
+
+
 /*****************************************************************************
  *                            *** OHM plugin glue ***                        *
  *****************************************************************************/
@@ -1131,7 +2477,7 @@ OHM_PLUGIN_DESCRIPTION(PLUGIN_NAME,
                        OHM_LICENSE_LGPL, /* OHM_LICENSE_LGPL */
                        plugin_init, plugin_exit, NULL);
 
-OHM_PLUGIN_PROVIDES_METHODS(PLUGIN_PREFIX, 11,
+OHM_PLUGIN_PROVIDES_METHODS(PLUGIN_PREFIX, 18,
                             OHM_EXPORT(add_factstore_entry,     "add_factstore_entry"),
                             OHM_EXPORT(delete_factstore_entry,  "delete_factstore_entry"),
                             OHM_EXPORT(update_factstore_entry,  "update_factstore_entry"),
@@ -1142,7 +2488,14 @@ OHM_PLUGIN_PROVIDES_METHODS(PLUGIN_PREFIX, 11,
                             OHM_EXPORT(set_field_by_entry,      "set_field_by_entry"),
                             OHM_EXPORT(get_field_by_name,       "get_field_by_name"),
                             OHM_EXPORT(add_fact_watch,          "add_fact_watch"),
-                            OHM_EXPORT(add_field_watch,         "add_field_watch")
+                            OHM_EXPORT(add_field_watch,         "add_field_watch"),
+                            OHM_EXPORT(add_deferred_field_watch,"add_deferred_field_watch"),
+                            OHM_EXPORT(add_index,               "add_index"),
+                            OHM_EXPORT(dump_profile,            "dump_profile"),
+                            OHM_EXPORT(begin_batch,             "begin_batch"),
+                            OHM_EXPORT(commit_batch,            "commit_batch"),
+                            OHM_EXPORT(register_schema,         "register_schema"),
+                            OHM_EXPORT(set_field_by_handle,     "set_field_by_handle")
 );
 
 /*
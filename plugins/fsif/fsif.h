@@ -30,6 +30,8 @@ USA.
 #include <ohm/ohm-plugin-debug.h>
 
 #include <glib.h>
+#include <glib-object.h>
+#include <ohm/ohm-fact.h>
 
 typedef enum {
     fact_watch_unknown = 0,
@@ -74,6 +76,111 @@ typedef void (*fsif_field_watch_cb_t)(fsif_entry_t *, char *, fsif_field_t *,
 typedef void (*fsif_fact_watch_cb_t)(fsif_entry_t *, char *, fsif_fact_watch_e,
                                      void *);
 
+/*
+ * Field handles. A plugin describes the fields of a fact it accesses
+ * frequently with a table of handles terminated by FSIF_HANDLE_END and
+ * registers it once with register_schema. The registered handles can be
+ * used to read the fields with the inline accessors below and to write
+ * them with set_field_by_handle, without looking up the field by name.
+ */
+
+#define FSIF_FLD_STATIC   0x01  /* string values come from a small fixed
+                                   set, store them interned, not copied */
+
+typedef struct fsif_fldhandle_s fsif_fldhandle_t;
+
+struct fsif_fldhandle_s {
+    const char     *name;
+    fsif_fldtype_t  type;
+    int             flags;
+    GQuark          quark;      /* set by register_schema */
+    const int      *profiling;  /* set by register_schema, profiler state */
+    GValue       *(*profiled_get)(fsif_entry_t *, fsif_fldhandle_t *,
+                                  void *);  /* counted read by fsif */
+};
+
+#define FSIF_HANDLE(_name, _type, _flags) \
+    { _name, _type, _flags, 0, NULL, NULL }
+#define FSIF_HANDLE_END \
+    { NULL, fldtype_invalid, 0, 0, NULL, NULL }
+
+/*
+ * The accessors are inlined into the calling plugin, so they can't see
+ * the profiler of fsif. While it is on, reads are done by fsif instead,
+ * where they get counted like the ones by name.
+ */
+static inline GValue *fsif_handle_get(fsif_entry_t *entry, fsif_fldhandle_t *h)
+{
+    if (h->profiling != NULL && *h->profiling)
+        return h->profiled_get(entry, h, __builtin_return_address(0));
+
+    return ohm_structure_qget(OHM_STRUCTURE(entry), h->quark);
+}
+
+static inline GValue *fsif_handle_value(fsif_entry_t *entry,
+                                        fsif_fldhandle_t *h, GType type)
+{
+    GValue *gv = fsif_handle_get(entry, h);
+
+    return (gv != NULL && G_VALUE_TYPE(gv) == type) ? gv : NULL;
+}
+
+static inline const char *fsif_get_string(fsif_entry_t *entry,
+                                          fsif_fldhandle_t *h)
+{
+    GValue *gv = fsif_handle_value(entry, h, G_TYPE_STRING);
+
+    return gv ? g_value_get_string(gv) : NULL;
+}
+
+static inline long fsif_get_integer(fsif_entry_t *entry, fsif_fldhandle_t *h,
+                                    long defval)
+{
+    GValue *gv = fsif_handle_get(entry, h);
+
+    if (gv != NULL) {
+        switch (G_VALUE_TYPE(gv)) {
+        case G_TYPE_INT:  return g_value_get_int(gv);
+        case G_TYPE_LONG: return g_value_get_long(gv);
+        default:          break;
+        }
+    }
+
+    return defval;
+}
+
+static inline unsigned long fsif_get_unsignd(fsif_entry_t *entry,
+                                             fsif_fldhandle_t *h)
+{
+    GValue *gv = fsif_handle_value(entry, h, G_TYPE_ULONG);
+
+    return gv ? g_value_get_ulong(gv) : 0;
+}
+
+static inline double fsif_get_floating(fsif_entry_t *entry,
+                                       fsif_fldhandle_t *h)
+{
+    GValue *gv = fsif_handle_value(entry, h, G_TYPE_DOUBLE);
+
+    return gv ? g_value_get_double(gv) : 0.0;
+}
+
+static inline unsigned long long fsif_get_time(fsif_entry_t *entry,
+                                               fsif_fldhandle_t *h)
+{
+    GValue *gv = fsif_handle_value(entry, h, G_TYPE_UINT64);
+
+    return gv ? g_value_get_uint64(gv) : 0ULL;
+}
+
+static inline gpointer fsif_get_pointer(fsif_entry_t *entry,
+                                        fsif_fldhandle_t *h)
+{
+    GValue *gv = fsif_handle_value(entry, h, G_TYPE_POINTER);
+
+    return gv ? g_value_get_pointer(gv) : NULL;
+}
+
 
 #endif /* __OHM_FSIF_PLUGIN_H__ */
 
@@ -0,0 +1,301 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/* fsif field access microbenchmark: compares the name based get_field /
+ * set_field / update_factstore_entry path with the registered field
+ * handles on a private factstore, no plugins are loaded */
+
+#define _GNU_SOURCE
+
+#include <time.h>
+
+#include "../fsif.c"
+#include "../fsif-profile.c"
+
+/* referred to by the plugin glue of fsif.c, there is no daemon here */
+const char *ohm_plugin_get_param(OhmPlugin *plugin, const char *key)
+{
+    (void)plugin;
+    (void)key;
+
+    return NULL;
+}
+
+gboolean ohm_module_find_method(char *name, char **sig, void **method)
+{
+    (void)name;
+    (void)sig;
+    (void)method;
+
+    return FALSE;
+}
+
+#define DEFAULT_ROUNDS 100000
+#define DEFAULT_FACTS  200
+
+#define BENCH_FACT "com.nokia.policy.fsif_bench"
+
+static fsif_fldhandle_t handles[] = {
+    FSIF_HANDLE("manager_id", fldtype_integer, 0              ),
+    FSIF_HANDLE("request"   , fldtype_string , FSIF_FLD_STATIC),
+    FSIF_HANDLE("reqno"     , fldtype_integer, 0              ),
+    FSIF_HANDLE_END
+};
+
+#define H_MANAGER_ID (handles + 0)
+#define H_REQUEST    (handles + 1)
+#define H_REQNO      (handles + 2)
+
+static const char *requests[] = { "acquire", "release" };
+
+static long checksum;
+
+static double now (void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static OhmFact *create_facts (int nfact)
+{
+    fsif_field_t  fldlist[4];
+    fsif_field_t  selist[2];
+    int           i;
+
+    memset(fldlist, 0, sizeof(fldlist));
+    fldlist[0].type = fldtype_integer;
+    fldlist[0].name = "manager_id";
+    fldlist[1].type = fldtype_string;
+    fldlist[1].name = "request";
+    fldlist[1].value.string = "release";
+    fldlist[2].type = fldtype_integer;
+    fldlist[2].name = "reqno";
+
+    for (i = 0; i < nfact; i++) {
+        fldlist[0].value.integer = i;
+
+        if (!fsif_add_factstore_entry(BENCH_FACT, fldlist))
+            return NULL;
+    }
+
+    memset(selist, 0, sizeof(selist));
+    selist[0].type = fldtype_integer;
+    selist[0].name = "manager_id";
+    selist[0].value.integer = nfact - 1;
+
+    return find_entry(BENCH_FACT, selist);
+}
+
+static double get_by_name (OhmFact *fact, int rounds)
+{
+    fsif_value_t v;
+    double       start;
+    int          i;
+
+    start = now();
+
+    for (i = 0; i < rounds; i++) {
+        get_field(fact, fldtype_integer, "manager_id", &v);
+        checksum += v.integer;
+        get_field(fact, fldtype_string, "request", &v);
+        checksum += v.string[0];
+    }
+
+    return (now() - start) / (2.0 * rounds);
+}
+
+static double get_by_handle (OhmFact *fact, int rounds)
+{
+    double start;
+    int    i;
+
+    start = now();
+
+    for (i = 0; i < rounds; i++) {
+        checksum += fsif_get_integer(fact, H_MANAGER_ID, -1);
+        checksum += fsif_get_string(fact, H_REQUEST)[0];
+    }
+
+    return (now() - start) / (2.0 * rounds);
+}
+
+static double set_by_name (OhmFact *fact, int rounds)
+{
+    fsif_value_t v;
+    double       start;
+    int          i;
+
+    start = now();
+
+    for (i = 0; i < rounds; i++) {
+        v.string = (char *)requests[i & 1];
+        set_field(fact, fldtype_string, "request", &v);
+        v.integer = i;
+        set_field(fact, fldtype_integer, "reqno", &v);
+    }
+
+    return (now() - start) / (2.0 * rounds);
+}
+
+static double set_by_handle (OhmFact *fact, int rounds)
+{
+    fsif_value_t v;
+    double       start;
+    int          i;
+
+    start = now();
+
+    for (i = 0; i < rounds; i++) {
+        v.string = (char *)requests[i & 1];
+        fsif_set_field_by_handle(fact, H_REQUEST, &v);
+        v.integer = i;
+        fsif_set_field_by_handle(fact, H_REQNO, &v);
+    }
+
+    return (now() - start) / (2.0 * rounds);
+}
+
+/* the resource-set request update: look up by manager_id, set 2 fields */
+static double update_by_name (int nfact, int rounds)
+{
+    fsif_field_t selist[2], fldlist[3];
+    double       start;
+    int          i;
+
+    memset(selist, 0, sizeof(selist));
+    selist[0].type = fldtype_integer;
+    selist[0].name = "manager_id";
+
+    memset(fldlist, 0, sizeof(fldlist));
+    fldlist[0].type = fldtype_string;
+    fldlist[0].name = "request";
+    fldlist[1].type = fldtype_integer;
+    fldlist[1].name = "reqno";
+
+    start = now();
+
+    for (i = 0; i < rounds; i++) {
+        selist[0].value.integer  = i % nfact;
+        fldlist[0].value.string  = (char *)requests[i & 1];
+        fldlist[1].value.integer = i;
+        fsif_update_factstore_entry(BENCH_FACT, selist, fldlist);
+    }
+
+    return (now() - start) / rounds;
+}
+
+static double update_by_handle (int nfact, int rounds)
+{
+    fsif_field_t  selist[2];
+    fsif_value_t  v;
+    OhmFact      *fact;
+    double        start;
+    int           i;
+
+    memset(selist, 0, sizeof(selist));
+    selist[0].type = fldtype_integer;
+    selist[0].name = "manager_id";
+
+    start = now();
+
+    for (i = 0; i < rounds; i++) {
+        selist[0].value.integer = i % nfact;
+
+        if ((fact = find_entry(BENCH_FACT, selist)) == NULL)
+            continue;
+
+        fsif_begin_batch();
+        v.string = (char *)requests[i & 1];
+        fsif_set_field_by_handle(fact, H_REQUEST, &v);
+        v.integer = i;
+        fsif_set_field_by_handle(fact, H_REQNO, &v);
+        fsif_commit_batch();
+    }
+
+    return (now() - start) / rounds;
+}
+
+int main (int argc, char **argv)
+{
+    OhmFact *fact;
+    int      rounds = DEFAULT_ROUNDS;
+    int      nfact  = DEFAULT_FACTS;
+    double   gn, gh, sn, sh, un, uh, ui;
+
+    if (argc > 1)
+        rounds = atoi(argv[1]);
+    if (argc > 2)
+        nfact = atoi(argv[2]);
+
+    if (rounds <= 0 || nfact <= 0) {
+        printf("usage: %s [rounds [facts]]\n", argv[0]);
+        return 1;
+    }
+
+    g_type_init();
+
+    fs = ohm_fact_store_get_fact_store();
+
+    /* keep the indexes up to date as the plugin would */
+    g_signal_connect(G_OBJECT(fs), "updated" , G_CALLBACK(updated_cb) , NULL);
+    g_signal_connect(G_OBJECT(fs), "inserted", G_CALLBACK(inserted_cb), NULL);
+    g_signal_connect(G_OBJECT(fs), "removed" , G_CALLBACK(removed_cb) , NULL);
+
+    if ((fact = create_facts(nfact)) == NULL) {
+        printf("bench: failed to create the test facts\n");
+        return 1;
+    }
+
+    fsif_register_schema(BENCH_FACT, handles);
+
+    gn = get_by_name(fact, rounds);
+    gh = get_by_handle(fact, rounds);
+    sn = set_by_name(fact, rounds);
+    sh = set_by_handle(fact, rounds);
+    un = update_by_name(nfact, rounds);
+    uh = update_by_handle(nfact, rounds);
+
+    fsif_add_index(BENCH_FACT, "manager_id");
+
+    ui = update_by_handle(nfact, rounds);
+
+    printf("%d rounds, %d facts\n", rounds, nfact);
+    printf("  get by name:                 %9.1f ns/field\n", gn);
+    printf("  get by handle:               %9.1f ns/field\n", gh);
+    printf("  set by name:                 %9.1f ns/field\n", sn);
+    printf("  set by handle:               %9.1f ns/field\n", sh);
+    printf("  update by selector:          %9.1f ns/update\n", un);
+    printf("  update by handle:            %9.1f ns/update\n", uh);
+    printf("  update by handle, indexed:   %9.1f ns/update\n", ui);
+    printf("  (checksum %ld)\n", checksum);
+
+    return 0;
+}
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
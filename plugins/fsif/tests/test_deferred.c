@@ -0,0 +1,256 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/* deferred field watch test: several updates of a field are delivered as
+ * a single callback with the final value, from idle and never from within
+ * the update itself, on a private factstore with no plugins loaded */
+
+#define _GNU_SOURCE
+
+#include <time.h>
+
+#include "../fsif.c"
+#include "../fsif-profile.c"
+
+/* referred to by the plugin glue of fsif.c, there is no daemon here */
+const char *ohm_plugin_get_param(OhmPlugin *plugin, const char *key)
+{
+    (void)plugin;
+    (void)key;
+
+    return NULL;
+}
+
+gboolean ohm_module_find_method(char *name, char **sig, void **method)
+{
+    (void)name;
+    (void)sig;
+    (void)method;
+
+    return FALSE;
+}
+
+#define TEST_FACT "com.nokia.policy.fsif_test"
+
+typedef struct {
+    int      calls;                     /* number of callbacks */
+    OhmFact *fact;                      /* entry of the last callback */
+    int      value;                     /* value of the last callback */
+    int      order[4];                  /* ids of the called entries */
+} watch_log_t;
+
+static watch_log_t sync_log;
+static watch_log_t deferred_log;
+static int         updating;            /* we're in the middle of updates */
+static int         failed;
+
+#define CHECK(cond, fmt, args...) do {                                  \
+        if (!(cond)) {                                                  \
+            printf("FAIL: " fmt "\n" , ## args);                        \
+            failed = TRUE;                                              \
+        }                                                               \
+    } while (0)
+
+static void log_call(watch_log_t *log, fsif_entry_t *entry, fsif_field_t *fld)
+{
+    fsif_value_t id;
+
+    get_field(entry, fldtype_integer, "id", &id);
+
+    if (log->calls < (int)(sizeof(log->order) / sizeof(log->order[0])))
+        log->order[log->calls] = id.integer;
+
+    log->calls++;
+    log->fact  = entry;
+    log->value = fld->value.integer;
+}
+
+static void sync_cb(fsif_entry_t *entry, char *name, fsif_field_t *fld,
+                    void *data)
+{
+    (void)name;
+    (void)data;
+
+    log_call(&sync_log, entry, fld);
+}
+
+static void deferred_cb(fsif_entry_t *entry, char *name, fsif_field_t *fld,
+                        void *data)
+{
+    (void)name;
+    (void)data;
+
+    CHECK(!updating, "deferred watch called from within an update");
+
+    log_call(&deferred_log, entry, fld);
+}
+
+static OhmFact *create_entry (int id)
+{
+    fsif_field_t fldlist[3], selist[2];
+
+    memset(fldlist, 0, sizeof(fldlist));
+    fldlist[0].type = fldtype_integer;
+    fldlist[0].name = "id";
+    fldlist[0].value.integer = id;
+    fldlist[1].type = fldtype_integer;
+    fldlist[1].name = "value";
+
+    if (!fsif_add_factstore_entry(TEST_FACT, fldlist))
+        return NULL;
+
+    memset(selist, 0, sizeof(selist));
+    selist[0].type = fldtype_integer;
+    selist[0].name = "id";
+    selist[0].value.integer = id;
+
+    return find_entry(TEST_FACT, selist);
+}
+
+static void set_value (OhmFact *fact, int value)
+{
+    fsif_value_t v;
+
+    v.integer = value;
+    set_field(fact, fldtype_integer, "value", &v);
+}
+
+static void run_idle (void)
+{
+    while (g_main_context_iteration(NULL, FALSE))
+        ;
+}
+
+static void reset_logs (void)
+{
+    memset(&sync_log, 0, sizeof(sync_log));
+    memset(&deferred_log, 0, sizeof(deferred_log));
+}
+
+/* three updates of one field collapse into one callback */
+static void test_collapse (OhmFact *fact)
+{
+    reset_logs();
+
+    updating = TRUE;
+    set_value(fact, 1);
+    set_value(fact, 2);
+    set_value(fact, 3);
+    updating = FALSE;
+
+    CHECK(sync_log.calls == 3, "%d synchronous callbacks instead of 3",
+          sync_log.calls);
+    CHECK(deferred_log.calls == 0, "deferred watch called before idle");
+    CHECK(deferred.srcid != 0, "no idle callback scheduled");
+
+    run_idle();
+
+    CHECK(deferred_log.calls == 1, "%d deferred callbacks instead of 1",
+          deferred_log.calls);
+    CHECK(deferred_log.fact == fact, "deferred callback for the wrong entry");
+    CHECK(deferred_log.value == 3, "deferred callback with value %d "
+          "instead of the final 3", deferred_log.value);
+
+    run_idle();
+
+    CHECK(deferred_log.calls == 1, "deferred callback repeated");
+}
+
+/* updates of different entries are delivered once each in order */
+static void test_order (OhmFact *fact1, OhmFact *fact2)
+{
+    reset_logs();
+
+    updating = TRUE;
+    set_value(fact2, 10);
+    set_value(fact1, 11);
+    set_value(fact2, 12);
+    set_value(fact1, 13);
+    updating = FALSE;
+
+    CHECK(deferred_log.calls == 0, "deferred watch called before idle");
+
+    run_idle();
+
+    CHECK(deferred_log.calls == 2, "%d deferred callbacks instead of 2",
+          deferred_log.calls);
+    CHECK(deferred_log.order[0] == 2 && deferred_log.order[1] == 1,
+          "deferred callbacks in wrong order (%d, %d)",
+          deferred_log.order[0], deferred_log.order[1]);
+    CHECK(deferred_log.value == 13, "deferred callback with value %d "
+          "instead of the final 13", deferred_log.value);
+}
+
+/* a removed entry is not called back for */
+static void test_removed (OhmFact *fact)
+{
+    reset_logs();
+
+    set_value(fact, 20);
+    ohm_fact_store_remove(fs, fact);
+
+    run_idle();
+
+    CHECK(deferred_log.calls == 0, "deferred callback for a removed entry");
+}
+
+int main (int argc, char **argv)
+{
+    OhmFact *fact1, *fact2;
+
+    (void)argc;
+    (void)argv;
+
+    g_type_init();
+
+    fs = ohm_fact_store_get_fact_store();
+
+    g_signal_connect(G_OBJECT(fs), "updated" , G_CALLBACK(updated_cb) , NULL);
+    g_signal_connect(G_OBJECT(fs), "inserted", G_CALLBACK(inserted_cb), NULL);
+    g_signal_connect(G_OBJECT(fs), "removed" , G_CALLBACK(removed_cb) , NULL);
+
+    if ((fact1 = create_entry(1)) == NULL || (fact2 = create_entry(2)) == NULL) {
+        printf("FAIL: failed to create the test facts\n");
+        return 1;
+    }
+
+    fsif_add_field_watch(TEST_FACT, NULL, "value", sync_cb, NULL);
+    fsif_add_deferred_field_watch(TEST_FACT, NULL, "value", deferred_cb, NULL);
+
+    test_collapse(fact1);
+    test_order(fact1, fact2);
+    test_removed(fact2);
+
+    deferred_purge();
+
+    if (failed)
+        return 1;
+
+    printf("PASS: deferred field watches\n");
+    return 0;
+}
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
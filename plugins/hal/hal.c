@@ -37,18 +37,19 @@ OHM_DEBUG_PLUGIN(hal,
 
 hal_plugin *hal_plugin_p = NULL;
 
-#define DBUS_ADMIN_INTERFACE       "org.freedesktop.DBus"
-#define DBUS_ADMIN_PATH            "/org/freedesktop/DBus"
-#define DBUS_NAME_OWNER_CHANGED    "NameOwnerChanged"
-
 #define HALD_DBUS_NAME              "org.freedesktop.Hal"
 
-static int watch_dbus_addr(const char *addr, int watchit,
-                           DBusHandlerResult (*filter)(DBusConnection *,
-                                                       DBusMessage *, void *),
-                           void *user_data);
-static DBusHandlerResult hald_change(DBusConnection *c,
-                                     DBusMessage *msg, void *data);
+OHM_IMPORTABLE(int, add_watch, (DBusBusType type, const char *name,
+                                void (*handler)(const char *, const char *,
+                                                const char *, void *),
+                                void *data));
+OHM_IMPORTABLE(int, del_watch, (DBusBusType type, const char *name,
+                                void (*handler)(const char *, const char *,
+                                                const char *, void *),
+                                void *data));
+
+static void hald_change(const char *name, const char *before,
+                        const char *after, void *data);
 static DBusConnection *sys_conn;
 
 static void
@@ -69,7 +70,8 @@ plugin_init(OhmPlugin * plugin)
         return;
     }
 
-    watch_dbus_addr(HALD_DBUS_NAME, TRUE, hald_change, NULL);
+    if (!add_watch(DBUS_BUS_SYSTEM, HALD_DBUS_NAME, hald_change, NULL))
+        OHM_ERROR("Failed to watch %s on system D-BUS.", HALD_DBUS_NAME);
 
     OHM_DEBUG(DBG_HAL, "< HAL plugin init");
     return;
@@ -94,7 +96,7 @@ plugin_exit(OhmPlugin * plugin)
     (void) plugin;
 
     if (sys_conn) {
-        watch_dbus_addr(HALD_DBUS_NAME, FALSE, hald_change, NULL);
+        del_watch(DBUS_BUS_SYSTEM, HALD_DBUS_NAME, hald_change, NULL);
         
         dbus_connection_unref(sys_conn);
         sys_conn = NULL;
@@ -107,101 +109,32 @@ plugin_exit(OhmPlugin * plugin)
     return;
 }
 
-static int watch_dbus_addr(const char *addr, int watchit,
-                           DBusHandlerResult (*filter)(DBusConnection *,
-                                                       DBusMessage *, void *),
-                           void *user_data)
-{
-    char      match[1024];
-    DBusError err;
-
-    snprintf(match, sizeof(match),
-             "type='signal',"
-             "sender='%s',interface='%s',member='%s',path='%s',"
-             "arg0='%s'",
-             DBUS_ADMIN_INTERFACE, DBUS_ADMIN_INTERFACE,
-             DBUS_NAME_OWNER_CHANGED, DBUS_ADMIN_PATH,
-             addr);
-
-    if (filter) {
-        if (watchit) {
-            if (!dbus_connection_add_filter(sys_conn, filter, user_data,NULL)) {
-                OHM_ERROR("Failed to install dbus filter %p.", filter);
-                return FALSE;
-            }
-        }
-        else
-            dbus_connection_remove_filter(sys_conn, filter, user_data);
-    }
-
-    /*
-     * Notes:
-     *   We block when adding filters, to minimize (= eliminate ?) the time
-     *   window for the client to crash after it has let us know about itself
-     *   but before we managed to install the filter. According to the docs
-     *   we do not re-enter the main loop and all other messages than the
-     *   reply to AddMatch will get queued and processed once we're back in the
-     *   main loop. On the watch removal path we do not care about errors and
-     *   we do not want to block either.
-     */
-
-    if (watchit) {
-        dbus_error_init(&err);
-        dbus_bus_add_match(sys_conn, match, &err);
-
-        if (dbus_error_is_set(&err)) {
-            OHM_ERROR("Can't add match \"%s\": %s", match, err.message);
-            dbus_error_free(&err);
-            return FALSE;
-        }
-    }
-    else
-        dbus_bus_remove_match(sys_conn, match, NULL);
-
-    return TRUE;
-}
-
-DBusHandlerResult hald_change(DBusConnection *c, DBusMessage *msg,
-                              void *user_data)
+static void
+hald_change(const char *name, const char *before, const char *after,
+            void *data)
 {
-    gchar *sender = NULL, *before = NULL, *after = NULL;
-    gboolean ret;
     hal_plugin *plugin = hal_plugin_p;
 
-    (void)user_data;
+    (void)data;
 
     OHM_DEBUG(DBG_HAL, "> hald_change");
 
-    if (plugin == NULL) {
-        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
-    }
-
-    if (!dbus_message_get_args(msg,
-            NULL,
-            DBUS_TYPE_STRING,
-            &sender,
-            DBUS_TYPE_STRING,
-            &before,
-            DBUS_TYPE_STRING,
-            &after,
-            DBUS_TYPE_INVALID) ||
-        strcmp(sender, HALD_DBUS_NAME))
-        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    if (plugin == NULL || sys_conn == NULL)
+        return;
 
     OHM_DEBUG(DBG_HAL, "  check_hald: sender '%s', before '%s', after '%s'",
-            sender, before, after);
+            name, before, after);
 
     if (!strcmp(before, "") && strcmp(after, "")) {
         OHM_INFO("hald appeared on D-Bus.");
         /* hald service just started, check if it is hald */
-        reload_hal_context(c, plugin);
+        reload_hal_context(sys_conn, plugin);
     }
     else {
         OHM_INFO("hald went away.");
     }
 
     OHM_DEBUG(DBG_HAL, "< hald_change");
-    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 }
 
 OHM_PLUGIN_DESCRIPTION("hal",
@@ -214,6 +147,10 @@ OHM_PLUGIN_PROVIDES_METHODS(hal, 2,
         OHM_EXPORT(unset_observer, "unset_observer"),
         OHM_EXPORT(set_observer, "set_observer"));
 
+OHM_PLUGIN_REQUIRES_METHODS(hal, 2,
+        OHM_IMPORT("dbus.add_watch", add_watch),
+        OHM_IMPORT("dbus.del_watch", del_watch));
+
 /*
  * Local Variables:
  * c-basic-offset: 4
@@ -51,7 +51,17 @@ static int             timeout;    /* message timeoutin msec */
 static char           *backend;    /* backend's D-Bus address or NULL */
 static int             namesig;    /* whether we ever got a NameOwnerChanged */
 
+OHM_IMPORTABLE(int, add_watch, (DBusBusType type, const char *name,
+                                void (*handler)(const char *, const char *,
+                                                const char *, void *),
+                                void *data));
+OHM_IMPORTABLE(int, del_watch, (DBusBusType type, const char *name,
+                                void (*handler)(const char *, const char *,
+                                                const char *, void *),
+                                void *data));
+
 static void get_parameters(OhmPlugin *);
+static int  lookup_watch_methods(void);
 static void system_bus_init(void);
 static void session_bus_init(const char *);
 static void setup_dbus_proxy_methods(void);
@@ -75,7 +85,7 @@ static int close_array(DBusMessageIter *, DBusMessageIter *);
 
 static int get_name_owner(const char *);
 static void name_queried(DBusPendingCall *, void *);
-static DBusHandlerResult name_changed(DBusConnection *, DBusMessage *, void *);
+static void name_changed(const char *, const char *, const char *, void *);
 
 static DBusHandlerResult proxy_method(DBusConnection *, DBusMessage *, void *);
 static uint32_t play_handler(DBusMessage *, char *, char *);
@@ -106,6 +116,9 @@ void dbusif_init(OhmPlugin *plugin)
 
     ENTER;
 
+    if (!lookup_watch_methods())
+        exit(1);
+
     system_bus_init();
 
     LEAVE;
@@ -399,39 +412,19 @@ void dbusif_free_data(void *data)
 
 void dbusif_monitor_client(const char *address, int monitor)
 {
-    static char *fmt =
-        "type='signal',"
-        "sender='"    DBUS_ADMIN_SERVICE             "',"
-        "interface='" DBUS_ADMIN_INTERFACE           "',"
-        "member='"    DBUS_NAME_OWNER_CHANGED_SIGNAL "',"
-        "path='"      DBUS_ADMIN_PATH                "',"
-        "arg0='"      "%s"                           "'";
-
-    char filter[256];
-    DBusError err;
+    DBusBusType type = systembus ? DBUS_BUS_SYSTEM : DBUS_BUS_SESSION;
 
     if (address != NULL) {
-        snprintf(filter, sizeof(filter), fmt, address);
-
         if (monitor) {
-            dbus_error_init(&err);
-
             OHM_DEBUG(DBG_DBUS, "start monitoring client \"%s\"", address);
 
-            /* setup_dbus_proxy_methods() already added the
-               name_changed() filter */
-
-            dbus_bus_add_match(conn, filter, &err);
-
-            if (dbus_error_is_set(&err)) {
-                OHM_ERROR("Can't add match \"&s\": %s", filter, err.message);
-                dbus_error_free(&err);
-            }
+            if (!add_watch(type, address, name_changed, NULL))
+                OHM_ERROR("notification: can't watch client '%s'", address);
         }
         else {
             OHM_DEBUG(DBG_DBUS, "stop monitoring client \"%s\"", address);
 
-            dbus_bus_remove_match(conn, filter, NULL);
+            del_watch(type, address, name_changed, NULL);
         }
     }
 }
@@ -488,6 +481,20 @@ static void get_parameters(OhmPlugin *plugin)
 }
 
 
+static int lookup_watch_methods(void)
+{
+    char *add_sig = (char *)add_watch_SIGNATURE;
+    char *del_sig = (char *)del_watch_SIGNATURE;
+
+    if (!ohm_module_find_method("dbus.add_watch", &add_sig,(void*)&add_watch) ||
+        !ohm_module_find_method("dbus.del_watch", &del_sig,(void*)&del_watch)) {
+        OHM_ERROR("notification: can't find D-Bus name watch methods");
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
 static void system_bus_init(void)
 {
     DBusError   err;
@@ -558,38 +565,23 @@ static void session_bus_init(const char *addr)
 
 static void setup_dbus_proxy_methods(void)
 {
-    static char *filter =
-        "type='signal',"
-        "sender='"    DBUS_ADMIN_SERVICE             "',"
-        "interface='" DBUS_ADMIN_INTERFACE           "',"
-        "member='"    DBUS_NAME_OWNER_CHANGED_SIGNAL "',"
-        "path='"      DBUS_ADMIN_PATH                "',"
-        "arg0='"      DBUS_NGF_BACKEND_SERVICE       "'";
-
     static struct DBusObjectPathVTable method = {
         .message_function = proxy_method
     };
 
     const char *busname = systembus ? "system" : "session";
+    DBusBusType type    = systembus ? DBUS_BUS_SYSTEM : DBUS_BUS_SESSION;
     DBusError   err;
     int         retval;
 
     dbus_error_init(&err);
 
     /*
-     * signal filtering to track the backand
+     * track the backend, the dbus plugin demultiplexes NameOwnerChanged
      */
-    if (!dbus_connection_add_filter(conn, name_changed,NULL, NULL)) {
-        OHM_ERROR("Can't add filter 'name_changed'");
-        exit(1);
-    }
-
-    dbus_bus_add_match(conn, filter, &err);
-
-    if (dbus_error_is_set(&err)) {
-        OHM_ERROR("notification: can't watch backend '%s': %s",
-                  DBUS_NGF_BACKEND_SERVICE, err.message);
-        dbus_error_free(&err);
+    if (!add_watch(type, DBUS_NGF_BACKEND_SERVICE, name_changed, NULL)) {
+        OHM_ERROR("notification: can't watch backend '%s'",
+                  DBUS_NGF_BACKEND_SERVICE);
         exit(1);
     }
 
@@ -985,59 +977,34 @@ static void name_queried(DBusPendingCall *pend, void *data)
     dbus_pending_call_unref(pend);
 }
 
-static DBusHandlerResult name_changed(DBusConnection *conn,
-                                      DBusMessage    *msg,
-                                      void           *ud)
+static void name_changed(const char *name, const char *before,
+                         const char *after, void *ud)
 {
-    char              *sender;
-    char              *before;
-    char              *after;
-    gboolean           success;
-    DBusHandlerResult  result;
-
-    (void)conn;
     (void)ud;
 
+    if (!strcmp(name, DBUS_NGF_BACKEND_SERVICE)) {
 
-    result  = DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
-    success = dbus_message_is_signal(msg, DBUS_ADMIN_INTERFACE,
-                                     DBUS_NAME_OWNER_CHANGED_SIGNAL);
-
-    if (success) {
-        success = dbus_message_get_args(msg, NULL,
-                                        DBUS_TYPE_STRING, &sender,
-                                        DBUS_TYPE_STRING, &before,
-                                        DBUS_TYPE_STRING, &after,
-                                        DBUS_TYPE_INVALID);
+        namesig = TRUE;  /* supress the result of GetNameOwner's */
 
-        if (success && sender) {
-            if (!strcmp(sender, DBUS_NGF_BACKEND_SERVICE)) {
-
-                namesig = TRUE;  /* supress the result of GetNameOwner's */
-
-                if (after && strcmp(after, "")) {
-                    OHM_DEBUG(DBG_DBUS, "notification backend "
-                              "is up (%s)", after);
-                    backend = strdup(after);
-                }
-                else if (before != NULL && (!after || !strcmp(after, ""))) {
-                    OHM_DEBUG(DBG_DBUS, "notification backend is gone");
-                    free(backend);
-                    backend = NULL;
-                    proxy_backend_is_down();
-                }
-            }
-            else {
-                if (before != NULL && (!after || !strcmp(after, ""))) {
-                    OHM_DEBUG(DBG_DBUS, "notification client '%s' is gone",
-                              sender);
-                    proxy_client_is_down(sender);
-                }
-            }
+        if (after && strcmp(after, "")) {
+            OHM_DEBUG(DBG_DBUS, "notification backend "
+                      "is up (%s)", after);
+            backend = strdup(after);
+        }
+        else if (before != NULL && (!after || !strcmp(after, ""))) {
+            OHM_DEBUG(DBG_DBUS, "notification backend is gone");
+            free(backend);
+            backend = NULL;
+            proxy_backend_is_down();
+        }
+    }
+    else {
+        if (before != NULL && (!after || !strcmp(after, ""))) {
+            OHM_DEBUG(DBG_DBUS, "notification client '%s' is gone",
+                      name);
+            proxy_client_is_down(name);
         }
     }
-
-    return result;
 }
 
 
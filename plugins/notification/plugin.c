@@ -124,7 +124,7 @@ OHM_PLUGIN_PROVIDES(
     "maemo.notification"
 );
 
-OHM_PLUGIN_REQUIRES("resource", "rule_engine");
+OHM_PLUGIN_REQUIRES("resource", "rule_engine", "dbus");
 
 OHM_PLUGIN_DBUS_SIGNALS(
     { NULL, DBUS_POLICY_DECISION_INTERFACE, DBUS_POLICY_NEW_SESSION_SIGNAL,
@@ -36,6 +36,11 @@ static void client_init(OhmPlugin *plugin)
     cl_head.prev = (void *)&cl_head;
 
     (void)plugin;
+
+    /* see init_selist() for the fields clients are looked up by */
+    if (!fsif_add_index(FACTSTORE_PLAYBACK, "dbusid") ||
+        !fsif_add_index(FACTSTORE_PLAYBACK, "pid"))
+        OHM_ERROR("playback: failed to index %s", FACTSTORE_PLAYBACK);
 }
 
 
@@ -50,7 +50,7 @@ static goodbye_cb_t       goodbye_notif; /* hello notification */
 static int                timeout;       /* message timeout in msec */
 
 static DBusHandlerResult info(DBusConnection *, DBusMessage *, void *);
-static DBusHandlerResult name_changed(DBusConnection *, DBusMessage *, void *);
+static void name_changed(const char *, const char *, const char *, void *);
 static DBusHandlerResult hello(DBusConnection *, DBusMessage *, void *);
 static DBusHandlerResult goodbye(DBusConnection *, DBusMessage *, void *);
 static DBusHandlerResult notify(DBusConnection *,DBusMessage *, void*);
@@ -66,57 +66,8 @@ static prop_notif_t *find_property_notifier(char *);
 
 
 
-static char *filter_signal(char *buf, size_t size,
-                           const char *sender, const char *interface,
-                           const char *member, const char *path, ...)
-{
-#define FILTER_TAG(tag, value)                                          \
-        if (value != NULL) {                                            \
-            n  = snprintf(p, l, "%s%s='%s'", t, tag, value);            \
-            p += n;                                                     \
-            l -= n;                                                     \
-            t  = ",";                                                   \
-        }
-#define FILTER_ARG(i, value)                                            \
-        if (value != NULL) {                                            \
-            n  = snprintf(p, l, "%sarg%d='%s'", t, i, value);           \
-            p += n;                                                     \
-            l -= n;                                                     \
-            t  = ",";                                                   \
-        }
-
-    va_list ap;
-    char *p, *t, *argval;
-    int   l, n, i;
-
-    t = "";
-    p = buf;
-    l = size;
-
-    FILTER_TAG("type", "signal");
-    FILTER_TAG("sender", sender);
-    FILTER_TAG("interface", interface);
-    FILTER_TAG("member", member);
-    FILTER_TAG("path", path);
-
-    va_start(ap, path);
-    
-    for (i = 0; (argval = va_arg(ap, char *)) != NULL; i++)
-        FILTER_ARG(i, argval);
-
-    va_end(ap);
-    
-    return buf;
-
-#undef FILTER_TAG
-#undef FILTER_ARG
-}
-
-
-
 static void system_bus_init(void)
 {
-    char        filter[1024];
     DBusError   err;
 
     dbus_error_init(&err);
@@ -130,22 +81,11 @@ static void system_bus_init(void)
         exit(0);
     }
 
-    if (!dbus_connection_add_filter(sys_conn, info,NULL, NULL)) {
-        OHM_ERROR("Can't add filter 'info'");
+    if (!add_signal(DBUS_BUS_SYSTEM, NULL, DBUS_POLICY_DECISION_INTERFACE,
+                    DBUS_INFO_SIGNAL, NULL, NULL, info, NULL)) {
+        OHM_ERROR("Can't add signal handler 'info'");
         exit(1);
     }
-
-    filter_signal(filter, sizeof(filter),
-                  NULL, DBUS_POLICY_DECISION_INTERFACE, DBUS_INFO_SIGNAL,
-                  NULL, NULL);
-
-    dbus_bus_add_match(sys_conn, filter, &err);
-    if (dbus_error_is_set(&err)) {
-        OHM_ERROR("Can't add match \"&s\": %s", filter, err.message);
-        dbus_error_free(&err);
-        exit(1);
-    }
-
 }
 
 
@@ -156,7 +96,6 @@ static int session_bus_init(const char *address)
     };
 
 
-    char       filter[1024];
     DBusError  err;
     int        retval;
     int        success;
@@ -204,45 +143,22 @@ static int session_bus_init(const char *address)
     dbus_connection_setup_with_g_main(sess_conn, NULL);
 
     /*
-     * add signal filters
+     * add signal handlers, the dbus plugin dispatches them for us
      */
 
-    if (!dbus_connection_add_filter(sess_conn, name_changed,NULL, NULL)) {
-        OHM_ERROR("Can't add filter 'name_changed'");
-        exit(1);
-    }
-
-    filter_signal(filter, sizeof(filter),
-                  NULL, DBUS_PLAYBACK_INTERFACE, NULL, NULL,
-                  NULL);
-                            
-    dbus_bus_add_match(sess_conn, filter, &err);
-    if (dbus_error_is_set(&err)) {
-        OHM_ERROR("Can't add match \"%s\": %s", filter, err.message);
-        dbus_error_free(&err);
-        exit(1);
-    }
-    if (!dbus_connection_add_filter(sess_conn, hello,NULL, NULL)) {
-        OHM_ERROR("Can't add filter 'hello'");
+    if (!add_signal(DBUS_BUS_SESSION, NULL, DBUS_PLAYBACK_INTERFACE,
+                    DBUS_HELLO_SIGNAL, NULL, NULL, hello, NULL)) {
+        OHM_ERROR("Can't add signal handler 'hello'");
         exit(1);
     }
-    if (!dbus_connection_add_filter(sess_conn, goodbye,NULL, NULL)) {
-        OHM_ERROR("Can't add filter 'goodbye'");
-        exit(1);
-    }
-
-    filter_signal(filter, sizeof(filter),
-                  NULL, DBUS_INTERFACE_PROPERTIES, NULL, NULL,
-                  NULL);
-    
-    dbus_bus_add_match(sess_conn, filter, &err);
-    if (dbus_error_is_set(&err)) {
-        OHM_ERROR("Can't add match \"%s\": %s", filter, err.message);
-        dbus_error_free(&err);
+    if (!add_signal(DBUS_BUS_SESSION, NULL, DBUS_PLAYBACK_INTERFACE,
+                    DBUS_GOODBYE_SIGNAL, NULL, NULL, goodbye, NULL)) {
+        OHM_ERROR("Can't add signal handler 'goodbye'");
         exit(1);
     }
-    if (!dbus_connection_add_filter(sess_conn, notify,NULL, NULL)) {
-        OHM_ERROR("Can't add filter 'notify'");
+    if (!add_signal(DBUS_BUS_SESSION, NULL, DBUS_INTERFACE_PROPERTIES,
+                    DBUS_NOTIFY_SIGNAL, NULL, NULL, notify, NULL)) {
+        OHM_ERROR("Can't add signal handler 'notify'");
         exit(1);
     }
 
@@ -367,38 +283,21 @@ dbusif_new_session(DBusConnection *c, DBusMessage *msg, void *data)
 
 static int dbusif_watch_client(const char *id, int watchit)
 {
-    char       filter[1024];
-    DBusError  err;
-
-    filter_signal(filter, sizeof(filter),
-                  DBUS_ADMIN_INTERFACE, DBUS_ADMIN_INTERFACE,
-                  DBUS_NAME_OWNER_CHANGED_SIGNAL, DBUS_ADMIN_PATH,
-                  id, id, "",
-                  NULL);
-    
     /*
      * Notes:
-     *   We block when adding filters, to minimize (= eliminate ?) the time
-     *   window for the client to crash after it has let us know about itself
-     *   but before we managed to install the filter. According to the docs
-     *   we do not re-enter the main loop and all other messages than the
-     *   reply to AddMatch will get queued and processed once we're back in the
-     *   main loop. On the watch removal path we do not care about errors and
-     *   we do not want to block either.
+     *   The dbus plugin demultiplexes NameOwnerChanged for us. Adding the
+     *   watch installs the match rule right away, so the window for the
+     *   client to crash before we notice is as small as it used to be.
      */
 
     if (watchit) {
-        dbus_error_init(&err);
-        dbus_bus_add_match(sess_conn, filter, &err);
-
-        if (dbus_error_is_set(&err)) {
-            OHM_ERROR("Can't add match \"%s\": %s", filter, err.message);
-            dbus_error_free(&err);
+        if (!add_watch(DBUS_BUS_SESSION, id, name_changed, NULL)) {
+            OHM_ERROR("Can't watch client %s", id);
             return FALSE;
         }
     }
     else
-        dbus_bus_remove_match(sess_conn, filter, NULL);
+        del_watch(DBUS_BUS_SESSION, id, name_changed, NULL);
     
     return TRUE;
 }
@@ -897,45 +796,15 @@ static DBusHandlerResult info(DBusConnection *conn, DBusMessage *msg,
 }
 
 
-static DBusHandlerResult name_changed(DBusConnection *conn, DBusMessage *msg,
-                                      void *user_data)
+static void name_changed(const char *name, const char *before,
+                         const char *after, void *data)
 {
-    (void)conn;
-    (void)user_data;
-
-    char              *sender;
-    char              *before;
-    char              *after;
-    gboolean           success;
-    DBusHandlerResult  result;
-
-    success = dbus_message_is_signal(msg, DBUS_ADMIN_INTERFACE,
-                                     DBUS_NAME_OWNER_CHANGED_SIGNAL);
-
-    if (!success)
-        result = DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
-    else {
-#if 0
-        result = DBUS_HANDLER_RESULT_HANDLED;
-#else
-        result = DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
-#endif
-
-        success = dbus_message_get_args(msg, NULL,
-                                        DBUS_TYPE_STRING, &sender,
-                                        DBUS_TYPE_STRING, &before,
-                                        DBUS_TYPE_STRING, &after,
-                                        DBUS_TYPE_INVALID);
+    (void)data;
 
-        if (success && sender != NULL && before != NULL) {
-            if (!after || !strcmp(after, "")) {
-                OHM_DEBUG(DBG_DBUS, "client %s is gone", sender);
-                client_purge(sender);
-            }
-        }
+    if (before != NULL && (!after || !strcmp(after, ""))) {
+        OHM_DEBUG(DBG_DBUS, "client %s is gone", name);
+        client_purge((char *)name);
     }
-
-    return result;
 }
 
 
@@ -77,6 +77,32 @@ OHM_IMPORTABLE(int, update_factstore_entry, (char *name,
                                              fsif_field_t *selist,
                                              fsif_field_t *fldlist));
 
+OHM_IMPORTABLE(int, add_index, (char *factname, char *fldname));
+
+OHM_IMPORTABLE(int, begin_batch, (void));
+
+OHM_IMPORTABLE(int, commit_batch, (void));
+
+OHM_IMPORTABLE(int, register_schema, (char             *factname,
+                                      fsif_fldhandle_t *handles));
+
+OHM_IMPORTABLE(int, add_signal, (DBusBusType type,
+                                 const char *path, const char *interface,
+                                 const char *member, const char *signature,
+                                 const char *sender,
+                                 DBusObjectPathMessageFunction handler,
+                                 void *data));
+
+OHM_IMPORTABLE(int, add_watch, (DBusBusType type, const char *name,
+                                void (*handler)(const char *, const char *,
+                                                const char *, void *),
+                                void *data));
+
+OHM_IMPORTABLE(int, del_watch, (DBusBusType type, const char *name,
+                                void (*handler)(const char *, const char *,
+                                                const char *, void *),
+                                void *data));
+
 int fsif_add_field_watch(char                  *factname,
                          fsif_field_t          *selist,
                          char                  *fldname,
@@ -113,6 +139,26 @@ int fsif_update_factstore_entry(char *name,
     return update_factstore_entry(name, selist, fldlist);
 }
 
+int fsif_add_index(char *factname, char *fldname)
+{
+    return add_index(factname, fldname);
+}
+
+int fsif_begin_batch(void)
+{
+    return begin_batch();
+}
+
+int fsif_commit_batch(void)
+{
+    return commit_batch();
+}
+
+int fsif_register_schema(char *factname, fsif_fldhandle_t *handles)
+{
+    return register_schema(factname, handles);
+}
+
 static void timestamp_init(void)
 {
     char *signature;
@@ -154,13 +200,20 @@ static void plugin_destroy(OhmPlugin *plugin)
 #include "fsif.c"
 
 
-OHM_PLUGIN_REQUIRES_METHODS(playback, 6,
+OHM_PLUGIN_REQUIRES_METHODS(playback, 13,
     OHM_IMPORT("dres.resolve", resolve)
     OHM_IMPORT("fsif.add_field_watch", add_field_watch),
     OHM_IMPORT("fsif.get_field_by_entry", get_field_by_entry),
     OHM_IMPORT("fsif.add_factstore_entry", add_factstore_entry),
     OHM_IMPORT("fsif.update_factstore_entry", update_factstore_entry),
-    OHM_IMPORT("fsif.delete_factstore_entry", delete_factstore_entry)
+    OHM_IMPORT("fsif.delete_factstore_entry", delete_factstore_entry),
+    OHM_IMPORT("fsif.add_index", add_index),
+    OHM_IMPORT("fsif.begin_batch", begin_batch),
+    OHM_IMPORT("fsif.commit_batch", commit_batch),
+    OHM_IMPORT("fsif.register_schema", register_schema),
+    OHM_IMPORT("dbus.add_signal", add_signal),
+    OHM_IMPORT("dbus.add_watch", add_watch),
+    OHM_IMPORT("dbus.del_watch", del_watch)
 );
 
 OHM_PLUGIN_PROVIDES_METHODS(playback, 1,
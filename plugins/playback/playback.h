@@ -73,6 +73,14 @@ int fsif_update_factstore_entry(char *name,
                                 fsif_field_t *selist,
                                 fsif_field_t *fldlist);
 
+int fsif_add_index(char *factname, char *fldname);
+
+int fsif_begin_batch(void);
+
+int fsif_commit_batch(void);
+
+int fsif_register_schema(char *factname, fsif_fldhandle_t *handles);
+
 
 #endif /* __OHM_PLAYBACK_H__ */
 
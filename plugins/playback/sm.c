@@ -282,6 +282,23 @@ static char *class_to_group(char *);
 static void  schedule_deferred_request(client_t *);
 static void  schedule_fake_setprop_succeeded_event(client_t *, char *, char *);
 
+static fsif_fldhandle_t playback_handles[] = {
+    FSIF_HANDLE("dbusid", fldtype_string , 0),
+    FSIF_HANDLE("object", fldtype_string , 0),
+    FSIF_HANDLE_END
+};
+
+static fsif_fldhandle_t mute_handles[] = {
+    FSIF_HANDLE("mute"  , fldtype_string , FSIF_FLD_STATIC),
+    FSIF_HANDLE("forced", fldtype_integer, 0              ),
+    FSIF_HANDLE_END
+};
+
+#define H_DBUSID  (&playback_handles[0])
+#define H_OBJECT  (&playback_handles[1])
+#define H_MUTE    (&mute_handles[0])
+#define H_FORCED  (&mute_handles[1])
+
 
 static void sm_init(OhmPlugin *plugin)
 {
@@ -294,12 +311,20 @@ static void sm_init(OhmPlugin *plugin)
 
     verify_state_machine();
 
+    fsif_register_schema(FACTSTORE_PLAYBACK, playback_handles);
+    fsif_register_schema(FACTSTORE_MUTE    , mute_handles    );
+
     dbusif_add_hello_notification(fire_hello_signal_event);
     dbusif_add_goodbye_notification(fire_client_gone_event);
     dbusif_add_property_notification("State", fire_state_signal_event);
 
 #define ADD_FIELD_WATCH(f,s,n,cb) fsif_add_field_watch(f, s, n, cb,NULL)
 
+    /*
+     * setstate must be watched synchronously: the state machine mutes the
+     * 'setstate changed' event (rqsetst.evsrc = -1) only for the duration
+     * of its own resolve
+     */
     ADD_FIELD_WATCH(FACTSTORE_PLAYBACK , NULL  , "setstate", setstate_cb );
     ADD_FIELD_WATCH(FACTSTORE_PLAYBACK , NULL  , "playhint", playhint_cb );
     ADD_FIELD_WATCH(FACTSTORE_PRIVACY  , NULL  , "value"   , privacy_cb  );
@@ -995,11 +1020,13 @@ static int process_pbreq(sm_evdata_t *evdata, void *usrdata)
                 cl->pid    = pid    ? strdup(pid)    : NULL;
                 cl->stream = stream ? strdup(stream) : NULL;
 
+                fsif_begin_batch();
                 client_update_factstore_entry(cl, "pid", pid);
                 if (stream) {
                     client_update_factstore_entry(cl, "stream", stream);
                 }
                 client_update_factstore_entry(cl, "state", state);
+                fsif_commit_batch();
                 
                 dbusif_send_stream_info_to_pep("register", cl->group, pid,
                                                stream ? stream : "<unknown>");
@@ -1470,30 +1497,24 @@ static void mute_cb(fsif_entry_t *entry, char *name, fsif_field_t *fld,
     (void)fld;
     (void)usrdata;
 
-    fsif_value_t mute;
-    fsif_value_t forced;
+    const char *mute;
     int state = 0;
 
 
-    forced.integer = FALSE;
-    fsif_get_field_by_entry(entry, fldtype_integer, "forced", &forced);
+    if (fsif_get_integer(entry, H_FORCED, FALSE))
+        return;                   /* suppress notification for forced mutes */
     
-    if (forced.integer)           /* suppress notification for forced mutes */
-        return;
-    
-    fsif_get_field_by_entry(entry, fldtype_string, "mute", &mute);
-
-    if (mute.string == NULL) {
+    if ((mute = fsif_get_string(entry, H_MUTE)) == NULL) {
         OHM_ERROR("[%s] invalid field value '<null>'", __FUNCTION__);
         return;
     }
 
-    if (!strcmp(mute.string, "muted"))
+    if (!strcmp(mute, "muted"))
         state = 1;
-    else if (!strcmp(mute.string, "unmuted"))
+    else if (!strcmp(mute, "unmuted"))
         state = 0;
     else {
-        OHM_ERROR("[%s] invalid field value '%s'", __FUNCTION__, mute.string);
+        OHM_ERROR("[%s] invalid field value '%s'", __FUNCTION__, mute);
         return;
     }
 
@@ -1503,26 +1524,23 @@ static void mute_cb(fsif_entry_t *entry, char *name, fsif_field_t *fld,
 
 static client_t *find_client_by_fact(fsif_entry_t *entry)
 {
-    client_t     *cl;
-    fsif_value_t  dbusid;
-    fsif_value_t  object;
+    client_t   *cl;
+    const char *dbusid = fsif_get_string(entry, H_DBUSID);
+    const char *object = fsif_get_string(entry, H_OBJECT);
 
-    fsif_get_field_by_entry(entry, fldtype_string, "dbusid", &dbusid);
-    fsif_get_field_by_entry(entry, fldtype_string, "object", &object);
-
-    if (dbusid.string == NULL || *dbusid.string == '\0') {
+    if (dbusid == NULL || *dbusid == '\0') {
         OHM_ERROR("[%s] Can't find client: no dbusid", __FUNCTION__);
         return NULL;
     }
 
-    if (object.string == NULL || *object.string == '\0') {
+    if (object == NULL || *object == '\0') {
         OHM_ERROR("[%s] Can't find client: no object", __FUNCTION__);
         return NULL;
     }
 
-    if ((cl = client_find_by_dbus(dbusid.string, object.string)) == NULL) {
+    if ((cl = client_find_by_dbus((char *)dbusid, (char *)object)) == NULL) {
         OHM_ERROR("[%s] Can't find client for %s:%s",
-                  __FUNCTION__, dbusid.string, object.string);
+                  __FUNCTION__, dbusid, object);
         return NULL;
     }
 
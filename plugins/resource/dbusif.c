@@ -33,7 +33,6 @@ USA.
 #include "manager.h"
 
 typedef struct {
-    char                  *addr;
     dbusif_pid_query_cb_t  func;
     void                  *data;
 } query_t;
@@ -48,7 +47,7 @@ static resconn_t        *res_conn;       /* resource manager connection */
 static void system_bus_init(void);
 static void session_bus_init(const char *);
 static void res_conn_setup(DBusConnection *);
-static void pid_queried(DBusPendingCall *, void *);
+static void pid_queried(const char *, pid_t, void *);
 
 
 
@@ -168,50 +167,34 @@ DBusHandlerResult dbusif_session_notification(DBusConnection *conn,
 
 void dbusif_query_pid(char *addr, dbusif_pid_query_cb_t func, void *data)
 {
-    DBusConnection  *conn  = use_system_bus ? sys_conn : sess_conn;
-    query_t         *query = NULL;
-    DBusMessage     *msg;
-    DBusPendingCall *pend;
-    int              success;
+    DBusBusType  type = use_system_bus ? DBUS_BUS_SYSTEM : DBUS_BUS_SESSION;
+    query_t     *query;
+    pid_t        pid;
 
     if (!func)
         return;
 
-    do { /* not a loop */
-        if (!conn || !(query = malloc(sizeof(query_t))))
-            break;
+    /*
+     * Notes: the PIDs are cached by the dbus plugin, which also takes care
+     *   of sharing the query if the same peer is already being queried.
+     */
 
-        memset(query, 0, sizeof(query_t));
-        query->addr = strdup(addr);
+    if ((pid = dbusplugin_lookup_pid(type, addr)) != 0) {
+        OHM_DEBUG(DBG_DBUS, "PID of %s is %u (cached)", addr, pid);
+        func(pid, data);
+        return;
+    }
+
+    if ((query = malloc(sizeof(query_t))) != NULL) {
         query->func = func;
         query->data = data;
 
-        msg = dbus_message_new_method_call(DBUS_ADMIN_NAME,
-                                           DBUS_ADMIN_PATH,
-                                           DBUS_ADMIN_INTERFACE,
-                                           DBUS_QUERY_PID_METHOD);
-        if (!msg)
-            break;
-
-        success = dbus_message_append_args(msg,
-                                           DBUS_TYPE_STRING, &addr,
-                                           DBUS_TYPE_INVALID);
-
-        if (!success                                                    ||
-            !dbus_connection_send_with_reply(conn, msg, &pend, -1)      ||
-            !dbus_pending_call_set_notify(pend, pid_queried, query, NULL))
-            break;
-
-        dbus_message_unref(msg);
-
-        OHM_DEBUG(DBG_DBUS, "quering PID for address %s on %s bus",
-                  query->addr, use_system_bus ? "system" : "session");
-
-        return;
-    } while (0);
+        if (dbusplugin_query_pid(type, addr, pid_queried, query)) {
+            OHM_DEBUG(DBG_DBUS, "quering PID for address %s on %s bus",
+                      addr, use_system_bus ? "system" : "session");
+            return;
+        }
 
-    if (query) {
-        free(query->addr);
         free(query);
     }
 
@@ -325,63 +308,18 @@ static void res_conn_setup(DBusConnection *conn)
     resproto_set_handler(res_conn, RESMSG_VIDEO     , manager_video     );
 }
 
-static void pid_queried(DBusPendingCall *pend, void *data)
+static void pid_queried(const char *addr, pid_t pid, void *data)
 {
-    query_t       *query   = (query_t *)data;
-    int            success = FALSE;
-    dbus_uint32_t  pid     = 0;
-    const char    *error   = "";
-    DBusMessage   *reply   = NULL;
-    const char    *str;
-
-    do { /* not a loop */
-        if ((reply = dbus_pending_call_steal_reply(pend)) == NULL) {
-            error = "NoReplyMessage";
-            break;
-        }
-
-        if (dbus_message_get_type(reply) == DBUS_MESSAGE_TYPE_ERROR) {
-            if ((str = dbus_message_get_error_name(reply)) == NULL)
-                error = "UnknownError";
-            else {
-                for (error = str + strlen(str);  error > str;   error--) {
-                    if (*error == '.') {
-                        error++;
-                        break;
-                    }
-                }
-            }
-            break;
-        }
-
-
-        success = dbus_message_get_args(reply, NULL,
-                                        DBUS_TYPE_UINT32, &pid,
-                                        DBUS_TYPE_INVALID);
-
-        if (success)
-            error = "OK";
+    query_t *query = (query_t *)data;
 
-    } while(0);
-
-    if (query) {
-        if (success)
-            OHM_DEBUG(DBG_DBUS, "pid query succeeded: %s -> %u",
-                      query->addr, pid);
-        else
-            OHM_DEBUG(DBG_DBUS, "pid query for %s failed: %s",
-                      query->addr, error);
-
-        query->func(pid, query->data);
-
-        free(query->addr);
-        free(query);
-    }
+    if (pid)
+        OHM_DEBUG(DBG_DBUS, "pid query succeeded: %s -> %u", addr, pid);
+    else
+        OHM_DEBUG(DBG_DBUS, "pid query for %s failed", addr);
 
-    if (reply)
-        dbus_message_unref(reply);
+    query->func(pid, query->data);
 
-    dbus_pending_call_unref(pend);
+    free(query);
 }
 
 /* 
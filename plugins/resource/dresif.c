@@ -28,7 +28,7 @@ USA.
 #include "plugin.h"
 #include "dresif.h"
 #include "resource-set.h"
-#include "timestamp.h"
+#include "trace.h"
 
 #define DRESIF_VARTYPE(t)  (char *)(t)
 #define DRESIF_VARVALUE(v) (char *)(v)
@@ -93,9 +93,9 @@ int dresif_resource_request(uint32_t  manager_id,
 #endif
     vars[++i] = NULL;
 
-    timestamp_add("resource request -- resolving start");
+    TRACE(trace_resolve_start, manager_id, 0, 0, 0);
     status = resolve("resource_request", vars);
-    timestamp_add("resource request -- resolving end");
+    TRACE(trace_resolve_end, manager_id, status, 0, 0);
     
     if (status < 0) {
         OHM_DEBUG(DBG_DRES, "resolving resource_request for %s/%d "
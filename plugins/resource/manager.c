@@ -27,6 +27,7 @@ USA.
 #include <stdarg.h>
 #include <ctype.h>
 #include <errno.h>
+#include <sys/time.h>
 
 #include "plugin.h"
 #include "manager.h"
@@ -36,11 +37,41 @@ USA.
 #include "dbusif.h"
 #include "transaction.h"
 #include "auth.h"
+#include "trace.h"
 
 #define MAX_CREDS 16
 
-typedef struct reg_data_s {
+/*
+ * Registration pipeline. Pending registrations are kept in a doubly
+ * linked queue. The pid is cached per D-Bus peer: registrations of a
+ * peer that arrive while its pid is being queried wait for the same
+ * query instead of issuing their own, so N registrations from a process
+ * cost a single lookup. A peer is forgotten when it has neither pending
+ * registrations nor resource sets left. Authorization verdicts are not
+ * cached here, the auth plugin does that and knows when a process has
+ * changed its credentials.
+ */
+typedef enum {
+    query_none = 0,
+    query_pending,
+    query_done,
+} query_state_t;
+
+typedef struct reg_data_s  reg_data_t;
+typedef struct peer_s      peer_t;
+
+struct peer_s {
+    char              *name;
+    int                refcnt;          /* registrations + resource sets */
+    query_state_t      state;           /* of the pid query */
+    pid_t              pid;
+    reg_data_t        *waiting;         /* registrations waiting for pid */
+};
+
+struct reg_data_s {
     struct reg_data_s *next;
+    struct reg_data_s *prev;
+    struct reg_data_s *wait;            /* next waiting for the same query */
     int                canceled;
     int                authorize;
     resmsg_t          *msg;
@@ -49,7 +80,67 @@ typedef struct reg_data_s {
     pid_t              pid;
     char              *method;
     char              *arg;
-} reg_data_t;
+    peer_t            *peer;            /* NULL for the internal transport */
+};
+
+typedef struct {
+    reg_data_t        *first;
+    reg_data_t        *last;
+} reg_queue_t;
+
+/*
+ * Batched resolving. When enabled acquire, release and update requests
+ * are not resolved one by one but collected until the main loop goes
+ * idle (or the configured window expires) and resolved with a single
+ * resource_request. The policy evaluates all resource sets, so the one
+ * resolution produces the grants and advices for every collected set.
+ * The transactions of the collected requests are kept referenced until
+ * then, so that the replies carry the values of the batched resolution.
+ */
+/*
+ * Request priorities. Requests of urgent classes (eg. calls and alarms)
+ * are never held back: they are resolved immediately, together with
+ * whatever is waiting in the batches. Requests of background classes are
+ * deferred for a longer window and merged into a single resolution even
+ * when batching is otherwise disabled. The rest are batched as configured.
+ */
+typedef enum {
+    prio_urgent = 0,
+    prio_normal,
+    prio_background,
+} prio_t;
+
+typedef struct {
+    char               *klass;
+    prio_t              prio;
+    uint64_t            requests;       /* resolved requests */
+    uint64_t            batched;        /* of which were batched */
+    uint64_t            latency_total;  /* request to resolution, usecs */
+    uint64_t            latency_max;
+} class_stat_t;
+
+typedef struct batch_req_s {
+    struct batch_req_s *next;
+    uint32_t            manager_id;
+    uint32_t            txid;           /* referenced until resolved,
+                                           NO_TRANSACTION if deferred */
+    uint32_t            reqno;
+    int                 reply;          /* queue grant for always-reply */
+    char               *request;
+    class_stat_t       *stat;
+    struct timeval      queued;
+} batch_req_t;
+
+typedef struct {
+    int                 enabled;
+    unsigned int        window;         /* in ms, 0 for idle */
+    guint               srcid;
+    batch_req_t        *first;
+    batch_req_t       **last;
+} batch_t;
+
+#define DEFAULT_URGENT_CLASSES  "call,ringtone,alarm,emergency"
+#define DEFAULT_DEFER_WINDOW    100     /* ms */
 
 typedef void (*auth_request_cb_t)(int, char *, void *);
 
@@ -58,7 +149,12 @@ OHM_IMPORTABLE(int, auth_request, (char *id_type,  void *id,
                                    auth_request_cb_t callback, void *data));
 
 static uint32_t     trans_id;
-static reg_data_t  *reg_reqs;
+static int          traced;             /* request trace span is open */
+static reg_queue_t  reg_queue;
+static GHashTable  *peers;              /* peer name -> peer_t */
+static batch_t      batch    = { .last = &batch.first    };
+static batch_t      deferred = { .last = &deferred.first };
+static GHashTable  *class_stats;        /* class name -> class_stat_t */
 
 static void forced_auto_release(resource_set_t *);
 
@@ -76,10 +172,26 @@ static int  reg_request_create(resmsg_t *, resset_t *, void *);
 static void reg_request_destroy(reg_data_t *);
 static void reg_request_cancel(resset_t *);
 
+static peer_t *peer_ref(const char *);
+static void    peer_unref(peer_t *);
+static void    peer_unref_by_name(const char *);
+static void    peer_query_pid(reg_data_t *);
+static void    peer_pid_cb(pid_t, void *);
+
 static void transaction_start(resource_set_t *, resmsg_t *);
 static void transaction_end(resource_set_t *);
 static void transaction_complete(uint32_t *, int, uint32_t, void *);
 
+static void batch_init(OhmPlugin *);
+static int  resolve_request(resource_set_t *, char *, int);
+static void batch_flush(void);
+
+static void          class_init(OhmPlugin *);
+static class_stat_t *class_stat(const char *);
+static void          class_account(class_stat_t *, struct timeval *, int);
+static void          print_class_stat(gpointer, gpointer, gpointer);
+static batch_req_t  *batch_take(batch_t *);
+
 
 
 /*! \addtogroup pubif
@@ -106,16 +218,87 @@ void manager_init(OhmPlugin *plugin)
         exit(1);
     }
 
+    peers = g_hash_table_new(g_str_hash, g_str_equal);
+
+    /*
+     * These can't be deferred field watches. The grant and advice
+     * changes must be queued to the transaction of the resolve that made
+     * them and the request and block values are used by the very next
+     * client request, which may well be dispatched before an idle
+     * callback.
+     */
     ADD_FIELD_WATCH("granted", granted_cb);
     ADD_FIELD_WATCH("advice" , advice_cb );
     ADD_FIELD_WATCH("request", request_cb);
     ADD_FIELD_WATCH("block"  , block_cb  );
 
+    class_init(plugin);
+    batch_init(plugin);
+
     LEAVE;
 
 #undef ADD_FIELD_WATCH
 }
 
+void manager_exit(OhmPlugin *plugin)
+{
+    batch_req_t *list;
+    batch_req_t *req;
+
+    (void)plugin;
+
+    /* the policy might be gone already, drop what has not been resolved */
+    list = batch_take(&batch);
+
+    while ((req = list) != NULL) {
+        list = req->next;
+        transaction_unref(req->txid);
+        free(req);
+    }
+
+    list = batch_take(&deferred);
+
+    while ((req = list) != NULL) {
+        list = req->next;
+        transaction_unref(req->txid);
+        free(req);
+    }
+
+    if (DBG_MGR)
+        manager_print_class_stats(stdout);
+}
+
+void manager_print_class_stats(FILE *fp)
+{
+    fprintf(fp, "%-16s %-10s %10s %10s %12s %10s\n", "class", "priority",
+            "requests", "batched", "avg (us)", "max (us)");
+
+    if (class_stats != NULL)
+        g_hash_table_foreach(class_stats, print_class_stat, fp);
+}
+
+int manager_dump_class_stats(const char *path)
+{
+    FILE *fp;
+
+    if (path == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if ((fp = fopen(path, "w")) == NULL)
+        return -1;
+
+    manager_print_class_stats(fp);
+
+    if (fclose(fp) != 0)
+        return -1;
+
+    OHM_INFO("resource: class statistics written to %s", path);
+
+    return 0;
+}
+
 void manager_register(resmsg_t *msg, resset_t *resset, void *proto_data)
 {
     resource_set_dump_message(msg, resset, "from");
@@ -159,10 +342,15 @@ void manager_unregister(resmsg_t *msg, resset_t *resset, void *proto_data)
 
     reg_request_cancel(resset);
 
-    if (rs)
+    if (rs) {
+        if (resset->resconn->any.transp == RESPROTO_TRANSPORT_DBUS)
+            peer_unref_by_name(resset->peer);
+
         resource_set_destroy(resset);
+    }
 
     if (manager_id) {
+        batch_flush();
         dresif_resource_request(manager_id, client_name, client_id,
                                 "unregister");
     }
@@ -202,6 +390,7 @@ void manager_update(resmsg_t *msg, resset_t *resset, void *proto_data)
  /* uint32_t         reqno  = record->reqno; */
     int32_t          errcod = 0;
     const char      *errmsg = "OK";
+    int              batched = FALSE;
 
     resource_set_dump_message(msg, resset, "from");
 
@@ -238,18 +427,21 @@ void manager_update(resmsg_t *msg, resset_t *resset, void *proto_data)
 
     transaction_start(rs, msg);
 
+    fsif_begin_batch();
     resource_set_update_factstore(resset, update_flags);
     if (rs->request && !strcmp(rs->request, "acquire") &&
         rs->granted.client != 0)
         resource_set_update_factstore(resset, update_request);
+    fsif_commit_batch();
 
-    dresif_resource_request(rs->manager_id, resset->peer, resset->id, "update");
+    batched = resolve_request(rs, "update", TRUE);
 
  reply_message:
     OHM_DEBUG(DBG_MGR, "message replied with %d '%s'", errcod, errmsg);
     resproto_reply_message(resset, msg, proto_data, errcod, errmsg);
 
-    if (trans_id != NO_TRANSACTION && (resset->mode & RESMSG_MODE_ALWAYS_REPLY))
+    if (trans_id != NO_TRANSACTION && !batched &&
+        (resset->mode & RESMSG_MODE_ALWAYS_REPLY))
         resource_set_queue_change(rs, trans_id, rs->reqno, resource_set_granted);
 
     transaction_end(rs);
@@ -262,6 +454,7 @@ void manager_acquire(resmsg_t *msg, resset_t *resset, void *proto_data)
     int32_t         errcod = 0;
     const char     *errmsg = "OK";
     int             acquire;
+    int             batched = FALSE;
 
     resource_set_dump_message(msg, resset, "from");
 
@@ -291,8 +484,7 @@ void manager_acquire(resmsg_t *msg, resset_t *resset, void *proto_data)
 
         if (acquire) {
             resource_set_update_factstore(resset, update_request);
-            dresif_resource_request(rs->manager_id, resset->peer,
-                                    resset->id, "acquire");
+            batched = resolve_request(rs, "acquire", TRUE);
         }
     }
 
@@ -300,7 +492,8 @@ void manager_acquire(resmsg_t *msg, resset_t *resset, void *proto_data)
 
     resproto_reply_message(resset, msg, proto_data, errcod, errmsg);
 
-    if (rs && trans_id && (resset->mode & RESMSG_MODE_ALWAYS_REPLY)) {
+    if (rs && trans_id && !batched &&
+        (resset->mode & RESMSG_MODE_ALWAYS_REPLY)) {
         resource_set_queue_change(rs,trans_id,rs->reqno,resource_set_granted);
     }
 
@@ -314,6 +507,7 @@ void manager_release(resmsg_t *msg, resset_t *resset, void *proto_data)
     int32_t         errcod = 0;
     const char     *errmsg = "OK";
     int             release;
+    int             batched = FALSE;
 
     resource_set_dump_message(msg, resset, "from");
 
@@ -340,23 +534,28 @@ void manager_release(resmsg_t *msg, resset_t *resset, void *proto_data)
             release = FALSE;
         }
 
+        fsif_begin_batch();
+
         if (rs->block) {
             rs->block = 0;
             resource_set_update_factstore(resset, update_block);
         }
 
-        if (release) {
+        if (release)
             resource_set_update_factstore(resset, update_request);
-            dresif_resource_request(rs->manager_id, resset->peer,
-                                    resset->id, "release");
-        }
+
+        fsif_commit_batch();
+
+        if (release)
+            batched = resolve_request(rs, "release", TRUE);
     }
 
     OHM_DEBUG(DBG_MGR, "message replied with %d '%s'", errcod, errmsg);
 
     resproto_reply_message(resset, msg, proto_data, errcod, errmsg);
 
-    if (rs && trans_id && (resset->mode & RESMSG_MODE_ALWAYS_REPLY)) {
+    if (rs && trans_id && !batched &&
+        (resset->mode & RESMSG_MODE_ALWAYS_REPLY)) {
         resource_set_queue_change(rs,trans_id,rs->reqno,resource_set_granted);
     }
 
@@ -393,6 +592,7 @@ void manager_audio(resmsg_t *msg, resset_t *resset, void *proto_data)
                                         propnam, method,pattern);
 
         if (success) {
+            batch_flush();
             dresif_resource_request(rs->manager_id, resset->peer,
                                     resset->id, "audio");
         }
@@ -428,6 +628,7 @@ void manager_video(resmsg_t *msg, resset_t *resset, void *proto_data)
         success = resource_set_add_spec(resset, resource_video, pid);
 
         if (success) {
+            batch_flush();
             dresif_resource_request(rs->manager_id, resset->peer,
                                     resset->id, "video");
         }
@@ -462,11 +663,12 @@ static void forced_auto_release(resource_set_t *rs)
             rs->request = strdup("release");
             rs->block   = 0;
 
+            fsif_begin_batch();
             resource_set_update_factstore(resset, update_block);
             resource_set_update_factstore(resset, update_request);
+            fsif_commit_batch();
 
-            dresif_resource_request(rs->manager_id, resset->peer,
-                                    resset->id, "release");
+            resolve_request(rs, "release", FALSE);
 
             transaction_end(rs);
         }
@@ -565,6 +767,11 @@ static void register_cb(int32_t errcod, reg_data_t *regreq)
         goto reply_message;
     }
 
+    if (regreq->peer != NULL)
+        regreq->peer->refcnt++;
+
+    batch_flush();
+
     transaction_start(rs, msg);
     dresif_resource_request(rs->manager_id, resset->peer, resset->id, "register");
 
@@ -737,14 +944,10 @@ static int reg_request_create(resmsg_t *msg,resset_t *resset,void *proto_data)
     resconn_t   *resconn = resset->resconn;
     resmsg_t    *msgcopy;
     reg_data_t  *regreq;
-    reg_data_t  *last;
     char        *method;
     char        *arg;
     int          success = FALSE;
     
-    for (last = (reg_data_t *)&reg_reqs;   last->next;   last = last->next)
-        ;
-
     if ((msgcopy = malloc(sizeof(resmsg_t)))   != NULL &&
         (regreq  = malloc(sizeof(reg_data_t))) != NULL    )
     {
@@ -755,8 +958,11 @@ static int reg_request_create(resmsg_t *msg,resset_t *resset,void *proto_data)
         regreq->resset     = resset;
         regreq->proto_data = proto_data;
         
-        last->next = regreq;
-        
+        if ((regreq->prev = reg_queue.last) != NULL)
+            reg_queue.last->next = regreq;
+        else
+            reg_queue.first = regreq;
+        reg_queue.last = regreq;
 
         switch (resconn->any.transp) {
 
@@ -778,8 +984,10 @@ static int reg_request_create(resmsg_t *msg,resset_t *resset,void *proto_data)
                 else if (!method || !arg) {
                     OHM_DEBUG(DBG_AUTH, "applying default policies");
                     
-                    if (auth_get_default_policy() == auth_accept)
-                        dbusif_query_pid(resset->peer, pid_cb, regreq);
+                    if (auth_get_default_policy() == auth_accept) {
+                        regreq->peer = peer_ref(resset->peer);
+                        peer_query_pid(regreq);
+                    }
                     else
                         authorize_cb(FALSE, "not authorized", regreq);
                 }
@@ -788,8 +996,9 @@ static int reg_request_create(resmsg_t *msg,resset_t *resset,void *proto_data)
                         regreq->method    = strdup(method);
                         regreq->arg       = strdup(arg);
                         regreq->authorize = TRUE;
+                        regreq->peer      = peer_ref(resset->peer);
 
-                        dbusif_query_pid(resset->peer, pid_cb, regreq);
+                        peer_query_pid(regreq);
                     }
                     else {
                         OHM_DEBUG(DBG_AUTH, "unsupported auth method '%s'",
@@ -818,25 +1027,34 @@ static int reg_request_create(resmsg_t *msg,resset_t *resset,void *proto_data)
 
         } /* switch transp */
     }
+    else {
+        free(msgcopy);
+        errno = ENOMEM;
+    }
 
     return success;
 }
 
 static void reg_request_destroy(reg_data_t *regreq)
 {
-    reg_data_t *prev;
-
     if (regreq != NULL) {
-        for (prev = (reg_data_t *)&reg_reqs;  prev->next;  prev = prev->next) {
-            if (prev->next == regreq) {
-                prev->next = regreq->next;
-                free(regreq->msg);
-                free(regreq->method);
-                free(regreq->arg);
-                free(regreq);
-                return;
-            }
-        }
+        if (regreq->prev != NULL)
+            regreq->prev->next = regreq->next;
+        else
+            reg_queue.first = regreq->next;
+
+        if (regreq->next != NULL)
+            regreq->next->prev = regreq->prev;
+        else
+            reg_queue.last = regreq->prev;
+
+        if (regreq->peer != NULL)
+            peer_unref(regreq->peer);
+
+        free(regreq->msg);
+        free(regreq->method);
+        free(regreq->arg);
+        free(regreq);
     }
 }
 
@@ -844,7 +1062,7 @@ static void reg_request_cancel(resset_t *resset)
 {
     reg_data_t *regreq;
 
-    for (regreq = reg_reqs;   regreq;   regreq = regreq->next) {
+    for (regreq = reg_queue.first;   regreq;   regreq = regreq->next) {
         if (regreq->resset == resset) {
             regreq->canceled = TRUE;
             regreq->resset   = NULL;
@@ -852,16 +1070,132 @@ static void reg_request_cancel(resset_t *resset)
     }
 }
 
+static peer_t *peer_ref(const char *name)
+{
+    peer_t *peer;
+
+    if ((peer = g_hash_table_lookup(peers, name)) == NULL) {
+        if ((peer = malloc(sizeof(peer_t))) == NULL)
+            return NULL;
+
+        memset(peer, 0, sizeof(peer_t));
+        peer->name = strdup(name);
+
+        g_hash_table_insert(peers, peer->name, peer);
+
+        OHM_DEBUG(DBG_AUTH, "peer %s added to the cache", name);
+    }
+
+    peer->refcnt++;
+
+    return peer;
+}
+
+static void peer_unref(peer_t *peer)
+{
+    if (--peer->refcnt > 0)
+        return;
+
+    OHM_DEBUG(DBG_AUTH, "peer %s removed from the cache", peer->name);
+
+    g_hash_table_remove(peers, peer->name);
+
+    free(peer->name);
+    free(peer);
+}
+
+static void peer_unref_by_name(const char *name)
+{
+    peer_t *peer;
+
+    if (name != NULL && (peer = g_hash_table_lookup(peers, name)) != NULL)
+        peer_unref(peer);
+}
+
+/* waiters are pushed to the head, hand them out in arrival order */
+static reg_data_t *take_waiting(reg_data_t **list)
+{
+    reg_data_t *regreq, *next, *reversed;
+
+    for (regreq = *list, reversed = NULL;  regreq;  regreq = next) {
+        next = regreq->wait;
+        regreq->wait = reversed;
+        reversed = regreq;
+    }
+
+    *list = NULL;
+
+    return reversed;
+}
+
+static void peer_query_pid(reg_data_t *regreq)
+{
+    peer_t *peer = regreq->peer;
+
+    if (peer == NULL) {
+        register_cb(ENOMEM, regreq);
+        return;
+    }
+
+    if (peer->state == query_done) {
+        OHM_DEBUG(DBG_AUTH, "PID of %s is %u (peer cache)",
+                  peer->name, peer->pid);
+        pid_cb(peer->pid, regreq);
+        return;
+    }
+
+    regreq->wait  = peer->waiting;
+    peer->waiting = regreq;
+
+    if (peer->state == query_none) {
+        peer->state = query_pending;
+        dbusif_query_pid(peer->name, peer_pid_cb, peer);
+    }
+}
+
+static void peer_pid_cb(pid_t pid, void *data)
+{
+    peer_t     *peer = (peer_t *)data;
+    reg_data_t *regreq, *next;
+
+    /* a failed query is not cached, the next registration retries */
+    peer->pid   = pid;
+    peer->state = pid ? query_done : query_none;
+
+    peer->refcnt++;
+
+    for (regreq = take_waiting(&peer->waiting);  regreq;  regreq = next) {
+        next = regreq->wait;
+        regreq->wait = NULL;
+
+        pid_cb(pid, regreq);
+    }
+
+    peer_unref(peer);
+}
+
 static void transaction_start(resource_set_t *rs, resmsg_t *msg)
 {
     trans_id = transaction_create(transaction_complete, NULL);
 
     if (trans_id != NO_TRANSACTION && rs && msg)
         rs->reqno = msg->any.reqno;
+
+    if (rs && msg) {
+        TRACE(trace_request, rs->manager_id, trans_id, msg->type,
+              msg->any.reqno);
+        traced = TRUE;
+    }
 }
 
 static void transaction_end(resource_set_t *rs)
 {
+    /* close only what was opened, the trace spans have to nest */
+    if (rs != NULL && traced) {
+        TRACE(trace_request_done, rs->manager_id, trans_id, 0, 0);
+        traced = FALSE;
+    }
+
     if (trans_id != NO_TRANSACTION) {
         transaction_unref(trans_id);
         trans_id = NO_TRANSACTION;
@@ -881,6 +1215,339 @@ static void transaction_complete(uint32_t *ids,int nid,uint32_t txid,void *ud)
         resource_set_send_queued_changes(ids[i], txid);
 }
 
+static void batch_init(OhmPlugin *plugin)
+{
+    const char *param;
+    char       *end;
+
+    deferred.enabled = TRUE;
+    deferred.window  = DEFAULT_DEFER_WINDOW;
+
+    if ((param = ohm_plugin_get_param(plugin, "background-window")) != NULL) {
+        deferred.window = strtoul(param, &end, 10);
+
+        if (*end != '\0') {
+            OHM_ERROR("resource: invalid background-window value '%s'",param);
+            deferred.window = DEFAULT_DEFER_WINDOW;
+        }
+    }
+
+    param = ohm_plugin_get_param(plugin, "request-batching");
+
+    if (param == NULL || !strcmp(param, "no"))
+        return;
+
+    if (!strcmp(param, "idle")) {
+        batch.enabled = TRUE;
+        batch.window  = 0;
+    }
+    else {
+        batch.window = strtoul(param, &end, 10);
+
+        if (*end == '\0')
+            batch.enabled = TRUE;
+        else {
+            OHM_ERROR("resource: invalid request-batching value '%s'", param);
+            return;
+        }
+    }
+
+    OHM_INFO("resource: request batching enabled (%s%u ms window)",
+             batch.window ? "" : "idle, ", batch.window);
+}
+
+static batch_req_t *batch_take(batch_t *b)
+{
+    batch_req_t *list;
+
+    if (b->srcid) {
+        g_source_remove(b->srcid);
+        b->srcid = 0;
+    }
+
+    list = b->first;
+
+    b->first = NULL;
+    b->last  = &b->first;
+
+    return list;
+}
+
+static void batch_resolve(batch_req_t *list)
+{
+    batch_req_t    *req;
+    batch_req_t    *last;
+    resource_set_t *rs;
+    resset_t       *resset;
+    uint32_t        saved_id;
+    int             n;
+
+    if (list == NULL)
+        return;
+
+    /*
+     * the grant and advice changes of the resolution are collected to a
+     * transaction of their own; the reqno's of the batched requests are
+     * restored so that the watches can associate the grants with them
+     */
+    saved_id = trans_id;
+    trans_id = transaction_create(transaction_complete, NULL);
+
+    for (req = list, last = NULL, n = 0;   req != NULL;   req = req->next) {
+        if ((rs = resource_set_find_by_id(req->manager_id)) != NULL) {
+            rs->reqno = req->reqno;
+            last      = req;
+            n++;
+
+            TRACE(trace_batch_member, req->manager_id, req->txid,
+                  trans_id, 0);
+        }
+    }
+
+    if (last != NULL) {
+        rs     = resource_set_find_by_id(last->manager_id);
+        resset = rs->resset;
+
+        TRACE(trace_batch, trans_id, n, 0, 0);
+
+        OHM_DEBUG(DBG_MGR, "resolving %d batched request%s", n, n>1?"s":"");
+
+        dresif_resource_request(rs->manager_id, resset->peer, resset->id,
+                                last->request);
+    }
+
+    while ((req = list) != NULL) {
+        list = req->next;
+
+        if ((rs = resource_set_find_by_id(req->manager_id)) != NULL) {
+            if (req->reply) {
+                resource_set_queue_change(rs,
+                                          req->txid != NO_TRANSACTION ?
+                                          req->txid : trans_id,
+                                          req->reqno, resource_set_granted);
+            }
+            rs->reqno = 0;
+        }
+
+        class_account(req->stat, &req->queued, TRUE);
+
+        if (req->txid != NO_TRANSACTION)
+            transaction_unref(req->txid);
+        free(req);
+    }
+
+    if (trans_id != NO_TRANSACTION)
+        transaction_unref(trans_id);
+
+    trans_id = saved_id;
+}
+
+static gboolean batch_cb(gpointer data)
+{
+    batch_t *b = (batch_t *)data;
+
+    b->srcid = 0;
+    batch_resolve(batch_take(b));
+
+    return FALSE;
+}
+
+static int resolve_request(resource_set_t *rs, char *request, int reply)
+{
+    resset_t       *resset = rs->resset;
+    class_stat_t   *stat   = class_stat(resset->klass);
+    batch_t        *b;
+    batch_req_t    *req;
+    struct timeval  start;
+
+    gettimeofday(&start, NULL);
+
+    switch (stat ? stat->prio : prio_normal) {
+    case prio_urgent:
+        /* don't wait for the batches, take them along if there are any */
+        b = (batch.first || deferred.first) ? &batch : NULL;
+        break;
+    case prio_background:
+        b = &deferred;
+        break;
+    default:
+        b = batch.enabled ? &batch : NULL;
+        break;
+    }
+
+    if (b == NULL || trans_id == NO_TRANSACTION ||
+        (req = malloc(sizeof(batch_req_t))) == NULL)
+    {
+        dresif_resource_request(rs->manager_id, resset->peer, resset->id,
+                                request);
+        class_account(stat, &start, FALSE);
+        return FALSE;
+    }
+
+    memset(req, 0, sizeof(batch_req_t));
+    req->manager_id = rs->manager_id;
+    req->reqno      = rs->reqno;
+    req->reply      = reply && (resset->mode & RESMSG_MODE_ALWAYS_REPLY);
+    req->request    = request;
+    req->stat       = stat;
+    req->queued     = start;
+
+    /*
+     * Transactions complete in order, so one held for the whole defer
+     * window would hold back every later grant, urgent ones included.
+     * The replies of deferred requests go with the transaction of the
+     * batch instead.
+     */
+    if (b == &deferred)
+        req->txid = NO_TRANSACTION;
+    else {
+        req->txid = trans_id;
+        transaction_ref(trans_id);
+    }
+
+    *b->last = req;
+    b->last  = &req->next;
+
+    TRACE(trace_queued, rs->manager_id, trans_id, b == &deferred ? 2 : 1, 0);
+
+    if (stat && stat->prio == prio_urgent) {
+        OHM_DEBUG(DBG_MGR, "%s request of %s/%u (manager id %u) flushes the "
+                  "batches", request, resset->peer, resset->id,rs->manager_id);
+        batch_flush();
+        return TRUE;
+    }
+
+    if (!b->srcid) {
+        if (b->window)
+            b->srcid = g_timeout_add(b->window, batch_cb, b);
+        else
+            b->srcid = g_idle_add(batch_cb, b);
+    }
+
+    OHM_DEBUG(DBG_MGR, "%s request of %s/%u (manager id %u) %s",
+              request, resset->peer, resset->id, rs->manager_id,
+              b == &deferred ? "deferred" : "batched");
+
+    return TRUE;
+}
+
+/* resolve everything pending, the deferred requests as well */
+static void batch_flush(void)
+{
+    batch_req_t  *list;
+    batch_req_t **tail;
+
+    list = batch_take(&batch);
+
+    for (tail = &list;  *tail != NULL;  tail = &(*tail)->next)
+        ;
+
+    *tail = batch_take(&deferred);
+
+    batch_resolve(list);
+}
+
+static void class_init(OhmPlugin *plugin)
+{
+    static struct {
+        const char *param;
+        const char *defval;
+        prio_t      prio;
+    } lists[] = {
+        { "urgent-classes"    , DEFAULT_URGENT_CLASSES, prio_urgent     },
+        { "background-classes", NULL                  , prio_background },
+    };
+
+    const char   *param;
+    char          buf[512];
+    char         *klass, *saveptr;
+    class_stat_t *stat;
+    unsigned int  i;
+
+    class_stats = g_hash_table_new(g_str_hash, g_str_equal);
+
+    for (i = 0;  i < sizeof(lists) / sizeof(lists[0]);  i++) {
+        if ((param = ohm_plugin_get_param(plugin, lists[i].param)) == NULL &&
+            (param = lists[i].defval) == NULL)
+            continue;
+
+        strncpy(buf, param, sizeof(buf));
+        buf[sizeof(buf)-1] = '\0';
+
+        for (klass = strtok_r(buf, ", ", &saveptr);
+             klass != NULL;
+             klass = strtok_r(NULL, ", ", &saveptr))
+        {
+            if ((stat = class_stat(klass)) != NULL)
+                stat->prio = lists[i].prio;
+        }
+
+        OHM_INFO("resource: %s: %s", lists[i].param, param);
+    }
+}
+
+static class_stat_t *class_stat(const char *klass)
+{
+    class_stat_t *stat;
+
+    if (klass == NULL)
+        return NULL;
+
+    if ((stat = g_hash_table_lookup(class_stats, klass)) == NULL) {
+        if ((stat = malloc(sizeof(class_stat_t))) != NULL) {
+            memset(stat, 0, sizeof(class_stat_t));
+            stat->klass = strdup(klass);
+            stat->prio  = prio_normal;
+
+            g_hash_table_insert(class_stats, stat->klass, stat);
+        }
+    }
+
+    return stat;
+}
+
+static void class_account(class_stat_t *stat, struct timeval *start,
+                          int batched)
+{
+    struct timeval now;
+    uint64_t       usecs;
+
+    if (stat == NULL)
+        return;
+
+    gettimeofday(&now, NULL);
+
+    usecs = (uint64_t)(now.tv_sec - start->tv_sec) * 1000000ULL +
+            (now.tv_usec - start->tv_usec);
+
+    stat->requests++;
+    stat->latency_total += usecs;
+
+    if (batched)
+        stat->batched++;
+
+    if (usecs > stat->latency_max)
+        stat->latency_max = usecs;
+}
+
+static void print_class_stat(gpointer key, gpointer value, gpointer data)
+{
+    static const char *prio_names[] = { "urgent", "normal", "background" };
+
+    class_stat_t *stat = (class_stat_t *)value;
+    FILE         *fp   = (FILE *)data;
+
+    (void)key;
+
+    fprintf(fp, "%-16s %-10s %10llu %10llu %12.1f %10llu\n",
+            stat->klass, prio_names[stat->prio],
+            (unsigned long long)stat->requests,
+            (unsigned long long)stat->batched,
+            stat->requests ?
+                (double)stat->latency_total / stat->requests : 0.0,
+            (unsigned long long)stat->latency_max);
+}
+
 
 /* 
  * Local Variables:
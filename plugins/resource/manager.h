@@ -21,12 +21,15 @@ USA.
 #ifndef __OHM_RESOURCE_MANAGER_H__
 #define __OHM_RESOURCE_MANAGER_H__
 
+#include <stdio.h>
+
 #include <res-conn.h>
 
 /* hack to avoid multiple includes */
 typedef struct _OhmPlugin OhmPlugin;
 
 void manager_init(OhmPlugin *);
+void manager_exit(OhmPlugin *);
 
 void manager_register(resmsg_t *, resset_t *, void *);
 void manager_unregister(resmsg_t *, resset_t *, void *);
@@ -36,6 +39,9 @@ void manager_release(resmsg_t *, resset_t *, void *);
 void manager_audio(resmsg_t *, resset_t *, void *);
 void manager_video(resmsg_t *, resset_t *, void *);
 
+void manager_print_class_stats(FILE *);
+int  manager_dump_class_stats(const char *);
+
 #endif	/* __OHM_RESOURCE_MANAGER_H__ */
 
 /* 
@@ -28,7 +28,7 @@ USA.
 #include <ohm/ohm-plugin-dbus.h>
 
 #include "plugin.h"
-#include "timestamp.h"
+#include "trace.h"
 #include "dbusif.h"
 #include "internalif.h"
 #include "manager.h"
@@ -46,6 +46,12 @@ static const char *OHM_VAR(internalif_timer_add,_SIGNATURE) =
 static const char *OHM_VAR(internalif_timer_del,_SIGNATURE) =
     "void(void *timer)";
 
+static const char *OHM_VAR(trace_dump,_SIGNATURE) =
+    "int(const char *path)";
+
+static const char *OHM_VAR(manager_dump_class_stats,_SIGNATURE) =
+    "int(const char *path)";
+
 
 int DBG_INIT, DBG_MGR, DBG_SET, DBG_DBUS, DBG_INTERNAL;
 int DBG_DRES, DBG_FS, DBG_QUE, DBG_TRANSACT, DBG_MEDIA, DBG_AUTH;
@@ -88,6 +94,28 @@ OHM_IMPORTABLE(int, update_factstore_entry, (char *name,
                                              fsif_field_t *selist,
                                              fsif_field_t *fldlist));
 
+OHM_IMPORTABLE(int, add_index, (char *factname, char *fldname));
+
+OHM_IMPORTABLE(int, begin_batch, (void));
+
+OHM_IMPORTABLE(int, commit_batch, (void));
+
+OHM_IMPORTABLE(fsif_entry_t *, get_entry, (char         *name,
+                                           fsif_field_t *selist));
+
+OHM_IMPORTABLE(int, register_schema, (char             *factname,
+                                      fsif_fldhandle_t *handles));
+
+OHM_IMPORTABLE(void, set_field_by_handle, (fsif_entry_t     *entry,
+                                           fsif_fldhandle_t *handle,
+                                           fsif_value_t     *vptr));
+
+OHM_IMPORTABLE(pid_t, lookup_pid, (DBusBusType type, const char *name));
+
+OHM_IMPORTABLE(int, query_pid, (DBusBusType type, const char *name,
+                                void (*cb)(const char *, pid_t, void *),
+                                void *data));
+
 int fsif_add_field_watch(char                  *factname,
                          fsif_field_t          *selist,
                          char                  *fldname,
@@ -124,6 +152,49 @@ int fsif_update_factstore_entry(char *name,
     return update_factstore_entry(name, selist, fldlist);
 }
 
+int fsif_add_index(char *factname, char *fldname)
+{
+    return add_index(factname, fldname);
+}
+
+int fsif_begin_batch(void)
+{
+    return begin_batch();
+}
+
+int fsif_commit_batch(void)
+{
+    return commit_batch();
+}
+
+fsif_entry_t *fsif_get_entry(char *name, fsif_field_t *selist)
+{
+    return get_entry(name, selist);
+}
+
+int fsif_register_schema(char *factname, fsif_fldhandle_t *handles)
+{
+    return register_schema(factname, handles);
+}
+
+void fsif_set_field_by_handle(fsif_entry_t     *entry,
+                              fsif_fldhandle_t *handle,
+                              fsif_value_t     *vptr)
+{
+    set_field_by_handle(entry, handle, vptr);
+}
+
+pid_t dbusplugin_lookup_pid(DBusBusType type, const char *name)
+{
+    return lookup_pid(type, name);
+}
+
+int dbusplugin_query_pid(DBusBusType type, const char *name,
+                         void (*cb)(const char *, pid_t, void *), void *data)
+{
+    return query_pid(type, name, cb, data);
+}
+
 
 void plugin_print_timestamp(const char *function, const char *phase)
 {
@@ -149,7 +220,7 @@ static void plugin_init(OhmPlugin *plugin)
 
     ENTER;
 
-    timestamp_init(plugin);
+    trace_init(plugin);
     dbusif_init(plugin);
     ruleif_init(plugin);
     internalif_init(plugin);
@@ -170,7 +241,9 @@ static void plugin_init(OhmPlugin *plugin)
 
 static void plugin_destroy(OhmPlugin *plugin)
 {
+    manager_exit(plugin);
     auth_exit(plugin);
+    trace_exit(plugin);
 }
 
 
@@ -198,18 +271,28 @@ OHM_PLUGIN_DBUS_SIGNALS(
 );
 
 
-OHM_PLUGIN_REQUIRES_METHODS(resource, 5,
+OHM_PLUGIN_REQUIRES_METHODS(resource, 13,
     OHM_IMPORT("fsif.add_field_watch", add_field_watch),
     OHM_IMPORT("fsif.get_field_by_entry", get_field_by_entry),
     OHM_IMPORT("fsif.add_factstore_entry", add_factstore_entry),
     OHM_IMPORT("fsif.update_factstore_entry", update_factstore_entry),
-    OHM_IMPORT("fsif.delete_factstore_entry", delete_factstore_entry)
+    OHM_IMPORT("fsif.delete_factstore_entry", delete_factstore_entry),
+    OHM_IMPORT("fsif.add_index", add_index),
+    OHM_IMPORT("fsif.begin_batch", begin_batch),
+    OHM_IMPORT("fsif.commit_batch", commit_batch),
+    OHM_IMPORT("fsif.get_entry", get_entry),
+    OHM_IMPORT("fsif.register_schema", register_schema),
+    OHM_IMPORT("fsif.set_field_by_handle", set_field_by_handle),
+    OHM_IMPORT("dbus.lookup_pid", lookup_pid),
+    OHM_IMPORT("dbus.query_pid", query_pid)
 );
 
 
-OHM_PLUGIN_PROVIDES_METHODS(resource, 2,
+OHM_PLUGIN_PROVIDES_METHODS(resource, 4,
     OHM_EXPORT(internalif_timer_add, "restimer_add"),
-    OHM_EXPORT(internalif_timer_del, "restimer_del")
+    OHM_EXPORT(internalif_timer_del, "restimer_del"),
+    OHM_EXPORT(trace_dump, "trace_dump"),
+    OHM_EXPORT(manager_dump_class_stats, "class_stats")
 );
 
 
@@ -24,6 +24,7 @@ USA.
 #include <glib.h>
 #include <glib-object.h>
 #include <gmodule.h>
+#include <dbus/dbus.h>
 #include <ohm/ohm-plugin.h>
 #include <ohm/ohm-plugin-log.h>
 #include <ohm/ohm-plugin-debug.h>
@@ -78,6 +79,26 @@ int fsif_update_factstore_entry(char *name,
                                 fsif_field_t *selist,
                                 fsif_field_t *fldlist);
 
+int fsif_add_index(char *factname, char *fldname);
+
+int fsif_begin_batch(void);
+
+int fsif_commit_batch(void);
+
+fsif_entry_t *fsif_get_entry(char *name, fsif_field_t *selist);
+
+int fsif_register_schema(char *factname, fsif_fldhandle_t *handles);
+
+void fsif_set_field_by_handle(fsif_entry_t     *entry,
+                              fsif_fldhandle_t *handle,
+                              fsif_value_t     *vptr);
+
+/* From dbus plugin. */
+pid_t dbusplugin_lookup_pid(DBusBusType type, const char *name);
+
+int dbusplugin_query_pid(DBusBusType type, const char *name,
+                         void (*cb)(const char *, pid_t, void *), void *data);
+
 /*
 static void plugin_init(OhmPlugin *);
 static void plugin_destroy(OhmPlugin *);
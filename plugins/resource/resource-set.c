@@ -30,11 +30,7 @@ USA.
 #include "plugin.h"
 #include "resource-spec.h"
 #include "transaction.h"
-
-#define HASH_BITS      8
-#define HASH_DIM       (1 << HASH_BITS)
-#define HASH_MASK      (HASH_DIM - 1)
-#define HASH_INDEX(i)  ((i) & HASH_MASK)
+#include "trace.h"
 
 #define INTEGER_FIELD(n,v) { fldtype_integer, n, .value.integer = v }
 #define STRING_FIELD(n,v)  { fldtype_string , n, .value.string  = v ? v : "" }
@@ -42,7 +38,23 @@ USA.
 
 #define SELIST_DIM  2
 
-static resource_set_t  *hash_table[HASH_DIM];
+static GHashTable      *hash_table;      /* manager_id -> resource_set_t */
+static GQuark           fact_quark;      /* resource_set_t of an OhmFact */
+
+enum {
+    H_MANAGER_ID = 0,
+    H_REQUEST,
+    H_REQNO,
+    H_BLOCK,
+};
+
+static fsif_fldhandle_t handles[] = {
+    FSIF_HANDLE("manager_id", fldtype_integer, 0              ),
+    FSIF_HANDLE("request"   , fldtype_string , FSIF_FLD_STATIC),
+    FSIF_HANDLE("reqno"     , fldtype_integer, 0              ),
+    FSIF_HANDLE("block"     , fldtype_integer, 0              ),
+    FSIF_HANDLE_END
+};
 
 static gboolean idle_task(gpointer);
 
@@ -58,6 +70,7 @@ static int update_factstore_request(resource_set_t *);
 static int update_factstore_block(resource_set_t *);
 static int update_factstore_audio(resource_set_t *, resource_audio_stream_t *);
 static int update_factstore_video(resource_set_t *, resource_video_stream_t *);
+static fsif_entry_t *factstore_entry(resource_set_t *);
 
 static void add_to_hash_table(resource_set_t *);
 static void delete_from_hash_table(resource_set_t *);
@@ -75,6 +88,19 @@ void resource_set_init(OhmPlugin *plugin)
 
     ENTER;
 
+    hash_table = g_hash_table_new(g_direct_hash, g_direct_equal);
+    fact_quark = g_quark_from_static_string("resource_set");
+
+    if (!fsif_add_index(FACTSTORE_RESOURCE_SET, "manager_id")) {
+        OHM_ERROR("resource: failed to index %s by manager_id",
+                  FACTSTORE_RESOURCE_SET);
+    }
+
+    if (!fsif_register_schema(FACTSTORE_RESOURCE_SET, handles)) {
+        OHM_ERROR("resource: failed to register field handles for %s",
+                  FACTSTORE_RESOURCE_SET);
+    }
+
     LEAVE;
 }
 
@@ -313,24 +339,37 @@ int resource_set_add_idle_task(resource_set_t *rs, resource_set_task_t task)
 
 resource_set_t *resource_set_find(fsif_entry_t *entry)
 {
-    fsif_value_t manager_id;
-    resource_set_t *rs = NULL;
+    uint32_t        manager_id;
+    resource_set_t *rs;
     
-    manager_id.integer = INVALID_MANAGER_ID;
-    fsif_get_field_by_entry(entry, fldtype_integer, "manager_id", &manager_id);
+    /* the facts we created carry their resource set */
+    if ((rs = g_object_get_qdata(G_OBJECT(entry), fact_quark)) != NULL)
+        return rs;
+
+    manager_id = fsif_get_integer(entry, &handles[H_MANAGER_ID],
+                                  INVALID_MANAGER_ID);
 
-    if (manager_id.integer == INVALID_MANAGER_ID)
+    if (manager_id == INVALID_MANAGER_ID)
         OHM_DEBUG(DBG_FS, "failed to get manager_id"); 
     else  {
-        if ((rs = find_in_hash_table(manager_id.integer)) == NULL) {
+        if ((rs = find_in_hash_table(manager_id)) == NULL) {
             OHM_DEBUG(DBG_SET, "can't find resource set with manager_id %u",
-                      manager_id.integer);
+                      manager_id);
+        }
+        else {
+            /* the fact was recreated behind our back */
+            g_object_set_qdata(G_OBJECT(entry), fact_quark, rs);
         }
     }
 
     return rs;
 }
 
+resource_set_t *resource_set_find_by_id(uint32_t manager_id)
+{
+    return find_in_hash_table(manager_id);
+}
+
 void resource_set_dump_message(resmsg_t *msg,resset_t *resset,const char *dir)
 {
     resconn_t *rconn = resset->resconn;
@@ -420,6 +459,7 @@ static void enqueue_send_request(resource_set_t          *rs,
     resource_set_qhead_t  *qhead;
     resource_set_queue_t  *qentry;
     char                   buf[128];
+    char                   buf2[128];
 
     if (rs == NULL || (resset = rs->resset) == NULL) {
         OHM_ERROR("resource: refuse to deque and send field: argument error");
@@ -432,11 +472,29 @@ static void enqueue_send_request(resource_set_t          *rs,
     default:                                                           return;
     }
 
+    qhead = &value->queue;
+
+    /*
+     * the rules may change the same field several times within a
+     * transaction; only the final value will be sent, so just update
+     * the pending entry of the transaction if there is one
+     */
+    if ((qentry = qhead->tail) != NULL && qentry->txid == txid) {
+        if (reqno)
+            qentry->reqno = reqno;
+
+        OHM_DEBUG(DBG_SET, "%s/%u (manager_id %u) %s value %s superseded by %s",
+                  resset->peer, resset->id, rs->manager_id, type,
+                  resmsg_res_str(qentry->value, buf, sizeof(buf)),
+                  resmsg_res_str(value->factstore, buf2, sizeof(buf2)));
+
+        qentry->value = value->factstore;
+        return;
+    }
+
     if ((qentry = malloc(sizeof(resource_set_queue_t))) == NULL)
         OHM_ERROR("resource: [%s] memory allocation failure", __FUNCTION__);
     else {
-        qhead = &value->queue;
-
         memset(qentry, 0, sizeof(resource_set_queue_t));
         qentry->txid  = txid;
         qentry->reqno = reqno;
@@ -459,6 +517,7 @@ static void dequeue_and_send(resource_set_t          *rs,
     resource_set_output_t *value;
     resource_set_qhead_t  *qhead;
     resource_set_queue_t  *qentry;
+    resource_set_queue_t  *next;
     int32_t                block;
     resmsg_t               msg;
     char                   buf[128];
@@ -482,10 +541,28 @@ static void dequeue_and_send(resource_set_t          *rs,
      * and this function is called with strictly monoton txid's
      */
     while ((qentry = queue_pop_head(qhead)) != NULL) {
-        if (qentry->txid > txid)
-            return;             /* nothing to send */
+        if (qentry->txid > txid) {
+            /* nothing to send: put it back */
+            if ((qentry->next = qhead->head) != NULL)
+                qhead->head->prev = qentry;
+            else
+                qhead->tail = qentry;
+            qhead->head = qentry;
+            return;
+        }
 
         if (qentry->txid == txid) {
+            /* send only the last value of the transaction */
+            while ((next = qhead->head) != NULL && next->txid == txid) {
+                queue_pop_head(qhead);
+
+                if (next->reqno)
+                    qentry->reqno = next->reqno;
+                qentry->value = next->value;
+
+                free(next);
+            }
+
             if (qentry->reqno || value->client != qentry->value) {
                 if (block && type == RESMSG_GRANT) {
                     OHM_DEBUG(DBG_SET, "%s/%u (manager_id %u) dequed but not "
@@ -503,6 +580,11 @@ static void dequeue_and_send(resource_set_t          *rs,
                     if (resproto_send_message(resset, &msg, NULL)) {
                         value->client = qentry->value;
 
+                        TRACE(type == RESMSG_GRANT ?
+                              trace_grant_sent : trace_advice_sent,
+                              rs->manager_id, txid, qentry->reqno,
+                              qentry->value);
+
                         OHM_DEBUG(DBG_SET, "%s/%u (manager_id %u) dequed and "
                                   "sent %s value %s", resset->peer, resset->id,
                                   rs->manager_id, resmsg_type_str(type),
@@ -547,10 +629,11 @@ static void destroy_queue(resource_set_t *rs, resource_set_field_id_t what)
 
 static int add_factstore_entry(resource_set_t *rs)
 {
-    resset_t *resset    = rs->resset;
-    uint32_t  mandatory = resset->flags.all & ~resset->flags.opt;
-    char     *audiogr;
-    int       success;
+    resset_t     *resset    = rs->resset;
+    uint32_t      mandatory = resset->flags.all & ~resset->flags.opt;
+    char         *audiogr;
+    fsif_entry_t *entry;
+    int           success;
 
     /* TODO: this should come from prolog at init time */
     audiogr = strcmp(resset->klass, "proclaimer") ? resset->klass : "alwayson";
@@ -578,18 +661,25 @@ static int add_factstore_entry(resource_set_t *rs)
 
     success = fsif_add_factstore_entry(FACTSTORE_RESOURCE_SET, fldlist);
 
+    if (success && (entry = factstore_entry(rs)) != NULL)
+        g_object_set_qdata(G_OBJECT(entry), fact_quark, rs);
+
     return success;
 }
 
 static int delete_factstore_entry(resource_set_t *rs)
 {
-    int success;
+    fsif_entry_t *entry;
+    int           success;
 
     fsif_field_t  selist[] = {
         INTEGER_FIELD("manager_id", rs->manager_id),
         INVALID_FIELD
     };
 
+    /* someone else might still hold a reference to the fact */
+    if ((entry = factstore_entry(rs)) != NULL)
+        g_object_set_qdata(G_OBJECT(entry), fact_quark, NULL);
 
     success = fsif_delete_factstore_entry(FACTSTORE_RESOURCE_SET, selist);
 
@@ -624,42 +714,55 @@ static int update_factstore_flags(resource_set_t *rs)
 
 static int update_factstore_request(resource_set_t *rs)
 {
-    static int  reqno;
-    int         success;
+    static int    reqno;
+    fsif_entry_t *entry;
+    fsif_value_t  value;
 
-    fsif_field_t  selist[]  = {
-        INTEGER_FIELD ("manager_id", rs->manager_id),
-        INVALID_FIELD
-    };
-    fsif_field_t  fldlist[] = {
-        STRING_FIELD  ("request", rs->request),
-        INTEGER_FIELD ("reqno"  , reqno++    ),
-        INVALID_FIELD
-    };
+    if ((entry = factstore_entry(rs)) == NULL)
+        return FALSE;
 
-    success = fsif_update_factstore_entry(FACTSTORE_RESOURCE_SET,
-                                          selist, fldlist);
+    fsif_begin_batch();
 
-    return success;
+    value.string = rs->request ? rs->request : "";
+    fsif_set_field_by_handle(entry, &handles[H_REQUEST], &value);
+
+    value.integer = reqno++;
+    fsif_set_field_by_handle(entry, &handles[H_REQNO], &value);
+
+    fsif_commit_batch();
+
+    return TRUE;
 }
 
 static int update_factstore_block(resource_set_t *rs)
 {
-    int success;
+    fsif_entry_t *entry;
+    fsif_value_t  value;
+
+    if ((entry = factstore_entry(rs)) == NULL)
+        return FALSE;
+
+    value.integer = rs->block;
+    fsif_set_field_by_handle(entry, &handles[H_BLOCK], &value);
+
+    return TRUE;
+}
+
+static fsif_entry_t *factstore_entry(resource_set_t *rs)
+{
+    fsif_entry_t *entry;
 
     fsif_field_t  selist[]  = {
         INTEGER_FIELD ("manager_id", rs->manager_id),
         INVALID_FIELD
     };
-    fsif_field_t  fldlist[] = {
-        INTEGER_FIELD ("block"  , rs->block),
-        INVALID_FIELD
-    };
 
-    success = fsif_update_factstore_entry(FACTSTORE_RESOURCE_SET,
-                                          selist, fldlist);
+    if ((entry = fsif_get_entry(FACTSTORE_RESOURCE_SET, selist)) == NULL) {
+        OHM_DEBUG(DBG_FS, "can't find %s entry with manager_id %u",
+                  FACTSTORE_RESOURCE_SET, rs->manager_id);
+    }
 
-    return success;
+    return entry;
 }
 
 
@@ -707,41 +810,23 @@ static int update_factstore_video(resource_set_t          *rs,
 
 static void add_to_hash_table(resource_set_t *rs)
 {
-    int index = HASH_INDEX(rs->manager_id);
-
-    rs->next = hash_table[index];
-    hash_table[index] = rs;
+    g_hash_table_insert(hash_table, GUINT_TO_POINTER(rs->manager_id), rs);
 }
 
 static void delete_from_hash_table(resource_set_t *rs)
 {
-    int              index  = HASH_INDEX(rs->manager_id);
-    resset_t        *resset = rs->resset;
-    resource_set_t  *prev;
+    resset_t *resset = rs->resset;
 
-    for (prev = (void *)&hash_table[index];   prev->next;  prev = prev->next) {
-        if (prev->next == rs) {
-            prev->next = rs->next;
-            return;
-        }
+    if (!g_hash_table_remove(hash_table, GUINT_TO_POINTER(rs->manager_id))) {
+        OHM_ERROR("resource: failed to remove resource %s/%u (manager id %u) "
+                  "from hash table: not found",
+                  resset->peer, resset->id, rs->manager_id); 
     }
-
-    OHM_ERROR("resource: failed to remove resource %s/%u (manager id %u) "
-              "from hash table: not found",
-              resset->peer, resset->id, rs->manager_id); 
 }
 
 static resource_set_t *find_in_hash_table(uint32_t manager_id)
 {
-    int index = HASH_INDEX(manager_id);
-    resource_set_t *rs;
-
-    for (rs = hash_table[index];   rs != NULL;   rs = rs->next) {
-        if (manager_id == rs->manager_id)
-            break;
-    }
-
-    return rs;
+    return g_hash_table_lookup(hash_table, GUINT_TO_POINTER(manager_id));
 }
 
 /* 
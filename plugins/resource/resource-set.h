@@ -69,7 +69,6 @@ typedef struct {
 
 
 typedef struct resource_set_s {
-    struct resource_set_s   *next;
     pid_t                    client_pid; /* pid of the resource client */
     uint32_t                 manager_id; /* resource-set generated unique ID */
     resset_t                *resset;     /* link to libresource */
@@ -107,6 +106,7 @@ void resource_set_send_queued_changes(uint32_t, uint32_t);
 void resource_set_send_release_request(resource_set_t *);
 int  resource_set_add_idle_task(resource_set_t *, resource_set_task_t);
 resource_set_t *resource_set_find(struct _OhmFact *);
+resource_set_t *resource_set_find_by_id(uint32_t);
 
 void resource_set_dump_message(resmsg_t *, resset_t *, const char *);
 
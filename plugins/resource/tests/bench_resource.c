@@ -0,0 +1,1004 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/* resource manager benchmark: drives the resource manager code through the
+ * internal (loopback) transport with synthetic clients of mixed classes.
+ * The factstore interface is linked in, the dres policy, the rule engine
+ * and the authorization are replaced by stubs, so neither ohmd nor a bus
+ * daemon is needed. BENCH_TRACE=<records> (and BENCH_TRACE_FILE=<path>)
+ * in the environment turn on the decision trace for trace-report */
+
+#define _GNU_SOURCE
+
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+/*
+ * the entry points of fsif.c are static, give them private names here
+ * and provide the global fsif_* functions the resource code links against
+ */
+#define fsif_add_field_watch        fsif_static_add_field_watch
+#define fsif_get_field_by_entry     fsif_static_get_field_by_entry
+#define fsif_add_factstore_entry    fsif_static_add_factstore_entry
+#define fsif_delete_factstore_entry fsif_static_delete_factstore_entry
+#define fsif_update_factstore_entry fsif_static_update_factstore_entry
+#define fsif_add_index              fsif_static_add_index
+#define fsif_begin_batch            fsif_static_begin_batch
+#define fsif_commit_batch           fsif_static_commit_batch
+#define fsif_get_entry              fsif_static_get_entry
+#define fsif_register_schema        fsif_static_register_schema
+#define fsif_set_field_by_handle    fsif_static_set_field_by_handle
+
+#include "../../fsif/fsif.c"
+#include "../../fsif/fsif-profile.c"
+
+#undef fsif_add_field_watch
+#undef fsif_get_field_by_entry
+#undef fsif_add_factstore_entry
+#undef fsif_delete_factstore_entry
+#undef fsif_update_factstore_entry
+#undef fsif_add_index
+#undef fsif_begin_batch
+#undef fsif_commit_batch
+#undef fsif_get_entry
+#undef fsif_register_schema
+#undef fsif_set_field_by_handle
+
+#include <res-conn.h>
+
+#include "../plugin.h"
+#include "../internalif.h"
+#include "../manager.h"
+#include "../resource-set.h"
+#include "../resource-spec.h"
+#include "../transaction.h"
+#include "../dresif.h"
+#include "../ruleif.h"
+#include "../dbusif.h"
+#include "../auth.h"
+#include "../trace.h"
+
+#define DEFAULT_SETS    10000
+#define DEFAULT_CYCLES  2
+#define DEFAULT_WINDOW  64
+#define LOOKUP_ROUNDS   100
+
+#define BENCH_PEER      "bench"
+
+/* DBG_FS comes from fsif.c */
+int DBG_INIT, DBG_MGR, DBG_SET, DBG_DBUS, DBG_INTERNAL;
+int DBG_DRES, DBG_QUE, DBG_TRANSACT, DBG_MEDIA, DBG_AUTH;
+int DBG_RULE;
+
+typedef struct {
+    const char *name;
+    uint32_t    mandatory;
+    uint32_t    optional;
+} class_def_t;
+
+/* in decreasing priority, as the stub policy sees them */
+static class_def_t classes[] = {
+    { "call"     , RESMSG_AUDIO_PLAYBACK | RESMSG_AUDIO_RECORDING,
+                   RESMSG_VIDEO_PLAYBACK                          },
+    { "alarm"    , RESMSG_AUDIO_PLAYBACK, RESMSG_VIBRA | RESMSG_LEDS },
+    { "ringtone" , RESMSG_AUDIO_PLAYBACK, RESMSG_VIBRA | RESMSG_LEDS },
+    { "navigator", RESMSG_AUDIO_PLAYBACK, 0                       },
+    { "camera"   , RESMSG_VIDEO_PLAYBACK, RESMSG_AUDIO_RECORDING  },
+    { "player"   , RESMSG_AUDIO_PLAYBACK, RESMSG_VIDEO_PLAYBACK   },
+    { "game"     , RESMSG_AUDIO_PLAYBACK | RESMSG_BACKLIGHT,
+                   RESMSG_VIBRA                                   },
+    { "event"    , RESMSG_LEDS          , RESMSG_AUDIO_PLAYBACK   },
+};
+
+#define NCLASS (int)(sizeof(classes) / sizeof(classes[0]))
+
+
+/*
+ * stub policy: resources are exclusive and go to the acquired sets in
+ * class priority order, the most recent acquisition first within a class
+ */
+typedef struct policy_set_s {
+    struct policy_set_s *next;
+    struct policy_set_s *prev;
+    uint32_t             manager_id;
+    int                  klass;
+    uint32_t             mandatory;
+    uint32_t             optional;
+    int                  acquired;
+    uint32_t             granted;
+    uint32_t             advice;
+} policy_set_t;
+
+typedef struct {
+    policy_set_t  **sets;               /* indexed by manager_id */
+    uint32_t        nset;
+    policy_set_t    heads[NCLASS];      /* list heads per class */
+    uint64_t        resolves;
+} policy_t;
+
+typedef struct {
+    resset_t   *rset;
+    uint32_t    id;
+    int         klass;
+    uint32_t    reqno;
+    uint32_t    acquire_reqno;          /* 0 if no grant is pending */
+    double      acquired_at;
+    int         video;
+    int         busy;
+} client_t;
+
+typedef enum {
+    op_register = 0,
+    op_acquire,
+    op_update,
+    op_release,
+    op_unregister,
+} op_t;
+
+typedef struct {
+    client_t   *clients;
+    int         nclient;
+    int         cycles;
+    int         window;
+    uint64_t    next;                   /* next operation to issue */
+    uint64_t    total;                  /* operations in this phase */
+    uint64_t    done;
+    int         inflight;
+    uint64_t    failed;
+    int         phase;                  /* op_register, op_acquire, ... */
+    GMainLoop  *loop;
+} driver_t;
+
+typedef struct {
+    double     *samples;                /* grant latencies in usecs */
+    int         nsample;
+    int         size;
+} latency_t;
+
+static policy_t    policy;
+static driver_t    driver;
+static latency_t   latency;
+static resconn_t  *conn;
+static int         manager_up;
+static uint64_t    fs_writes;
+static const char *batching;
+static const char *background;
+
+
+/*
+ * glue normally provided by the plugin loader and the other plugins
+ */
+
+int fsif_add_field_watch(char                  *factname,
+                         fsif_field_t          *selist,
+                         char                  *fldname,
+                         fsif_field_watch_cb_t  callback,
+                         void                  *usrdata)
+{
+    return fsif_static_add_field_watch(factname, selist, fldname,
+                                       callback, usrdata);
+}
+
+int fsif_get_field_by_entry(fsif_entry_t   *entry,
+                            fsif_fldtype_t  type,
+                            char           *name,
+                            fsif_value_t   *vptr)
+{
+    return fsif_static_get_field_by_entry(entry, type, name, vptr);
+}
+
+int fsif_add_factstore_entry(char *name, fsif_field_t *fldlist)
+{
+    return fsif_static_add_factstore_entry(name, fldlist);
+}
+
+int fsif_delete_factstore_entry(char *name, fsif_field_t *selist)
+{
+    return fsif_static_delete_factstore_entry(name, selist);
+}
+
+int fsif_update_factstore_entry(char         *name,
+                                fsif_field_t *selist,
+                                fsif_field_t *fldlist)
+{
+    return fsif_static_update_factstore_entry(name, selist, fldlist);
+}
+
+int fsif_add_index(char *factname, char *fldname)
+{
+    return fsif_static_add_index(factname, fldname);
+}
+
+int fsif_begin_batch(void)
+{
+    return fsif_static_begin_batch();
+}
+
+int fsif_commit_batch(void)
+{
+    return fsif_static_commit_batch();
+}
+
+fsif_entry_t *fsif_get_entry(char *name, fsif_field_t *selist)
+{
+    return fsif_static_get_entry(name, selist);
+}
+
+int fsif_register_schema(char *factname, fsif_fldhandle_t *handles)
+{
+    return fsif_static_register_schema(factname, handles);
+}
+
+void fsif_set_field_by_handle(fsif_entry_t     *entry,
+                              fsif_fldhandle_t *handle,
+                              fsif_value_t     *vptr)
+{
+    fsif_static_set_field_by_handle(entry, handle, vptr);
+}
+
+void plugin_print_timestamp(const char *function, const char *phase)
+{
+    (void)function;
+    (void)phase;
+}
+
+void dbusif_query_pid(char *addr, dbusif_pid_query_cb_t func, void *data)
+{
+    (void)addr;
+
+    func(getpid(), data);
+}
+
+const char *ohm_plugin_get_param(OhmPlugin *plugin, const char *key)
+{
+    (void)plugin;
+
+    if (!strcmp(key, "request-batching"))
+        return batching;
+    if (!strcmp(key, "background-classes"))
+        return background;
+    if (!strcmp(key, "trace"))
+        return getenv("BENCH_TRACE");
+    if (!strcmp(key, "trace-file"))
+        return getenv("BENCH_TRACE_FILE");
+
+    return NULL;
+}
+
+
+/*
+ * stub rule engine: every class accepts the resources it is asked for
+ */
+
+static int stub_rule_find(char *name, int arity)
+{
+    (void)arity;
+
+    return strcmp(name, "resource_class_request") ? -1 : 0;
+}
+
+static int stub_rule_eval(int rule, void *retval, void **args, int narg)
+{
+    static char  *entry[3 + 2*3 + 1];
+    static char **result[2] = { entry, NULL };
+
+    (void)rule;
+
+    if (narg < 3)
+        return 0;
+
+    entry[0] = "name";
+    entry[1] = "resource_class_request";
+    entry[2] = args[1];
+    entry[3] = "mandatory";
+    entry[4] = (char *)'i';
+    entry[5] = args[3];
+    entry[6] = "optional";
+    entry[7] = (char *)'i';
+    entry[8] = args[5];
+    entry[9] = NULL;
+
+    *(char ****)retval = result;
+
+    return 1;
+}
+
+static void stub_rules_free(void *retval)
+{
+    (void)retval;
+}
+
+
+/*
+ * stub authorization: never reached with the internal transport
+ */
+
+static int stub_auth_request(char *id_type, void *id,
+                             char *req_type, void *req,
+                             void (*callback)(int, char *, void *), void *data)
+{
+    (void)id_type;
+    (void)id;
+    (void)req_type;
+    (void)req;
+
+    callback(TRUE, "OK", data);
+
+    return TRUE;
+}
+
+
+/*
+ * stub policy
+ */
+
+static int class_index(const char *name)
+{
+    int i;
+
+    for (i = 0;  i < NCLASS;  i++) {
+        if (!strcmp(name, classes[i].name))
+            return i;
+    }
+
+    return NCLASS - 1;
+}
+
+static void policy_init(void)
+{
+    int i;
+
+    for (i = 0;  i < NCLASS;  i++)
+        policy.heads[i].next = policy.heads[i].prev = policy.heads + i;
+}
+
+static void policy_unlink(policy_set_t *ps)
+{
+    ps->prev->next = ps->next;
+    ps->next->prev = ps->prev;
+}
+
+static void policy_link_head(policy_set_t *ps)
+{
+    policy_set_t *head = policy.heads + ps->klass;
+
+    ps->next = head->next;
+    ps->prev = head;
+    head->next->prev = ps;
+    head->next = ps;
+}
+
+static void policy_read_fact(policy_set_t *ps)
+{
+    fsif_field_t  selist[2];
+    fsif_entry_t *entry;
+    fsif_value_t  v;
+
+    memset(selist, 0, sizeof(selist));
+    selist[0].type          = fldtype_integer;
+    selist[0].name          = "manager_id";
+    selist[0].value.integer = ps->manager_id;
+
+    if ((entry = fsif_get_entry(FACTSTORE_RESOURCE_SET, selist)) == NULL)
+        return;
+
+    if (fsif_get_field_by_entry(entry, fldtype_string, "class", &v))
+        ps->klass = class_index(v.string);
+    if (fsif_get_field_by_entry(entry, fldtype_integer, "mandatory", &v))
+        ps->mandatory = v.integer;
+    if (fsif_get_field_by_entry(entry, fldtype_integer, "optional", &v))
+        ps->optional = v.integer;
+}
+
+static policy_set_t *policy_register(uint32_t manager_id)
+{
+    policy_set_t **sets;
+    policy_set_t  *ps;
+    uint32_t       n;
+
+    if (manager_id >= policy.nset) {
+        n = policy.nset ? policy.nset : 256;
+
+        while (n <= manager_id)
+            n *= 2;
+
+        if ((sets = realloc(policy.sets, n * sizeof(sets[0]))) == NULL)
+            return NULL;
+
+        memset(sets + policy.nset, 0, (n - policy.nset) * sizeof(sets[0]));
+
+        policy.sets = sets;
+        policy.nset = n;
+    }
+
+    if ((ps = calloc(1, sizeof(*ps))) != NULL) {
+        ps->manager_id = manager_id;
+        policy_read_fact(ps);
+        policy_link_head(ps);
+
+        policy.sets[manager_id] = ps;
+    }
+
+    return ps;
+}
+
+static void policy_write(policy_set_t *ps, uint32_t granted, uint32_t advice)
+{
+    fsif_field_t selist[2];
+    fsif_field_t fldlist[3];
+    int          i = 0;
+
+    memset(selist, 0, sizeof(selist));
+    selist[0].type          = fldtype_integer;
+    selist[0].name          = "manager_id";
+    selist[0].value.integer = ps->manager_id;
+
+    memset(fldlist, 0, sizeof(fldlist));
+
+    if (granted != ps->granted) {
+        fldlist[i].type          = fldtype_integer;
+        fldlist[i].name          = "granted";
+        fldlist[i].value.integer = granted;
+        i++;
+    }
+
+    if (advice != ps->advice) {
+        fldlist[i].type          = fldtype_integer;
+        fldlist[i].name          = "advice";
+        fldlist[i].value.integer = advice;
+        i++;
+    }
+
+    if (i > 0) {
+        ps->granted = granted;
+        ps->advice  = advice;
+
+        fsif_update_factstore_entry(FACTSTORE_RESOURCE_SET, selist, fldlist);
+    }
+}
+
+static void policy_recalculate(void)
+{
+    policy_set_t *head, *ps;
+    uint32_t      avail, grant;
+    int           i;
+
+    avail = ~(uint32_t)0;
+
+    for (i = 0;  i < NCLASS;  i++) {
+        head = policy.heads + i;
+
+        for (ps = head->next;  ps != head;  ps = ps->next) {
+            if ((ps->mandatory & avail) == ps->mandatory)
+                grant = (ps->mandatory | ps->optional) & avail;
+            else
+                grant = 0;
+
+            if (ps->acquired) {
+                avail &= ~grant;
+                policy_write(ps, grant, grant);
+            }
+            else
+                policy_write(ps, 0, grant);
+        }
+    }
+}
+
+static int stub_resolve(char *goal, char **locals)
+{
+    policy_set_t *ps;
+    uint32_t      manager_id = 0;
+    char         *request    = NULL;
+    int           i;
+
+    if (strcmp(goal, "resource_request"))
+        return 0;
+
+    for (i = 0;  locals[i] != NULL;  i += 3) {
+        if (!strcmp(locals[i], "manager_id"))
+            manager_id = GPOINTER_TO_UINT(locals[i+2]);
+        else if (!strcmp(locals[i], "request"))
+            request = locals[i+2];
+    }
+
+    if (request == NULL)
+        return 0;
+
+    policy.resolves++;
+
+    ps = manager_id < policy.nset ? policy.sets[manager_id] : NULL;
+
+    if (!strcmp(request, "register")) {
+        if (ps == NULL && (ps = policy_register(manager_id)) == NULL)
+            return 0;
+    }
+    else if (ps == NULL)
+        return 1;
+    else if (!strcmp(request, "unregister")) {
+        policy_unlink(ps);
+        policy.sets[manager_id] = NULL;
+        free(ps);
+    }
+    else if (!strcmp(request, "acquire")) {
+        ps->acquired = TRUE;
+        policy_unlink(ps);
+        policy_link_head(ps);
+    }
+    else if (!strcmp(request, "release"))
+        ps->acquired = FALSE;
+    else if (!strcmp(request, "update"))
+        policy_read_fact(ps);
+
+    policy_recalculate();
+
+    return 1;
+}
+
+gboolean ohm_module_find_method(char *name, char **sig, void **method)
+{
+    static struct {
+        const char *name;
+        void       *method;
+    } stubs[] = {
+        { "dres.resolve"    , stub_resolve      },
+        { "auth.request"    , stub_auth_request },
+        { "rule_engine.find", stub_rule_find    },
+        { "rule_engine.eval", stub_rule_eval    },
+        { "rule_engine.free", stub_rules_free   },
+        { "rule_engine.dump", stub_rules_free   },
+        { NULL              , NULL              }
+    };
+
+    int i;
+
+    (void)sig;
+
+    for (i = 0;  stubs[i].name != NULL;  i++) {
+        if (!strcmp(name, stubs[i].name)) {
+            *method = stubs[i].method;
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+
+/*
+ * synthetic clients
+ */
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void latency_add(double usecs)
+{
+    double *samples;
+    int     size;
+
+    if (latency.nsample >= latency.size) {
+        size = latency.size ? 2 * latency.size : 1024;
+
+        if ((samples = realloc(latency.samples, size * sizeof(double))) == NULL)
+            return;
+
+        latency.samples = samples;
+        latency.size    = size;
+    }
+
+    latency.samples[latency.nsample++] = usecs;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double d1 = *(const double *)a;
+    double d2 = *(const double *)b;
+
+    return d1 < d2 ? -1 : (d1 > d2 ? 1 : 0);
+}
+
+static double percentile(double p)
+{
+    int idx;
+
+    if (latency.nsample == 0)
+        return 0.0;
+
+    idx = (int)(p / 100.0 * (latency.nsample - 1) + 0.5);
+
+    return latency.samples[idx];
+}
+
+static void pump(void);
+
+/* the status of a register request may arrive before rset->userdata is set */
+static client_t *client_find(uint32_t id)
+{
+    if (id < 1 || id > (uint32_t)driver.nclient)
+        return NULL;
+
+    return driver.clients + (id - 1);
+}
+
+static void client_status(resset_t *rset, resmsg_t *msg)
+{
+    client_t *c = rset ? client_find(rset->id) : NULL;
+
+    if (msg->type != RESMSG_STATUS)
+        return;
+
+    if (msg->status.errcod)
+        driver.failed++;
+
+    if (c != NULL && c->busy) {
+        c->busy = FALSE;
+        driver.inflight--;
+        driver.done++;
+    }
+
+    pump();
+}
+
+static void client_grant(resmsg_t *msg, resset_t *rset, void *data)
+{
+    client_t *c = client_find(msg->notify.id);
+
+    (void)data;
+
+    if (c != NULL && c->acquire_reqno && msg->notify.reqno == c->acquire_reqno){
+        latency_add((now() - c->acquired_at) / 1000.0);
+        c->acquire_reqno = 0;
+    }
+}
+
+static void client_advice(resmsg_t *msg, resset_t *rset, void *data)
+{
+    (void)msg;
+    (void)rset;
+    (void)data;
+}
+
+static void client_unregister(resmsg_t *msg, resset_t *rset, void *data)
+{
+    resproto_reply_message(rset, msg, data, 0, "OK");
+}
+
+static void client_manager_up(resconn_t *rc)
+{
+    (void)rc;
+
+    manager_up = TRUE;
+}
+
+static void client_record(client_t *c, resmsg_t *msg, resmsg_type_t type)
+{
+    class_def_t *cd = classes + c->klass;
+
+    memset(msg, 0, sizeof(*msg));
+    msg->record.type      = type;
+    msg->record.id        = c->id;
+    msg->record.reqno     = c->reqno++;
+    msg->record.rset.all  = cd->mandatory | (c->video ? cd->optional : 0);
+    msg->record.rset.opt  = c->video ? cd->optional : 0;
+    msg->record.klass     = (char *)cd->name;
+    msg->record.mode      = RESMSG_MODE_ALWAYS_REPLY;
+}
+
+static int client_issue(client_t *c, op_t op)
+{
+    resmsg_t msg;
+    int      success;
+
+    switch (op) {
+
+    case op_register:
+        client_record(c, &msg, RESMSG_REGISTER);
+
+        c->rset = resconn_connect(conn, &msg, client_status);
+        success = (c->rset != NULL);
+        break;
+
+    case op_update:
+        c->video = !c->video;
+        client_record(c, &msg, RESMSG_UPDATE);
+        success = resproto_send_message(c->rset, &msg, client_status);
+        break;
+
+    case op_acquire:
+    case op_release:
+        memset(&msg, 0, sizeof(msg));
+        msg.possess.type  = (op == op_acquire) ? RESMSG_ACQUIRE:RESMSG_RELEASE;
+        msg.possess.id    = c->id;
+        msg.possess.reqno = c->reqno++;
+
+        if (op == op_acquire) {
+            c->acquire_reqno = msg.possess.reqno;
+            c->acquired_at   = now();
+        }
+
+        success = resproto_send_message(c->rset, &msg, client_status);
+        break;
+
+    case op_unregister:
+        memset(&msg, 0, sizeof(msg));
+        msg.possess.type  = RESMSG_UNREGISTER;
+        msg.possess.id    = c->id;
+        msg.possess.reqno = c->reqno++;
+        success = resconn_disconnect(c->rset, &msg, client_status);
+        break;
+
+    default:
+        success = FALSE;
+        break;
+    }
+
+    return success;
+}
+
+static op_t cycle_op(uint64_t step)
+{
+    static op_t ops[] = { op_acquire, op_update, op_release };
+
+    return ops[step % 3];
+}
+
+/* keep up to 'window' requests in flight, in order per client */
+static void pump(void)
+{
+    client_t *c;
+    op_t      op;
+
+    while (driver.inflight < driver.window && driver.next < driver.total) {
+        c = driver.clients + (driver.next % driver.nclient);
+
+        if (c->busy)
+            break;
+
+        if (driver.phase == op_acquire)
+            op = cycle_op(driver.next / driver.nclient);
+        else
+            op = driver.phase;
+
+        driver.next++;
+
+        c->busy = TRUE;
+        driver.inflight++;
+
+        if (!client_issue(c, op) && c->busy) {
+            driver.failed++;
+            driver.done++;
+            driver.inflight--;
+            c->busy = FALSE;
+        }
+    }
+
+    if (driver.done >= driver.total)
+        g_main_loop_quit(driver.loop);
+}
+
+static double run_phase(int phase, uint64_t total)
+{
+    double start;
+
+    driver.phase = phase;
+    driver.next  = 0;
+    driver.done  = 0;
+    driver.total = total;
+
+    start = now();
+
+    pump();
+
+    if (driver.done < driver.total)
+        g_main_loop_run(driver.loop);
+
+    return now() - start;
+}
+
+
+/* the fact -> resource set mapping every field watch callback does */
+static double lookup_by_fact(void)
+{
+    GSList   *facts, *l;
+    uint64_t  n;
+    double    start;
+    int       i;
+
+    facts = fsif_get_entries_by_name(FACTSTORE_RESOURCE_SET);
+    start = now();
+
+    for (i = 0, n = 0;  i < LOOKUP_ROUNDS;  i++) {
+        for (l = facts;  l != NULL;  l = l->next, n++) {
+            if (resource_set_find(l->data) == NULL)
+                driver.failed++;
+        }
+    }
+
+    return n ? (now() - start) / n : 0.0;
+}
+
+static void count_writes(void *data, OhmFact *fact, GQuark fld, gpointer val)
+{
+    (void)data;
+    (void)fact;
+    (void)fld;
+    (void)val;
+
+    fs_writes++;
+}
+
+static void resource_init(void)
+{
+    /* fsif first, as ohmd would load it */
+    plugin_init(NULL);
+
+    g_signal_connect(G_OBJECT(fs), "updated", G_CALLBACK(count_writes), NULL);
+
+    trace_init(NULL);
+    ruleif_init(NULL);
+    internalif_init(NULL);
+    dresif_init(NULL);
+    manager_init(NULL);
+    resource_set_init(NULL);
+    resource_spec_init(NULL);
+    transaction_init(NULL);
+    auth_init(NULL);
+}
+
+static void clients_init(int nclient)
+{
+    int i;
+
+    conn = resproto_init(RESPROTO_ROLE_CLIENT, RESPROTO_TRANSPORT_INTERNAL,
+                         client_manager_up, BENCH_PEER,
+                         internalif_timer_add, internalif_timer_del);
+
+    if (conn == NULL) {
+        printf("bench: can't initialize the resource loopback protocol\n");
+        exit(1);
+    }
+
+    resproto_set_handler(conn, RESMSG_UNREGISTER, client_unregister);
+    resproto_set_handler(conn, RESMSG_GRANT     , client_grant     );
+    resproto_set_handler(conn, RESMSG_ADVICE    , client_advice    );
+
+    if ((driver.clients = calloc(nclient, sizeof(client_t))) == NULL) {
+        printf("bench: failed to allocate %d clients\n", nclient);
+        exit(1);
+    }
+
+    for (i = 0;  i < nclient;  i++) {
+        driver.clients[i].id    = i + 1;
+        driver.clients[i].klass = i % NCLASS;
+        driver.clients[i].reqno = 1;
+    }
+
+    driver.nclient = nclient;
+}
+
+int main(int argc, char **argv)
+{
+    struct rusage       ru;
+    transaction_stats_t tx;
+    int                 nset   = DEFAULT_SETS;
+    int                 cycles = DEFAULT_CYCLES;
+    int                 window = DEFAULT_WINDOW;
+    uint64_t            nreq, writes;
+    double              treg, tcyc, tunreg, tfind;
+    int                 i;
+
+    if (argc > 1)
+        nset = atoi(argv[1]);
+    if (argc > 2)
+        cycles = atoi(argv[2]);
+    if (argc > 3)
+        window = atoi(argv[3]);
+    if (argc > 4)
+        batching = argv[4];
+    if (argc > 5)
+        background = argv[5];
+
+    if (nset <= 0 || cycles <= 0 || window <= 0) {
+        printf("usage: %s [sets [cycles [window [request-batching "
+               "[background-classes]]]]]\n", argv[0]);
+        return 1;
+    }
+
+    g_type_init();
+
+    driver.loop   = g_main_loop_new(NULL, FALSE);
+    driver.window = window;
+
+    policy_init();
+    resource_init();
+    clients_init(nset);
+
+    for (i = 0;  !manager_up && i < 1000;  i++)
+        g_main_context_iteration(NULL, FALSE);
+
+    if (!manager_up) {
+        printf("bench: resource manager did not come up\n");
+        return 1;
+    }
+
+    treg  = run_phase(op_register, nset);
+    tfind = lookup_by_fact();
+
+    nreq   = (uint64_t)nset * cycles * 3;
+    writes = fs_writes;
+    tcyc   = run_phase(op_acquire, nreq);
+    writes = fs_writes - writes;
+
+    tunreg = run_phase(op_unregister, nset);
+
+    manager_exit(NULL);
+    trace_exit(NULL);
+
+    getrusage(RUSAGE_SELF, &ru);
+    transaction_get_stats(&tx);
+    qsort(latency.samples, latency.nsample, sizeof(double), compare_double);
+
+    printf("%d resource sets, %d classes, %d cycles, window %d, "
+           "batching %s\n", nset, NCLASS, cycles, window,
+           batching ? batching : "no");
+    printf("  register:          %10.0f requests/s\n", nset / (treg / 1e9));
+    printf("  fact lookup:       %10.1f ns/lookup (%d live sets)\n",
+           tfind, nset);
+    printf("  acquire/update/release:\n");
+    printf("                     %10.0f requests/s\n", nreq / (tcyc / 1e9));
+    printf("                     %10.2f factstore writes/request\n",
+           (double)writes / nreq);
+    printf("                     %10llu policy resolves\n",
+           (unsigned long long)policy.resolves);
+    printf("  unregister:        %10.0f requests/s\n", nset / (tunreg / 1e9));
+    printf("  grant latency:     %10.1f us p50\n", percentile(50.0));
+    printf("                     %10.1f us p90\n", percentile(90.0));
+    printf("                     %10.1f us p99\n", percentile(99.0));
+    printf("                     %10.1f us max (%d grants)\n",
+           percentile(100.0), latency.nsample);
+    printf("  transactions:      %10u created, %u completed\n",
+           tx.created, tx.completed);
+    printf("                     %10u peak in flight\n", tx.peak);
+    printf("                     %10.1f us avg completion (max %llu us)\n",
+           tx.completed ? (double)tx.latency_total / tx.completed : 0.0,
+           (unsigned long long)tx.latency_max);
+    printf("  failed requests:   %10llu\n",(unsigned long long)driver.failed);
+    printf("  peak memory:       %10ld kB\n", ru.ru_maxrss);
+    printf("\n");
+    manager_print_class_stats(stdout);
+
+    return driver.failed ? 1 : 0;
+}
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
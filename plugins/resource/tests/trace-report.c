@@ -0,0 +1,449 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/* trace-report: turns a resource decision trace (see the 'trace' and
+ * 'trace-file' parameters of the resource plugin) into a per-request
+ * latency breakdown. With -v every request is listed, otherwise only the
+ * per request type summary is printed */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include <res-msg.h>
+
+typedef struct _OhmPlugin OhmPlugin;
+#include "../trace.h"
+
+#define NO_TIME   0
+#define MAX_TYPE  16
+
+typedef enum {
+    phase_queue = 0,            /* request -> resolve start */
+    phase_resolve,              /* resolve start -> resolve end */
+    phase_reply,                /* request -> reply sent */
+    phase_complete,             /* request -> transaction completed */
+    phase_grant,                /* request -> grant sent */
+    phase_max
+} phase_t;
+
+typedef struct {
+    uint32_t  manager_id;
+    uint32_t  txid;
+    uint32_t  type;
+    uint32_t  batch;            /* txid of the batch resolving it, or 0 */
+    int       queued;
+    uint64_t  t[phase_max + 1]; /* request, resolve start/end, done, ... */
+} request_t;
+
+enum { T_REQ, T_RSTART, T_REND, T_DONE, T_COMPLETE, T_GRANT };
+
+typedef struct {
+    uint32_t  txid;
+    uint64_t  start;
+    uint64_t  end;
+} batch_t;
+
+typedef struct {
+    uint64_t *samples;
+    int       n;
+} series_t;
+
+static const char *phase_names[phase_max] = {
+    "queue", "resolve", "reply", "complete", "grant"
+};
+
+static request_t *requests;
+static int        nrequest;
+static batch_t   *batches;
+static int        nbatch;
+static int        verbose;
+
+
+static void *grow(void *ptr, int n, size_t size)
+{
+    /* start with 64 and double at the powers of two */
+    if (n == 0 || (n >= 64 && (n & (n - 1)) == 0)) {
+        if ((ptr = realloc(ptr, (n ? 2 * n : 64) * size)) == NULL) {
+            fprintf(stderr, "trace-report: out of memory\n");
+            exit(1);
+        }
+    }
+
+    return ptr;
+}
+
+/* the transaction id's are monotonic, so are the arrays */
+static request_t *find_request(uint32_t txid)
+{
+    int lo = 0, hi = nrequest - 1, mid;
+
+    while (lo <= hi) {
+        mid = (lo + hi) / 2;
+
+        if (requests[mid].txid == txid)
+            return requests + mid;
+
+        if (requests[mid].txid < txid)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+
+    return NULL;
+}
+
+static batch_t *find_batch(uint32_t txid)
+{
+    int lo = 0, hi = nbatch - 1, mid;
+
+    while (lo <= hi) {
+        mid = (lo + hi) / 2;
+
+        if (batches[mid].txid == txid)
+            return batches + mid;
+
+        if (batches[mid].txid < txid)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+
+    return NULL;
+}
+
+static int map_events(FILE *fp, uint32_t nevent, int *map)
+{
+    static const char *known[trace_event_max] = {
+        [ trace_request       ] = "request",
+        [ trace_request_done  ] = "request_done",
+        [ trace_queued        ] = "queued",
+        [ trace_batch         ] = "batch",
+        [ trace_batch_member  ] = "batch_member",
+        [ trace_resolve_start ] = "resolve_start",
+        [ trace_resolve_end   ] = "resolve_end",
+        [ trace_tx_complete   ] = "tx_complete",
+        [ trace_grant_sent    ] = "grant_sent",
+        [ trace_advice_sent   ] = "advice_sent",
+    };
+    char     name[TRACE_NAME_LEN];
+    uint32_t i;
+    int      j;
+
+    for (i = 0;  i < nevent;  i++) {
+        if (fread(name, sizeof(name), 1, fp) != 1)
+            return -1;
+
+        name[sizeof(name) - 1] = '\0';
+        map[i] = -1;
+
+        for (j = 0;  j < trace_event_max;  j++) {
+            if (!strcmp(name, known[j])) {
+                map[i] = j;
+                break;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static void process(trace_record_t *rec, int event)
+{
+    static request_t *current;  /* request being handled */
+    static batch_t   *resolving;
+    static uint32_t   pending;  /* batch announced, not resolved yet */
+    request_t        *req;
+    batch_t          *b;
+
+    switch (event) {
+
+    case trace_request:
+        if (rec->arg[1] == 0)   /* no transaction, can't be followed */
+            break;
+        requests = grow(requests, nrequest, sizeof(request_t));
+        current  = requests + nrequest++;
+        memset(current, 0, sizeof(*current));
+        current->manager_id = rec->arg[0];
+        current->txid       = rec->arg[1];
+        current->type       = rec->arg[2];
+        current->t[T_REQ]   = rec->nsec;
+        break;
+
+    case trace_request_done:
+        if ((req = find_request(rec->arg[1])) != NULL)
+            req->t[T_DONE] = rec->nsec;
+        current = NULL;
+        break;
+
+    case trace_queued:
+        if ((req = find_request(rec->arg[1])) != NULL)
+            req->queued = rec->arg[2];
+        break;
+
+    case trace_batch_member:
+        if ((req = find_request(rec->arg[1])) != NULL)
+            req->batch = rec->arg[2];
+        break;
+
+    case trace_batch:
+        batches = grow(batches, nbatch, sizeof(batch_t));
+        b = batches + nbatch++;
+        memset(b, 0, sizeof(*b));
+        b->txid = pending = rec->arg[0];
+        break;
+
+    case trace_resolve_start:
+        if (pending && (resolving = find_batch(pending)) != NULL)
+            resolving->start = rec->nsec;
+        else if (current && !current->queued && !current->t[T_RSTART])
+            current->t[T_RSTART] = rec->nsec;
+        pending = 0;
+        break;
+
+    case trace_resolve_end:
+        if (resolving != NULL)
+            resolving->end = rec->nsec;
+        else if (current && !current->queued && !current->t[T_REND])
+            current->t[T_REND] = rec->nsec;
+        resolving = NULL;
+        break;
+
+    case trace_tx_complete:
+        if ((req = find_request(rec->arg[0])) != NULL)
+            req->t[T_COMPLETE] = rec->nsec;
+        break;
+
+    case trace_grant_sent:
+        if ((req = find_request(rec->arg[1])) != NULL && !req->t[T_GRANT])
+            req->t[T_GRANT] = rec->nsec;
+        break;
+
+    default:
+        break;
+    }
+}
+
+static int load(const char *path)
+{
+    FILE           *fp;
+    trace_header_t  hdr;
+    trace_record_t  rec;
+    int            *map;
+    uint32_t        i;
+
+    if ((fp = fopen(path, "r")) == NULL) {
+        fprintf(stderr, "trace-report: can't open %s: %s\n",
+                path, strerror(errno));
+        return -1;
+    }
+
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+        memcmp(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic)) ||
+        hdr.reclen != sizeof(trace_record_t))
+    {
+        fprintf(stderr, "trace-report: %s is not a resource trace\n", path);
+        fclose(fp);
+        return -1;
+    }
+
+    if ((map = calloc(hdr.nevent, sizeof(int))) == NULL ||
+        map_events(fp, hdr.nevent, map) < 0)
+    {
+        fprintf(stderr, "trace-report: can't read the event names\n");
+        fclose(fp);
+        return -1;
+    }
+
+    for (i = 0;  i < hdr.nrecord;  i++) {
+        if (fread(&rec, sizeof(rec), 1, fp) != 1) {
+            fprintf(stderr, "trace-report: %s is truncated at record %u\n",
+                    path, i);
+            break;
+        }
+
+        if (rec.event < hdr.nevent && map[rec.event] >= 0)
+            process(&rec, map[rec.event]);
+    }
+
+    printf("%s: %u records, %u lost, %d requests, %d batches\n",
+           path, i, hdr.lost, nrequest, nbatch);
+
+    free(map);
+    fclose(fp);
+
+    return 0;
+}
+
+/* phase length in ns, or -1 if not (completely) traced */
+static int64_t phase(request_t *req, phase_t p)
+{
+    uint64_t from = req->t[T_REQ], to;
+
+    switch (p) {
+    case phase_queue:    to = req->t[T_RSTART];                          break;
+    case phase_resolve:  from = req->t[T_RSTART]; to = req->t[T_REND];   break;
+    case phase_reply:    to = req->t[T_DONE];                            break;
+    case phase_complete: to = req->t[T_COMPLETE];                        break;
+    case phase_grant:    to = req->t[T_GRANT];                           break;
+    default:             return -1;
+    }
+
+    if (from == NO_TIME || to == NO_TIME || to < from)
+        return -1;
+
+    return (int64_t)(to - from);
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static void print_series(const char *name, series_t *s)
+{
+    uint64_t total = 0;
+    int      i;
+
+    if (s->n == 0) {
+        printf("    %-9s         -\n", name);
+        return;
+    }
+
+    qsort(s->samples, s->n, sizeof(uint64_t), compare_u64);
+
+    for (i = 0;  i < s->n;  i++)
+        total += s->samples[i];
+
+    printf("    %-9s %9.1f %9.1f %9.1f %9.1f %9.1f\n", name,
+           total / 1000.0 / s->n,
+           s->samples[s->n / 2] / 1000.0,
+           s->samples[(int)(s->n * 0.9)] / 1000.0,
+           s->samples[(int)(s->n * 0.99)] / 1000.0,
+           s->samples[s->n - 1] / 1000.0);
+}
+
+static void report(void)
+{
+    series_t   series[MAX_TYPE][phase_max];
+    request_t *req;
+    batch_t   *b;
+    int64_t    len;
+    int        count[MAX_TYPE];
+    int        i, p, type;
+
+    memset(series, 0, sizeof(series));
+    memset(count, 0, sizeof(count));
+
+    for (i = 0;  i < nrequest;  i++) {
+        req = requests + i;
+
+        /* the batched ones are resolved with their batch */
+        if (req->batch && (b = find_batch(req->batch)) != NULL) {
+            req->t[T_RSTART] = b->start;
+            req->t[T_REND]   = b->end;
+        }
+
+        if (verbose) {
+            printf("txid %u %s manager id %u%s:", req->txid,
+                   resmsg_type_str(req->type), req->manager_id,
+                   req->queued == 2 ? " (deferred)" :
+                   req->queued      ? " (batched)"  : "");
+
+            for (p = 0;  p < phase_max;  p++) {
+                if ((len = phase(req, p)) >= 0)
+                    printf(" %s %.1f", phase_names[p], len / 1000.0);
+            }
+            printf("\n");
+        }
+
+        if ((type = req->type) >= MAX_TYPE)
+            continue;
+
+        count[type]++;
+
+        for (p = 0;  p < phase_max;  p++) {
+            if ((len = phase(req, p)) < 0)
+                continue;
+
+            series[type][p].samples = grow(series[type][p].samples,
+                                           series[type][p].n,
+                                           sizeof(uint64_t));
+            series[type][p].samples[series[type][p].n++] = len;
+        }
+    }
+
+    printf("latencies in usec, measured from the arrival of the request\n"
+           "(resolve: the length of the policy resolution)\n");
+
+    for (type = 0;  type < MAX_TYPE;  type++) {
+        if (count[type] == 0)
+            continue;
+
+        printf("%s: %d requests\n", resmsg_type_str(type), count[type]);
+        printf("    %-9s %9s %9s %9s %9s %9s\n",
+               "", "avg", "p50", "p90", "p99", "max");
+
+        for (p = 0;  p < phase_max;  p++) {
+            print_series(phase_names[p], &series[type][p]);
+            free(series[type][p].samples);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = NULL;
+    int         i;
+
+    for (i = 1;  i < argc;  i++) {
+        if (!strcmp(argv[i], "-v"))
+            verbose = 1;
+        else
+            path = argv[i];
+    }
+
+    if (path == NULL || argc > 3) {
+        printf("usage: %s [-v] trace-file\n", argv[0]);
+        return 1;
+    }
+
+    if (load(path) < 0)
+        return 1;
+
+    report();
+
+    free(requests);
+    free(batches);
+
+    return 0;
+}
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
@@ -0,0 +1,261 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/*! \defgroup pubif Public Interfaces */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "plugin.h"
+#include "trace.h"
+
+#define DEFAULT_TRACE_FILE "/tmp/ohm-resource.trace"
+#define MAX_TRACE_SIZE     (1 << 22)
+
+int                    trace_enabled;
+tracepoint_provider_t *trace_shared;    /* timestamp plugin, if any */
+
+OHM_IMPORTABLE(tracepoint_provider_t *, trace_provider,
+               (const char *category));
+
+static trace_record_t *ring;
+static uint32_t        mask;
+static uint32_t        head;    /* total number of records added */
+static char           *dump_file;
+
+static uint32_t shared_events[trace_event_max];
+
+/* how the events map to the spans of the timestamp plugin */
+static struct {
+    const char *name;
+    int         phase;
+} spans[trace_event_max] = {
+    [ trace_request       ] = { "request"     , tracepoint_begin   },
+    [ trace_request_done  ] = { "request"     , tracepoint_end     },
+    [ trace_queued        ] = { "queued"      , tracepoint_instant },
+    [ trace_batch         ] = { "batch"       , tracepoint_instant },
+    [ trace_batch_member  ] = { "batch_member", tracepoint_instant },
+    [ trace_resolve_start ] = { "resolve"     , tracepoint_begin   },
+    [ trace_resolve_end   ] = { "resolve"     , tracepoint_end     },
+    [ trace_tx_complete   ] = { "tx_complete" , tracepoint_instant },
+    [ trace_grant_sent    ] = { "grant"       , tracepoint_instant },
+    [ trace_advice_sent   ] = { "advice"      , tracepoint_instant },
+};
+
+static void shared_init(void);
+
+static const char *names[trace_event_max] = {
+    [ trace_request       ] = "request",
+    [ trace_request_done  ] = "request_done",
+    [ trace_queued        ] = "queued",
+    [ trace_batch         ] = "batch",
+    [ trace_batch_member  ] = "batch_member",
+    [ trace_resolve_start ] = "resolve_start",
+    [ trace_resolve_end   ] = "resolve_end",
+    [ trace_tx_complete   ] = "tx_complete",
+    [ trace_grant_sent    ] = "grant_sent",
+    [ trace_advice_sent   ] = "advice_sent",
+};
+
+
+/*! \addtogroup pubif
+ *  Functions
+ *  @{
+ */
+
+void trace_init(OhmPlugin *plugin)
+{
+    const char *param;
+    char       *end;
+    uint32_t    size;
+
+    ENTER;
+
+    shared_init();
+
+    param = ohm_plugin_get_param(plugin, "trace");
+
+    if (param == NULL || !strcmp(param, "no"))
+        goto out;
+
+    size = strtoul(param, &end, 10);
+
+    if (*end != '\0' || size == 0 || size > MAX_TRACE_SIZE) {
+        OHM_ERROR("resource: invalid trace value '%s'", param);
+        goto out;
+    }
+
+    /* round up to a power of two, the ring index is masked */
+    for (mask = 1;  mask < size;  mask <<= 1)
+        ;
+
+    if ((ring = calloc(mask, sizeof(trace_record_t))) == NULL) {
+        OHM_ERROR("resource: can't allocate %u trace records", mask);
+        mask = 0;
+        goto out;
+    }
+
+    size = mask--;
+
+    param     = ohm_plugin_get_param(plugin, "trace-file");
+    dump_file = strdup(param ? param : DEFAULT_TRACE_FILE);
+
+    trace_enabled = TRUE;
+
+    OHM_INFO("resource: tracing %u records, dumped to %s", size, dump_file);
+
+ out:
+    LEAVE;
+}
+
+void trace_exit(OhmPlugin *plugin)
+{
+    (void)plugin;
+
+    if (trace_enabled) {
+        trace_enabled = FALSE;
+
+        if (trace_dump(dump_file) < 0) {
+            OHM_ERROR("resource: failed to dump trace to %s: %s",
+                      dump_file, strerror(errno));
+        }
+    }
+
+    free(ring);
+    free(dump_file);
+
+    ring         = NULL;
+    dump_file    = NULL;
+    mask         = 0;
+    head         = 0;
+    trace_shared = NULL;
+}
+
+void trace_add(trace_event_t event,
+               uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3)
+{
+    trace_record_t  *rec;
+    struct timespec  ts;
+
+    if (TRACEPOINT_ON(trace_shared)) {
+        trace_shared->record(shared_events[event], spans[event].phase,
+                             a0, a1, a2);
+    }
+
+    if (ring == NULL)
+        return;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    rec = ring + (head++ & mask);
+
+    rec->nsec   = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    rec->event  = event;
+    rec->arg[0] = a0;
+    rec->arg[1] = a1;
+    rec->arg[2] = a2;
+    rec->arg[3] = a3;
+}
+
+int trace_dump(const char *path)
+{
+    FILE           *fp;
+    trace_header_t  hdr;
+    char            name[TRACE_NAME_LEN];
+    uint32_t        first;
+    uint32_t        size;
+    uint32_t        n;
+    int             i;
+
+    if (ring == NULL || path == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if ((fp = fopen(path, "w")) == NULL)
+        return -1;
+
+    size  = mask + 1;
+    first = head > size ? head - size : 0;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic));
+    hdr.nevent  = trace_event_max;
+    hdr.nrecord = head - first;
+    hdr.lost    = first;
+    hdr.reclen  = sizeof(trace_record_t);
+
+    fwrite(&hdr, sizeof(hdr), 1, fp);
+
+    for (i = 0;  i < trace_event_max;  i++) {
+        memset(name, 0, sizeof(name));
+        strncpy(name, names[i], sizeof(name) - 1);
+        fwrite(name, sizeof(name), 1, fp);
+    }
+
+    /* the ring may have wrapped around: oldest first */
+    if ((n = size - (first & mask)) > hdr.nrecord)
+        n = hdr.nrecord;
+
+    fwrite(ring + (first & mask), sizeof(trace_record_t), n, fp);
+    fwrite(ring, sizeof(trace_record_t), hdr.nrecord - n, fp);
+
+    if (fclose(fp) != 0)
+        return -1;
+
+    OHM_INFO("resource: dumped %u trace records (%u lost) to %s",
+             hdr.nrecord, hdr.lost, path);
+
+    return hdr.nrecord;
+}
+
+
+/*!
+ * @}
+ */
+
+static void shared_init(void)
+{
+    char *signature = (char *)trace_provider_SIGNATURE;
+    int   i;
+
+    trace_provider = NULL;
+    ohm_module_find_method("timestamp.trace_provider",
+                           &signature, (void *)&trace_provider);
+
+    if (trace_provider == NULL ||
+        (trace_shared = trace_provider("resource")) == NULL)
+        return;
+
+    for (i = 0;  i < trace_event_max;  i++)
+        shared_events[i] = trace_shared->event(trace_shared, spans[i].name);
+
+    OHM_INFO("resource: tracepoints are forwarded to the timestamp plugin");
+}
+
+/* 
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
@@ -0,0 +1,101 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+#ifndef __OHM_RESOURCE_TRACE_H__
+#define __OHM_RESOURCE_TRACE_H__
+
+#include <stdint.h>
+
+#include "../timestamp/tracepoint.h"
+
+#define TRACE_MAGIC    "OHMRTRC1"
+#define TRACE_NAME_LEN 32
+
+/*
+ * tracepoints of the resource decisions. The arguments are stored as
+ * plain integers, the names below are written to the dump so that the
+ * offline tools do not depend on the numbering. When the timestamp plugin
+ * is loaded they are forwarded to its 'resource' trace category as well.
+ */
+typedef enum {
+    trace_request = 0,          /* manager_id, txid, msg type, reqno */
+    trace_request_done,         /* manager_id, txid */
+    trace_queued,               /* manager_id, txid, batched (1) /
+                                   deferred (2) */
+    trace_batch,                /* batch txid, number of requests */
+    trace_batch_member,         /* manager_id, txid, batch txid */
+    trace_resolve_start,        /* manager_id */
+    trace_resolve_end,          /* manager_id, resolver status */
+    trace_tx_complete,          /* txid, number of resource sets */
+    trace_grant_sent,           /* manager_id, txid, reqno, resources */
+    trace_advice_sent,          /* manager_id, txid, reqno, resources */
+    trace_event_max
+} trace_event_t;
+
+typedef struct {
+    uint64_t  nsec;             /* CLOCK_MONOTONIC */
+    uint32_t  event;            /* trace_event_t */
+    uint32_t  arg[4];
+    uint32_t  unused;
+} trace_record_t;
+
+/*
+ * dump layout: the header, trace_event_max names of TRACE_NAME_LEN bytes
+ * then nrecord records, oldest first, all in host byte order
+ */
+typedef struct {
+    char      magic[8];
+    uint32_t  nevent;
+    uint32_t  nrecord;
+    uint32_t  lost;             /* records overwritten in the ring */
+    uint32_t  reclen;           /* sizeof(trace_record_t) */
+} trace_header_t;
+
+
+#ifdef NO_RESOURCE_TRACE
+#define TRACE(ev, a0, a1, a2, a3) do { } while (0)
+#else
+#define TRACE(ev, a0, a1, a2, a3)                                     \
+    do {                                                              \
+        if (__builtin_expect(trace_enabled, 0) ||                     \
+            TRACEPOINT_ON(trace_shared))                              \
+            trace_add(ev, a0, a1, a2, a3);                            \
+    } while (0)
+#endif
+
+extern int                    trace_enabled;
+extern tracepoint_provider_t *trace_shared;
+
+void trace_init(OhmPlugin *);
+void trace_exit(OhmPlugin *);
+
+void trace_add(trace_event_t, uint32_t, uint32_t, uint32_t, uint32_t);
+int  trace_dump(const char *);
+
+
+#endif	/* __OHM_RESOURCE_TRACE_H__ */
+
+/* 
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
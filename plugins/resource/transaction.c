@@ -24,21 +24,18 @@ USA.
 #include <string.h>
 #include <stdarg.h>
 #include <errno.h>
+#include <sys/time.h>
 
 #include "plugin.h"
 #include "transaction.h"
+#include "trace.h"
 
-#define HASH_BITS      10
-#define HASH_DIM       (1 << HASH_BITS)
-#define HASH_MASK      (HASH_DIM - 1)
-#define HASH_INDEX(i)  ((i) & HASH_MASK)
-
-#define ALLOC_DIM      1024
-#define ALLOC_JUNK     (ALLOC_DIM * sizeof(uint32_t))
+#define RING_MIN       64       /* initial number of ring slots */
+#define TABLE_MIN      4        /* initial size of resource set tables */
 
 
 typedef struct {
-    int       junks;
+    int       size;
     int       length;
     uint32_t *table;    
 } resset_table_t;
@@ -48,19 +45,37 @@ typedef struct {
     void                   *user_data;
 } completion_t;
 
-typedef struct {
-    uint32_t           id;
-    int                refcnt;
-    resset_table_t     resset;
-    completion_t       completion;
+typedef struct transaction_s {
+    struct transaction_s *next;         /* free list link */
+    uint32_t              id;
+    int                   refcnt;
+    resset_table_t        resset;
+    completion_t          completion;
+    struct timeval        created;
 } transaction_t;
 
+/*
+ * Transactions complete in the order they were created, so the ones in
+ * flight always have consecutive ids from txread to txwrite. They are
+ * kept in a ring indexed by the low bits of the id which is doubled when
+ * it fills up. Completed transactions go back to a free list with their
+ * resource set tables, to be reused by the following transactions.
+ */
+typedef struct {
+    transaction_t **slots;
+    uint32_t        mask;
+    transaction_t  *pool;
+} ring_t;
 
-static transaction_t   transactions[HASH_DIM];
+
+static ring_t          ring;
 static uint32_t        txwrite;
 static uint32_t        txread = 1;
+static transaction_stats_t stats;
 
 static transaction_t *find_transaction(uint32_t);
+static transaction_t *alloc_transaction(void);
+static int grow_ring(void);
 static int add_resource_set(transaction_t *, uint32_t);
 static void complete_transaction(uint32_t);
 
@@ -76,6 +91,9 @@ void transaction_init(OhmPlugin *plugin)
 
     ENTER;
 
+    if (!grow_ring())
+        OHM_ERROR("resource: failed to allocate transaction table");
+
     LEAVE;
 }
 
@@ -83,27 +101,45 @@ uint32_t transaction_create(transaction_callback_t callback, void *user_data)
 {
     static uint32_t  count = NO_TRANSACTION;
 
-    uint32_t       txid = ++count;
-    int            idx  = HASH_INDEX(txid);
-    transaction_t *tx   = transactions + idx;
+    transaction_t *tx;
+    uint32_t       txid;
+    uint32_t       inflight;
+
+    if ((ring.slots == NULL || txwrite - txread + 1 > ring.mask) &&
+        !grow_ring())
+    {
+        OHM_ERROR("resource: can't grow transaction table");
+        return NO_TRANSACTION;
+    }
 
-    if (tx->id != NO_TRANSACTION) {
-        OHM_ERROR("resource: transaction table overflow: transaction %u",txid);
-        txid = NO_TRANSACTION;
+    if ((tx = alloc_transaction()) == NULL) {
+        OHM_ERROR("resource: failed to allocate transaction");
+        return NO_TRANSACTION;
     }
-    else {
-        memset(tx, 0, sizeof(transaction_t));
-        tx->id     = txid;
-        tx->refcnt = 1;
 
-        tx->completion.function  = callback;
-        tx->completion.user_data = user_data;
+    txid = ++count;
+
+    tx->id     = txid;
+    tx->refcnt = 1;
+
+    tx->completion.function  = callback;
+    tx->completion.user_data = user_data;
 
-        txwrite = txid;
+    gettimeofday(&tx->created, NULL);
 
-        OHM_DEBUG(DBG_TRANSACT, "transaction %u created", txid);
+    ring.slots[txid & ring.mask] = tx;
+    txwrite = txid;
+
+    stats.created++;
+
+    if ((inflight = txwrite - txread + 1) > stats.peak) {
+        stats.peak = inflight;
+        OHM_DEBUG(DBG_TRANSACT, "new peak of %u transactions in flight",
+                  inflight);
     }
 
+    OHM_DEBUG(DBG_TRANSACT, "transaction %u created", txid);
+
     return txid;
 }
 
@@ -164,6 +200,14 @@ int transaction_unref(uint32_t txid)
     return success;
 }
 
+void transaction_get_stats(transaction_stats_t *st)
+{
+    if (st != NULL) {
+        *st = stats;
+        st->inflight = txwrite - txread + 1;
+    }
+}
+
 
 /*!
  * @}
@@ -171,35 +215,93 @@ int transaction_unref(uint32_t txid)
 
 static transaction_t *find_transaction(uint32_t txid)
 {
-    int            idx = HASH_INDEX(txid);
-    transaction_t *tx  = transactions + idx;
+    transaction_t *tx;
+
+    if (txid == NO_TRANSACTION || txid < txread || txid > txwrite)
+        return NULL;
+
+    tx = ring.slots[txid & ring.mask];
+
+    return (tx != NULL && tx->id == txid) ? tx : NULL;
+}
+
+static transaction_t *alloc_transaction(void)
+{
+    transaction_t *tx;
+
+    if ((tx = ring.pool) != NULL) {
+        ring.pool = tx->next;
+        tx->next  = NULL;
+        tx->resset.length = 0;
+    }
+    else {
+        if ((tx = malloc(sizeof(transaction_t))) != NULL)
+            memset(tx, 0, sizeof(transaction_t));
+    }
+
+    return tx;
+}
+
+static void free_transaction(transaction_t *tx)
+{
+    tx->id     = NO_TRANSACTION;
+    tx->refcnt = 0;
+    tx->next   = ring.pool;
 
-    return (txid != NO_TRANSACTION && txid == tx->id) ? tx : NULL;
+    memset(&tx->completion, 0, sizeof(tx->completion));
+
+    ring.pool = tx;
 }
 
+static int grow_ring(void)
+{
+    transaction_t **slots;
+    uint32_t        size;
+    uint32_t        mask;
+    uint32_t        id;
+
+    size = ring.slots ? (ring.mask + 1) * 2 : RING_MIN;
+    mask = size - 1;
+
+    if ((slots = calloc(size, sizeof(transaction_t *))) == NULL)
+        return FALSE;
+
+    if (ring.slots != NULL) {
+        for (id = txread;  id <= txwrite;  id++)
+            slots[id & mask] = ring.slots[id & ring.mask];
+
+        free(ring.slots);
+
+        OHM_DEBUG(DBG_TRANSACT, "transaction table grown to %u slots", size);
+    }
+
+    ring.slots = slots;
+    ring.mask  = mask;
+
+    return TRUE;
+}
 
 static int add_resource_set(transaction_t *tx, uint32_t rsid)
 {
-    int   idx   = tx->resset.length;
-    int   junks;
-    int   size;
-    void *mem;
-    int   i;
+    int       idx   = tx->resset.length;
+    int       size;
+    uint32_t *table;
+    int       i;
 
     for (i = 0;    i < tx->resset.length;   i++) {
         if (tx->resset.table[i] == rsid)
             return TRUE;        /* it is already there */
     }
     
-    if ((junks = (idx + ALLOC_JUNK) / ALLOC_JUNK) > tx->resset.junks) {
-        size = junks * ALLOC_JUNK * sizeof(uint32_t *);
-        mem  = realloc(tx->resset.table, size);
+    if (idx >= tx->resset.size) {
+        size  = tx->resset.size ? tx->resset.size * 2 : TABLE_MIN;
+        table = realloc(tx->resset.table, size * sizeof(uint32_t));
         
-        if (mem == NULL)
+        if (table == NULL)
             return FALSE;
 
-        tx->resset.junks = junks;
-        tx->resset.table = mem;
+        tx->resset.size  = size;
+        tx->resset.table = table;
     }
 
     tx->resset.length = idx + 1;
@@ -210,10 +312,14 @@ static int add_resource_set(transaction_t *tx, uint32_t rsid)
 
 static void complete_transaction(uint32_t txid)
 {
-    transaction_t *tx;
-    uint32_t       id;
+    transaction_t  *tx;
+    uint32_t        id;
+    struct timeval  now;
+    uint64_t        usecs;
 
     if (txid == txread) {
+        gettimeofday(&now, NULL);
+
         for (id = txread;  id <= txwrite;   id++)  {
             if ((tx = find_transaction(id)) == NULL) {
                 OHM_ERROR("resource: wants to complete transaction %u "
@@ -226,13 +332,24 @@ static void complete_transaction(uint32_t txid)
 
             OHM_DEBUG(DBG_TRANSACT, "completing transaction %u", tx->id);
 
+            TRACE(trace_tx_complete, tx->id, tx->resset.length, 0, 0);
+
             if (tx->completion.function != NULL) {
                 tx->completion.function(tx->resset.table, tx->resset.length,
                                         tx->id, tx->completion.user_data);
             }
-        
-            free(tx->resset.table);
-            memset(tx, 0, sizeof(*tx));
+
+            usecs = (uint64_t)(now.tv_sec  - tx->created.tv_sec) * 1000000ULL
+                  + (now.tv_usec - tx->created.tv_usec);
+
+            stats.completed++;
+            stats.latency_total += usecs;
+
+            if (usecs > stats.latency_max)
+                stats.latency_max = usecs;
+
+            ring.slots[id & ring.mask] = NULL;
+            free_transaction(tx);
             
             txread = id + 1;
         }
@@ -27,6 +27,15 @@ USA.
 
 typedef void   (*transaction_callback_t)(uint32_t *, int, uint32_t, void *);
 
+typedef struct {
+    uint32_t  created;          /* transactions created */
+    uint32_t  completed;        /* transactions completed */
+    uint32_t  inflight;         /* transactions not completed yet */
+    uint32_t  peak;             /* max. number of transactions in flight */
+    uint64_t  latency_total;    /* sum of create-complete times in usec */
+    uint64_t  latency_max;      /* longest create-complete time in usec */
+} transaction_stats_t;
+
 
 void transaction_init(OhmPlugin *);
 
@@ -37,6 +46,8 @@ int transaction_add_resource_set(uint32_t, uint32_t);
 int transaction_ref(uint32_t);
 int transaction_unref(uint32_t);
 
+void transaction_get_stats(transaction_stats_t *);
+
 
 
 #endif	/* __OHM_RESOURCE_TRANSACTION_H__ */
@@ -43,6 +43,12 @@ OHM_IMPORTABLE(int, add_field_watch, (char                  *factname,
                                       fsif_field_watch_cb_t  callback,
                                       void                  *usrdata));
 
+OHM_IMPORTABLE(int, add_deferred_field_watch, (char                  *factname,
+                                               fsif_field_t          *selist,
+                                               char                  *fldname,
+                                               fsif_field_watch_cb_t  callback,
+                                               void                  *usrdata));
+
 OHM_IMPORTABLE(int, add_fact_watch, (char                 *factname,
                                      fsif_fact_watch_e     type,
                                      fsif_fact_watch_cb_t  callback,
@@ -63,8 +69,9 @@ OHM_IMPORTABLE(fsif_entry_t *, get_entry, (char           *name,
 
 OHM_IMPORTABLE(GSList *, get_entries_by_name, (char       *name));
 
-OHM_PLUGIN_REQUIRES_METHODS(route, 6,
+OHM_PLUGIN_REQUIRES_METHODS(route, 7,
     OHM_IMPORT("fsif.add_field_watch", add_field_watch),
+    OHM_IMPORT("fsif.add_deferred_field_watch", add_deferred_field_watch),
     OHM_IMPORT("fsif.add_fact_watch", add_fact_watch),
     OHM_IMPORT("fsif.get_field_by_name", get_field_by_name),
     OHM_IMPORT("fsif.get_field_by_entry", get_field_by_entry),
@@ -87,6 +94,16 @@ int fsif_add_field_watch(char                  *factname,
     return add_field_watch(factname, selist, fldname, callback, usrdata);
 }
 
+int fsif_add_deferred_field_watch(char                  *factname,
+                                  fsif_field_t          *selist,
+                                  char                  *fldname,
+                                  fsif_field_watch_cb_t  callback,
+                                  void                  *usrdata)
+{
+    return add_deferred_field_watch(factname, selist, fldname, callback,
+                                    usrdata);
+}
+
 int fsif_add_fact_watch(char                 *factname,
                         fsif_fact_watch_e     type,
                         fsif_fact_watch_cb_t  callback,
@@ -49,6 +49,12 @@ int fsif_add_field_watch(char                  *factname,
                          fsif_field_watch_cb_t  callback,
                          void                  *usrdata);
 
+int fsif_add_deferred_field_watch(char                  *factname,
+                                  fsif_field_t          *selist,
+                                  char                  *fldname,
+                                  fsif_field_watch_cb_t  callback,
+                                  void                  *usrdata);
+
 int fsif_add_fact_watch(char                 *factname,
                         fsif_fact_watch_e     type,
                         fsif_fact_watch_cb_t  callback,
@@ -240,13 +240,21 @@ void route_init(OhmPlugin *plugin)
     if ((entries = fsif_get_entries_by_name(FACTSTORE_FEATURE)))
         g_slist_foreach(entries, (GFunc) read_features, NULL);
 
-    fsif_add_field_watch(FACTSTORE_AUDIO_ROUTE, NULL, FACTSTORE_AUDIO_ARG_DEVICE,
-                         audio_route_changed_cb, NULL);
-
-    fsif_add_field_watch(FACTSTORE_FEATURE, NULL, FACTSTORE_FEATURE_ARG_ALLOWED,
-                         audio_feature_changed_cb, NULL);
-    fsif_add_field_watch(FACTSTORE_FEATURE, NULL, FACTSTORE_FEATURE_ARG_ENABLED,
-                         audio_feature_changed_cb, NULL);
+    /*
+     * A resolve may rewrite the routes and features several times before
+     * it settles. We only want to signal the final state, so these are
+     * delivered once per field from idle with the final value.
+     */
+    fsif_add_deferred_field_watch(FACTSTORE_AUDIO_ROUTE, NULL,
+                                  FACTSTORE_AUDIO_ARG_DEVICE,
+                                  audio_route_changed_cb, NULL);
+
+    fsif_add_deferred_field_watch(FACTSTORE_FEATURE, NULL,
+                                  FACTSTORE_FEATURE_ARG_ALLOWED,
+                                  audio_feature_changed_cb, NULL);
+    fsif_add_deferred_field_watch(FACTSTORE_FEATURE, NULL,
+                                  FACTSTORE_FEATURE_ARG_ENABLED,
+                                  audio_feature_changed_cb, NULL);
 }
 
 static void route_free(struct audio_device_mapping_route *r)
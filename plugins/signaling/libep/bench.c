@@ -0,0 +1,291 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/* libep decoding microbenchmark: no bus is needed, the decision signals
+ * are built and demarshalled locally and fed to ep_decode */
+
+#include <time.h>
+
+#include "ep.h"
+
+#define DEFAULT_ROUNDS 100000
+
+static const char *fields[] = { "type", "device", "mute", "mode", "group" };
+
+#define NFIELD (int) (sizeof(fields) / sizeof(fields[0]))
+
+static int nset      = 4;
+static int ndecision = 2;
+
+static double now (void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int append_field (DBusMessageIter *fact, const char *name, int i)
+{
+    DBusMessageIter field, variant;
+    const char     *s = "headset";
+
+    if (!dbus_message_iter_open_container(fact, DBUS_TYPE_STRUCT, NULL, &field))
+        return FALSE;
+
+    if (!dbus_message_iter_append_basic(&field, DBUS_TYPE_STRING, &name))
+        return FALSE;
+
+    if (i & 1) {
+        dbus_int32_t v = i;
+
+        if (!dbus_message_iter_open_container(&field, DBUS_TYPE_VARIANT,
+                        "i", &variant) ||
+            !dbus_message_iter_append_basic(&variant, DBUS_TYPE_INT32, &v))
+            return FALSE;
+    }
+    else {
+        if (!dbus_message_iter_open_container(&field, DBUS_TYPE_VARIANT,
+                        "s", &variant) ||
+            !dbus_message_iter_append_basic(&variant, DBUS_TYPE_STRING, &s))
+            return FALSE;
+    }
+
+    dbus_message_iter_close_container(&field, &variant);
+    dbus_message_iter_close_container(fact, &field);
+
+    return TRUE;
+}
+
+static DBusMessage *build_message (void)
+{
+    DBusMessage     *msg, *copy;
+    DBusMessageIter  it, arr, ent, facts, fact;
+    dbus_uint32_t    txid = 0;
+    char             name[64];
+    const char      *n = name;
+    char            *buf;
+    int              len, i, j, k;
+
+    msg = dbus_message_new_signal(POLICY_DBUS_PATH "/" POLICY_DECISION,
+            POLICY_DBUS_INTERFACE, "actions");
+
+    if (msg == NULL)
+        return NULL;
+
+    dbus_message_iter_init_append(msg, &it);
+    dbus_message_iter_append_basic(&it, DBUS_TYPE_UINT32, &txid);
+    dbus_message_iter_open_container(&it, DBUS_TYPE_ARRAY, "{saa(sv)}", &arr);
+
+    for (i = 0; i < nset; i++) {
+        snprintf(name, sizeof(name), "com.nokia.policy.bench_%d", i);
+
+        dbus_message_iter_open_container(&arr, DBUS_TYPE_DICT_ENTRY, NULL, &ent);
+        dbus_message_iter_append_basic(&ent, DBUS_TYPE_STRING, &n);
+        dbus_message_iter_open_container(&ent, DBUS_TYPE_ARRAY, "a(sv)", &facts);
+
+        for (j = 0; j < ndecision; j++) {
+            dbus_message_iter_open_container(&facts, DBUS_TYPE_ARRAY, "(sv)", &fact);
+            for (k = 0; k < NFIELD; k++) {
+                if (!append_field(&fact, fields[k], k)) {
+                    dbus_message_unref(msg);
+                    return NULL;
+                }
+            }
+            dbus_message_iter_close_container(&facts, &fact);
+        }
+
+        dbus_message_iter_close_container(&ent, &facts);
+        dbus_message_iter_close_container(&arr, &ent);
+    }
+
+    dbus_message_iter_close_container(&it, &arr);
+
+    /* go through the wire format to get a message like the received ones */
+
+    dbus_message_set_serial(msg, 1);
+
+    if (!dbus_message_marshal(msg, &buf, &len)) {
+        dbus_message_unref(msg);
+        return NULL;
+    }
+
+    copy = dbus_message_demarshal(buf, len, NULL);
+
+    dbus_free(buf);
+    dbus_message_unref(msg);
+
+    return copy;
+}
+
+#define LOOKUP_REPEAT 100
+
+static ep_key keys[NFIELD];
+static long   checksum;
+static double lookup_time;
+static long   lookup_count;
+
+static void decode_only (const char *decision_name,
+        struct ep_decision **decisions, ep_answer_cb cb, ep_answer_token token,
+        void *user_data)
+{
+    (void) decision_name;
+    (void) decisions;
+    (void) user_data;
+
+    cb(token, 1);
+}
+
+static void lookup_by_name (const char *decision_name,
+        struct ep_decision **decisions, ep_answer_cb cb, ep_answer_token token,
+        void *user_data)
+{
+    struct ep_decision **d;
+    double start = now();
+    int    r, i;
+
+    (void) decision_name;
+    (void) user_data;
+
+    for (r = 0; r < LOOKUP_REPEAT; r++) {
+        for (d = decisions; *d; d++) {
+            for (i = 0; i < NFIELD; i++) {
+                if (ep_decision_type(*d, fields[i]) == EP_VALUE_INT)
+                    checksum += ep_decision_get_int(*d, fields[i]);
+                else
+                    checksum += ep_decision_get_string(*d, fields[i]) != NULL;
+                lookup_count += 2;
+            }
+        }
+    }
+
+    lookup_time += now() - start;
+
+    cb(token, 1);
+}
+
+static void lookup_by_key (const char *decision_name,
+        struct ep_decision **decisions, ep_answer_cb cb, ep_answer_token token,
+        void *user_data)
+{
+    struct ep_decision **d;
+    double start = now();
+    int    r, i;
+
+    (void) decision_name;
+    (void) user_data;
+
+    for (r = 0; r < LOOKUP_REPEAT; r++) {
+        for (d = decisions; *d; d++) {
+            for (i = 0; i < NFIELD; i++) {
+                if (ep_decision_type_by_key(*d, keys[i]) == EP_VALUE_INT)
+                    checksum += ep_decision_get_int_by_key(*d, keys[i]);
+                else
+                    checksum += ep_decision_get_string_by_key(*d, keys[i]) != NULL;
+                lookup_count += 2;
+            }
+        }
+    }
+
+    lookup_time += now() - start;
+
+    cb(token, 1);
+}
+
+static double run (DBusMessage *msg, ep_decision_cb cb, int rounds)
+{
+    double start;
+    int    i;
+
+    start = now();
+
+    for (i = 0; i < rounds; i++) {
+        if (!ep_decode(msg, NULL, cb, NULL)) {
+            printf("bench: failed to decode the message\n");
+            exit(1);
+        }
+    }
+
+    return (now() - start) / rounds;
+}
+
+static double run_lookups (DBusMessage *msg, ep_decision_cb cb, int rounds)
+{
+    lookup_time  = 0;
+    lookup_count = 0;
+
+    run(msg, cb, rounds);
+
+    return lookup_time / lookup_count;
+}
+
+int main (int argc, char **argv)
+{
+    DBusMessage *msg;
+    int          rounds = DEFAULT_ROUNDS;
+    int          i;
+    double       decode, decode_keys, by_name, by_key;
+
+    if (argc > 1)
+        rounds = atoi(argv[1]);
+    if (argc > 2)
+        nset = atoi(argv[2]);
+    if (argc > 3)
+        ndecision = atoi(argv[3]);
+
+    if (rounds <= 0 || nset <= 0 || ndecision <= 0) {
+        printf("usage: %s [rounds [decision-sets [decisions-per-set]]]\n",
+                argv[0]);
+        return 1;
+    }
+
+    if ((msg = build_message()) == NULL) {
+        printf("bench: failed to build the test message\n");
+        return 1;
+    }
+
+    /* warm up the decoder arena */
+    run(msg, decode_only, rounds / 10 + 1);
+    decode = run(msg, decode_only, rounds);
+
+    by_name = run_lookups(msg, lookup_by_name, rounds / LOOKUP_REPEAT + 1);
+
+    for (i = 0; i < NFIELD; i++)
+        keys[i] = ep_key_register(fields[i]);
+
+    /* the registered keys are resolved by the decoder, so this includes
+     * the (hashed) lookups done while decoding */
+    decode_keys = run(msg, decode_only, rounds);
+
+    by_key = run_lookups(msg, lookup_by_key, rounds / LOOKUP_REPEAT + 1);
+
+    printf("%d rounds, %d decision sets x %d decisions x %d fields\n",
+            rounds, nset, ndecision, NFIELD);
+    printf("  decode:                  %9.1f ns/message\n", decode);
+    printf("  decode, registered keys: %9.1f ns/message\n", decode_keys);
+    printf("  lookup by name:          %9.1f ns/lookup\n", by_name);
+    printf("  lookup by key:           %9.1f ns/lookup\n", by_key);
+    printf("  (checksum %ld)\n", checksum);
+
+    dbus_message_unref(msg);
+
+    return 0;
+}
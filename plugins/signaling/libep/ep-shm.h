@@ -0,0 +1,137 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/* shared memory decision channel -- layout shared by signaling and libep
+ *
+ * The policy side owns a single segment with one decision ring. Every
+ * decision is written into the ring once, tagged with the set of readers
+ * (enforcement points) that need to process it. The EPs only get a read
+ * only descriptor for it. Each reader has a small segment of its own for
+ * its read position and a ring of acks going back to the policy side, so
+ * an EP can only ever scribble over its own state. Doorbells are eventfds:
+ * one per reader for new decisions and one per reader for new acks.
+ * Everything is set up over the D-Bus policy interface with the
+ * METHOD_POLICY_SHM call.
+ *
+ * A reader that falls a full ring behind is dropped by the policy side
+ * (its slot is deactivated) and gets its decisions over D-Bus again. */
+
+#ifndef LIBEP_SHM_H
+#define LIBEP_SHM_H
+
+#include <stdint.h>
+
+#define POLICY_SHM_CHANNEL      "shm_channel"
+
+#define EP_SHM_MAGIC            0x45505348      /* "EPSH" */
+#define EP_SHM_VERSION          2
+#define EP_SHM_MAX_READERS      32
+#define EP_SHM_ACK_SLOTS        256             /* power of two */
+#define EP_SHM_RING_SIZE        (256 * 1024)    /* power of two */
+
+#define EP_SHM_ALIGN            8
+#define EP_SHM_ALIGN_SIZE(n)    (((n) + EP_SHM_ALIGN - 1) & ~(EP_SHM_ALIGN - 1))
+
+#define EP_SHM_VALUE_INVALID    0               /* same as enum ep_value_type */
+#define EP_SHM_VALUE_INT        1
+#define EP_SHM_VALUE_FLOAT      2
+#define EP_SHM_VALUE_STRING     3
+
+struct ep_shm_ack {
+    uint32_t txid;
+    uint32_t status;
+};
+
+struct ep_shm_reader {                  /* in the reader's own segment */
+    volatile uint64_t  read_pos;        /* written by the reader */
+    volatile uint32_t  ack_head;        /* written by the reader */
+    uint32_t           pad;
+    struct ep_shm_ack  acks[EP_SHM_ACK_SLOTS];
+};
+
+struct ep_shm_slot {                    /* in the shared segment */
+    volatile uint32_t  active;          /* nonzero while in use, differs
+                                           every time the slot is reused */
+    volatile uint32_t  ack_tail;        /* acks consumed so far */
+};
+
+struct ep_shm_header {
+    uint32_t              magic;
+    uint32_t              version;
+    uint32_t              ring_size;
+    uint32_t              max_readers;
+    volatile uint64_t     write_pos;    /* written by the policy side */
+    struct ep_shm_slot    readers[EP_SHM_MAX_READERS];
+};
+
+#define EP_SHM_DATA_OFFSET      EP_SHM_ALIGN_SIZE(sizeof(struct ep_shm_header))
+#define EP_SHM_SEGMENT_SIZE(r)  (EP_SHM_DATA_OFFSET + (r))
+#define EP_SHM_DATA(hdr)        ((char *) (hdr) + EP_SHM_DATA_OFFSET)
+#define EP_SHM_READER_SIZE      sizeof(struct ep_shm_reader)
+
+/*
+ * Records in the ring. Positions are free running byte counters, the
+ * offset in the ring is pos % ring_size. A record never wraps: if it does
+ * not fit before the end of the ring the writer puts a padding record
+ * (readers == 0) there, or if not even a record header fits, both sides
+ * just skip to the beginning.
+ *
+ * A record is a header followed by the decision sets, each set by its
+ * decisions and each decision by its pairs. Every element carries its
+ * total size so readers can walk them. Strings are stored right after
+ * the element referring to them and the children of an element come
+ * after its strings. String references are offsets from the start of
+ * the element referring to them.
+ */
+
+struct ep_shm_record {
+    uint32_t size;              /* including the header and padding */
+    uint32_t txid;
+    uint32_t readers;           /* bitmask of readers, 0 for padding */
+    uint32_t signal;            /* signal name */
+    uint32_t nset;
+    uint32_t pad;
+};
+
+struct ep_shm_set {
+    uint32_t size;              /* including the decisions */
+    uint32_t name;
+    uint32_t ndecision;
+    uint32_t pad;
+};
+
+struct ep_shm_decision {
+    uint32_t size;              /* including the pairs */
+    uint32_t npair;
+};
+
+struct ep_shm_pair {
+    uint32_t size;              /* including the strings */
+    uint32_t key;
+    uint32_t type;
+    uint32_t pad;
+    union {
+        int32_t  i;
+        double   d;
+        uint32_t s;             /* offset of a string value */
+    } value;
+};
+
+#endif
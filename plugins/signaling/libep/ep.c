@@ -18,7 +18,11 @@ USA.
 *************************************************************************/
 
 
+#include <errno.h>
+#include <sys/mman.h>
+
 #include "ep.h"
+#include "ep-shm.h"
 
 
 /* globals */
@@ -27,6 +31,17 @@ static DBusConnection *connection = NULL;
 static struct ep_list_head_s cb_list;
 static struct ep_list_head_s transaction_list;
 
+/* shared memory decision channel, if one is set up */
+static struct ep_shm_header *shm = NULL;
+static size_t                shm_size;
+static struct ep_shm_reader *shm_rd = NULL;
+static int                   shm_reader = -1;
+static uint32_t              shm_active = 0;
+static int                   shm_doorbell = -1;
+static int                   shm_ackbell = -1;
+static char                 *shm_copy = NULL;   /* see ep_shm_dispatch */
+static uint32_t              shm_copy_size = 0;
+
 struct transaction_data {
     int txid;
     unsigned int refcount;
@@ -124,47 +139,6 @@ static int ep_list_remove (struct ep_list_head_s *head, void *data)
     return TRUE;
 }
 
-static void ep_list_free_all (struct ep_list_head_s *head) {
-
-    struct ep_list_node_s *node = head->first, *p_node = NULL;
-
-    while (node) {
-        p_node = node;
-        node = node->next;
-
-        free(p_node);
-    }
-
-    head->first = NULL;
-    head->last = NULL;
-}
-
-static void ** ep_list_convert_to_array(struct ep_list_head_s *head) {
-
-    struct ep_list_node_s *node = head->first;
-    int node_count = 0, i = 0;
-    void **retval = NULL;
-
-    while (node) {
-        node_count++;
-        node = node->next;
-    }
-
-    retval = calloc(node_count + 1, sizeof(void *));
-
-    if (!retval)
-        return NULL;
-
-    node = head->first;
-
-    for (i = 0; i < node_count; i++) {
-        retval[i] = node->data;
-        node = node->next;
-    }
-    
-    return retval;
-}
-
 static struct transaction_data * ep_get_transaction(int txid) {
     
     /* check if it is still valid -- need to be in the list */
@@ -184,423 +158,1602 @@ static struct transaction_data * ep_get_transaction(int txid) {
     return NULL;
 }
 
+/* the policy engine drops us from the channel if we fall behind, after
+ * that everything goes over D-Bus again */
+static int shm_in_use (void)
+{
+    return shm != NULL && shm->readers[shm_reader].active == shm_active;
+}
+
+static int shm_ack (int txid, int status)
+{
+    struct ep_shm_reader *rd = shm_rd;
+    uint32_t              head = rd->ack_head;
+    uint64_t              one = 1;
+
+    if (head - shm->readers[shm_reader].ack_tail >= EP_SHM_ACK_SLOTS)
+        return FALSE;
+
+    rd->acks[head & (EP_SHM_ACK_SLOTS - 1)].txid   = txid;
+    rd->acks[head & (EP_SHM_ACK_SLOTS - 1)].status = status;
+
+    __sync_synchronize();
+    rd->ack_head = head + 1;
+
+    if (write(shm_ackbell, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        return FALSE;
+
+    return TRUE;
+}
+
 static void send_signal (int txid, int status)
 {
     DBusMessage *msg;
     char         path[256];
     int          ret;
 
+    if (shm_in_use()) {
+        if (txid == 0)
+            return;
+        /* if the ack ring is full, fall back to the status signal */
+        if (shm_ack(txid, status))
+            return;
+    }
+
 #if 0
     printf("libep: sending %s signal with txid %i\n",
             status ? "ACK" : "NACK", txid);
 #endif
 
-    snprintf(path, sizeof(path), "%s/%s", POLICY_DBUS_PATH, POLICY_DECISION);
+    snprintf(path, sizeof(path), "%s/%s", POLICY_DBUS_PATH, POLICY_DECISION);
+
+    msg = dbus_message_new_signal(path, POLICY_DBUS_INTERFACE, POLICY_STATUS);
+
+    if (msg == NULL) {
+        goto fail;
+    }
+
+    ret = dbus_message_append_args(msg,
+            DBUS_TYPE_UINT32, &txid,
+            DBUS_TYPE_UINT32, &status,
+            DBUS_TYPE_INVALID);
+
+    if (!ret) {
+        goto fail;
+    }
+
+    ret = dbus_connection_send(connection, msg, NULL);
+
+    if (!ret) {
+        goto fail;
+    }
+
+    dbus_message_unref(msg);
+    return;
+
+ fail:
+
+    dbus_message_unref(msg);    /* should cope with NULL msg */
+    return;
+}
+
+static void send_if_done(struct transaction_data *data)
+{
+    /* see if the callbacks acked the message right away */
+
+    if (data->txid == 0)
+        return;
+
+    if (data->refcount != 0)
+        return; /* no need to send yet */
+
+    /* all callbacks have returned true or one has failed */
+    send_signal(data->txid, TRUE);
+    ep_list_remove(&transaction_list, data);
+    free(data);
+    data = NULL;
+}
+
+static void ep_ready(int txid, int status) {
+
+    struct transaction_data *data = NULL;
+
+    if (txid == 0)
+        return;
+
+    /* find the correct transaction data structure */
+    data = ep_get_transaction(txid);
+
+    if (data) {
+#if 0
+        printf("libep: decreasing data '%p' reference count from '%u' to '%u'\n",
+                data, data->refcount, data->refcount - 1);
+#endif
+        data->refcount--;
+        if ((data->refcount == 0 && data->ready) || !status) {
+            /* all callbacks have returned true or one has failed */
+            send_signal(txid, status);
+            ep_list_remove(&transaction_list, data);
+            free(data);
+            data = NULL;
+        }
+    }
+
+    return;
+}
+
+
+/* arena for the decoded decisions
+ *
+ * The decisions handed to the callbacks only live until the callbacks
+ * return, so everything is carved out of a chain of chunks that is
+ * rewound for the next message instead of being freed. The keys and
+ * string values are not copied at all; they point into the message. */
+
+#define ARENA_CHUNK_SIZE 4096
+#define ARENA_ALIGN      sizeof(double)
+
+struct ep_arena_chunk {
+    struct ep_arena_chunk *next;
+    size_t size;
+    size_t used;
+    double data[];              /* double for alignment */
+};
+
+struct ep_arena {
+    struct ep_arena_chunk *first;
+    struct ep_arena_chunk *current;
+    int busy;
+};
+
+static struct ep_arena decode_arena;
+
+static void *arena_alloc (struct ep_arena *arena, size_t size)
+{
+    struct ep_arena_chunk *chunk = arena->current;
+    void *ptr;
+
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+    while (chunk && chunk->size - chunk->used < size) {
+        /* rewound chunks after the current one can be reused */
+        chunk = chunk->next;
+        if (chunk)
+            chunk->used = 0;
+    }
+
+    if (chunk == NULL) {
+        size_t chunk_size = size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE;
+
+        chunk = malloc(sizeof(struct ep_arena_chunk) + chunk_size);
+
+        if (chunk == NULL)
+            return NULL;
+
+        chunk->size = chunk_size;
+        chunk->used = 0;
+
+        /* keep the chain ordered: insert right after the current chunk */
+        if (arena->current) {
+            chunk->next = arena->current->next;
+            arena->current->next = chunk;
+        }
+        else {
+            chunk->next = arena->first;
+            arena->first = chunk;
+        }
+    }
+
+    arena->current = chunk;
+
+    ptr = (char *) chunk->data + chunk->used;
+    chunk->used += size;
+
+    memset(ptr, 0, size);
+
+    return ptr;
+}
+
+static void arena_reset (struct ep_arena *arena)
+{
+    arena->current = arena->first;
+
+    if (arena->current)
+        arena->current->used = 0;
+}
+
+static void arena_free (struct ep_arena *arena)
+{
+    struct ep_arena_chunk *chunk = arena->first, *next;
+
+    while (chunk) {
+        next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+
+    arena->first = NULL;
+    arena->current = NULL;
+}
+
+static struct ep_arena *arena_get (void)
+{
+    struct ep_arena *arena;
+
+    if (!decode_arena.busy) {
+        arena = &decode_arena;
+    }
+    else {
+        /* a callback ended up decoding another message, use a private
+         * arena for that so that we don't rewind the outer decisions */
+        if ((arena = calloc(1, sizeof(struct ep_arena))) == NULL)
+            return NULL;
+    }
+
+    arena_reset(arena);
+    arena->busy = TRUE;
+
+    return arena;
+}
+
+static void arena_put (struct ep_arena *arena)
+{
+    if (arena == NULL)
+        return;
+
+    if (arena == &decode_arena) {
+        arena->busy = FALSE;
+    }
+    else {
+        arena_free(arena);
+        free(arena);
+    }
+}
+
+
+/* registered keys: a small open addressing hash from key name to handle */
+
+struct ep_key_entry {
+    char        *name;
+    unsigned int hash;
+    ep_key       key;
+};
+
+static struct ep_key_entry *key_table;
+static unsigned int         key_table_size;  /* always a power of two */
+static int                  key_count;
+
+static unsigned int key_hash (const char *name)
+{
+    unsigned int h = 2166136261u;
+
+    while (*name) {
+        h ^= (unsigned char) *name++;
+        h *= 16777619u;
+    }
+
+    return h;
+}
+
+static ep_key key_lookup (const char *name)
+{
+    unsigned int hash, i;
+
+    if (key_count == 0)
+        return EP_KEY_INVALID;
+
+    hash = key_hash(name);
+
+    for (i = hash & (key_table_size - 1);
+         key_table[i].name != NULL;
+         i = (i + 1) & (key_table_size - 1)) {
+        if (key_table[i].hash == hash && strcmp(key_table[i].name, name) == 0)
+            return key_table[i].key;
+    }
+
+    return EP_KEY_INVALID;
+}
+
+static int key_table_grow (void)
+{
+    struct ep_key_entry *table;
+    unsigned int size, i, j;
+
+    size = key_table_size ? 2 * key_table_size : 16;
+
+    if ((table = calloc(size, sizeof(struct ep_key_entry))) == NULL)
+        return FALSE;
+
+    for (i = 0; i < key_table_size; i++) {
+        if (key_table[i].name == NULL)
+            continue;
+
+        for (j = key_table[i].hash & (size - 1);
+             table[j].name != NULL;
+             j = (j + 1) & (size - 1))
+            ;
+
+        table[j] = key_table[i];
+    }
+
+    free(key_table);
+    key_table = table;
+    key_table_size = size;
+
+    return TRUE;
+}
+
+ep_key ep_key_register (const char *name)
+{
+    unsigned int hash, i;
+    ep_key key;
+
+    if (name == NULL)
+        return EP_KEY_INVALID;
+
+    if ((key = key_lookup(name)) != EP_KEY_INVALID)
+        return key;
+
+    if (2 * (key_count + 1) > (int) key_table_size && !key_table_grow())
+        return EP_KEY_INVALID;
+
+    hash = key_hash(name);
+
+    for (i = hash & (key_table_size - 1);
+         key_table[i].name != NULL;
+         i = (i + 1) & (key_table_size - 1))
+        ;
+
+    if ((key_table[i].name = strdup(name)) == NULL)
+        return EP_KEY_INVALID;
+
+    key_table[i].hash = hash;
+    key_table[i].key  = ++key_count;
+
+    return key_table[i].key;
+}
+
+
+/* decoding */
+
+union decode_value {
+    dbus_int32_t  i;
+    double        d;
+    char         *s;
+};
+
+typedef void (*decision_set_cb) (const char *actname,
+        struct ep_decision **decisions, void *user_data);
+
+static int count_elements (DBusMessageIter *it)
+{
+    DBusMessageIter copy = *it;
+    int n = 0;
+
+    if (dbus_message_iter_get_arg_type(&copy) == DBUS_TYPE_INVALID)
+        return 0;
+
+    do {
+        n++;
+    } while (dbus_message_iter_next(&copy));
+
+    return n;
+}
+
+static int decode_pair (DBusMessageIter *structit, struct ep_arena *arena,
+        struct ep_key_value_pair *pair)
+{
+    DBusMessageIter    structfieldit;
+    DBusMessageIter    variantit;
+    union decode_value value;
+    char              *key = NULL;
+
+    if (dbus_message_iter_get_arg_type(structit) != DBUS_TYPE_STRUCT)
+        return FALSE;
+
+    dbus_message_iter_recurse(structit, &structfieldit);
+
+    /* there are two fields inside the struct: one string and one variant */
+
+    if (dbus_message_iter_get_arg_type(&structfieldit) != DBUS_TYPE_STRING)
+        return FALSE;
+
+    dbus_message_iter_get_basic(&structfieldit, (void *)&key);
+    pair->key = key;
+
+    if (!dbus_message_iter_next(&structfieldit))
+        return FALSE;
+
+    if (dbus_message_iter_get_arg_type(&structfieldit) != DBUS_TYPE_VARIANT)
+        return FALSE;
+
+    dbus_message_iter_recurse(&structfieldit, &variantit);
+
+    switch (dbus_message_iter_get_arg_type(&variantit)) {
+        case DBUS_TYPE_INT32:
+            dbus_message_iter_get_basic(&variantit, (void *)&value.i);
+            if ((pair->value = arena_alloc(arena, sizeof(int))) == NULL)
+                return FALSE;
+            *(int *) pair->value = value.i;
+            pair->type = EP_VALUE_INT;
+            break;
+        case DBUS_TYPE_DOUBLE:
+            dbus_message_iter_get_basic(&variantit, (void *)&value.d);
+            if ((pair->value = arena_alloc(arena, sizeof(double))) == NULL)
+                return FALSE;
+            *(double *) pair->value = value.d;
+            pair->type = EP_VALUE_FLOAT;
+            break;
+        case DBUS_TYPE_STRING:
+            dbus_message_iter_get_basic(&variantit, (void *)&value.s);
+            pair->value = value.s;
+            pair->type = EP_VALUE_STRING;
+            break;
+        default:
+            /* unknown D-Bus type, leave the pair invalid */
+            break;
+    }
+
+    return TRUE;
+}
+
+static struct ep_decision *decode_decision (DBusMessageIter *actit,
+        struct ep_arena *arena, int *success)
+{
+    struct ep_decision        *decision;
+    struct ep_key_value_pair  *pairs;
+    DBusMessageIter            structit;
+    int                        npair, n, i;
+    ep_key                     key;
+
+    if (dbus_message_iter_get_arg_type(actit) != DBUS_TYPE_ARRAY) {
+        *success = FALSE;
+        return NULL;
+    }
+
+    dbus_message_iter_recurse(actit, &structit);
+
+    npair = count_elements(&structit);
+
+    decision = arena_alloc(arena, sizeof(struct ep_decision));
+    pairs    = arena_alloc(arena, npair * sizeof(struct ep_key_value_pair));
+
+    if (decision == NULL || (npair && pairs == NULL))
+        goto oom;
+
+    decision->pairs = arena_alloc(arena,
+            (npair + 1) * sizeof(struct ep_key_value_pair *));
+    decision->nslot = key_count + 1;
+    decision->slots = arena_alloc(arena,
+            decision->nslot * sizeof(struct ep_key_value_pair *));
+
+    if (decision->pairs == NULL || decision->slots == NULL)
+        goto oom;
+
+    /* gather the key-value pairs to the decision */
+    for (i = 0, n = 0; i < npair; i++, dbus_message_iter_next(&structit)) {
+        struct ep_key_value_pair *pair = pairs + n;
+
+        if (!decode_pair(&structit, arena, pair)) {
+            *success = FALSE;
+            continue;
+        }
+
+        key = key_lookup(pair->key);
+
+        if (key != EP_KEY_INVALID && decision->slots[key] == NULL)
+            decision->slots[key] = pair;
+
+        decision->pairs[n++] = pair;
+    }
+
+    return decision;
+
+ oom:
+    *success = FALSE;
+    return NULL;
+}
+
+static int decode_decision_sets (DBusMessageIter *msgit, struct ep_arena *arena,
+        decision_set_cb cb, void *user_data)
+{
+    DBusMessageIter  arrit;
+    DBusMessageIter  entit;
+    DBusMessageIter  actit;
+    char            *actname;
+    int              success = TRUE;
+
+    /**
+     * This is really complicated and nasty. Idea is that the message is
+     * supposed to look something like this:
+     *
+     * uint32 0
+     * array [
+     *    dict entry(
+     *       string "com.nokia.policy.audio_route"
+     *       array [
+     *          array [
+     *             struct {
+     *                string "type"
+     *                variant                      string "source"
+     *             }
+     *             struct {
+     *                string "device"
+     *                variant                      string "headset"
+     *             }
+     *          ]
+     *          array [
+     *             struct {
+     *                string "type"
+     *                variant                      string "sink"
+     *             }
+     *             struct {
+     *                string "device"
+     *                variant                      string "headset"
+     *             }
+     *          ]
+     *       ]
+     *    )
+     * ]
+     *
+     * msgit points to the outermost array.
+     */
+
+    if (dbus_message_iter_get_arg_type(msgit) != DBUS_TYPE_ARRAY)
+        return FALSE;
+
+    dbus_message_iter_recurse(msgit, &arrit);
+
+    if (dbus_message_iter_get_arg_type(&arrit) == DBUS_TYPE_INVALID)
+        return TRUE;
+
+    do {
+        struct ep_decision **decisions;
+        int ndecision, i, n;
+
+        if (dbus_message_iter_get_arg_type(&arrit) != DBUS_TYPE_DICT_ENTRY) {
+            success = FALSE;
+            continue;
+        }
+
+        dbus_message_iter_recurse(&arrit, &entit);
+
+        if (dbus_message_iter_get_arg_type(&entit) != DBUS_TYPE_STRING) {
+            success = FALSE;
+            continue;
+        }
+
+        dbus_message_iter_get_basic(&entit, (void *)&actname);
+
+        if (!dbus_message_iter_next(&entit) ||
+            dbus_message_iter_get_arg_type(&entit) != DBUS_TYPE_ARRAY) {
+            success = FALSE;
+            continue;
+        }
+
+        dbus_message_iter_recurse(&entit, &actit);
+
+        ndecision = count_elements(&actit);
+        decisions = arena_alloc(arena,
+                (ndecision + 1) * sizeof(struct ep_decision *));
+
+        if (decisions == NULL) {
+            success = FALSE;
+            continue;
+        }
+
+        /* gather the decisions to the decision set */
+        for (i = 0, n = 0; i < ndecision; i++, dbus_message_iter_next(&actit)) {
+            struct ep_decision *decision;
+
+            if ((decision = decode_decision(&actit, arena, &success)) != NULL)
+                decisions[n++] = decision;
+        }
+
+        cb(actname, decisions, user_data);
+
+    } while (dbus_message_iter_next(&arrit));
+
+    return success;
+}
+
+static int name_matches (char **decision_names, const char *actname)
+{
+    int i, count = 0;
+
+    if (decision_names == NULL || decision_names[0] == NULL)
+        return 1;               /* subscribed to all decisions */
+
+    for (i = 0; decision_names[i] != NULL; i++) {
+        if (strcmp(decision_names[i], actname) == 0)
+            count++;
+    }
+
+    return count;
+}
+
+struct handle_data {
+    struct cb_data           *data;
+    struct transaction_data  *trans_data;
+    dbus_uint32_t             txid;
+    int                       found;
+};
+
+static void handle_decision_set (const char *actname,
+        struct ep_decision **decisions, void *user_data)
+{
+    struct handle_data *hd = user_data;
+    int count, i;
+
+    if ((count = name_matches(hd->data->decision_names, actname)) == 0)
+        return;
+
+    /* count the callbacks if a transaction is needed */
+    if (hd->trans_data)
+        hd->trans_data->refcount += count;
+
+    /* send the decisions */
+    for (i = 0; i < count; i++)
+        hd->data->cb(actname, decisions, ep_ready, hd->txid,
+                hd->data->user_data);
+
+    hd->found = TRUE;
+}
+
+/* decoders for the different decision sources: a D-Bus message, a
+ * shared memory record or the delta cache */
+
+typedef int (*decision_decoder) (void *src, struct ep_arena *arena,
+        decision_set_cb cb, void *user_data);
+
+static int decode_message (void *src, struct ep_arena *arena,
+        decision_set_cb cb, void *user_data)
+{
+    return decode_decision_sets(src, arena, cb, user_data);
+}
+
+static int decode_shm_record (void *src, struct ep_arena *arena,
+        decision_set_cb cb, void *user_data);
+
+static void handle_decisions (dbus_uint32_t txid, decision_decoder decode,
+        void *src, struct cb_data *data)
+{
+    struct transaction_data *trans_data = NULL;
+    struct handle_data       hd;
+    struct ep_arena         *arena = NULL;
+
+    int              success = TRUE;
+
+    if (txid != 0) {
+        trans_data = calloc(1, sizeof(struct transaction_data));
+        if (!trans_data)
+            goto send_signal;
+        trans_data->txid = txid;
+        if (!ep_list_append(&transaction_list, trans_data)) {
+            success = FALSE;
+            goto send_signal;
+        }
+    }
+
+    if (src == NULL || (arena = arena_get()) == NULL) {
+        success = FALSE;
+        goto send_signal;
+    }
+
+    hd.data       = data;
+    hd.trans_data = trans_data;
+    hd.txid       = txid;
+    hd.found      = FALSE;
+
+    if (!decode(src, arena, handle_decision_set, &hd))
+        success = FALSE;
+
+    arena_put(arena);
+
+    if (txid == 0) {
+        /* no ack is needed, go to send_signal for cleanup */
+        goto send_signal;
+    }
+
+    if (hd.found) {
+
+        /* It's possible that the callbacks have had errors, and the
+         * NACK is already sent. In this case the transaction is already
+         * removed from the list and freed. See if this is the case. */
+        trans_data = ep_get_transaction(txid);
+        if (!trans_data) {
+            return;
+        }
+
+        /* the ACK signal is now ready to be sent */
+        trans_data->ready = TRUE;
+        send_if_done(trans_data);
+
+        return; /* success */
+    }
+
+send_signal:
+
+    /* no-one is interested or everything failed, just send the signal
+     * and be done with it */
+
+    if (trans_data) {
+        ep_list_remove(&transaction_list, trans_data);
+        free(trans_data);
+        trans_data = NULL;
+    }
+
+    send_signal(txid, success);
+}
+
+static void handle_message (DBusMessage *msg, struct cb_data *data)
+{
+    /* parse the message to ep_decision array */
+
+    dbus_uint32_t    txid;
+    DBusMessageIter  msgit;
+
+    dbus_message_iter_init(msg, &msgit);
+
+    if (dbus_message_iter_get_arg_type(&msgit) != DBUS_TYPE_UINT32)
+        return;
+
+    dbus_message_iter_get_basic(&msgit, (void *)&txid);
+
+    if (!dbus_message_iter_next(&msgit))
+        handle_decisions(txid, decode_message, NULL, data);
+    else
+        handle_decisions(txid, decode_message, &msgit, data);
+}
+
+struct decode_data {
+    char           **decision_names;
+    ep_decision_cb   cb;
+    void            *user_data;
+};
+
+static void decode_answer (ep_answer_token token, int success)
+{
+    (void) token;
+    (void) success;
+}
+
+static void decode_decision_set (const char *actname,
+        struct ep_decision **decisions, void *user_data)
+{
+    struct decode_data *dd = user_data;
+    int count, i;
+
+    count = name_matches(dd->decision_names, actname);
+
+    for (i = 0; i < count; i++)
+        dd->cb(actname, decisions, decode_answer, 0, dd->user_data);
+}
+
+int ep_decode (DBusMessage *msg, const char **decision_names,
+        ep_decision_cb cb, void *user_data)
+{
+    struct decode_data  dd;
+    struct ep_arena    *arena;
+    DBusMessageIter     msgit;
+    int                 success;
+
+    if (msg == NULL || cb == NULL)
+        return FALSE;
+
+    if (!dbus_message_iter_init(msg, &msgit) ||
+        dbus_message_iter_get_arg_type(&msgit) != DBUS_TYPE_UINT32 ||
+        !dbus_message_iter_next(&msgit))
+        return FALSE;
+
+    if ((arena = arena_get()) == NULL)
+        return FALSE;
+
+    dd.decision_names = (char **) decision_names;
+    dd.cb             = cb;
+    dd.user_data      = user_data;
+
+    success = decode_decision_sets(&msgit, arena, decode_decision_set, &dd);
+
+    arena_put(arena);
+
+    return success;
+}
+
+/* shared memory decision channel
+ *
+ * The records are decoded in place: the keys, the string values and
+ * even the numeric values point straight into the shared segment. The
+ * policy engine does not reuse the space before our read position moves
+ * past the record, which only happens after the callbacks return. */
+
+static uint32_t shm_skip_string (char *base, uint32_t offs)
+{
+    return offs + EP_SHM_ALIGN_SIZE(strlen(base + offs) + 1);
+}
+
+static struct ep_decision *decode_shm_decision (struct ep_shm_decision *sd,
+        struct ep_arena *arena, int *success)
+{
+    struct ep_decision        *decision;
+    struct ep_key_value_pair  *pairs;
+    struct ep_shm_pair        *sp;
+    uint32_t                   offs;
+    int                        i, n;
+    ep_key                     key;
+
+    decision = arena_alloc(arena, sizeof(struct ep_decision));
+    pairs    = arena_alloc(arena, sd->npair * sizeof(struct ep_key_value_pair));
+
+    if (decision == NULL || (sd->npair && pairs == NULL))
+        goto oom;
+
+    decision->pairs = arena_alloc(arena,
+            (sd->npair + 1) * sizeof(struct ep_key_value_pair *));
+    decision->nslot = key_count + 1;
+    decision->slots = arena_alloc(arena,
+            decision->nslot * sizeof(struct ep_key_value_pair *));
+
+    if (decision->pairs == NULL || decision->slots == NULL)
+        goto oom;
+
+    offs = EP_SHM_ALIGN_SIZE(sizeof(*sd));
+
+    for (i = 0, n = 0; i < (int) sd->npair; i++) {
+        struct ep_key_value_pair *pair = pairs + n;
+
+        sp = (struct ep_shm_pair *) ((char *) sd + offs);
+
+        if (sp->size < sizeof(*sp) || offs + sp->size > sd->size) {
+            *success = FALSE;
+            break;
+        }
+
+        offs += sp->size;
+
+        pair->key = (char *) sp + sp->key;
+
+        switch (sp->type) {
+            case EP_SHM_VALUE_INT:
+                pair->value = (void *) &sp->value.i;
+                pair->type  = EP_VALUE_INT;
+                break;
+            case EP_SHM_VALUE_FLOAT:
+                pair->value = (void *) &sp->value.d;
+                pair->type  = EP_VALUE_FLOAT;
+                break;
+            case EP_SHM_VALUE_STRING:
+                pair->value = (char *) sp + sp->value.s;
+                pair->type  = EP_VALUE_STRING;
+                break;
+            default:
+                /* leave the pair invalid, like the D-Bus decoder does */
+                break;
+        }
+
+        key = key_lookup(pair->key);
+
+        if (key != EP_KEY_INVALID && decision->slots[key] == NULL)
+            decision->slots[key] = pair;
+
+        decision->pairs[n++] = pair;
+    }
+
+    return decision;
+
+ oom:
+    *success = FALSE;
+    return NULL;
+}
+
+static int decode_shm_record (void *src, struct ep_arena *arena,
+        decision_set_cb cb, void *user_data)
+{
+    struct ep_shm_record    *rec = src;
+    struct ep_shm_set       *set;
+    struct ep_shm_decision  *sd;
+    struct ep_decision     **decisions;
+    char                    *base = (char *) rec;
+    uint32_t                 offs, doffs;
+    int                      success = TRUE;
+    int                      i, j, n;
+
+    offs = shm_skip_string(base, rec->signal);
+
+    for (i = 0; i < (int) rec->nset; i++) {
+        set = (struct ep_shm_set *) (base + offs);
+
+        if (set->size < sizeof(*set) || offs + set->size > rec->size)
+            return FALSE;
+
+        offs += set->size;
+
+        decisions = arena_alloc(arena,
+                (set->ndecision + 1) * sizeof(struct ep_decision *));
+
+        if (decisions == NULL) {
+            success = FALSE;
+            continue;
+        }
+
+        doffs = shm_skip_string((char *) set, set->name);
+
+        for (j = 0, n = 0; j < (int) set->ndecision; j++) {
+            struct ep_decision *decision;
+
+            sd = (struct ep_shm_decision *) ((char *) set + doffs);
+
+            if (sd->size < sizeof(*sd) || doffs + sd->size > set->size) {
+                success = FALSE;
+                break;
+            }
+
+            doffs += sd->size;
+
+            if ((decision = decode_shm_decision(sd, arena, &success)) != NULL)
+                decisions[n++] = decision;
+        }
+
+        cb((char *) set + set->name, decisions, user_data);
+    }
+
+    return success;
+}
+
+static void handle_shm_record (struct ep_shm_record *rec)
+{
+    struct ep_list_node_s *node;
+    struct cb_data        *data;
+    const char            *signal = (char *) rec + rec->signal;
+
+    for (node = cb_list.first; node != NULL; node = node->next) {
+        data = node->data;
+        if (!strcmp(data->signal, signal))
+            handle_decisions(rec->txid, decode_shm_record, rec, data);
+    }
+}
+
+static void shm_close (void)
+{
+    if (shm != NULL)
+        munmap(shm, shm_size);
+
+    if (shm_rd != NULL)
+        munmap(shm_rd, EP_SHM_READER_SIZE);
+
+    if (shm_doorbell >= 0)
+        close(shm_doorbell);
+
+    if (shm_ackbell >= 0)
+        close(shm_ackbell);
+
+    free(shm_copy);
+
+    shm_copy      = NULL;
+    shm_copy_size = 0;
+    shm          = NULL;
+    shm_rd       = NULL;
+    shm_reader   = -1;
+    shm_active   = 0;
+    shm_doorbell = -1;
+    shm_ackbell  = -1;
+}
+
+int ep_shm_enable (void)
+{
+#ifdef DBUS_TYPE_UNIX_FD
+    DBusMessage   *msg = NULL, *reply = NULL;
+    DBusError      err;
+    int            fd = -1, rdfd = -1, doorbell = -1, ackbell = -1;
+    dbus_uint32_t  idx, size;
+    void          *addr, *rdaddr;
+    int            success = 0;
+
+    if (connection == NULL || shm != NULL)
+        return shm != NULL;
+
+    dbus_error_init(&err);
+
+    msg = dbus_message_new_method_call(POLICY_DBUS_NAME,
+            POLICY_DBUS_PATH,
+            POLICY_DBUS_INTERFACE,
+            POLICY_SHM_CHANNEL);
+
+    if (msg == NULL)
+        goto failed;
+
+    reply = dbus_connection_send_with_reply_and_block(connection, msg, -1, &err);
+
+    if (reply == NULL ||
+        !dbus_message_get_args(reply, &err,
+            DBUS_TYPE_UNIX_FD, &fd,
+            DBUS_TYPE_UNIX_FD, &rdfd,
+            DBUS_TYPE_UNIX_FD, &doorbell,
+            DBUS_TYPE_UNIX_FD, &ackbell,
+            DBUS_TYPE_UINT32 , &idx,
+            DBUS_TYPE_UINT32 , &size,
+            DBUS_TYPE_INVALID))
+        goto failed;
+
+    /* the layout is compiled in on both sides */
+    if (size != EP_SHM_RING_SIZE || idx >= EP_SHM_MAX_READERS)
+        goto failed;
+
+    /* the ring is read only for us, only our own state is writable */
+    shm_size = EP_SHM_SEGMENT_SIZE(size);
+    addr = mmap(NULL, shm_size, PROT_READ, MAP_SHARED, fd, 0);
+
+    if (addr == MAP_FAILED)
+        goto failed;
+
+    rdaddr = mmap(NULL, EP_SHM_READER_SIZE, PROT_READ | PROT_WRITE,
+            MAP_SHARED, rdfd, 0);
+
+    if (rdaddr == MAP_FAILED) {
+        munmap(addr, shm_size);
+        goto failed;
+    }
+
+    shm          = addr;
+    shm_rd       = rdaddr;
+    shm_reader   = idx;
+    shm_doorbell = doorbell;
+    shm_ackbell  = ackbell;
+    doorbell     = ackbell = -1;
+
+    if (shm->magic != EP_SHM_MAGIC || shm->version != EP_SHM_VERSION ||
+        (shm_active = shm->readers[idx].active) == 0) {
+        shm_close();
+        goto failed;
+    }
+
+    success = 1;
+
+    /* intentional fallthrough */
+
+ failed:
+    if (fd >= 0)
+        close(fd);
+    if (rdfd >= 0)
+        close(rdfd);
+    if (doorbell >= 0)
+        close(doorbell);
+    if (ackbell >= 0)
+        close(ackbell);
+    if (reply)
+        dbus_message_unref(reply);
+    if (msg)
+        dbus_message_unref(msg);
+    dbus_error_free(&err);
+
+    return success;
+#else
+    return 0;
+#endif
+}
+
+int ep_shm_fd (void)
+{
+    return shm_doorbell;
+}
+
+int ep_shm_dispatch (void)
+{
+    struct ep_shm_reader  *rd;
+    struct ep_shm_record  *rec;
+    char                  *ring, *buf;
+    uint64_t               cnt, pos, end;
+    uint32_t               offs, left, size;
+    int                    n = 0;
+
+    if (shm == NULL)
+        return -1;
+
+    if (read(shm_doorbell, &cnt, sizeof(cnt)) < 0 && errno != EAGAIN)
+        return -1;
+
+    rd   = shm_rd;
+    ring = EP_SHM_DATA(shm);
+    pos  = rd->read_pos;
+    end  = shm->write_pos;
+
+    __sync_synchronize();
+
+    while (pos < end) {
+        /* once dropped, the ring is no longer kept for us */
+        if (!shm_in_use())
+            return -1;
+
+        offs = pos & (EP_SHM_RING_SIZE - 1);
+        left = EP_SHM_RING_SIZE - offs;
+
+        if (left < sizeof(struct ep_shm_record)) {
+            /* not even a padding record fits here */
+            pos += left;
+            continue;
+        }
+
+        rec  = (struct ep_shm_record *) (ring + offs);
+        size = rec->size;
+
+        if (size < sizeof(*rec) || size > left) {
+            /* we are out of sync with the writer, skip what we have */
+            rd->read_pos = end;
+            return -1;
+        }
+
+        /*
+         * The callbacks get a private copy: if we are dropped for lagging
+         * behind, the writer may reuse the slot at any time. Whatever we
+         * copied is only good if we were still in use after the copy.
+         */
+        if (size >= shm_copy_size) {
+            if ((buf = realloc(shm_copy, size + 1)) == NULL)
+                return -1;
+            shm_copy      = buf;
+            shm_copy_size = size + 1;
+        }
+
+        memcpy(shm_copy, rec, size);
+        shm_copy[size] = '\0';
+
+        __sync_synchronize();
+
+        if (!shm_in_use())
+            return -1;
+
+        rec = (struct ep_shm_record *) shm_copy;
+
+        if (rec->size != size || rec->signal >= size) {
+            rd->read_pos = end;
+            return -1;
+        }
+
+        if (rec->readers & (1U << shm_reader)) {
+            handle_shm_record(rec);
+            n++;
+        }
+
+        pos += size;
+
+        __sync_synchronize();
+        rd->read_pos = pos;
+    }
+
+    return n;
+}
+
+/* decision deltas
+ *
+ * In delta mode the policy engine sends each decision set as the changes
+ * against the version we have last acked (or in full, with base version
+ * 0, if it does not know what we have). The full view of every decision
+ * set is kept here and the callbacks get decisions built from it, so
+ * they cannot tell the difference. */
+
+struct ep_delta_pair {
+    char               *key;
+    enum ep_value_type  type;
+    union {
+        int     i;
+        double  d;
+        char   *s;
+    } value;
+};
+
+struct ep_delta_decision {
+    struct ep_delta_pair *pairs;
+    int                   npair;
+};
+
+struct ep_delta_set {
+    struct ep_delta_set      *next;
+    char                     *name;
+    dbus_uint32_t             version;      /* 0 if out of sync */
+    struct ep_delta_decision *decisions;
+    int                       ndecision;
+};
+
+static struct ep_delta_set *delta_sets;
+static int                  delta_mode;
+
+static void delta_pair_clear (struct ep_delta_pair *pair)
+{
+    if (pair->type == EP_VALUE_STRING)
+        free(pair->value.s);
+
+    pair->type = EP_VALUE_INVALID;
+}
+
+static void delta_set_clear (struct ep_delta_set *set)
+{
+    int i, j;
+
+    for (i = 0; i < set->ndecision; i++) {
+        for (j = 0; j < set->decisions[i].npair; j++) {
+            free(set->decisions[i].pairs[j].key);
+            delta_pair_clear(set->decisions[i].pairs + j);
+        }
+        free(set->decisions[i].pairs);
+    }
+
+    free(set->decisions);
+
+    set->decisions = NULL;
+    set->ndecision = 0;
+    set->version   = 0;
+}
+
+static struct ep_delta_set *delta_set_lookup (const char *name, int create)
+{
+    struct ep_delta_set *set;
+
+    for (set = delta_sets; set != NULL; set = set->next) {
+        if (!strcmp(set->name, name))
+            return set;
+    }
+
+    if (!create || (set = calloc(1, sizeof(*set))) == NULL)
+        return NULL;
+
+    if ((set->name = strdup(name)) == NULL) {
+        free(set);
+        return NULL;
+    }
+
+    set->next  = delta_sets;
+    delta_sets = set;
+
+    return set;
+}
+
+static void delta_free_all (void)
+{
+    struct ep_delta_set *set, *next;
+
+    for (set = delta_sets; set != NULL; set = next) {
+        next = set->next;
+        delta_set_clear(set);
+        free(set->name);
+        free(set);
+    }
+
+    delta_sets = NULL;
+}
+
+/* set the value of key in the decision, adding the key if necessary */
+static int delta_update (struct ep_delta_decision *decision,
+        DBusMessageIter *structit)
+{
+    struct ep_delta_pair      *pair = NULL, *pairs;
+    struct ep_key_value_pair   kv;
+    struct ep_arena           *arena;
+    int                        i, success;
+
+    /* let the D-Bus decoder do the type checking and conversions */
+    if ((arena = arena_get()) == NULL)
+        return FALSE;
+
+    memset(&kv, 0, sizeof(kv));
+    success = decode_pair(structit, arena, &kv);
+
+    if (!success)
+        goto out;
+
+    for (i = 0; i < decision->npair; i++) {
+        if (!strcmp(decision->pairs[i].key, kv.key)) {
+            pair = decision->pairs + i;
+            break;
+        }
+    }
+
+    if (pair == NULL) {
+        pairs = realloc(decision->pairs,
+                (decision->npair + 1) * sizeof(*pairs));
+
+        if (pairs == NULL || (pairs[decision->npair].key = strdup(kv.key)) == NULL) {
+            if (pairs)
+                decision->pairs = pairs;
+            success = FALSE;
+            goto out;
+        }
+
+        decision->pairs = pairs;
+        pair = pairs + decision->npair++;
+        pair->type = EP_VALUE_INVALID;
+    }
+
+    delta_pair_clear(pair);
+
+    switch (kv.type) {
+        case EP_VALUE_INT:
+            pair->value.i = *(int *) kv.value;
+            break;
+        case EP_VALUE_FLOAT:
+            pair->value.d = *(double *) kv.value;
+            break;
+        case EP_VALUE_STRING:
+            if ((pair->value.s = strdup(kv.value)) == NULL) {
+                success = FALSE;
+                goto out;
+            }
+            break;
+        default:
+            break;
+    }
+
+    pair->type = kv.type;
+
+ out:
+    arena_put(arena);
+    return success;
+}
+
+static int delta_apply_set (DBusMessageIter *entit)
+{
+    struct ep_delta_set  *set;
+    DBusMessageIter       actit, structit;
+    char                 *name;
+    dbus_uint32_t         base, version;
+    int                   ndecision, i;
+
+    /* struct { string name, uint32 base, uint32 version, aa(sv) } */
+
+    if (dbus_message_iter_get_arg_type(entit) != DBUS_TYPE_STRING)
+        return FALSE;
+    dbus_message_iter_get_basic(entit, (void *)&name);
+
+    if (!dbus_message_iter_next(entit) ||
+        dbus_message_iter_get_arg_type(entit) != DBUS_TYPE_UINT32)
+        return FALSE;
+    dbus_message_iter_get_basic(entit, (void *)&base);
+
+    if (!dbus_message_iter_next(entit) ||
+        dbus_message_iter_get_arg_type(entit) != DBUS_TYPE_UINT32)
+        return FALSE;
+    dbus_message_iter_get_basic(entit, (void *)&version);
+
+    if (!dbus_message_iter_next(entit) ||
+        dbus_message_iter_get_arg_type(entit) != DBUS_TYPE_ARRAY)
+        return FALSE;
+
+    if ((set = delta_set_lookup(name, TRUE)) == NULL)
+        return FALSE;
+
+    dbus_message_iter_recurse(entit, &actit);
+    ndecision = count_elements(&actit);
+
+    if (base == 0) {
+        /* full resync */
+        delta_set_clear(set);
+
+        set->decisions = calloc(ndecision + 1, sizeof(*set->decisions));
 
-    msg = dbus_message_new_signal(path, POLICY_DBUS_INTERFACE, POLICY_STATUS);
+        if (set->decisions == NULL)
+            return FALSE;
 
-    if (msg == NULL) {
-        goto fail;
+        set->ndecision = ndecision;
+    }
+    else if (set->version != base || set->ndecision != ndecision) {
+        /* we have missed something, the policy engine will resync */
+        delta_set_clear(set);
+        return FALSE;
     }
 
-    ret = dbus_message_append_args(msg,
-            DBUS_TYPE_UINT32, &txid,
-            DBUS_TYPE_UINT32, &status,
-            DBUS_TYPE_INVALID);
+    for (i = 0; i < ndecision; i++, dbus_message_iter_next(&actit)) {
+        if (dbus_message_iter_get_arg_type(&actit) != DBUS_TYPE_ARRAY)
+            goto fail;
 
-    if (!ret) {
-        goto fail;
-    }
+        dbus_message_iter_recurse(&actit, &structit);
 
-    ret = dbus_connection_send(connection, msg, NULL);
+        if (dbus_message_iter_get_arg_type(&structit) == DBUS_TYPE_INVALID)
+            continue;           /* no changes */
 
-    if (!ret) {
-        goto fail;
+        do {
+            if (!delta_update(set->decisions + i, &structit))
+                goto fail;
+        } while (dbus_message_iter_next(&structit));
     }
 
-    dbus_message_unref(msg);
-    return;
+    set->version = version;
 
- fail:
+    return TRUE;
 
-    dbus_message_unref(msg);    /* should cope with NULL msg */
-    return;
+ fail:
+    delta_set_clear(set);
+    return FALSE;
 }
 
-static void send_if_done(struct transaction_data *data)
+/* msgit points to the array of decision sets */
+static int delta_apply (DBusMessageIter *msgit)
 {
-    /* see if the callbacks acked the message right away */
-
-    if (data->txid == 0)
-        return;
+    DBusMessageIter arrit, entit;
+    int             success = TRUE;
 
-    if (data->refcount != 0)
-        return; /* no need to send yet */
+    if (dbus_message_iter_get_arg_type(msgit) != DBUS_TYPE_ARRAY)
+        return FALSE;
 
-    /* all callbacks have returned true or one has failed */
-    send_signal(data->txid, TRUE);
-    ep_list_remove(&transaction_list, data);
-    free(data);
-    data = NULL;
-}
+    dbus_message_iter_recurse(msgit, &arrit);
 
-static void ep_ready(int txid, int status) {
+    if (dbus_message_iter_get_arg_type(&arrit) == DBUS_TYPE_INVALID)
+        return TRUE;
 
-    struct transaction_data *data = NULL;
+    do {
+        if (dbus_message_iter_get_arg_type(&arrit) != DBUS_TYPE_STRUCT) {
+            success = FALSE;
+            continue;
+        }
 
-    if (txid == 0)
-        return;
+        dbus_message_iter_recurse(&arrit, &entit);
 
-    /* find the correct transaction data structure */
-    data = ep_get_transaction(txid);
+        if (!delta_apply_set(&entit))
+            success = FALSE;
 
-    if (data) {
-#if 0
-        printf("libep: decreasing data '%p' reference count from '%u' to '%u'\n",
-                data, data->refcount, data->refcount - 1);
-#endif
-        data->refcount--;
-        if ((data->refcount == 0 && data->ready) || !status) {
-            /* all callbacks have returned true or one has failed */
-            send_signal(txid, status);
-            ep_list_remove(&transaction_list, data);
-            free(data);
-            data = NULL;
-        }
-    }
+    } while (dbus_message_iter_next(&arrit));
 
-    return;
+    return success;
 }
 
+static struct ep_decision *delta_decision (struct ep_delta_decision *dd,
+        struct ep_arena *arena)
+{
+    struct ep_decision        *decision;
+    struct ep_key_value_pair  *pairs;
+    struct ep_delta_pair      *dp;
+    int                        i;
+    ep_key                     key;
+
+    decision = arena_alloc(arena, sizeof(struct ep_decision));
+    pairs    = arena_alloc(arena, dd->npair * sizeof(struct ep_key_value_pair));
 
-static void free_decisions(struct ep_decision **decisions) {
+    if (decision == NULL || (dd->npair && pairs == NULL))
+        return NULL;
 
-    struct ep_decision **decisions_iter = decisions;
+    decision->pairs = arena_alloc(arena,
+            (dd->npair + 1) * sizeof(struct ep_key_value_pair *));
+    decision->nslot = key_count + 1;
+    decision->slots = arena_alloc(arena,
+            decision->nslot * sizeof(struct ep_key_value_pair *));
 
-    while (*decisions_iter) {
-        struct ep_decision *decision = *decisions_iter;
-        struct ep_key_value_pair **pairs = decision->pairs;
+    if (decision->pairs == NULL || decision->slots == NULL)
+        return NULL;
 
-        while (*pairs) {
-            struct ep_key_value_pair *pair = *pairs;
+    for (i = 0; i < dd->npair; i++) {
+        dp = dd->pairs + i;
 
-            free(pair->key);
-            free(pair->value);
-            free(pair);
+        pairs[i].key  = dp->key;
+        pairs[i].type = dp->type;
 
-            pairs++;
+        switch (dp->type) {
+            case EP_VALUE_INT:    pairs[i].value = &dp->value.i; break;
+            case EP_VALUE_FLOAT:  pairs[i].value = &dp->value.d; break;
+            case EP_VALUE_STRING: pairs[i].value = dp->value.s;  break;
+            default:                                             break;
         }
-        free(decision->pairs);
 
-        decisions_iter++;
+        key = key_lookup(dp->key);
+
+        if (key != EP_KEY_INVALID && decision->slots[key] == NULL)
+            decision->slots[key] = pairs + i;
+
+        decision->pairs[i] = pairs + i;
     }
-    free(decisions);
+
+    return decision;
 }
 
-static void handle_message (DBusMessage *msg, struct cb_data *data)
+/* the decision sets named in the delta message, from the cache */
+static int decode_delta (void *src, struct ep_arena *arena,
+        decision_set_cb cb, void *user_data)
 {
-    char *cb_decision_name;
-    int found = 0, i = 0;
+    DBusMessageIter      arrit = *(DBusMessageIter *) src, entit;
+    struct ep_delta_set *set;
+    struct ep_decision **decisions;
+    char                *name;
+    int                  success = TRUE;
+    int                  i, n;
+
+    if (dbus_message_iter_get_arg_type(&arrit) == DBUS_TYPE_INVALID)
+        return TRUE;
 
-    struct transaction_data *trans_data = NULL;
+    do {
+        dbus_message_iter_recurse(&arrit, &entit);
+        dbus_message_iter_get_basic(&entit, (void *)&name);
 
-    /* parse the message to ep_decision array */
+        if ((set = delta_set_lookup(name, FALSE)) == NULL || !set->version) {
+            success = FALSE;
+            continue;
+        }
 
-    dbus_uint32_t    txid;
-    char            *actname;
+        decisions = arena_alloc(arena,
+                (set->ndecision + 1) * sizeof(struct ep_decision *));
 
-    DBusMessageIter  msgit;
-    DBusMessageIter  arrit;
-    DBusMessageIter  entit;
-    DBusMessageIter  actit;
-    DBusMessageIter  structit;
-    DBusMessageIter  structfieldit;
-    DBusMessageIter  variantit;
+        if (decisions == NULL) {
+            success = FALSE;
+            continue;
+        }
 
-    int              success = TRUE;
+        for (i = 0, n = 0; i < set->ndecision; i++) {
+            if ((decisions[n] = delta_decision(set->decisions + i, arena)))
+                n++;
+            else
+                success = FALSE;
+        }
 
-    /* printf("libep: parsing the message\n"); */
+        cb(set->name, decisions, user_data);
 
-    /**
-     * This is really complicated and nasty. Idea is that the message is
-     * supposed to look something like this:
-     *
-     * uint32 0
-     * array [
-     *    dict entry(
-     *       string "com.nokia.policy.audio_route"
-     *       array [
-     *          array [
-     *             struct {
-     *                string "type"
-     *                variant                      string "source"
-     *             }
-     *             struct {
-     *                string "device"
-     *                variant                      string "headset"
-     *             }
-     *          ]
-     *          array [
-     *             struct {
-     *                string "type"
-     *                variant                      string "sink"
-     *             }
-     *             struct {
-     *                string "device"
-     *                variant                      string "headset"
-     *             }
-     *          ]
-     *       ]
-     *    )
-     * ]
-     *
-     */
+    } while (dbus_message_iter_next(&arrit));
 
-    dbus_message_iter_init(msg, &msgit);
+    return success;
+}
 
-    if (dbus_message_iter_get_arg_type(&msgit) != DBUS_TYPE_UINT32)
-        return;
+static void handle_delta_message (DBusMessage *msg)
+{
+    struct ep_list_node_s *node;
+    struct cb_data        *data;
+    DBusMessageIter        msgit, arrit;
+    dbus_uint32_t          txid;
+    const char            *member = dbus_message_get_member(msg);
+    int                    handled = FALSE;
 
+    dbus_message_iter_init(msg, &msgit);
     dbus_message_iter_get_basic(&msgit, (void *)&txid);
+    dbus_message_iter_next(&msgit);
 
-    if (txid != 0) {
-        trans_data = calloc(1, sizeof(struct transaction_data));
-        if (!trans_data)
-            goto send_signal;
-        trans_data->txid = txid;
-        if (!ep_list_append(&transaction_list, trans_data)) {
-            success = FALSE;
-            goto send_signal;
-        }
-    }
-
-    /* printf("libep: txid: %u\n", txid); */
-
-    if (!dbus_message_iter_next(&msgit) ||
-        dbus_message_iter_get_arg_type(&msgit) != DBUS_TYPE_ARRAY) {
-        success = FALSE;
-        goto send_signal;
+    /* update the cache once, whoever is interested in the decisions */
+    if (!delta_apply(&msgit)) {
+        send_signal(txid, FALSE);
+        return;
     }
 
-    dbus_message_iter_recurse(&msgit, &arrit);
+    for (node = cb_list.first; node != NULL; node = node->next) {
+        data = node->data;
 
-    do {
-        if (dbus_message_iter_get_arg_type(&arrit) != DBUS_TYPE_DICT_ENTRY) {
-            success = FALSE;
+        if (strcmp(data->signal, member))
             continue;
-        }
 
-        dbus_message_iter_recurse(&arrit, &entit);
-
-        do {
-            struct ep_decision **decisions = NULL;
-            struct ep_list_head_s decision_list;
-            
-            memset(&decision_list, 0, sizeof(struct ep_list_head_s));
-    
-            if (dbus_message_iter_get_arg_type(&entit) != DBUS_TYPE_STRING) {
-                success = FALSE;
-                continue;
-            }
-            
-            dbus_message_iter_get_basic(&entit, (void *)&actname);
-    
-            /* printf("libep: decision set name '%s'\n", actname); */
-            
-            if (!dbus_message_iter_next(&entit) ||
-                dbus_message_iter_get_arg_type(&entit) != DBUS_TYPE_ARRAY) {
-                success = FALSE;
-                continue;
-            }
-            
-            dbus_message_iter_recurse(&entit, &actit);
-            
-            /* gather the decisions to the decision set */
-            do {
-                struct ep_decision *decision = calloc(1, sizeof(struct ep_decision));
-
-                struct ep_list_head_s pair_list;
-                memset(&pair_list, 0, sizeof(struct ep_list_head_s));
-
-                if (dbus_message_iter_get_arg_type(&actit) != DBUS_TYPE_ARRAY) {
-                    success = FALSE;
-                    free(decision);
-                    continue;
-                }
-                dbus_message_iter_recurse(&actit, &structit);
-
-                /* gather the key-value pairs to the decision */
-                do {
-                    struct ep_key_value_pair *pair =
-                        calloc(1, sizeof(struct ep_key_value_pair));
-                    void *tmp = NULL;
-                    char *key = NULL;
-
-                    if (dbus_message_iter_get_arg_type(&structit) != DBUS_TYPE_STRUCT) {
-                        success = FALSE;
-                        free(pair);
-                        continue;
-                    }
-                    dbus_message_iter_recurse(&structit, &structfieldit);
-
-                    /* there are two fields inside the struct: one
-                     * string and one variant */
-
-                    if (dbus_message_iter_get_arg_type(&structfieldit) != DBUS_TYPE_STRING) {
-                        success = FALSE;
-                        free(pair);
-                        continue;
-                    }
-
-                    dbus_message_iter_get_basic(&structfieldit, (void *)&key);
-                    pair->key = strdup(key);
-                    /* printf("libep:   key: '%s'\n", pair->key); */
-
-                    if (!dbus_message_iter_next(&structfieldit)) {
-                        success = FALSE;
-                        free(pair);
-                        continue;
-                    }
-
-                    if (dbus_message_iter_get_arg_type(&structfieldit) != DBUS_TYPE_VARIANT) {
-                        success = FALSE;
-                        free(pair);
-                        continue;
-                    }
-                    dbus_message_iter_recurse(&structfieldit, &variantit);
-                    dbus_message_iter_get_basic(&variantit, (void *)&tmp);
-                    
-                    switch (dbus_message_iter_get_arg_type(&variantit)) {
-                        case DBUS_TYPE_INT32:
-                            pair->value = malloc(sizeof(int));
-                            memcpy(pair->value, &tmp, sizeof(int));
-                            pair->type = EP_VALUE_INT;
-                            /* printf("libep:   value (int)    '%i'\n",
-                                    *(int *) pair->value); */
-                            break;
-                        case DBUS_TYPE_DOUBLE:
-                            pair->value = malloc(sizeof(double));
-                            memcpy(pair->value, &tmp, sizeof(double));
-                            pair->type = EP_VALUE_FLOAT;
-                            /* printf("libep:   value (float)  '%f'\n",
-                                    *(float *) pair->value); */
-                            break;
-                        case DBUS_TYPE_STRING:
-                            pair->value = strdup(tmp);
-                            pair->type = EP_VALUE_STRING;
-                            /* printf("libep:   value (string) '%s'\n",
-                                    (char *) pair->value); */
-                            break;
-                        default:
-                            /* printf("libep:   value is unknown D-Bus type '%i'\n", 
-                                    dbus_message_iter_get_arg_type(&variantit)); */
-                            break;
-                    }
-                    
-                    ep_list_append(&pair_list, pair);
-
-                } while (dbus_message_iter_next(&structit));
-
-                decision->pairs =
-                    (struct ep_key_value_pair **) ep_list_convert_to_array(&pair_list);
-                ep_list_free_all(&pair_list);
-                
-                ep_list_append(&decision_list, decision);
-            
-            } while (dbus_message_iter_next(&entit));
-
-            decisions = (struct ep_decision **) ep_list_convert_to_array(&decision_list);
-            ep_list_free_all(&decision_list);
-
-            /* count the callbacks if a transaction is needed */
-            if (trans_data) {
-                if (data->decision_names[0]) {
-                    i = 0;
-                    cb_decision_name = data->decision_names[i];
-                    while (cb_decision_name) {
-                        if (strcmp(cb_decision_name, actname) == 0) {
-                            trans_data->refcount++;
-#if 0
-                            printf("libep: increased transaction data '%p' refcount to %u for name '%s'\n",
-                                    trans_data, trans_data->refcount, cb_decision_name);
-#endif
-                        }
-                        cb_decision_name = data->decision_names[++i];
-                    }
-                }
-                else {
-                    /* subscribe to all decisions */
-                    trans_data->refcount++;
-                }
-            }
-
-            if (data->decision_names[0]) {
-                i = 0;
-                cb_decision_name = data->decision_names[i];
-
-                /* send the decisions */
-                while (cb_decision_name) {
-                    if (strcmp(cb_decision_name, actname) == 0) {
-                        data->cb(actname, decisions, ep_ready, txid, data->user_data);
-                        found = TRUE;
-                    }
-                    cb_decision_name = data->decision_names[++i];
-                }
-            }
-            else {
-                /* call the callback for all decisions */
-                data->cb(actname, decisions, ep_ready, txid, data->user_data);
-                found = TRUE;
-            }
-            
-            free_decisions(decisions);
-
-        } while (dbus_message_iter_next(&entit));
-
-    } while (dbus_message_iter_next(&arrit));
-    
-    if (txid == 0) {
-        /* no ack is needed, go to send_signal for cleanup */
-        goto send_signal;
+        dbus_message_iter_recurse(&msgit, &arrit);
+        handle_decisions(txid, decode_delta, &arrit, data);
+        handled = TRUE;
     }
 
-    if (found) {
+    /* the delta was sent to us alone, nobody else is going to ack it */
+    if (!handled)
+        send_signal(txid, TRUE);
+}
 
-        /* It's possible that the callbacks have had errors, and the
-         * NACK is already sent. In this case the transaction is already
-         * removed from the list and freed. See if this is the case. */
-        trans_data = ep_get_transaction(txid);
-        if (!trans_data) {
-            return;
-        }
+int ep_delta_enable (void)
+{
+    DBusMessage *msg, *reply;
+    int          success = 0;
 
-        /* the ACK signal is now ready to be sent */
-        trans_data->ready = TRUE;
-        send_if_done(trans_data);
+    if (connection == NULL)
+        return 0;
 
-#if 0
-        printf("libep: signal handling success, waiting for callbacks\n");
-#endif
-        return; /* success */
-    }
+    if (delta_mode)
+        return 1;
 
-send_signal:
+    msg = dbus_message_new_method_call(POLICY_DBUS_NAME,
+            POLICY_DBUS_PATH,
+            POLICY_DBUS_INTERFACE,
+            POLICY_DELTA_MODE);
 
-    /* no-one is interested or everything failed, just send the signal
-     * and be done with it */
+    if (msg == NULL)
+        return 0;
 
-    /* TODO: free all memory */
+    reply = dbus_connection_send_with_reply_and_block(connection, msg, -1, NULL);
 
-    if (trans_data) {
-        ep_list_remove(&transaction_list, trans_data);
-        free(trans_data);
-        trans_data = NULL;
+    if (reply != NULL) {
+        if (dbus_message_get_type(reply) != DBUS_MESSAGE_TYPE_ERROR)
+            success = 1;
+        dbus_message_unref(reply);
     }
 
-    /* printf("libep: not waiting for handlers to return, parsing %s a success\n",
-            success ? "was" : "was not"); */
+    dbus_message_unref(msg);
+
+    delta_mode = success;
 
-    send_signal(txid, success);
+    return success;
 }
 
 static DBusHandlerResult filter (DBusConnection *conn, DBusMessage *msg,
@@ -618,6 +1771,23 @@ static DBusHandlerResult filter (DBusConnection *conn, DBusMessage *msg,
     if (ep_list_empty(head))
         goto end;
 
+    /* the decisions come through the shared memory channel */
+    if (shm_in_use())
+        goto end;
+
+    if (dbus_message_get_type(msg) == DBUS_MESSAGE_TYPE_SIGNAL &&
+        dbus_message_has_interface(msg, POLICY_DBUS_INTERFACE) &&
+        dbus_message_has_signature(msg, POLICY_DELTA_SIGNATURE)) {
+        if (delta_mode)
+            handle_delta_message(msg);
+        goto end;
+    }
+
+    /* in delta mode the full decisions broadcast to the others are not
+     * for us, we get our own */
+    if (delta_mode)
+        goto end;
+
     node = head->first;
     
     while (node) {
@@ -723,6 +1893,11 @@ int ep_unregister (DBusConnection *c)
     dbus_connection_remove_filter(connection, filter, NULL);
     dbus_bus_remove_match(connection, polrule, NULL);
 
+    shm_close();
+
+    delta_free_all();
+    delta_mode = FALSE;
+
     /* then unregister */
 
     msg = dbus_message_new_method_call(POLICY_DBUS_NAME,
@@ -821,10 +1996,25 @@ failed:
     return 0;
 }
 
+static struct ep_key_value_pair * ep_find_pair_by_key(
+        struct ep_decision *decision, ep_key key)
+{
+    if (key <= EP_KEY_INVALID || key >= decision->nslot)
+        return NULL;
+
+    return decision->slots[key];
+}
+
 static struct ep_key_value_pair * ep_find_pair(
         struct ep_decision *decision, const char *key)
 {
     struct ep_key_value_pair **pairs = decision->pairs;
+    ep_key k = key_lookup(key);
+
+    /* registered keys are already resolved by the decoder */
+    if (k != EP_KEY_INVALID && k < decision->nslot)
+        return decision->slots[k];
+
     while (*pairs) {
         struct ep_key_value_pair *pair = *pairs;
 
@@ -878,3 +2068,42 @@ double ep_decision_get_float (struct ep_decision *decision, const char *key)
         return 0.0; /* TODO error handling */
     return *(double *) pair->value;
 }
+
+int ep_decision_has_key_by_key (struct ep_decision *decision, ep_key key)
+{
+    if (ep_find_pair_by_key(decision, key))
+        return TRUE;
+    return FALSE;
+}
+
+enum ep_value_type ep_decision_type_by_key (struct ep_decision *decision, ep_key key)
+{
+    struct ep_key_value_pair *pair = ep_find_pair_by_key(decision, key);
+    if (!pair)
+        return EP_VALUE_INVALID;
+    return pair->type;
+}
+
+const char * ep_decision_get_string_by_key (struct ep_decision *decision, ep_key key)
+{
+    struct ep_key_value_pair *pair = ep_find_pair_by_key(decision, key);
+    if (!pair || pair->type != EP_VALUE_STRING)
+        return NULL;
+    return (char *) pair->value;
+}
+
+int ep_decision_get_int_by_key (struct ep_decision *decision, ep_key key)
+{
+    struct ep_key_value_pair *pair = ep_find_pair_by_key(decision, key);
+    if (!pair || pair->type != EP_VALUE_INT)
+        return 0;
+    return *(int *) pair->value;
+}
+
+double ep_decision_get_float_by_key (struct ep_decision *decision, ep_key key)
+{
+    struct ep_key_value_pair *pair = ep_find_pair_by_key(decision, key);
+    if (!pair || pair->type != EP_VALUE_FLOAT)
+        return 0.0;
+    return *(double *) pair->value;
+}
@@ -36,6 +36,8 @@ USA.
 #define POLICY_DBUS_NAME        "org.freedesktop.ohm"
 #define POLICY_DECISION         "decision"
 #define POLICY_STATUS           "status"
+#define POLICY_DELTA_MODE       "delta_mode"
+#define POLICY_DELTA_SIGNATURE  "ua(suuaa(sv))"
 
 /* As simple API as possible: those wanting to do more difficult things
  * can use the D-Bus API directly. */
@@ -55,8 +57,19 @@ struct ep_key_value_pair {
 
 struct ep_decision {
     struct ep_key_value_pair **pairs;
+    struct ep_key_value_pair **slots;   /* pairs indexed by ep_key */
+    int nslot;
 };
 
+/* Keys registered with ep_key_register() are resolved to a small integer
+ * handle once, and the decoder attaches the matching pairs to every
+ * decision by handle. Lookups through a handle are then a plain array
+ * index instead of a string search. */
+
+typedef int ep_key;
+
+#define EP_KEY_INVALID 0
+
 
 /* callbacks and such */
 
@@ -92,4 +105,50 @@ const char * ep_decision_get_string (struct ep_decision *decision, const char *k
 int ep_decision_get_int             (struct ep_decision *decision, const char *key);
 double ep_decision_get_float        (struct ep_decision *decision, const char *key);
 
+
+/* key handles: register the interesting keys once (typically right after
+ * ep_filter) and use the _by_key variants in the decision callbacks */
+
+ep_key ep_key_register (const char *key);
+
+int ep_decision_has_key_by_key              (struct ep_decision *decision, ep_key key);
+enum ep_value_type ep_decision_type_by_key  (struct ep_decision *decision, ep_key key);
+
+const char * ep_decision_get_string_by_key  (struct ep_decision *decision, ep_key key);
+int ep_decision_get_int_by_key              (struct ep_decision *decision, ep_key key);
+double ep_decision_get_float_by_key         (struct ep_decision *decision, ep_key key);
+
+
+/* Decode a policy decision signal and pass each decision set to cb,
+ * without any transaction handling or acking. Meant for those who talk
+ * to the policy engine over the D-Bus API directly. The decisions and
+ * all the strings in them are only valid during the callback. Returns
+ * FALSE if the message could not be fully parsed. */
+
+int ep_decode (DBusMessage *msg, const char **decision_names,
+        ep_decision_cb cb, void *user_data);
+
+
+/* Shared memory decision channel for EPs running on the same host as the
+ * policy engine. Call ep_shm_enable after ep_register; from then on the
+ * decisions are no longer read from the bus but from a ring shared with
+ * the policy engine, and the acks go back the same way. Poll ep_shm_fd
+ * for input and call ep_shm_dispatch when it is readable; the callbacks
+ * are called from there. Returns FALSE (and the EP keeps using D-Bus) if
+ * the policy engine does not support the channel. An EP that falls too
+ * far behind is dropped from the channel and silently goes back to
+ * D-Bus; ep_shm_dispatch returns -1 from then on. */
+
+int ep_shm_enable   (void);
+int ep_shm_fd       (void);
+int ep_shm_dispatch (void);
+
+
+/* Ask the policy engine to send only the changed fields of the decisions
+ * from now on. libep keeps the full view and the callbacks see complete
+ * decisions as before. Call after ep_register; has no effect on EPs using
+ * the shared memory channel. */
+
+int ep_delta_enable (void);
+
 #endif
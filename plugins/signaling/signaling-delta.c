@@ -0,0 +1,466 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/**
+ * @file signaling-delta.c
+ * @brief decision deltas for external enforcement points
+ *
+ * EPs that opt in with the delta_mode method get their own copy of each
+ * decision signal, with only the fields that changed since the version
+ * of the fact the EP has last acked. The message looks like this:
+ *
+ * uint32 txid
+ * array [
+ *    struct {
+ *       string "com.nokia.policy.audio_route"
+ *       uint32 base        (version the changes apply to, 0 for all fields)
+ *       uint32 version     (version after applying the changes)
+ *       array [            (one per fact, possibly empty)
+ *          array [
+ *             struct {
+ *                string "device"
+ *                variant                      string "headset"
+ *             }
+ *          ]
+ *       ]
+ *    }
+ * ]
+ *
+ * A full copy is sent whenever the number of facts or their fields have
+ * changed, and whenever the previous version has not been acked (yet).
+ * A NAK from the EP drops everything we know about it, so the next
+ * decision is sent in full. Decisions without a transaction (txid 0) are
+ * never acked, so we can't know whether the EP could apply them and the
+ * decision after one of them is always sent in full.
+ */
+
+#include "signaling.h"
+
+static int DBG_SIGNALING;
+
+typedef struct {
+    GQuark  field;
+    GValue  value;
+} delta_field_t;
+
+typedef struct {
+    guint32    sent;            /* version of the snapshot */
+    guint32    acked;           /* last version acked by the EP */
+    guint      txid;            /* transaction that carried 'sent' */
+    GPtrArray *snapshot;        /* GArray of delta_field_t per fact */
+} delta_fact_t;
+
+static OhmFactStore *store;
+
+
+gboolean delta_init(int flag_signaling)
+{
+    DBG_SIGNALING = flag_signaling;
+    store = ohm_get_fact_store();
+
+    return TRUE;
+}
+
+
+/*
+ * snapshots
+ */
+
+static void snapshot_free(GPtrArray *snapshot)
+{
+    GArray *fields;
+    guint   i, j;
+
+    if (snapshot == NULL)
+        return;
+
+    for (i = 0; i < snapshot->len; i++) {
+        fields = g_ptr_array_index(snapshot, i);
+
+        for (j = 0; j < fields->len; j++)
+            g_value_unset(&g_array_index(fields, delta_field_t, j).value);
+
+        g_array_free(fields, TRUE);
+    }
+
+    g_ptr_array_free(snapshot, TRUE);
+}
+
+static void delta_fact_free(gpointer data)
+{
+    delta_fact_t *df = data;
+
+    snapshot_free(df->snapshot);
+    g_free(df);
+}
+
+static gboolean supported(GValue *gval)
+{
+    switch (G_VALUE_TYPE(gval)) {
+    case G_TYPE_STRING:
+    case G_TYPE_INT:
+    case G_TYPE_UINT:
+    case G_TYPE_LONG:
+    case G_TYPE_ULONG:
+    case G_TYPE_FLOAT:
+    case G_TYPE_DOUBLE:
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+static GPtrArray *snapshot_take(GSList *ohm_facts)
+{
+    GPtrArray     *snapshot = g_ptr_array_new();
+    GArray        *fields;
+    GSList        *j, *k;
+    delta_field_t  df;
+    GValue        *gval;
+
+    for (j = ohm_facts; j != NULL; j = g_slist_next(j)) {
+        OhmFact *of = j->data;
+
+        fields = g_array_new(FALSE, FALSE, sizeof(delta_field_t));
+
+        for (k = ohm_fact_get_fields(of); k != NULL; k = g_slist_next(k)) {
+            df.field = (GQuark)GPOINTER_TO_INT(k->data);
+            gval     = ohm_fact_get(of, g_quark_to_string(df.field));
+
+            if (gval == NULL || !G_IS_VALUE(gval) || !supported(gval))
+                continue;
+
+            memset(&df.value, 0, sizeof(df.value));
+            g_value_init(&df.value, G_VALUE_TYPE(gval));
+            g_value_copy(gval, &df.value);
+
+            g_array_append_val(fields, df);
+        }
+
+        g_ptr_array_add(snapshot, fields);
+    }
+
+    return snapshot;
+}
+
+static gboolean same_layout(GPtrArray *old, GPtrArray *new)
+{
+    GArray *o, *n;
+    guint   i, j;
+
+    if (old == NULL || old->len != new->len)
+        return FALSE;
+
+    for (i = 0; i < new->len; i++) {
+        o = g_ptr_array_index(old, i);
+        n = g_ptr_array_index(new, i);
+
+        if (o->len != n->len)
+            return FALSE;
+
+        for (j = 0; j < n->len; j++) {
+            if (g_array_index(o, delta_field_t, j).field !=
+                g_array_index(n, delta_field_t, j).field)
+                return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static gboolean value_equal(GValue *a, GValue *b)
+{
+    if (G_VALUE_TYPE(a) != G_VALUE_TYPE(b))
+        return FALSE;
+
+    switch (G_VALUE_TYPE(a)) {
+    case G_TYPE_STRING:
+        return !g_strcmp0(g_value_get_string(a), g_value_get_string(b));
+    case G_TYPE_INT:
+        return g_value_get_int(a) == g_value_get_int(b);
+    case G_TYPE_UINT:
+        return g_value_get_uint(a) == g_value_get_uint(b);
+    case G_TYPE_LONG:
+        return g_value_get_long(a) == g_value_get_long(b);
+    case G_TYPE_ULONG:
+        return g_value_get_ulong(a) == g_value_get_ulong(b);
+    case G_TYPE_FLOAT:
+        return g_value_get_float(a) == g_value_get_float(b);
+    case G_TYPE_DOUBLE:
+        return g_value_get_double(a) == g_value_get_double(b);
+    default:
+        return FALSE;
+    }
+}
+
+
+/*
+ * encoding
+ */
+
+static gboolean append_field(DBusMessageIter *fact, delta_field_t *df)
+{
+    DBusMessageIter  field, variant;
+    const gchar     *name = g_quark_to_string(df->field);
+    gchar            sig[2] = "?";
+    void            *value = NULL;
+    int              type;
+    gboolean         success = FALSE;
+
+    type = map_to_dbus_type(&df->value, sig, &value);
+
+    if (type == DBUS_TYPE_INVALID)
+        return TRUE;
+
+    if (!dbus_message_iter_open_container(fact, DBUS_TYPE_STRUCT, NULL, &field) ||
+        !dbus_message_iter_append_basic(&field, DBUS_TYPE_STRING, &name) ||
+        !dbus_message_iter_open_container(&field, DBUS_TYPE_VARIANT, sig,
+                                          &variant))
+        goto out;
+
+    if (type == DBUS_TYPE_STRING)
+        success = dbus_message_iter_append_basic(&variant, type, &value);
+    else
+        success = dbus_message_iter_append_basic(&variant, type, value);
+
+    dbus_message_iter_close_container(&field, &variant);
+    dbus_message_iter_close_container(fact, &field);
+
+ out:
+    g_free(value);
+    return success;
+}
+
+static gboolean append_fact(DBusMessageIter *facts, GArray *new, GArray *old)
+{
+    DBusMessageIter  fact;
+    delta_field_t   *n;
+    guint            i;
+
+    if (!dbus_message_iter_open_container(facts, DBUS_TYPE_ARRAY, "(sv)",
+                                          &fact))
+        return FALSE;
+
+    for (i = 0; i < new->len; i++) {
+        n = &g_array_index(new, delta_field_t, i);
+
+        if (old != NULL &&
+            value_equal(&n->value, &g_array_index(old, delta_field_t, i).value))
+            continue;
+
+        if (!append_field(&fact, n))
+            return FALSE;
+    }
+
+    dbus_message_iter_close_container(facts, &fact);
+
+    return TRUE;
+}
+
+static gboolean append_set(DBusMessageIter *sets, ExternalEPStrategy *s,
+                           const gchar *name, guint txid, GSList *ohm_facts)
+{
+    DBusMessageIter  set, facts;
+    delta_fact_t    *df;
+    GPtrArray       *snapshot;
+    guint32          base, version;
+    gboolean         delta;
+    guint            i;
+
+    if ((df = g_hash_table_lookup(s->delta_facts, name)) == NULL) {
+        df = g_new0(delta_fact_t, 1);
+        g_hash_table_insert(s->delta_facts, g_strdup(name), df);
+    }
+
+    snapshot = snapshot_take(ohm_facts);
+    delta    = df->acked != 0 && df->acked == df->sent &&
+        same_layout(df->snapshot, snapshot);
+    base     = delta ? df->acked : 0;
+    version  = df->sent + 1 ? df->sent + 1 : 1;
+
+    if (!dbus_message_iter_open_container(sets, DBUS_TYPE_STRUCT, NULL, &set) ||
+        !dbus_message_iter_append_basic(&set, DBUS_TYPE_STRING, &name) ||
+        !dbus_message_iter_append_basic(&set, DBUS_TYPE_UINT32, &base) ||
+        !dbus_message_iter_append_basic(&set, DBUS_TYPE_UINT32, &version) ||
+        !dbus_message_iter_open_container(&set, DBUS_TYPE_ARRAY, "a(sv)",
+                                          &facts))
+        goto fail;
+
+    for (i = 0; i < snapshot->len; i++) {
+        if (!append_fact(&facts, g_ptr_array_index(snapshot, i),
+                         delta ? g_ptr_array_index(df->snapshot, i) : NULL))
+            goto fail;
+    }
+
+    dbus_message_iter_close_container(&set, &facts);
+    dbus_message_iter_close_container(sets, &set);
+
+    OHM_DEBUG(DBG_SIGNALING, "%s for '%s': %s, version %u -> %u",
+              s->id, name, delta ? "delta" : "full", base, version);
+
+    snapshot_free(df->snapshot);
+    df->snapshot = snapshot;
+    df->sent     = version;
+    df->txid     = txid;
+
+    return TRUE;
+
+ fail:
+    snapshot_free(snapshot);
+    return FALSE;
+}
+
+gboolean delta_send_decision(DBusConnection *c, ExternalEPStrategy *s,
+                             Transaction *t, GSList *facts)
+{
+    DBusMessage     *msg;
+    DBusMessageIter  it, sets;
+    dbus_uint32_t    txid = t->txid;
+    GSList          *i, *ohm_facts;
+    gboolean         success = FALSE;
+
+    msg = dbus_message_new_signal(DBUS_PATH_POLICY "/decision",
+                                  DBUS_INTERFACE_POLICY, t->signal);
+
+    if (msg == NULL || !dbus_message_set_destination(msg, s->id))
+        goto out;
+
+    dbus_message_iter_init_append(msg, &it);
+
+    if (!dbus_message_iter_append_basic(&it, DBUS_TYPE_UINT32, &txid) ||
+        !dbus_message_iter_open_container(&it, DBUS_TYPE_ARRAY,
+                                          "(suuaa(sv))", &sets))
+        goto out;
+
+    for (i = facts; i != NULL; i = g_slist_next(i)) {
+        gchar *f = i->data;
+
+        if ((ohm_facts = ohm_fact_store_get_facts_by_name(store, f)) == NULL)
+            continue;
+
+        if (!append_set(&sets, s, f, txid, ohm_facts)) {
+            OHM_ERROR("signaling: failed to build decision delta for %s",
+                      s->id);
+            /* we do not know what the EP is going to get */
+            g_hash_table_remove_all(s->delta_facts);
+            goto out;
+        }
+    }
+
+    dbus_message_iter_close_container(&it, &sets);
+
+    success = dbus_connection_send(c, msg, NULL);
+
+ out:
+    /* send errors are handled like in send_ipc_signal: the transaction
+     * just times out */
+    if (msg != NULL)
+        dbus_message_unref(msg);
+
+    return success;
+}
+
+void delta_ack(ExternalEPStrategy *s, guint txid, guint status)
+{
+    GHashTableIter  it;
+    delta_fact_t   *df;
+
+    if (s->delta_facts == NULL)
+        return;
+
+    if (!status) {
+        /* maybe the EP could not apply the delta, start over */
+        OHM_DEBUG(DBG_SIGNALING, "NAK from %s, full resync", s->id);
+        g_hash_table_remove_all(s->delta_facts);
+        return;
+    }
+
+    /* decisions without a transaction are not really acked */
+    if (txid == 0)
+        return;
+
+    g_hash_table_iter_init(&it, s->delta_facts);
+
+    while (g_hash_table_iter_next(&it, NULL, (gpointer *)&df)) {
+        if (df->txid == txid)
+            df->acked = df->sent;
+    }
+}
+
+void delta_disable(ExternalEPStrategy *s)
+{
+    if (s->delta_facts != NULL)
+        g_hash_table_destroy(s->delta_facts);
+
+    s->delta_facts = NULL;
+    s->delta       = FALSE;
+}
+
+DBusHandlerResult delta_mode_request(DBusConnection *c, DBusMessage *msg,
+                                     void *user_data)
+{
+    DBusMessage        *reply;
+    EnforcementPoint   *ep;
+    ExternalEPStrategy *s;
+    const gchar        *sender;
+
+    (void) user_data;
+
+    if (msg == NULL)
+        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+    sender = dbus_message_get_sender(msg);
+    ep     = sender ? find_enforcement_point(sender) : NULL;
+
+    if (ep == NULL || !G_TYPE_CHECK_INSTANCE_TYPE(ep, EXTERNAL_EP_STRATEGY_TYPE)) {
+        reply = dbus_message_new_error(msg, DBUS_ERROR_FAILED,
+                                       "Not a registered external "
+                                       "enforcement point");
+    }
+    else {
+        s = EXTERNAL_EP_STRATEGY(ep);
+
+        if (!s->delta) {
+            s->delta       = TRUE;
+            s->delta_facts = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                                   g_free, delta_fact_free);
+        }
+
+        OHM_DEBUG(DBG_SIGNALING, "EP '%s' receives decision deltas", sender);
+
+        reply = dbus_message_new_method_return(msg);
+    }
+
+    if (reply != NULL) {
+        dbus_connection_send(c, reply, NULL);
+        dbus_message_unref(reply);
+    }
+
+    return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
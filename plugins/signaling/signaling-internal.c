@@ -38,16 +38,14 @@ GHashTable     *signal_queues;
 static OhmFactStore *store;
 static gboolean ecosystem_ready;
 
+static gint  coalesce_window = -1;  /* in ms, -1 if coalescing is disabled */
+static guint coalesced;             /* number of merged transactions */
+
     
 typedef void (*internal_ep_cb_t) (GObject *ep, GObject *transaction, gboolean success);
 
 static gboolean process_inq(gpointer data);
 
-static int watch_dbus_addr(const char *addr, gboolean watchit,
-                           DBusHandlerResult (*filter)(DBusConnection *,
-                                                       DBusMessage *, void *),
-                           void *user_data);
-
 static Transaction * transaction_lookup(guint txid)
 {
     return (Transaction *)g_hash_table_lookup(transactions, &txid);
@@ -85,7 +83,7 @@ gboolean init_signaling(DBusConnection *c, int flag_signaling, int flag_facts)
 
     connection = c;
 
-    return TRUE;
+    return shm_init(flag_signaling) && delta_init(flag_signaling);
 }
 
 gboolean deinit_signaling()
@@ -100,6 +98,8 @@ gboolean deinit_signaling()
 
     g_slist_free(enforcement_points);
 
+    shm_exit();
+
     /* TODO: stop all possibly ongoing transactions (or verify that they
      * are actually stopped when all enforcement points are gone) */
     if (transactions)
@@ -509,7 +509,7 @@ gboolean internal_ep_send_decision(EnforcementPoint *self,
     return TRUE;
 }
 
-static int map_to_dbus_type(GValue *gval, gchar *sig, void **value)
+int map_to_dbus_type(GValue *gval, gchar *sig, void **value)
 {
 
     int retval;
@@ -650,6 +650,23 @@ static gboolean send_ipc_signal(gpointer data)
      *
      */
 
+    /* the shared memory channels get their own copy of the decisions,
+     * the ones dropped from the ring need the D-Bus signal instead */
+    if (signal->shm_readers &&
+        shm_send_decision(transaction, facts, signal->shm_readers) != 0)
+        signal->dbus = TRUE;
+
+    /* and so do the EPs in delta mode */
+    for (i = signal->delta_eps; i != NULL; i = g_slist_next(i)) {
+        delta_send_decision(connection, i->data, transaction, facts);
+        g_object_unref(i->data);
+    }
+    g_slist_free(signal->delta_eps);
+    signal->delta_eps = NULL;
+
+    if (!signal->dbus)
+        goto end;
+
     OHM_DEBUG(DBG_SIGNALING, "sending signal with txid '%u'", txid);
 
     if ((dbus_signal =
@@ -799,7 +816,8 @@ end:
     g_object_unref(transaction);
     signal->klass->pending_signals = g_slist_remove(signal->klass->pending_signals, signal);
     g_free(signal);
-    dbus_message_unref(dbus_signal);
+    if (dbus_signal)
+        dbus_message_unref(dbus_signal);
     g_free(signal_name);
 
     return FALSE;
@@ -845,7 +863,7 @@ gboolean external_ep_send_decision(EnforcementPoint * self,
         /*
          * an IPC signal needs to be sent 
          */
-        pending_signal *signal = g_new0(pending_signal, 1);
+        signal = g_new0(pending_signal, 1);
         signal->facts = facts;
         signal->transaction = transaction;
         signal->klass = k;
@@ -855,6 +873,15 @@ gboolean external_ep_send_decision(EnforcementPoint * self,
         g_idle_add(send_ipc_signal, signal);
     }
 
+    /* note how this EP wants to receive the decision */
+    if (s->shm_reader >= 0)
+        signal->shm_readers |= 1U << s->shm_reader;
+    else if (s->delta)
+        signal->delta_eps = g_slist_prepend(signal->delta_eps,
+                g_object_ref(self));
+    else
+        signal->dbus = TRUE;
+
     /* internal bookkeeping */
 
     s->ongoing_transactions = g_slist_prepend(s->ongoing_transactions, transaction);
@@ -889,6 +916,11 @@ gboolean external_ep_unregister(EnforcementPoint * self)
     ExternalEPStrategy *s = EXTERNAL_EP_STRATEGY(self);
     GSList *i = NULL;
 
+    if (s->shm_reader >= 0) {
+        shm_close_channel(s->shm_reader);
+        s->shm_reader = -1;
+    }
+
     /* go through the ongoing_transactions list and remove this ep from
      * the transactions */
 
@@ -971,6 +1003,9 @@ gboolean external_ep_receive_ack(EnforcementPoint * self,
     /* internal reference count */
     s->ongoing_transactions = g_slist_remove(s->ongoing_transactions, transaction);
 
+    if (s->delta)
+        delta_ack(s, transaction->txid, status);
+
     /* tell the transaction that we are ready */
     transaction_ack_ep(transaction, self, status);
     if (transaction_done(transaction)) {
@@ -997,6 +1032,7 @@ static void transaction_instance_init(GTypeInstance * instance,
     self->not_answered = NULL;
     self->timeout_id = 0;
     self->built_ready = FALSE;
+    self->merged = NULL;
 }
 
 static void external_ep_dispose(GObject *object)
@@ -1009,6 +1045,8 @@ static void external_ep_dispose(GObject *object)
     g_free(self->id);
     self->id = NULL;
 
+    delta_disable(self);
+
     for (e = self->interested; e != NULL; e = g_slist_next(e)) {
         g_free(e->data);
     }
@@ -1062,6 +1100,13 @@ static void transaction_dispose(GObject *object)
     }
     g_slist_free(self->not_answered);
 
+    /* merged transactions that never got completed */
+    for (i = self->merged; i != 0; i = g_slist_next(i)) {
+        g_object_unref(i->data);
+    }
+    g_slist_free(self->merged);
+    self->merged = NULL;
+
     free_facts(self->facts);
     self->facts = NULL;
 
@@ -1263,6 +1308,9 @@ static void external_ep_strategy_instance_init(GTypeInstance * instance,
 
     OHM_DEBUG(DBG_SIGNALING, "initing external strategy");
     self->id = NULL;
+    self->shm_reader = -1;
+    self->delta = FALSE;
+    self->delta_facts = NULL;
 }
 
 static void external_ep_strategy_class_init(gpointer g_class,
@@ -1462,6 +1510,32 @@ void transaction_ack_ep(Transaction *self, EnforcementPoint *ep,
     return;
 }
 
+static GSList *ref_ep_list(GSList *ep_list)
+{
+    GSList *i, *copy = g_slist_copy(ep_list);
+
+    for (i = copy; i != NULL; i = g_slist_next(i)) {
+        g_object_ref(i->data);
+    }
+
+    return copy;
+}
+
+static void transaction_complete_merged(Transaction *self, Transaction *t)
+{
+    OHM_DEBUG(DBG_SIGNALING, "transaction %u completed with %u",
+            self->txid, t->txid);
+
+    self->acked        = ref_ep_list(t->acked);
+    self->nacked       = ref_ep_list(t->nacked);
+    self->not_answered = ref_ep_list(t->not_answered);
+    self->built_ready  = TRUE;
+
+    g_signal_emit (self, signals [ON_TRANSACTION_COMPLETE], 0);
+
+    g_object_unref(self);
+}
+
 void transaction_complete(Transaction *self)
 {
     GSList *i;
@@ -1503,6 +1577,13 @@ void transaction_complete(Transaction *self)
 
     g_signal_emit (self, signals [ON_TRANSACTION_COMPLETE], 0);
 
+    /* the transactions merged to this one share the outcome */
+    for (i = self->merged; i != NULL; i = g_slist_next(i)) {
+        transaction_complete_merged(i->data, self);
+    }
+    g_slist_free(self->merged);
+    self->merged = NULL;
+
     /* remove transaction from the table */
     g_hash_table_remove(transactions, &self->txid);
 
@@ -1764,12 +1845,8 @@ EnforcementPoint * register_enforcement_point(const gchar *uri,
     return ep;
 }
 
-gboolean unregister_enforcement_point(const gchar *uri)
+EnforcementPoint * find_enforcement_point(const gchar *uri)
 {
-
-    /* free memory and remove from the ep list */
-    /* also remember to remove the ep from ongoing transactions list */
-
     GSList *i = NULL;
     EnforcementPoint *ep = NULL;
     gchar *id;
@@ -1786,6 +1863,17 @@ gboolean unregister_enforcement_point(const gchar *uri)
         g_free(id);
     }
 
+    return ep;
+}
+
+gboolean unregister_enforcement_point(const gchar *uri)
+{
+
+    /* free memory and remove from the ep list */
+    /* also remember to remove the ep from ongoing transactions list */
+
+    EnforcementPoint *ep = find_enforcement_point(uri);
+
     if (ep == NULL) {
         return FALSE;
     }
@@ -1801,93 +1889,55 @@ gboolean unregister_enforcement_point(const gchar *uri)
     return TRUE;
 }
 
-static int watch_dbus_addr(const char *addr, gboolean watchit,
-                           DBusHandlerResult (*filter)(DBusConnection *,
-                                                       DBusMessage *, void *),
-                           void *user_data)
+void update_external_enforcement_points(const char *name,
+        const char *before, const char *after, void *data)
 {
-    char      match[1024];
-    DBusError err;
-
-    snprintf(match, sizeof(match),
-             "type='signal',"
-             "sender='%s',interface='%s',member='%s',path='%s',"
-             "arg0='%s'",
-             DBUS_INTERFACE_FDO, DBUS_INTERFACE_FDO,
-             SIGNAL_NAME_OWNER_CHANGED, DBUS_PATH_FDO,
-             addr);
+    (void) before;
+    (void) data;
 
-    if (filter) {
-        if (watchit) {
-            if (!dbus_connection_add_filter(connection, filter, user_data,NULL)) {
-                OHM_ERROR("Failed to install dbus filter %p.", filter);
-                return FALSE;
-            }
+    if (!strcmp(after, "")) {
+        /* a service went away, unregister if it was one of ours */
+        if (unregister_enforcement_point(name)) {
+            OHM_DEBUG(DBG_SIGNALING, "Removed service '%s'", name);
+            watch_dbus_addr(name, FALSE);
         }
-        else
-            dbus_connection_remove_filter(connection, filter, user_data);
-    }
-
-    /*
-     * Notes:
-     *   We block when adding filters, to minimize (= eliminate ?) the time
-     *   window for the client to crash after it has let us know about itself
-     *   but before we managed to install the filter. According to the docs
-     *   we do not re-enter the main loop and all other messages than the
-     *   reply to AddMatch will get queued and processed once we're back in the
-     *   main loop. On the watch removal path we do not care about errors and
-     *   we do not want to block either.
-     */
-
-    if (watchit) {
-        dbus_error_init(&err);
-        dbus_bus_add_match(connection, match, &err);
-
-        if (dbus_error_is_set(&err)) {
-            OHM_ERROR("Can't add match \"%s\": %s", match, err.message);
-            dbus_error_free(&err);
-            return FALSE;
+        else {
+            OHM_DEBUG(DBG_SIGNALING, "Terminated service '%s' wasn't registered", name);
         }
     }
-    else
-        dbus_bus_remove_match(connection, match, NULL);
-
-    return TRUE;
 }
 
-DBusHandlerResult update_external_enforcement_points(DBusConnection * c,
-        DBusMessage * msg,
-        void *user_data)
-{
-    gchar *sender = NULL, *before = NULL, *after = NULL;
+/* dbus.add_watch and dbus.del_watch as imported by the plugin, without
+ * them (as in the unit tests) the EPs are just not tracked */
+static name_watch_t add_name_watch;
+static name_watch_t del_name_watch;
 
-    (void) user_data;
-    (void) c;
+void set_name_watch_methods(name_watch_t add, name_watch_t del)
+{
+    add_name_watch = add;
+    del_name_watch = del;
+}
 
-    if (!dbus_message_get_args(msg,
-            NULL,
-            DBUS_TYPE_STRING,
-            &sender,
-            DBUS_TYPE_STRING,
-            &before,
-            DBUS_TYPE_STRING,
-            &after,
-            DBUS_TYPE_INVALID))
-        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+gboolean watch_dbus_addr(const char *addr, gboolean watchit)
+{
+    if (watchit) {
+        if (add_name_watch == NULL)
+            return TRUE;
 
-    if (!strcmp(after, "")) {
-        /* a service went away, unregister if it was one of ours */
-        if (unregister_enforcement_point(sender)) {
-            OHM_DEBUG(DBG_SIGNALING, "Removed service '%s'", sender);
-            watch_dbus_addr(sender, FALSE, update_external_enforcement_points, NULL);
-        }
-        else {
-            OHM_DEBUG(DBG_SIGNALING, "Terminated service '%s' wasn't registered", sender);
-            return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+        if (!add_name_watch(DBUS_BUS_SYSTEM, addr,
+                            update_external_enforcement_points, NULL)) {
+            OHM_ERROR("Failed to watch D-Bus name %s.", addr);
+            return FALSE;
         }
+        return TRUE;
     }
+    else {
+        if (del_name_watch == NULL)
+            return TRUE;
 
-    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+        return del_name_watch(DBUS_BUS_SYSTEM, addr,
+                              update_external_enforcement_points, NULL);
+    }
 }
 
 DBusHandlerResult register_external_enforcement_point(DBusConnection * c,
@@ -1961,7 +2011,7 @@ DBusHandlerResult register_external_enforcement_point(DBusConnection * c,
         reply = dbus_message_new_method_return(msg);
         /* start watching client so that we get notified when it disconnects
            even if it doesn't explicitly disconnect */
-        watch_dbus_addr(uri, TRUE, update_external_enforcement_points, NULL);
+        watch_dbus_addr(uri, TRUE);
     }
 
     if (reply == NULL) {
@@ -2010,6 +2060,7 @@ DBusHandlerResult unregister_external_enforcement_point(DBusConnection * c,
     }
     else {
         reply = dbus_message_new_method_return(msg);
+        watch_dbus_addr(uri, FALSE);
     }
 
     if (reply == NULL) {
@@ -2039,6 +2090,75 @@ err:
 }
 
 
+void set_coalesce_window(gint window)
+{
+    coalesce_window = window;
+}
+
+gint get_coalesce_window(void)
+{
+    return coalesce_window;
+}
+
+guint get_coalesced_count(void)
+{
+    return coalesced;
+}
+
+static gboolean facts_overlap(GSList *a, GSList *b)
+{
+    GSList *i;
+
+    for (i = b; i != NULL; i = g_slist_next(i)) {
+        if (g_slist_find_custom(a, i->data, compare_strings))
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+/*
+ * Try to merge t to the last decision waiting in the queue. Only the tail
+ * is considered since merging further back would reorder the decisions.
+ * The facts are read from the factstore only when the decision is sent,
+ * so the merged decision carries the latest state of all of them.
+ */
+static gboolean transaction_coalesce(GQueue *queue, Transaction *t)
+{
+    Transaction *p = g_queue_peek_tail(queue);
+    GSList      *i;
+
+    if (p == NULL)
+        return FALSE;
+
+    /* a decision without a transaction won't wait for the acks */
+    if (p->txid == 0 && t->txid != 0)
+        return FALSE;
+
+    if (!facts_overlap(p->facts, t->facts))
+        return FALSE;
+
+    for (i = t->facts; i != NULL; i = g_slist_next(i)) {
+        if (!g_slist_find_custom(p->facts, i->data, compare_strings))
+            p->facts = g_slist_append(p->facts, g_strdup(i->data));
+    }
+
+    if (t->timeout > p->timeout)
+        p->timeout = t->timeout;
+
+    OHM_DEBUG(DBG_SIGNALING, "merged transaction %u to %u on '%s'",
+            t->txid, p->txid, p->signal);
+
+    coalesced++;
+
+    if (t->txid != 0)
+        p->merged = g_slist_append(p->merged, t);  /* takes the queue ref */
+    else
+        g_object_unref(t);
+
+    return TRUE;
+}
+
 static guint get_txid()
 {
     static guint    txid = 0;
@@ -2120,18 +2240,23 @@ Transaction * queue_decision(gchar *signal, GSList *facts,
     if (g_queue_is_empty(queue))
         needs_processing = TRUE;
 
-    g_queue_push_tail(queue, transaction);
-    OHM_DEBUG(DBG_SIGNALING, "added transaction %p to queue '%s' (%p)",
-            transaction, signal, queue);
+    if (coalesce_window < 0 || !transaction_coalesce(queue, transaction)) {
+        g_queue_push_tail(queue, transaction);
+        OHM_DEBUG(DBG_SIGNALING, "added transaction %p to queue '%s' (%p)",
+                transaction, signal, queue);
+    }
 
     if (needs_processing) {
         data = g_strdup(signal);
 
-        if (deferred_execution)
+        if (!deferred_execution)
+            process_inq(data);
+        else if (coalesce_window > 0)
+            /* give the related decisions a chance to be merged */
+            g_timeout_add(coalesce_window, process_inq, data);
+        else
             /* add the policy decision to the queue to be processed later */
             g_idle_add(process_inq, data);
-        else
-            process_inq(data);
     }
 
     if (!need_transaction || !deferred_execution) {
@@ -2225,6 +2350,29 @@ DBusHandlerResult dbus_ack(DBusConnection * c, DBusMessage * msg,
     return DBUS_HANDLER_RESULT_HANDLED;
 }
 
+gboolean ack_enforcement_point(EnforcementPoint *ep, guint txid, guint status)
+{
+    /* acks coming through the shared memory channel: the sender is
+     * already known, only check that it still owes us an answer */
+
+    Transaction *transaction = transaction_lookup(txid);
+
+    if (transaction == NULL) {
+        OHM_DEBUG(DBG_SIGNALING, "unknown transaction %u, ignored", txid);
+        return FALSE;
+    }
+
+    if (g_slist_find(transaction->not_answered, ep) == NULL) {
+        OHM_DEBUG(DBG_SIGNALING, "unexpected ACK/NAK for transaction %u, "
+                "ignored", txid);
+        return FALSE;
+    }
+
+    enforcement_point_receive_ack(ep, transaction, status);
+
+    return TRUE;
+}
+
 
 /*
  * Local Variables:
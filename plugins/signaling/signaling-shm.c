@@ -0,0 +1,770 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/**
+ * @file signaling-shm.c
+ * @brief shared memory decision channel for co-located enforcement points
+ *
+ * External enforcement points on the same host can ask for a shared
+ * memory channel after registering. Decisions for such EPs are written
+ * once into a ring in a shared segment instead of being sent over the
+ * bus, and the EPs ack through a ring in a small per-EP segment. EPs
+ * that cannot keep up with the ring are moved back to D-Bus. See
+ * libep/ep-shm.h for the layout.
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+
+#include "signaling.h"
+#include "libep/ep-shm.h"
+
+#define SHM_OBJECT_NAME "/ohm-signaling-%d"
+#define SHM_READER_NAME "/ohm-signaling-%d-%d"
+
+static int DBG_SIGNALING;
+
+typedef struct {
+    EnforcementPoint     *ep;           /* not reffed, see shm_close_channel */
+    struct ep_shm_reader *rd;           /* the EP writes, we only trust
+                                           what we can check */
+    int                   fd;           /* of rd */
+    uint32_t              ack_tail;     /* private copy, see ack_cb */
+    int                   doorbell;     /* we write, the EP reads */
+    int                   ackbell;      /* the EP writes, we read */
+    guint                 watch;
+    GQueue               *unacked;      /* txids written but not acked */
+} shm_reader_t;
+
+typedef struct {
+    EnforcementPoint     *ep;
+    GQueue               *txids;
+} shm_nak_t;
+
+static struct ep_shm_header *shm;
+static size_t                shm_size;
+static int                   shm_fd = -1;
+static int                   shm_rofd = -1;      /* handed out to the EPs */
+static uint32_t              shm_serial;
+static shm_reader_t          readers[EP_SHM_MAX_READERS];
+static GByteArray           *scratch;
+static OhmFactStore         *store;
+
+
+static gboolean shm_create(void)
+{
+    char name[64];
+    int  i;
+
+    snprintf(name, sizeof(name), SHM_OBJECT_NAME, getpid());
+    shm_size = EP_SHM_SEGMENT_SIZE(EP_SHM_RING_SIZE);
+
+    if ((shm_fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600)) < 0) {
+        OHM_ERROR("signaling: can't create shared memory object '%s': %s",
+                  name, strerror(errno));
+        return FALSE;
+    }
+
+    /* the EPs get a read only fd over D-Bus, nobody needs the name */
+    shm_rofd = shm_open(name, O_RDONLY, 0);
+    shm_unlink(name);
+
+    if (shm_rofd < 0) {
+        OHM_ERROR("signaling: can't reopen shared memory object '%s': %s",
+                  name, strerror(errno));
+        goto fail;
+    }
+
+    if (ftruncate(shm_fd, shm_size) < 0) {
+        OHM_ERROR("signaling: failed to size shared memory object: %s",
+                  strerror(errno));
+        goto fail;
+    }
+
+    shm = mmap(NULL, shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+
+    if (shm == MAP_FAILED) {
+        OHM_ERROR("signaling: failed to map shared memory: %s",
+                  strerror(errno));
+        shm = NULL;
+        goto fail;
+    }
+
+    memset(shm, 0, sizeof(*shm));
+    shm->magic       = EP_SHM_MAGIC;
+    shm->version     = EP_SHM_VERSION;
+    shm->ring_size   = EP_SHM_RING_SIZE;
+    shm->max_readers = EP_SHM_MAX_READERS;
+
+    for (i = 0; i < EP_SHM_MAX_READERS; i++) {
+        readers[i].fd       = -1;
+        readers[i].doorbell = -1;
+        readers[i].ackbell  = -1;
+    }
+
+    scratch = g_byte_array_sized_new(4096);
+    store   = ohm_get_fact_store();
+
+    OHM_DEBUG(DBG_SIGNALING, "created %u byte decision channel",
+              (unsigned int) shm_size);
+
+    return TRUE;
+
+ fail:
+    if (shm_rofd >= 0)
+        close(shm_rofd);
+    close(shm_fd);
+    shm_fd   = -1;
+    shm_rofd = -1;
+    return FALSE;
+}
+
+gboolean shm_init(int flag_signaling)
+{
+    DBG_SIGNALING = flag_signaling;
+
+    /* the segment itself is created when the first EP asks for it */
+    return TRUE;
+}
+
+void shm_exit(void)
+{
+    int i;
+
+    if (shm == NULL)
+        return;
+
+    for (i = 0; i < EP_SHM_MAX_READERS; i++)
+        shm_close_channel(i);
+
+    munmap(shm, shm_size);
+    close(shm_fd);
+    close(shm_rofd);
+    g_byte_array_free(scratch, TRUE);
+
+    shm      = NULL;
+    shm_fd   = -1;
+    shm_rofd = -1;
+    scratch  = NULL;
+}
+
+
+/*
+ * acks
+ */
+
+/*
+ * Acks come in the order of the decisions, so whatever was written
+ * before an acked decision has been acked over D-Bus or has timed out.
+ */
+static void unacked_remove(shm_reader_t *r, guint32 txid)
+{
+    gpointer p = GUINT_TO_POINTER(txid);
+
+    if (g_queue_find(r->unacked, p) == NULL)
+        return;
+
+    while (g_queue_pop_head(r->unacked) != p)
+        ;
+}
+
+static gboolean ack_cb(GIOChannel *chan, GIOCondition cond, gpointer data)
+{
+    gint               idx = GPOINTER_TO_INT(data);
+    shm_reader_t      *r   = readers + idx;
+    struct ep_shm_ack  ack;
+    uint64_t           cnt;
+    uint32_t           head;
+
+    (void) chan;
+
+    if (cond & (G_IO_ERR | G_IO_HUP)) {
+        OHM_DEBUG(DBG_SIGNALING, "ack channel %d closed", idx);
+        r->watch = 0;
+        return FALSE;
+    }
+
+    if (read(r->ackbell, &cnt, sizeof(cnt)) != sizeof(cnt))
+        return TRUE;
+
+    head = r->rd->ack_head;
+    __sync_synchronize();
+
+    /*
+     * The head comes from the EP. The tail is our own, so a bogus head
+     * can at worst make us read a ring worth of garbage acks, which are
+     * checked against the ongoing transactions anyway.
+     */
+    if (head - r->ack_tail > EP_SHM_ACK_SLOTS) {
+        OHM_ERROR("signaling: bogus ack head %u (tail %u) on shared memory "
+                  "channel %d", head, r->ack_tail, idx);
+        head = r->ack_tail + EP_SHM_ACK_SLOTS;
+    }
+
+    while (r->ack_tail != head) {
+        ack = r->rd->acks[r->ack_tail & (EP_SHM_ACK_SLOTS - 1)];
+
+        /* let the EP reuse the slot before we dive into the callbacks */
+        r->ack_tail++;
+        __sync_synchronize();
+        shm->readers[idx].ack_tail = r->ack_tail;
+
+        OHM_DEBUG(DBG_SIGNALING, "shm ack from channel %d: txid %u, "
+                  "status %u", idx, ack.txid, ack.status);
+
+        unacked_remove(r, ack.txid);
+
+        ack_enforcement_point(r->ep, ack.txid, ack.status);
+
+        /* the ack may have finished off the EP and the channel with it */
+        if (r->rd == NULL)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+/*
+ * channel setup and teardown
+ */
+
+static gboolean shm_create_reader(shm_reader_t *r, gint idx)
+{
+    char  name[64];
+    void *addr;
+
+    snprintf(name, sizeof(name), SHM_READER_NAME, getpid(), idx);
+
+    if ((r->fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600)) < 0) {
+        OHM_ERROR("signaling: can't create shared memory object '%s': %s",
+                  name, strerror(errno));
+        return FALSE;
+    }
+
+    shm_unlink(name);
+
+    if (ftruncate(r->fd, EP_SHM_READER_SIZE) < 0) {
+        OHM_ERROR("signaling: failed to size shared memory object: %s",
+                  strerror(errno));
+        return FALSE;
+    }
+
+    addr = mmap(NULL, EP_SHM_READER_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
+                r->fd, 0);
+
+    if (addr == MAP_FAILED) {
+        OHM_ERROR("signaling: failed to map shared memory: %s",
+                  strerror(errno));
+        return FALSE;
+    }
+
+    r->rd = addr;
+    memset(r->rd, 0, sizeof(*r->rd));
+
+    return TRUE;
+}
+
+static gint shm_open_channel(EnforcementPoint *ep)
+{
+    shm_reader_t *r;
+    GIOChannel   *chan;
+    gint          idx;
+
+    if (shm == NULL && !shm_create())
+        return -1;
+
+    for (idx = 0; idx < EP_SHM_MAX_READERS; idx++) {
+        if (readers[idx].ep == NULL)
+            break;
+    }
+
+    if (idx == EP_SHM_MAX_READERS) {
+        OHM_ERROR("signaling: no free shared memory decision channels");
+        return -1;
+    }
+
+    r = readers + idx;
+
+    if (!shm_create_reader(r, idx))
+        goto fail;
+
+    r->doorbell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    r->ackbell  = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (r->doorbell < 0 || r->ackbell < 0) {
+        OHM_ERROR("signaling: failed to create eventfds: %s", strerror(errno));
+        goto fail;
+    }
+
+    chan = g_io_channel_unix_new(r->ackbell);
+    r->watch = g_io_add_watch(chan, G_IO_IN | G_IO_ERR | G_IO_HUP,
+                              ack_cb, GINT_TO_POINTER(idx));
+    g_io_channel_unref(chan);
+
+    r->ep       = ep;
+    r->ack_tail = 0;
+    r->unacked  = g_queue_new();
+
+    r->rd->read_pos = shm->write_pos;
+    shm->readers[idx].ack_tail = 0;
+    __sync_synchronize();
+
+    if (++shm_serial == 0)
+        shm_serial = 1;
+    shm->readers[idx].active = shm_serial;
+
+    return idx;
+
+ fail:
+    if (r->rd != NULL)
+        munmap(r->rd, EP_SHM_READER_SIZE);
+    if (r->fd >= 0)
+        close(r->fd);
+    if (r->doorbell >= 0)
+        close(r->doorbell);
+    if (r->ackbell >= 0)
+        close(r->ackbell);
+    r->rd = NULL;
+    r->fd = r->doorbell = r->ackbell = -1;
+
+    return -1;
+}
+
+void shm_close_channel(gint idx)
+{
+    shm_reader_t *r;
+
+    if (shm == NULL || idx < 0 || idx >= EP_SHM_MAX_READERS)
+        return;
+
+    r = readers + idx;
+
+    if (r->ep == NULL)
+        return;
+
+    OHM_DEBUG(DBG_SIGNALING, "closing shared memory channel %d", idx);
+
+    shm->readers[idx].active = 0;
+    __sync_synchronize();
+
+    if (r->watch)
+        g_source_remove(r->watch);
+
+    munmap(r->rd, EP_SHM_READER_SIZE);
+    close(r->fd);
+    close(r->doorbell);
+    close(r->ackbell);
+
+    if (r->unacked != NULL)
+        g_queue_free(r->unacked);
+
+    r->ep       = NULL;
+    r->rd       = NULL;
+    r->unacked  = NULL;
+    r->watch    = 0;
+    r->fd       = -1;
+    r->doorbell = -1;
+    r->ackbell  = -1;
+}
+
+static gboolean nak_cb(gpointer data)
+{
+    shm_nak_t *nak = data;
+    gpointer   txid;
+
+    while ((txid = g_queue_pop_head(nak->txids)) != NULL)
+        ack_enforcement_point(nak->ep, GPOINTER_TO_UINT(txid), 0);
+
+    g_queue_free(nak->txids);
+    g_object_unref(nak->ep);
+    g_free(nak);
+
+    return FALSE;
+}
+
+static void shm_drop_reader(gint idx)
+{
+    shm_reader_t       *r = readers + idx;
+    ExternalEPStrategy *s = EXTERNAL_EP_STRATEGY(r->ep);
+    shm_nak_t          *nak;
+
+    OHM_INFO("signaling: EP '%s' fell behind on shared memory channel %d, "
+             "moving it back to D-Bus", s->id, idx);
+
+    /*
+     * The decisions still in the ring may be overwritten before the EP
+     * gets to them. Fail their transactions instead of letting them time
+     * out, but not from here, we are in the middle of sending one.
+     */
+    if (!g_queue_is_empty(r->unacked)) {
+        nak        = g_new0(shm_nak_t, 1);
+        nak->ep    = g_object_ref(r->ep);
+        nak->txids = r->unacked;
+        r->unacked = NULL;
+
+        g_idle_add(nak_cb, nak);
+    }
+
+    s->shm_reader = -1;
+    shm_close_channel(idx);
+}
+
+DBusHandlerResult shm_channel_request(DBusConnection *c, DBusMessage *msg,
+                                      void *user_data)
+{
+    DBusMessage      *reply = NULL;
+    EnforcementPoint *ep;
+    const gchar      *sender;
+    const gchar      *error = NULL;
+    gint              idx;
+
+    (void) user_data;
+
+    if (msg == NULL)
+        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+    sender = dbus_message_get_sender(msg);
+    ep     = sender ? find_enforcement_point(sender) : NULL;
+
+#ifdef DBUS_TYPE_UNIX_FD
+    if (ep == NULL || !G_TYPE_CHECK_INSTANCE_TYPE(ep, EXTERNAL_EP_STRATEGY_TYPE))
+        error = "Not a registered external enforcement point";
+    else if (EXTERNAL_EP_STRATEGY(ep)->shm_reader >= 0)
+        error = "Shared memory channel already set up";
+    else if ((idx = shm_open_channel(ep)) < 0)
+        error = "Failed to set up shared memory channel";
+    else {
+        dbus_uint32_t size = EP_SHM_RING_SIZE;
+        dbus_uint32_t id   = idx;
+
+        EXTERNAL_EP_STRATEGY(ep)->shm_reader = idx;
+
+        OHM_DEBUG(DBG_SIGNALING, "EP '%s' uses shared memory channel %d",
+                  sender, idx);
+
+        reply = dbus_message_new_method_return(msg);
+
+        if (reply != NULL &&
+            !dbus_message_append_args(reply,
+                                      DBUS_TYPE_UNIX_FD, &shm_rofd,
+                                      DBUS_TYPE_UNIX_FD, &readers[idx].fd,
+                                      DBUS_TYPE_UNIX_FD, &readers[idx].doorbell,
+                                      DBUS_TYPE_UNIX_FD, &readers[idx].ackbell,
+                                      DBUS_TYPE_UINT32 , &id,
+                                      DBUS_TYPE_UINT32 , &size,
+                                      DBUS_TYPE_INVALID)) {
+            dbus_message_unref(reply);
+            reply = NULL;
+            shm_close_channel(idx);
+            EXTERNAL_EP_STRATEGY(ep)->shm_reader = -1;
+            error = "Failed to pass the shared memory channel";
+        }
+    }
+#else
+    (void) idx;
+    error = "Shared memory channels are not supported";
+#endif
+
+    if (error != NULL) {
+        OHM_DEBUG(DBG_SIGNALING, "shm channel request from '%s' failed: %s",
+                  sender ? sender : "<unknown>", error);
+        reply = dbus_message_new_error(msg, DBUS_ERROR_FAILED, error);
+    }
+
+    if (reply != NULL) {
+        dbus_connection_send(c, reply, NULL);
+        dbus_message_unref(reply);
+    }
+
+    return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+
+/*
+ * encoding decisions
+ */
+
+static guint32 put(GByteArray *buf, const void *data, guint size)
+{
+    static const guint8 zero[EP_SHM_ALIGN];
+    guint32 offs = buf->len;
+
+    g_byte_array_append(buf, data, size);
+
+    if (buf->len != EP_SHM_ALIGN_SIZE(buf->len))
+        g_byte_array_append(buf, zero, EP_SHM_ALIGN_SIZE(buf->len) - buf->len);
+
+    return offs;
+}
+
+static guint32 put_string(GByteArray *buf, const gchar *s)
+{
+    return put(buf, s, strlen(s) + 1);
+}
+
+#define AT(buf, type, offs) ((type *) ((buf)->data + (offs)))
+
+static void encode_pair(GByteArray *buf, const gchar *key, GValue *gval)
+{
+    struct ep_shm_pair pair;
+    guint32            offs, s;
+
+    memset(&pair, 0, sizeof(pair));
+
+    /* same type mapping as on the D-Bus path, minus the types libep
+     * does not know about */
+    switch (G_VALUE_TYPE(gval)) {
+    case G_TYPE_STRING:
+        pair.type = EP_SHM_VALUE_STRING;
+        break;
+    case G_TYPE_INT:
+        pair.type    = EP_SHM_VALUE_INT;
+        pair.value.i = g_value_get_int(gval);
+        break;
+    case G_TYPE_LONG:
+        pair.type    = EP_SHM_VALUE_INT;
+        pair.value.i = g_value_get_long(gval);
+        break;
+    case G_TYPE_FLOAT:
+        pair.type    = EP_SHM_VALUE_FLOAT;
+        pair.value.d = g_value_get_float(gval);
+        break;
+    case G_TYPE_DOUBLE:
+        pair.type    = EP_SHM_VALUE_FLOAT;
+        pair.value.d = g_value_get_double(gval);
+        break;
+    default:
+        pair.type = EP_SHM_VALUE_INVALID;
+        break;
+    }
+
+    offs = put(buf, &pair, sizeof(pair));
+
+    AT(buf, struct ep_shm_pair, offs)->key = put_string(buf, key) - offs;
+
+    if (pair.type == EP_SHM_VALUE_STRING) {
+        const gchar *str = g_value_get_string(gval);
+
+        s = put_string(buf, str ? str : "");
+        AT(buf, struct ep_shm_pair, offs)->value.s = s - offs;
+    }
+
+    AT(buf, struct ep_shm_pair, offs)->size = buf->len - offs;
+}
+
+static void encode_fact(GByteArray *buf, OhmFact *of)
+{
+    struct ep_shm_decision  decision;
+    GSList                 *fields, *k;
+    guint32                 offs, npair = 0;
+
+    memset(&decision, 0, sizeof(decision));
+    offs = put(buf, &decision, sizeof(decision));
+
+    fields = ohm_fact_get_fields(of);
+
+    for (k = fields; k != NULL; k = g_slist_next(k)) {
+        GQuark       qk    = (GQuark)GPOINTER_TO_INT(k->data);
+        const gchar *field = g_quark_to_string(qk);
+        GValue      *gval  = ohm_fact_get(of, field);
+
+        if (gval == NULL || !G_IS_VALUE(gval))
+            continue;
+
+        encode_pair(buf, field, gval);
+        npair++;
+    }
+
+    AT(buf, struct ep_shm_decision, offs)->npair = npair;
+    AT(buf, struct ep_shm_decision, offs)->size  = buf->len - offs;
+}
+
+static void encode_record(GByteArray *buf, guint32 txid, guint32 mask,
+                          const gchar *signal, GSList *facts)
+{
+    struct ep_shm_record  rec;
+    struct ep_shm_set     set;
+    GSList               *i, *j, *ohm_facts;
+    guint32               soffs, nset = 0;
+
+    g_byte_array_set_size(buf, 0);
+
+    memset(&rec, 0, sizeof(rec));
+    rec.txid    = txid;
+    rec.readers = mask;
+
+    put(buf, &rec, sizeof(rec));
+    AT(buf, struct ep_shm_record, 0)->signal = put_string(buf, signal);
+
+    for (i = facts; i != NULL; i = g_slist_next(i)) {
+        gchar *f = i->data;
+
+        if ((ohm_facts = ohm_fact_store_get_facts_by_name(store, f)) == NULL)
+            continue;
+
+        memset(&set, 0, sizeof(set));
+        soffs = put(buf, &set, sizeof(set));
+
+        AT(buf, struct ep_shm_set, soffs)->name = put_string(buf, f) - soffs;
+
+        for (j = ohm_facts; j != NULL; j = g_slist_next(j)) {
+            encode_fact(buf, j->data);
+            AT(buf, struct ep_shm_set, soffs)->ndecision++;
+        }
+
+        AT(buf, struct ep_shm_set, soffs)->size = buf->len - soffs;
+        nset++;
+    }
+
+    AT(buf, struct ep_shm_record, 0)->nset = nset;
+    AT(buf, struct ep_shm_record, 0)->size = buf->len;
+}
+
+#undef AT
+
+
+/*
+ * the ring
+ */
+
+/*
+ * Write a record to the ring, making room for it by dropping the readers
+ * that are too far behind. One stuck EP must not hold up the others, the
+ * dropped ones get their decisions over D-Bus from then on. Returns the
+ * readers dropped.
+ */
+static guint32 ring_write(GByteArray *buf)
+{
+    struct ep_shm_record *rec = (struct ep_shm_record *) buf->data;
+    uint32_t              size = buf->len;
+    uint64_t              wpos, rpos;
+    uint32_t              offs, tail, pad, dropped = 0;
+    char                 *ring = EP_SHM_DATA(shm);
+    int                   i;
+
+    wpos = shm->write_pos;
+    offs = wpos & (EP_SHM_RING_SIZE - 1);
+    tail = EP_SHM_RING_SIZE - offs;
+    pad  = tail < size ? tail : 0;
+
+    for (i = 0; i < EP_SHM_MAX_READERS; i++) {
+        if (readers[i].ep == NULL)
+            continue;
+
+        /* the position is written by the EP, anything past us is bogus */
+        rpos = readers[i].rd->read_pos;
+
+        if (rpos > wpos || wpos + pad + size - rpos > EP_SHM_RING_SIZE) {
+            shm_drop_reader(i);
+            dropped |= 1U << i;
+        }
+    }
+
+    rec->readers &= ~dropped;
+
+    if (pad) {
+        if (pad >= sizeof(struct ep_shm_record)) {
+            struct ep_shm_record *padding = (struct ep_shm_record *)(ring + offs);
+
+            memset(padding, 0, sizeof(*padding));
+            padding->size = pad;
+        }
+
+        wpos += pad;
+        offs  = 0;
+    }
+
+    memcpy(ring + offs, buf->data, size);
+
+    __sync_synchronize();
+    shm->write_pos = wpos + size;
+
+    return dropped;
+}
+
+/*
+ * Write a decision for the given readers. Returns the readers that did
+ * not get it, because they have been dropped since the decision was
+ * queued or to make room for it. Those need it over D-Bus.
+ */
+guint32 shm_send_decision(Transaction *t, GSList *facts, guint32 mask)
+{
+    uint64_t one = 1;
+    guint32  lost = 0;
+    int      i;
+
+    if (shm == NULL)
+        return mask;
+
+    for (i = 0; i < EP_SHM_MAX_READERS; i++) {
+        if ((mask & (1U << i)) && readers[i].ep == NULL)
+            lost |= 1U << i;
+    }
+
+    if ((mask &= ~lost) == 0)
+        return lost;
+
+    encode_record(scratch, t->txid, mask, t->signal, facts);
+
+    if (scratch->len > EP_SHM_RING_SIZE / 2) {
+        OHM_ERROR("signaling: %u byte decision %u does not fit the shared "
+                  "memory ring", scratch->len, t->txid);
+
+        for (i = 0; i < EP_SHM_MAX_READERS; i++) {
+            if (mask & (1U << i))
+                shm_drop_reader(i);
+        }
+
+        return lost | mask;
+    }
+
+    lost |= ring_write(scratch) & mask;
+    mask &= ~lost;
+
+    for (i = 0; t->txid != 0 && i < EP_SHM_MAX_READERS; i++) {
+        if (mask & (1U << i))
+            g_queue_push_tail(readers[i].unacked, GUINT_TO_POINTER(t->txid));
+    }
+
+    OHM_DEBUG(DBG_SIGNALING, "wrote %u byte decision %u to shm channels 0x%x",
+              scratch->len, t->txid, mask);
+
+    for (i = 0; i < EP_SHM_MAX_READERS; i++) {
+        if ((mask & (1U << i)) && readers[i].doorbell >= 0) {
+            if (write(readers[i].doorbell, &one, sizeof(one)) < 0 &&
+                errno != EAGAIN)
+                OHM_DEBUG(DBG_SIGNALING, "failed to ring doorbell %d", i);
+        }
+    }
+
+    return lost;
+}
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
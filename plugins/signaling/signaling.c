@@ -38,6 +38,17 @@ OHM_DEBUG_PLUGIN(signaling,
 /* completion cb type */
 typedef void (*completion_cb_t)(char *id, char *argt, void **argv);
 
+OHM_IMPORTABLE(int, add_command, (char *name, void (*handler)(char *)));
+
+OHM_IMPORTABLE(int, add_watch, (DBusBusType type, const char *name,
+                                void (*handler)(const char *, const char *,
+                                                const char *, void *),
+                                void *data));
+OHM_IMPORTABLE(int, del_watch, (DBusBusType type, const char *name,
+                                void (*handler)(const char *, const char *,
+                                                const char *, void *),
+                                void *data));
+
 /* public API (inside OHM) */
 
 OHM_EXPORTABLE(GObject *, register_internal_enforcement_point, (gchar *uri, gchar **interested))
@@ -197,21 +208,82 @@ error:
     return 0;
 }
 
+/* console */
+
+static void console_command(char *command)
+{
+    char *end;
+    long  window;
+
+    if (!strcmp(command, "help")) {
+        printf("signaling help              show this help\n");
+        printf("signaling stats             show statistics\n");
+        printf("signaling coalesce <ms|off> set the coalescing window\n");
+    }
+    else if (!strcmp(command, "stats")) {
+        if (get_coalesce_window() < 0)
+            printf("coalescing: off\n");
+        else
+            printf("coalescing: %d ms window\n", get_coalesce_window());
+        printf("merged transactions: %u\n", get_coalesced_count());
+    }
+    else if (!strncmp(command, "coalesce ", sizeof("coalesce ") - 1)) {
+        command += sizeof("coalesce ") - 1;
+
+        if (!strcmp(command, "off"))
+            set_coalesce_window(-1);
+        else {
+            window = strtol(command, &end, 10);
+
+            if (*end || window < 0 || window > G_MAXINT) {
+                printf("invalid coalescing window \"%s\"\n", command);
+                return;
+            }
+
+            set_coalesce_window((gint) window);
+        }
+    }
+    else
+        printf("unknown signaling command \"%s\"\n", command);
+}
+
+static gboolean console_init(gpointer data)
+{
+    char *signature = (char *) add_command_SIGNATURE;
+
+    (void) data;
+
+    /* dres needs us, so it is only around once everything is loaded */
+    if (ohm_module_find_method("dres.add_command", &signature,
+                               (void *) &add_command))
+        add_command("signaling", console_command);
+    else
+        OHM_INFO("signaling: console command extensions not available");
+
+    return FALSE;
+}
+
 /* init and exit */
 
     static void
 plugin_init(OhmPlugin * plugin)
 {
     DBusConnection *c = ohm_plugin_dbus_get_connection();
-
-    (void) plugin;
+    const char     *window;
 
     /* should we ref the connection? */
 
     if (!OHM_DEBUG_INIT(signaling))
         g_warning("Failed to initialize signaling plugin debugging.");
 
+    set_name_watch_methods(add_watch, del_watch);
     init_signaling(c, DBG_SIGNALING, DBG_FACTS);
+
+    if ((window = ohm_plugin_get_param(plugin, "coalesce-window")) != NULL &&
+        strcmp(window, "off"))
+        set_coalesce_window(atoi(window));
+
+    g_idle_add(console_init, NULL);
     return;
 }
 
@@ -237,6 +309,10 @@ OHM_PLUGIN_PROVIDES_METHODS(signaling, 5,
         OHM_EXPORT(queue_policy_decision, "queue_policy_decision"),
         OHM_EXPORT(queue_key_change, "queue_key_change"));
 
+OHM_PLUGIN_REQUIRES_METHODS(signaling, 2,
+        OHM_IMPORT("dbus.add_watch", add_watch),
+        OHM_IMPORT("dbus.del_watch", del_watch));
+
 OHM_PLUGIN_DBUS_SIGNALS(
         {NULL, DBUS_INTERFACE_POLICY, SIGNAL_POLICY_ACK,
             NULL, dbus_ack, NULL}
@@ -246,7 +322,11 @@ OHM_PLUGIN_DBUS_METHODS(
         {NULL, DBUS_PATH_POLICY, METHOD_POLICY_REGISTER,
             register_external_enforcement_point, NULL},
         {NULL, DBUS_PATH_POLICY, METHOD_POLICY_UNREGISTER,
-            unregister_external_enforcement_point, NULL}
+            unregister_external_enforcement_point, NULL},
+        {NULL, DBUS_PATH_POLICY, METHOD_POLICY_SHM,
+            shm_channel_request, NULL},
+        {NULL, DBUS_PATH_POLICY, METHOD_POLICY_DELTA,
+            delta_mode_request, NULL}
         );
 
 /*
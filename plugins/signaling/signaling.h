@@ -57,6 +57,8 @@ USA.
 
 #define METHOD_POLICY_REGISTER    "register"
 #define METHOD_POLICY_UNREGISTER  "unregister"
+#define METHOD_POLICY_SHM         "shm_channel"
+#define METHOD_POLICY_DELTA       "delta_mode"
 #define SIGNAL_POLICY_ACK         "status"
 #define SIGNAL_NAME_OWNER_CHANGED "NameOwnerChanged"
 
@@ -112,6 +114,7 @@ typedef struct _Transaction {
     guint           timeout_id; /* g_source */
     gboolean        built_ready;
     GSList         *facts;
+    GSList         *merged; /* coalesced transactions completing with this */
 
 } Transaction;
 
@@ -164,6 +167,9 @@ typedef struct _ExternalEPStrategy {
     gchar          *id;
     GSList         *ongoing_transactions;
     GSList         *interested;
+    gint            shm_reader; /* shared memory channel, -1 if none */
+    gboolean        delta;      /* EP wants decision deltas */
+    GHashTable     *delta_facts; /* what the EP knows, see signaling-delta.c */
 
 } ExternalEPStrategy;
 
@@ -176,6 +182,9 @@ typedef struct _pending_signal {
     GSList *facts;
     Transaction *transaction;
     ExternalEPStrategyClass *klass;
+    guint32 shm_readers; /* shared memory channels to write to */
+    gboolean dbus;       /* whether any EP needs the D-Bus signal */
+    GSList *delta_eps;   /* EPs in delta mode (reffed) */
 } pending_signal;
 
 GType           external_ep_get_type(void);
@@ -213,12 +222,62 @@ gboolean deinit_signaling();
 
 DBusHandlerResult dbus_ack(DBusConnection * c, DBusMessage * msg, void *data);
 
+/* merging decisions on the same signal before they are dispatched: window
+ * is how long (ms) the decisions wait for merging, -1 disables it */
+
+void set_coalesce_window(gint window);
+
+gint get_coalesce_window(void);
+
+guint get_coalesced_count(void);
+
 DBusHandlerResult register_external_enforcement_point(DBusConnection * c, DBusMessage * msg,
         void *user_data);
 
 DBusHandlerResult unregister_external_enforcement_point(DBusConnection * c, DBusMessage * msg, void *user_data);
 
-DBusHandlerResult update_external_enforcement_points(DBusConnection * c, DBusMessage * msg, void *user_data);
+void update_external_enforcement_points(const char *name, const char *before,
+        const char *after, void *data);
+
+/* start or stop tracking an external EP via the dbus plugin name watches */
+
+typedef int (*name_watch_t)(DBusBusType type, const char *name,
+        void (*handler)(const char *, const char *, const char *, void *),
+        void *data);
+
+void set_name_watch_methods(name_watch_t add, name_watch_t del);
+
+gboolean watch_dbus_addr(const char *addr, gboolean watchit);
+
+EnforcementPoint * find_enforcement_point(const gchar *uri);
+
+gboolean ack_enforcement_point(EnforcementPoint *ep, guint txid, guint status);
+
+/* shared memory decision channel (signaling-shm.c) */
+
+gboolean shm_init(int flag_signaling);
+
+void shm_exit(void);
+
+DBusHandlerResult shm_channel_request(DBusConnection * c, DBusMessage * msg, void *user_data);
+
+guint32 shm_send_decision(Transaction *t, GSList *facts, guint32 readers);
+
+void shm_close_channel(gint reader);
+
+/* decision deltas (signaling-delta.c) */
+
+gboolean delta_init(int flag_signaling);
+
+DBusHandlerResult delta_mode_request(DBusConnection * c, DBusMessage * msg, void *user_data);
+
+gboolean delta_send_decision(DBusConnection *c, ExternalEPStrategy *s, Transaction *t, GSList *facts);
+
+void delta_ack(ExternalEPStrategy *s, guint txid, guint status);
+
+void delta_disable(ExternalEPStrategy *s);
+
+int map_to_dbus_type(GValue *gval, gchar *sig, void **value);
 
 #endif
 
@@ -0,0 +1,696 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/**
+ * @file bench_signaling.c
+ * @brief signaling load generator and latency benchmark
+ *
+ * Starts a private dbus-daemon, forks N external enforcement points
+ * (libep clients, one process each) connected to it, registers M internal
+ * enforcement points and then drives policy decisions through the
+ * signaling core at the given rate. Reports decision-to-ack latency
+ * percentiles, transactions/sec, memory growth and timeouts.
+ */
+
+#include <getopt.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/wait.h>
+
+#include <dbus/dbus-glib-lowlevel.h>
+
+#include "../signaling.h"
+#include "../libep/ep.h"
+
+#define BENCH_SIGNAL  "actions"
+#define BENCH_FACT    "com.nokia.policy.bench_%d"
+
+#define fatal(fmt, args...) do {                                \
+        fprintf(stderr, "fatal error: "fmt"\n" , ## args);      \
+        exit(1);                                                \
+    } while (0)
+
+typedef void (*internal_ep_cb_t) (GObject *ep, GObject *transaction, gboolean success);
+
+typedef struct {
+    double start;
+} sample_t;
+
+static struct {
+    int      nexternal;                 /* number of libep clients */
+    int      ninternal;                 /* number of internal EPs */
+    int      nfact;                     /* facts per decision */
+    int      rate;                      /* decisions per second */
+    int      duration;                  /* seconds */
+    int      timeout;                   /* transaction timeout, ms */
+    int      shm;                       /* use the shared memory channel */
+    int      delta;                     /* use decision deltas */
+} cfg = { 4, 4, 4, 100, 10, 2000, FALSE, FALSE };
+
+static struct {
+    guint    issued;
+    guint    completed;
+    guint    timeouts;
+    guint    nacks;
+    GArray  *latency;                   /* in ms */
+    long     rss_start;
+    long     rss_end;
+} stats;
+
+static GMainLoop      *loop;
+static DBusConnection *bus;
+static pid_t           daemon_pid;
+static pid_t          *children;
+static int             registered;
+static double          started;
+static guint           ticker;
+static gboolean        draining;
+
+
+/**
+ * ohm_log:
+ **/
+void
+ohm_log(OhmLogLevel level, const gchar *format, ...)
+{
+    va_list     ap;
+    FILE       *out;
+    const char *prefix;
+
+    switch (level) {
+    case OHM_LOG_ERROR:   prefix = "E: "; out = stderr; break;
+    case OHM_LOG_WARNING: prefix = "W: "; out = stderr; break;
+    default:                                           return;
+    }
+
+    va_start(ap, format);
+
+    fputs(prefix, out);
+    vfprintf(out, format, ap);
+    fputs("\n", out);
+
+    va_end(ap);
+}
+
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static long rss_kb(void)
+{
+    FILE *fp;
+    long  size, rss;
+
+    if ((fp = fopen("/proc/self/statm", "r")) == NULL)
+        return 0;
+
+    if (fscanf(fp, "%ld %ld", &size, &rss) != 2)
+        rss = 0;
+
+    fclose(fp);
+
+    return rss * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+
+/*
+ * private bus
+ */
+
+static char *start_bus(void)
+{
+    char *argv[] = { "dbus-daemon", "--session", "--nofork",
+                     "--print-address=1", NULL };
+    char  address[512];
+    int   fd[2];
+    FILE *fp;
+
+    if (pipe(fd) < 0)
+        fatal("pipe failed (%s)", strerror(errno));
+
+    switch ((daemon_pid = fork())) {
+    case -1:
+        fatal("fork failed (%s)", strerror(errno));
+    case 0:
+        close(fd[0]);
+        dup2(fd[1], 1);
+        close(fd[1]);
+        execvp(argv[0], argv);
+        fprintf(stderr, "failed to exec dbus-daemon (%s)\n", strerror(errno));
+        _exit(1);
+    default:
+        close(fd[1]);
+    }
+
+    if ((fp = fdopen(fd[0], "r")) == NULL ||
+        fgets(address, sizeof(address), fp) == NULL)
+        fatal("failed to get the address of the private bus");
+
+    fclose(fp);
+
+    address[strcspn(address, "\n")] = '\0';
+
+    return g_strdup(address);
+}
+
+static DBusConnection *bus_connect(const char *address)
+{
+    DBusConnection *c;
+    DBusError       err;
+
+    dbus_error_init(&err);
+
+    if ((c = dbus_connection_open_private(address, &err)) == NULL ||
+        !dbus_bus_register(c, &err))
+        fatal("failed to connect to %s (%s)", address,
+              dbus_error_is_set(&err) ? err.message : "unknown error");
+
+    return c;
+}
+
+
+/*
+ * external enforcement points
+ */
+
+static void external_decision(const char *decision_name,
+        struct ep_decision **decisions, ep_answer_cb answer_cb,
+        ep_answer_token token, void *user_data)
+{
+    (void) decision_name;
+    (void) decisions;
+    (void) user_data;
+
+    answer_cb(token, 1);
+}
+
+static void run_shm_loop(DBusConnection *c)
+{
+    struct pollfd fds[2];
+    int           fd;
+
+    if (!dbus_connection_get_unix_fd(c, &fd))
+        _exit(1);
+
+    fds[0].fd     = fd;
+    fds[0].events = POLLIN;
+    fds[1].fd     = ep_shm_fd();
+    fds[1].events = POLLIN;
+
+    for (;;) {
+        while (dbus_connection_dispatch(c) == DBUS_DISPATCH_DATA_REMAINS)
+            ;
+        dbus_connection_flush(c);
+
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (fds[1].revents & POLLIN)
+            ep_shm_dispatch();
+
+        if (fds[0].revents && !dbus_connection_read_write(c, 0))
+            break;
+    }
+}
+
+static void run_external_ep(const char *address, int idx)
+{
+    const char     *signals[] = { BENCH_SIGNAL, NULL };
+    DBusConnection *c;
+    char            name[64];
+
+    c = bus_connect(address);
+
+    snprintf(name, sizeof(name), "bench external ep %d", idx);
+
+    if (!ep_filter(NULL, BENCH_SIGNAL, external_decision, NULL) ||
+        !ep_register(c, name, signals)) {
+        fprintf(stderr, "external ep %d: failed to register\n", idx);
+        _exit(1);
+    }
+
+    if (cfg.shm) {
+        if (!ep_shm_enable()) {
+            fprintf(stderr, "external ep %d: failed to set up the shared "
+                    "memory channel\n", idx);
+            _exit(1);
+        }
+
+        run_shm_loop(c);
+    }
+    else {
+        if (cfg.delta && !ep_delta_enable()) {
+            fprintf(stderr, "external ep %d: failed to enable deltas\n", idx);
+            _exit(1);
+        }
+
+        while (dbus_connection_read_write_dispatch(c, -1))
+            ;
+    }
+
+    _exit(0);
+}
+
+static void start_external_eps(const char *address)
+{
+    int i;
+
+    children = g_new0(pid_t, cfg.nexternal);
+
+    for (i = 0; i < cfg.nexternal; i++) {
+        switch ((children[i] = fork())) {
+        case -1:
+            fatal("fork failed (%s)", strerror(errno));
+        case 0:
+            run_external_ep(address, i);
+        default:
+            break;
+        }
+    }
+}
+
+
+/*
+ * internal enforcement points
+ */
+
+static void internal_decision(GObject *ep, GObject *transaction,
+                              internal_ep_cb_t cb, gpointer data)
+{
+    (void) data;
+
+    cb(ep, transaction, TRUE);
+}
+
+static void start_internal_eps(void)
+{
+    EnforcementPoint *ep;
+    GSList           *capabilities;
+    char              uri[64];
+    int               i;
+
+    for (i = 0; i < cfg.ninternal; i++) {
+        snprintf(uri, sizeof(uri), "bench-internal-%d", i);
+
+        capabilities = g_slist_prepend(NULL, g_strdup(BENCH_SIGNAL));
+
+        if ((ep = register_enforcement_point(uri, NULL, TRUE,
+                                             capabilities)) == NULL)
+            fatal("failed to register internal ep %s", uri);
+
+        g_signal_connect(ep, "on-decision", G_CALLBACK(internal_decision),
+                         NULL);
+    }
+}
+
+
+/*
+ * the policy side: the D-Bus bits the ohm plugin framework would
+ * normally route to the signaling plugin
+ */
+
+static DBusHandlerResult bus_filter(DBusConnection *c, DBusMessage *msg,
+                                    void *data)
+{
+    DBusHandlerResult result;
+
+    (void) data;
+
+    if (dbus_message_is_method_call(msg, DBUS_INTERFACE_POLICY,
+                                    METHOD_POLICY_REGISTER)) {
+        result = register_external_enforcement_point(c, msg, NULL);
+
+        if (result == DBUS_HANDLER_RESULT_HANDLED && !cfg.shm && !cfg.delta)
+            registered++;
+
+        return result;
+    }
+
+    if (dbus_message_is_method_call(msg, DBUS_INTERFACE_POLICY,
+                                    METHOD_POLICY_SHM)) {
+        /* with --shm the EPs are ready only after setting up the channel */
+        result = shm_channel_request(c, msg, NULL);
+        registered++;
+
+        return result;
+    }
+
+    if (dbus_message_is_method_call(msg, DBUS_INTERFACE_POLICY,
+                                    METHOD_POLICY_DELTA)) {
+        result = delta_mode_request(c, msg, NULL);
+        registered++;
+
+        return result;
+    }
+
+    if (dbus_message_is_method_call(msg, DBUS_INTERFACE_POLICY,
+                                    METHOD_POLICY_UNREGISTER))
+        return unregister_external_enforcement_point(c, msg, NULL);
+
+    if (dbus_message_is_signal(msg, DBUS_INTERFACE_POLICY, SIGNAL_POLICY_ACK))
+        return dbus_ack(c, msg, NULL);
+
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+static void setup_policy_side(const char *address)
+{
+    DBusError err;
+
+    bus = bus_connect(address);
+
+    dbus_error_init(&err);
+
+    if (dbus_bus_request_name(bus, POLICY_DBUS_NAME,
+                              DBUS_NAME_FLAG_DO_NOT_QUEUE, &err) !=
+        DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER)
+        fatal("failed to acquire %s (%s)", POLICY_DBUS_NAME,
+              dbus_error_is_set(&err) ? err.message : "already taken");
+
+    dbus_bus_add_match(bus, "type='signal',interface='" DBUS_INTERFACE_POLICY
+                       "',member='" SIGNAL_POLICY_ACK "'", &err);
+
+    if (dbus_error_is_set(&err))
+        fatal("failed to add match for acks (%s)", err.message);
+
+    if (!dbus_connection_add_filter(bus, bus_filter, NULL, NULL))
+        fatal("failed to add D-Bus filter");
+
+    dbus_connection_setup_with_g_main(bus, NULL);
+
+    if (!init_signaling(bus, 0, 0))
+        fatal("failed to initialize signaling");
+}
+
+static void create_facts(void)
+{
+    OhmFactStore *fs = ohm_fact_store_get_fact_store();
+    OhmFact      *fact;
+    char          name[64];
+    int           i;
+
+    for (i = 0; i < cfg.nfact; i++) {
+        snprintf(name, sizeof(name), BENCH_FACT, i);
+
+        fact = ohm_fact_new(name);
+        ohm_fact_set(fact, "type",   ohm_value_from_string("sink"));
+        ohm_fact_set(fact, "device", ohm_value_from_string("headset"));
+        ohm_fact_set(fact, "mute",   ohm_value_from_int(i & 1));
+
+        ohm_fact_store_insert(fs, fact);
+    }
+}
+
+
+/*
+ * load generation
+ */
+
+static void decision_complete(Transaction *t, gpointer data)
+{
+    sample_t *sample = data;
+    double    latency;
+
+    latency = now() - sample->start;
+
+    if (t->not_answered != NULL)
+        stats.timeouts++;
+    else
+        g_array_append_val(stats.latency, latency);
+
+    if (t->nacked != NULL)
+        stats.nacks++;
+
+    stats.completed++;
+
+    g_free(sample);
+    g_object_unref(t);
+
+    if (draining && stats.completed == stats.issued)
+        g_main_loop_quit(loop);
+}
+
+static void issue_decision(void)
+{
+    Transaction *t;
+    GSList      *facts = NULL;
+    sample_t    *sample;
+    char         name[64];
+    int          i;
+
+    for (i = 0; i < cfg.nfact; i++) {
+        snprintf(name, sizeof(name), BENCH_FACT, i);
+        facts = g_slist_prepend(facts, g_strdup(name));
+    }
+
+    sample = g_new0(sample_t, 1);
+    sample->start = now();
+
+    t = queue_decision(BENCH_SIGNAL, facts, 0, TRUE, cfg.timeout, TRUE);
+
+    if (t == NULL) {
+        g_free(sample);
+        return;
+    }
+
+    g_signal_connect(t, "on-transaction-complete",
+                     G_CALLBACK(decision_complete), sample);
+
+    stats.issued++;
+}
+
+static gboolean tick(gpointer data)
+{
+    double elapsed = now() - started;
+    guint  due;
+
+    (void) data;
+
+    if (elapsed >= cfg.duration * 1000.0) {
+        draining = TRUE;
+        ticker   = 0;
+
+        if (stats.completed == stats.issued)
+            g_main_loop_quit(loop);
+
+        return FALSE;
+    }
+
+    due = (guint) (elapsed * cfg.rate / 1000.0) + 1;
+
+    while (stats.issued < due)
+        issue_decision();
+
+    return TRUE;
+}
+
+static gboolean wait_for_eps(gpointer data)
+{
+    (void) data;
+
+    if (registered < cfg.nexternal)
+        return TRUE;
+
+    printf("%d external%s and %d internal enforcement points registered\n",
+           cfg.nexternal,
+           cfg.shm ? " (shared memory)" : cfg.delta ? " (deltas)" : "",
+           cfg.ninternal);
+
+    stats.rss_start = rss_kb();
+    started = now();
+    ticker  = g_timeout_add(1, tick, NULL);
+
+    return FALSE;
+}
+
+
+/*
+ * reporting
+ */
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double da = *(const double *) a;
+    double db = *(const double *) b;
+
+    return da < db ? -1 : (da > db ? 1 : 0);
+}
+
+static double percentile(double *values, guint n, double p)
+{
+    guint idx;
+
+    if (n == 0)
+        return 0.0;
+
+    idx = (guint) (p / 100.0 * (n - 1) + 0.5);
+
+    return values[idx];
+}
+
+static void report(double elapsed)
+{
+    double *values = (double *) stats.latency->data;
+    guint   n      = stats.latency->len;
+
+    qsort(values, n, sizeof(double), compare_doubles);
+
+    printf("decisions: %u issued, %u completed, %u timed out, %u nacked\n",
+           stats.issued, stats.completed, stats.timeouts, stats.nacks);
+    printf("throughput: %.1f transactions/sec\n",
+           elapsed > 0 ? stats.completed * 1000.0 / elapsed : 0.0);
+    printf("latency (ms): min %.3f, p50 %.3f, p90 %.3f, p99 %.3f, "
+           "max %.3f\n",
+           n ? values[0] : 0.0,
+           percentile(values, n, 50), percentile(values, n, 90),
+           percentile(values, n, 99), n ? values[n - 1] : 0.0);
+    printf("memory: rss %ld kB at start, %ld kB at end (%+ld kB)\n",
+           stats.rss_start, stats.rss_end, stats.rss_end - stats.rss_start);
+}
+
+
+static void usage(const char *argv0, int exit_code)
+{
+    printf("usage: %s [options]\n"
+           "  -e, --external N   number of external (libep) EPs [%d]\n"
+           "  -i, --internal N   number of internal EPs [%d]\n"
+           "  -f, --facts N      facts per decision [%d]\n"
+           "  -r, --rate N       decisions per second [%d]\n"
+           "  -d, --duration N   duration in seconds [%d]\n"
+           "  -t, --timeout N    transaction timeout in ms [%d]\n"
+           "  -s, --shm          external EPs use the shared memory channel\n"
+           "  -D, --delta        external EPs receive decision deltas\n"
+           "  -h, --help         show this help\n",
+           argv0, cfg.nexternal, cfg.ninternal, cfg.nfact, cfg.rate,
+           cfg.duration, cfg.timeout);
+    exit(exit_code);
+}
+
+static int int_arg(const char *arg, int min)
+{
+    char *end;
+    long  val;
+
+    errno = 0;
+    val = strtol(arg, &end, 10);
+
+    if (errno != 0 || *end || val < min)
+        fatal("invalid argument '%s'", arg);
+
+    return (int) val;
+}
+
+static void parse_cmdline(int argc, char **argv)
+{
+#define OPTIONS "e:i:f:r:d:t:sDh"
+    struct option options[] = {
+        { "external", required_argument, NULL, 'e' },
+        { "internal", required_argument, NULL, 'i' },
+        { "facts"   , required_argument, NULL, 'f' },
+        { "rate"    , required_argument, NULL, 'r' },
+        { "duration", required_argument, NULL, 'd' },
+        { "timeout" , required_argument, NULL, 't' },
+        { "shm"     , no_argument      , NULL, 's' },
+        { "delta"   , no_argument      , NULL, 'D' },
+        { "help"    , no_argument      , NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, OPTIONS, options, NULL)) != -1) {
+        switch (opt) {
+        case 'e': cfg.nexternal = int_arg(optarg, 0); break;
+        case 'i': cfg.ninternal = int_arg(optarg, 0); break;
+        case 'f': cfg.nfact     = int_arg(optarg, 0); break;
+        case 'r': cfg.rate      = int_arg(optarg, 1); break;
+        case 'd': cfg.duration  = int_arg(optarg, 1); break;
+        case 't': cfg.timeout   = int_arg(optarg, 1); break;
+        case 's': cfg.shm       = TRUE;               break;
+        case 'D': cfg.delta     = TRUE;               break;
+        case 'h': usage(argv[0], 0);
+        default:  usage(argv[0], 1);
+        }
+    }
+#undef OPTIONS
+}
+
+int main(int argc, char **argv)
+{
+    char   *address;
+    double  elapsed;
+    int     i;
+
+    parse_cmdline(argc, argv);
+
+    address = start_bus();
+
+    /* fork the libep clients before setting up anything glib related */
+    start_external_eps(address);
+
+    g_type_init();
+
+    loop = g_main_loop_new(NULL, FALSE);
+    stats.latency = g_array_new(FALSE, FALSE, sizeof(double));
+
+    setup_policy_side(address);
+    create_facts();
+    start_internal_eps();
+
+    g_timeout_add(10, wait_for_eps, NULL);
+
+    g_main_loop_run(loop);
+
+    elapsed = now() - started;
+    stats.rss_end = rss_kb();
+
+    report(elapsed);
+
+    for (i = 0; i < cfg.nexternal; i++)
+        kill(children[i], SIGTERM);
+    kill(daemon_pid, SIGTERM);
+
+    while (wait(NULL) > 0)
+        ;
+
+    deinit_signaling();
+
+    g_array_free(stats.latency, TRUE);
+    g_free(children);
+    g_free(address);
+
+    return stats.timeouts ? 1 : 0;
+}
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
@@ -703,6 +703,89 @@ START_TEST (test_signaling_timeout)
 }
 END_TEST
 
+/*
+ * test_signaling_coalesce
+ *
+ * Test that decisions with overlapping facts are merged before they are
+ * dispatched and that all the transactions still complete.
+ * */
+
+int coalesce_complete_count = 0;
+
+static gboolean test_coalesce_decision(EnforcementPoint *e, Transaction *t, internal_ep_cb_t cb, gpointer data) {
+    GSList *facts;
+    (void) data;
+
+    g_object_get(t, "facts", &facts, NULL);
+    fail_unless(g_slist_length(facts) == 2, "Facts were not merged");
+
+    decision_count++;
+    cb(G_OBJECT(e), G_OBJECT(t), TRUE);
+
+    return TRUE;
+}
+
+static void test_coalesce_complete(Transaction *t, gpointer data) {
+    GSList *acked, *i;
+    (void) data;
+
+    g_object_get(t, "acked", &acked, NULL);
+    fail_unless(g_slist_length(acked) == 1, "Acked EPs: %i", g_slist_length(acked));
+
+    for (i = acked; i != NULL; i = g_slist_next(i))
+        g_free(i->data);
+    g_slist_free(acked);
+
+    if (++coalesce_complete_count == 2)
+        g_main_loop_quit(loop);
+}
+
+START_TEST (test_signaling_coalesce)
+{
+    DBusError error;
+    DBusConnection *c;
+    Transaction *t1, *t2;
+    GSList *facts;
+    guint merged;
+    dbus_error_init(&error);
+
+    c = dbus_bus_get(DBUS_BUS_SYSTEM, &error);
+    init_signaling(c, 0, 0);
+    set_coalesce_window(0);
+
+    GSList *capabilities = g_slist_prepend(NULL, g_strdup("actions"));
+
+    EnforcementPoint *ep = register_enforcement_point("internal", NULL, TRUE, capabilities);
+    g_signal_connect(ep, "on-decision", G_CALLBACK(test_coalesce_decision), NULL);
+
+    decision_count = 0;
+    coalesce_complete_count = 0;
+    merged = get_coalesced_count();
+
+    facts = g_slist_prepend(NULL, g_strdup("com.nokia.policy.a"));
+    t1 = queue_decision("actions", facts, 0, TRUE, 2000, TRUE);
+
+    facts = g_slist_prepend(NULL, g_strdup("com.nokia.policy.b"));
+    facts = g_slist_prepend(facts, g_strdup("com.nokia.policy.a"));
+    t2 = queue_decision("actions", facts, 0, TRUE, 2000, TRUE);
+
+    g_signal_connect(t1, "on-transaction-complete", G_CALLBACK(test_coalesce_complete), NULL);
+    g_signal_connect(t2, "on-transaction-complete", G_CALLBACK(test_coalesce_complete), NULL);
+
+    g_main_loop_run(loop);
+
+    fail_unless(decision_count == 1, "Decision sent %i times", decision_count);
+    fail_unless(get_coalesced_count() == merged + 1, "Transactions were not merged");
+
+    g_object_unref(t1);
+    g_object_unref(t2);
+
+    set_coalesce_window(-1);
+    unregister_enforcement_point("internal");
+    deinit_signaling();
+}
+END_TEST
+
 
 Suite *ohm_signaling_suite(void)
 {
@@ -717,6 +800,7 @@ Suite *ohm_signaling_suite(void)
     tcase_add_test(tc_all, test_signaling_internal_ep_2);
     tcase_add_test(tc_all, test_signaling_internal_ep_gobject);
     tcase_add_test(tc_all, test_signaling_timeout);
+    tcase_add_test(tc_all, test_signaling_coalesce);
     
     tcase_set_timeout(tc_all, 120);
     suite_add_tcase(suite, tc_all);
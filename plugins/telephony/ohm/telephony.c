@@ -65,6 +65,28 @@ OHM_IMPORTABLE(void *, timer_add  , (uint32_t delay,
                                      resconn_timercb_t callback,
                                      void *data));
 OHM_IMPORTABLE(void  , timer_del  , (void *timer));
+OHM_IMPORTABLE(int    , add_signal , (DBusBusType type,
+                                      const char *path, const char *interface,
+                                      const char *member, const char *signature,
+                                      const char *sender,
+                                      DBusObjectPathMessageFunction handler,
+                                      void *data));
+OHM_IMPORTABLE(int    , del_signal , (DBusBusType type,
+                                      const char *path, const char *interface,
+                                      const char *member, const char *signature,
+                                      const char *sender,
+                                      DBusObjectPathMessageFunction handler,
+                                      void *data));
+OHM_IMPORTABLE(int    , add_watch  , (DBusBusType type, const char *name,
+                                      void (*handler)(const char *,
+                                                      const char *,
+                                                      const char *, void *),
+                                      void *data));
+OHM_IMPORTABLE(int    , del_watch  , (DBusBusType type, const char *name,
+                                      void (*handler)(const char *,
+                                                      const char *,
+                                                      const char *, void *),
+                                      void *data));
 
 
 
@@ -72,8 +94,8 @@ OHM_IMPORTABLE(void  , timer_del  , (void *timer));
  * D-Bus stuff
  */
 
-static int bus_add_match(char *type, char *interface, char *member, char *path);
-static void bus_del_match(char *type, char *interface, char *member,char *path);
+static int  bus_add_signals(void);
+static void bus_del_signals(void);
 
 #define DBUS_METHOD_HANDLER(name)                               \
     static DBusHandlerResult name(DBusConnection *c,            \
@@ -110,7 +132,6 @@ DBUS_METHOD_HANDLER(accept_call_request);
 DBUS_METHOD_HANDLER(hold_call_request);
 DBUS_METHOD_HANDLER(dtmf_start_request);
 DBUS_METHOD_HANDLER(dtmf_stop_request);
-DBUS_SIGNAL_HANDLER(name_owner_changed);
 
 
 static int tp_start_dtmf(call_t *call, unsigned int stream, int tone);
@@ -133,6 +154,8 @@ static int  bus_query_pid(const char *addr,
                            void (*query_cb)(DBusPendingCall *, void *),
                            void *data);
 static void bus_track_name(const char *name, int track);
+static void name_owner_changed(const char *name, const char *before,
+                               const char *after, void *data);
 
 static inline int need_video(void);
 
@@ -372,71 +395,11 @@ bus_init(const char *address)
      * set up DBUS signal handling
      */
     
-    if (!bus_add_match("signal", TELEPHONY_INTERFACE, NULL, NULL))
-        exit(1);
-
-    if (!bus_add_match("signal", TP_CHANNEL_GROUP, MEMBERS_CHANGED, NULL))
-        exit(1);
-
-    if (!bus_add_match("signal", TP_CONN_IFREQ, NEW_CHANNELS, NULL))
-        exit(1);
-
-    if (!bus_add_match("signal", TP_CHANNEL, CHANNEL_CLOSED, NULL))
-        exit(1);
-
-    if (!bus_add_match("signal", TP_CHANNEL_HOLD, HOLD_STATE_CHANGED, NULL))
-        exit(1);
-
-    if (!bus_add_match("signal", TP_CHANNEL_STATE, CALL_STATE_CHANGED, NULL))
-        exit(1);
-
-    if (!bus_add_match("signal", TP_CHANNEL_CALL, CALL_STATE_CHANGED,
-                       NULL))
-        exit(1);
-
-    if (!bus_add_match("signal", TP_CHANNEL_CALL, CONTENT_ADDED, NULL))
-        exit(1);
-
-    if (!bus_add_match("signal", TP_CHANNEL_CALL, CONTENT_REMOVED, NULL))
-        exit(1);
-    
-    if (!bus_add_match("signal", TP_DIALSTRINGS, SENDING_DIALSTRING, NULL))
-        exit(1);
-
-    if (!bus_add_match("signal", TP_DIALSTRINGS, STOPPED_DIALSTRING, NULL))
-        exit(1);
-
-    if (!bus_add_match("signal", TP_CHANNEL_MEDIA, STREAM_ADDED, NULL))
-        exit(1);
-
-    if (!bus_add_match("signal", TP_CHANNEL_MEDIA, STREAM_REMOVED, NULL))
-        exit(1);
-
-    if (!bus_add_match("signal", TP_CHANNEL_CONF_DRAFT, CHANNEL_MERGED, NULL))
-        exit(1);
-    
-    if (!bus_add_match("signal", TP_CHANNEL_CONF_DRAFT, CHANNEL_REMOVED, NULL))
-        exit(1);
-    
-    if (!bus_add_match("signal", TP_CHANNEL_CONF, CHANNEL_MERGED, NULL))
-        exit(1);
-    
-    if (!bus_add_match("signal", TP_CHANNEL_CONF, CHANNEL_REMOVED, NULL))
-        exit(1);
-    
-    if (!bus_add_match("signal", TP_CONFERENCE, MEMBER_CHANNEL_ADDED, NULL))
-        exit(1);
-    
-    if (!bus_add_match("signal", TP_CONFERENCE, MEMBER_CHANNEL_REMOVED, NULL))
+    if (!bus_add_signals())
         exit(1);
 
     bus_query_name(TP_STREAMENGINE_NAME, se_name_query_cb, NULL);
     bus_track_name(TP_STREAMENGINE_NAME, TRUE);
-    
-    if (!dbus_connection_add_filter(bus, dispatch_signal, NULL, NULL)) {
-        OHM_ERROR("Failed to add DBUS filter for signal dispatching.");
-        exit(1);
-    }
 
     
     /*
@@ -490,26 +453,9 @@ bus_exit(void)
         dbus_error_init(&err);
     }
     dbus_connection_unregister_object_path(bus, TELEPHONY_PATH);
-    dbus_connection_remove_filter(bus, dispatch_signal, NULL);
 
     bus_track_name(TP_STREAMENGINE_NAME, FALSE);
-    bus_del_match("signal", TELEPHONY_INTERFACE, NULL, NULL);
-    bus_del_match("signal", TP_CHANNEL_GROUP, MEMBERS_CHANGED, NULL);
-    bus_del_match("signal", TP_CONN_IFREQ, NEW_CHANNELS, NULL);
-    bus_del_match("signal", TP_CHANNEL, CHANNEL_CLOSED, NULL);
-    bus_del_match("signal", TP_CHANNEL_HOLD, HOLD_STATE_CHANGED, NULL);
-    bus_del_match("signal", TP_CHANNEL_STATE, CALL_STATE_CHANGED, NULL);
-    bus_del_match("signal", TP_CHANNEL_CALL, CALL_STATE_CHANGED, NULL);
-    bus_del_match("signal", TP_DIALSTRINGS, SENDING_DIALSTRING, NULL);
-    bus_del_match("signal", TP_DIALSTRINGS, STOPPED_DIALSTRING, NULL);
-    bus_del_match("signal", TP_CHANNEL_MEDIA, STREAM_ADDED, NULL);
-    bus_del_match("signal", TP_CHANNEL_MEDIA, STREAM_REMOVED, NULL);
-    bus_del_match("signal", TP_CHANNEL_CONF_DRAFT, CHANNEL_MERGED, NULL);
-    bus_del_match("signal", TP_CHANNEL_CONF_DRAFT, CHANNEL_REMOVED, NULL);
-    bus_del_match("signal", TP_CHANNEL_CONF, CHANNEL_MERGED, NULL);
-    bus_del_match("signal", TP_CHANNEL_CONF, CHANNEL_REMOVED, NULL);
-    bus_del_match("signal", TP_CONFERENCE, MEMBER_CHANNEL_ADDED, NULL);
-    bus_del_match("signal", TP_CONFERENCE, MEMBER_CHANNEL_REMOVED, NULL);
+    bus_del_signals();
     
     dbus_connection_unref(bus);
     bus = NULL;
@@ -570,83 +516,76 @@ bus_new_session(DBusConnection *c, DBusMessage *msg, void *data)
 }
 
 
+/*
+ * signals we are interested in, the dbus plugin dispatches them to us
+ *
+ * Notes: this has to cover everything dispatch_signal handles. Of the
+ *     policy telephony interface only call_ended was ever handled, so we
+ *     don't need an interface-wide match for it.
+ */
+
+static struct {
+    const char *interface;
+    const char *member;
+} bus_signals[] = {
+    { TELEPHONY_INTERFACE  , CALL_ENDED             },
+    { TP_CONNECTION        , NEW_CHANNEL            },
+    { TP_CHANNEL_GROUP     , MEMBERS_CHANGED        },
+    { TP_CONN_IFREQ        , NEW_CHANNELS           },
+    { TP_CHANNEL           , CHANNEL_CLOSED         },
+    { TP_CHANNEL_HOLD      , HOLD_STATE_CHANGED     },
+    { TP_CHANNEL_STATE     , CALL_STATE_CHANGED     },
+    { TP_CHANNEL_CALL      , CALL_STATE_CHANGED     },
+    { TP_CHANNEL_CALL      , CONTENT_ADDED          },
+    { TP_CHANNEL_CALL      , CONTENT_REMOVED        },
+    { TP_DIALSTRINGS       , SENDING_DIALSTRING     },
+    { TP_DIALSTRINGS       , STOPPED_DIALSTRING     },
+    { TP_CHANNEL_MEDIA     , STREAM_ADDED           },
+    { TP_CHANNEL_MEDIA     , STREAM_REMOVED         },
+    { TP_CHANNEL_CONF_DRAFT, CHANNEL_MERGED         },
+    { TP_CHANNEL_CONF_DRAFT, CHANNEL_REMOVED        },
+    { TP_CHANNEL_CONF      , CHANNEL_MERGED         },
+    { TP_CHANNEL_CONF      , CHANNEL_REMOVED        },
+    { TP_CONFERENCE        , MEMBER_CHANNEL_ADDED   },
+    { TP_CONFERENCE        , MEMBER_CHANNEL_REMOVED },
+    { NULL                 , NULL                   }
+};
+
+
 /********************
- * bus_add_match
+ * bus_add_signals
  ********************/
-int
-bus_add_match(char *type, char *interface, char *member, char *path)
+static int
+bus_add_signals(void)
 {
-#define MATCH(tag) do {                                         \
-        if (tag && tag[0]) {                                    \
-            n  = snprintf(p, l, "%s%s='%s'", t, #tag, tag);     \
-            p += n;                                             \
-            l -= n;                                             \
-            t  = ",";                                           \
-        }                                                       \
-    } while (0)
-
-    DBusError err;
-    char      rule[1024], *p, *t;
-    int       l, n;
-    
-    p = rule;
-    l = sizeof(rule);
-    t = "";
-    
-    MATCH(type);
-    MATCH(interface);
-    MATCH(member);
-    MATCH(path);
+    int i;
 
-    dbus_error_init(&err);
-    dbus_bus_add_match(bus, rule, &err);
-    
-    if (dbus_error_is_set(&err)) {
-        OHM_ERROR("Failed to add DBUS match %s (%s).", rule, err.message);
-        dbus_error_free(&err);
-        return FALSE;
+    for (i = 0; bus_signals[i].interface != NULL; i++) {
+        if (!add_signal(DBUS_BUS_SESSION, NULL,
+                        bus_signals[i].interface, bus_signals[i].member,
+                        NULL, NULL, dispatch_signal, NULL)) {
+            OHM_ERROR("Failed to add DBUS signal handler for %s.%s.",
+                      bus_signals[i].interface, bus_signals[i].member);
+            return FALSE;
+        }
     }
-    else
-        return TRUE;
-#undef MATCH
+
+    return TRUE;
 }
 
 
 /********************
- * bus_del_match
+ * bus_del_signals
  ********************/
-void
-bus_del_match(char *type, char *interface, char *member, char *path)
+static void
+bus_del_signals(void)
 {
-#define MATCH(tag) do {                                         \
-        if (tag && tag[0]) {                                    \
-            n  = snprintf(p, l, "%s%s='%s'", t, #tag, tag);     \
-            p += n;                                             \
-            l -= n;                                             \
-            t  = ",";                                           \
-        }                                                       \
-    } while (0)
-
-    DBusError err;
-    char      rule[1024], *p, *t;
-    int       l, n;
-    
-    p = rule;
-    l = sizeof(rule);
-    t = "";
-    
-    MATCH(type);
-    MATCH(interface);
-    MATCH(member);
-    MATCH(path);
+    int i;
 
-    dbus_error_init(&err);
-    dbus_bus_remove_match(bus, rule, &err);
-    
-    if (dbus_error_is_set(&err))
-        dbus_error_free(&err);
-        
-#undef MATCH
+    for (i = 0; bus_signals[i].interface != NULL; i++)
+        del_signal(DBUS_BUS_SESSION, NULL,
+                   bus_signals[i].interface, bus_signals[i].member,
+                   NULL, NULL, dispatch_signal, NULL);
 }
 
 
@@ -666,39 +605,10 @@ bus_send(DBusMessage *msg, dbus_uint32_t *serial)
 static void
 bus_track_name(const char *name, int track)
 {
-    char       filter[1024];
-    DBusError  error;
-
-    snprintf(filter, sizeof(filter),
-             "type='signal',"
-             "sender='org.freedesktop.DBus',interface='org.freedesktop.DBus',"
-             "member='NameOwnerChanged',path='/org/freedesktop/DBus',"
-             "arg0='%s'", name);
-    
-    /*
-     * Notes:
-     *   We block when adding filters, to minimize (= eliminate ?) the time
-     *   window for the client to crash after it has let us know about itself
-     *   but before we managed to install the filter. According to the docs
-     *   we do not re-enter the main loop and all other messages than the
-     *   reply to AddMatch will get queued and processed once we're back in the
-     *   main loop. On the watch removal path we do not care about errors and
-     *   we do not want to block either.
-     */
-
-    if (track) {
-        dbus_error_init(&error);
-
-        dbus_bus_add_match(bus, filter, &error);
-
-        if (dbus_error_is_set(&error)) {
-            OHM_ERROR("apptrack: failed to add match rule \"%s\": %s", filter,
-                      error.message);
-            dbus_error_free(&error);
-        }
-    }
+    if (track)
+        add_watch(DBUS_BUS_SESSION, name, name_owner_changed, NULL);
     else
-        dbus_bus_remove_match(bus, filter, NULL);
+        del_watch(DBUS_BUS_SESSION, name, name_owner_changed, NULL);
 }
 
 
@@ -909,9 +819,6 @@ dispatch_signal(DBusConnection *c, DBusMessage *msg, void *data)
     if (!interface || !member)
         return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
-    if (MATCHES("org.freedesktop.DBus", "NameOwnerChanged"))
-        return name_owner_changed(c, msg, data);
-
     if (MATCHES(TP_CONNECTION, NEW_CHANNEL))
         return channel_new(c, msg, data);
 
@@ -2154,25 +2061,15 @@ dtmf_mute(DBusConnection *c, DBusMessage *msg, void *data)
 /********************
  * name_owner_changed
  ********************/
-static DBusHandlerResult
-name_owner_changed(DBusConnection *c, DBusMessage *msg, void *data)
+static void
+name_owner_changed(const char *name, const char *before, const char *after,
+                   void *data)
 {
-    const char *name, *before, *after;
-
-    (void)c;
+    (void)before;
     (void)data;
     
-    if (!dbus_message_get_args(msg, NULL,
-                               DBUS_TYPE_STRING, &name,
-                               DBUS_TYPE_STRING, &before,
-                               DBUS_TYPE_STRING, &after,
-                               DBUS_TYPE_INVALID)) {
-        OHM_ERROR("Failed to parse NameOwnerChanged signal.");
-        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
-    }
-    
     if (strcmp(name, TP_STREAMENGINE_NAME))
-        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+        return;
 
     if (!after || !after[0]) {
         OHM_INFO("Telepathy stream engine went down.");
@@ -2185,8 +2082,6 @@ name_owner_changed(DBusConnection *c, DBusMessage *msg, void *data)
         
         bus_query_pid(after, se_pid_query_cb, NULL);
     }
-    
-    return DBUS_HANDLER_RESULT_HANDLED;
 }
 
 
@@ -4711,10 +4606,14 @@ OHM_PLUGIN_DESCRIPTION("telephony", "0.0.1", "krisztian.litkey@nokia.com",
                        OHM_LICENSE_NON_FREE,
                        plugin_init, plugin_exit, NULL);
 
-OHM_PLUGIN_REQUIRES_METHODS(telephony, 3,
+OHM_PLUGIN_REQUIRES_METHODS(telephony, 7,
    OHM_IMPORT("dres.resolve"         , resolve),
    OHM_IMPORT("resource.restimer_add", timer_add),
-   OHM_IMPORT("resource.restimer_del", timer_del)
+   OHM_IMPORT("resource.restimer_del", timer_del),
+   OHM_IMPORT("dbus.add_signal"      , add_signal),
+   OHM_IMPORT("dbus.del_signal"      , del_signal),
+   OHM_IMPORT("dbus.add_watch"       , add_watch),
+   OHM_IMPORT("dbus.del_watch"       , del_watch)
 );
 
 
@@ -18,34 +18,354 @@ USA.
 *************************************************************************/
 
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
 #include <ohm/ohm-plugin.h>
 #include <ohm/ohm-plugin-log.h>
 #include <ohm/ohm-plugin-debug.h>
 
 #include <sp_timestamp.h>
 
+#include "tracepoint.h"
+
 #define PLUGIN_PREFIX   timestamp
 #define PLUGIN_NAME    "timestamp"
 #define PLUGIN_VERSION "0.0.1"
 
+#define DEFAULT_RING_SIZE  16384        /* records per thread */
+#define MAX_RING_SIZE      (1 << 20)
+
+typedef struct {
+    uint64_t  nsec;                     /* CLOCK_MONOTONIC */
+    uint16_t  event;
+    uint8_t   phase;                    /* tracepoint_phase_t */
+    uint8_t   unused;
+    uint32_t  arg[3];
+} trace_record_t;
+
+/*
+ * every thread writes only its own ring, so the writer needs no locks;
+ * head is published with release semantics once the record is complete
+ */
+typedef struct trace_ring_s trace_ring_t;
+
+struct trace_ring_s {
+    trace_ring_t      *next;
+    pid_t              tid;
+    uint32_t           mask;
+    volatile uint32_t  head;            /* total number of records */
+    trace_record_t     records[0];
+};
+
+typedef struct {
+    char *name;
+    int   category;
+} trace_event_t;
+
+static pthread_mutex_t        lock = PTHREAD_MUTEX_INITIALIZER;
+static trace_ring_t          *rings;
+static __thread trace_ring_t *ring;
+static __thread int           ring_failed;
+static uint32_t               ring_size = DEFAULT_RING_SIZE;
+
+/*
+ * the providers and the mask they test are allocated once and never freed:
+ * an importer may hold on to its provider after we are gone, and it must
+ * find the mask cleared instead of unmapped memory
+ */
+static volatile uint32_t     *enabled;
+static tracepoint_provider_t *providers;
+static int                    nprovider;
+static trace_event_t          events[TRACEPOINT_EVENT_MAX];
+static uint32_t               nevent;
+static char                  *enable_spec;  /* for categories to come */
+static char                  *trace_file;
+
+static tracepoint_provider_t *category_find(const char *, int);
+
 
 /********************
- * plugin_init
+ * spec_match
+ ********************/
+static int
+spec_match(const char *spec, const char *name)
+{
+    const char *p;
+    size_t      len = strlen(name);
+
+    for (p = spec; p != NULL && *p; p += strcspn(p, ",")) {
+        while (*p == ',' || *p == ' ')
+            p++;
+
+        if (!strncmp(p, "all", 3) && (p[3] == ',' || p[3] == '\0'))
+            return TRUE;
+
+        if (!strncmp(p, name, len) && (p[len] == ',' || p[len] == '\0'))
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+
+/********************
+ * ring_create
+ ********************/
+static trace_ring_t *
+ring_create(void)
+{
+    trace_ring_t *r;
+
+    r = malloc(sizeof(*r) + ring_size * sizeof(trace_record_t));
+
+    if (r == NULL) {
+        ring_failed = TRUE;
+        return NULL;
+    }
+
+    r->tid  = syscall(SYS_gettid);
+    r->mask = ring_size - 1;
+    r->head = 0;
+
+    pthread_mutex_lock(&lock);
+    r->next = rings;
+    rings   = r;
+    pthread_mutex_unlock(&lock);
+
+    return (ring = r);
+}
+
+
+/********************
+ * record
  ********************/
 static void
-plugin_init(OhmPlugin *plugin)
+record(uint32_t event, int phase, uint32_t a0, uint32_t a1, uint32_t a2)
 {
-    (void)plugin;
+    trace_ring_t    *r = ring;
+    trace_record_t  *rec;
+    struct timespec  ts;
+    uint32_t         head;
+
+    if (r == NULL && (ring_failed || (r = ring_create()) == NULL))
+        return;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    head = r->head;
+    rec  = r->records + (head & r->mask);
+
+    rec->nsec   = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    rec->event  = event;
+    rec->phase  = phase;
+    rec->arg[0] = a0;
+    rec->arg[1] = a1;
+    rec->arg[2] = a2;
+
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
 }
 
 
 /********************
- * plugin_exit
+ * event_register
+ ********************/
+static uint32_t
+event_register(tracepoint_provider_t *tp, const char *name)
+{
+    int      category = tp - providers;
+    uint32_t id;
+
+    pthread_mutex_lock(&lock);
+
+    for (id = 0; id < nevent; id++) {
+        if (events[id].category == category && !strcmp(events[id].name, name))
+            goto out;
+    }
+
+    if (nevent < TRACEPOINT_EVENT_MAX &&
+        (events[nevent].name = strdup(name)) != NULL) {
+        events[nevent].category = category;
+        id = nevent++;
+    }
+    else {
+        OHM_ERROR("timestamp: can't register trace event %s/%s",
+                  tp->category, name);
+        id = TRACEPOINT_EVENT_MAX;       /* dropped by the dump */
+    }
+
+ out:
+    pthread_mutex_unlock(&lock);
+
+    return id;
+}
+
+
+/********************
+ * category_find
+ ********************/
+static tracepoint_provider_t *
+category_find(const char *name, int create)
+{
+    tracepoint_provider_t *tp;
+    int                    i;
+
+    for (i = 0; i < nprovider; i++) {
+        if (!strcmp(providers[i].category, name))
+            return providers + i;
+    }
+
+    if (!create || providers == NULL)
+        return NULL;
+
+    if (nprovider >= TRACEPOINT_CATEGORY_MAX) {
+        OHM_ERROR("timestamp: too many trace categories, %s ignored", name);
+        return NULL;
+    }
+
+    tp = providers + nprovider;
+
+    if ((tp->category = strdup(name)) == NULL)
+        return NULL;
+
+    tp->enabled = enabled;
+    tp->bit     = 1U << nprovider;
+    tp->event   = event_register;
+    tp->record  = record;
+
+    nprovider++;
+
+    if (spec_match(enable_spec, name))
+        __atomic_or_fetch(enabled, tp->bit, __ATOMIC_RELAXED);
+
+    return tp;
+}
+
+
+/********************
+ * json_string
  ********************/
 static void
-plugin_exit(OhmPlugin *plugin)
+json_string(FILE *fp, const char *s)
 {
-    (void)plugin;
+    fputc('"', fp);
+
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            fprintf(fp, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            fprintf(fp, "\\u%04x", *s);
+        else
+            fputc(*s, fp);
+    }
+
+    fputc('"', fp);
+}
+
+
+/********************
+ * dump_ring
+ ********************/
+static int
+dump_ring(FILE *fp, trace_ring_t *r, pid_t pid, int n)
+{
+    trace_record_t *copy, *rec;
+    uint32_t        size = r->mask + 1;
+    uint32_t        first, head, tail, i;
+
+    if ((copy = malloc(size * sizeof(*copy))) == NULL)
+        return n;
+
+    /*
+     * snapshot the ring without stopping the writer: whatever was written
+     * while copying may have overwritten the oldest records, drop those,
+     * including the slot of record tail which may be half written
+     */
+    head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    memcpy(copy, r->records, size * sizeof(*copy));
+    tail = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+
+    first = head > size ? head - size : 0;
+
+    if (tail >= size && tail + 1 - size > first)
+        first = tail + 1 - size;
+
+    for (i = first; i < head; i++) {
+        rec = copy + (i & r->mask);
+
+        if (rec->event >= nevent)
+            continue;
+
+        fprintf(fp, "%s\n{\"name\":", n++ ? "," : "");
+        json_string(fp, events[rec->event].name);
+        fprintf(fp, ",\"cat\":");
+        json_string(fp, providers[events[rec->event].category].category);
+        fprintf(fp, ",\"ph\":\"%c\",\"ts\":%llu.%03u,\"pid\":%d,\"tid\":%d",
+                rec->phase, (unsigned long long)(rec->nsec / 1000),
+                (unsigned int)(rec->nsec % 1000), pid, r->tid);
+
+        if (rec->phase == tracepoint_counter)
+            fprintf(fp, ",\"args\":{\"value\":%u}}", rec->arg[0]);
+        else {
+            if (rec->phase == tracepoint_instant)
+                fprintf(fp, ",\"s\":\"t\"");
+            fprintf(fp, ",\"args\":{\"a0\":%u,\"a1\":%u,\"a2\":%u}}",
+                    rec->arg[0], rec->arg[1], rec->arg[2]);
+        }
+    }
+
+    free(copy);
+
+    return n;
+}
+
+
+/********************
+ * plugin_init
+ ********************/
+static void
+plugin_init(OhmPlugin *plugin)
+{
+    const char *param;
+    char       *end;
+    uint32_t    size;
+
+    if ((param = ohm_plugin_get_param(plugin, "trace-size")) != NULL) {
+        size = strtoul(param, &end, 10);
+
+        if (*end != '\0' || size == 0 || size > MAX_RING_SIZE)
+            OHM_ERROR("timestamp: invalid trace-size '%s'", param);
+        else {
+            for (ring_size = 1; ring_size < size; ring_size <<= 1)
+                ;
+        }
+    }
+
+    if ((param = ohm_plugin_get_param(plugin, "trace")) != NULL &&
+        strcmp(param, "no")) {
+        enable_spec = strdup(param);
+        OHM_INFO("timestamp: tracing categories '%s'", param);
+    }
+
+    if ((param = ohm_plugin_get_param(plugin, "trace-file")) != NULL)
+        trace_file = strdup(param);
+
+    providers = calloc(TRACEPOINT_CATEGORY_MAX, sizeof(*providers));
+    enabled   = calloc(1, sizeof(*enabled));
+
+    if (providers == NULL || enabled == NULL) {
+        OHM_ERROR("timestamp: failed to allocate trace providers");
+        free(providers);
+        free((void *)enabled);
+        providers = NULL;
+        enabled   = NULL;
+    }
 }
 
 
@@ -62,6 +382,159 @@ OHM_EXPORTABLE(void, timestamp_add, (const char *step))
 }
 
 
+/********************
+ * trace_provider
+ ********************/
+OHM_EXPORTABLE(tracepoint_provider_t *, trace_provider, (const char *category))
+{
+    tracepoint_provider_t *tp;
+
+    pthread_mutex_lock(&lock);
+    tp = category_find(category, TRUE);
+    pthread_mutex_unlock(&lock);
+
+    return tp;
+}
+
+
+/********************
+ * trace_enable
+ ********************/
+OHM_EXPORTABLE(int, trace_enable, (const char *categories, int enable))
+{
+    tracepoint_provider_t *tp;
+    uint32_t               mask;
+    const char            *p;
+    char                   name[64];
+    int                    len;
+
+    pthread_mutex_lock(&lock);
+
+    for (p = categories, mask = 0; p != NULL && *p; p += len) {
+        p  += strspn(p, ", ");
+        len = strcspn(p, ", ");
+
+        if (len == 0)
+            break;
+
+        snprintf(name, sizeof(name), "%.*s", len, p);
+
+        if (!strcmp(name, "all")) {
+            /* the ones registered later, too */
+            free(enable_spec);
+            enable_spec = enable ? strdup("all") : NULL;
+
+            mask |= nprovider ? (uint32_t)((1ULL << nprovider) - 1) : 0;
+        }
+        else {
+            /* enabling a category nobody provides (yet) creates it */
+            if ((tp = category_find(name, enable)) != NULL)
+                mask |= tp->bit;
+        }
+    }
+
+    if (enabled == NULL)
+        mask = 0;
+    else if (enable)
+        __atomic_or_fetch(enabled, mask, __ATOMIC_RELAXED);
+    else
+        __atomic_and_fetch(enabled, ~mask, __ATOMIC_RELAXED);
+
+    pthread_mutex_unlock(&lock);
+
+    return __builtin_popcount(mask);
+}
+
+
+/********************
+ * trace_dump
+ ********************/
+OHM_EXPORTABLE(int, trace_dump, (const char *path))
+{
+    FILE         *fp;
+    trace_ring_t *r;
+    pid_t         pid = getpid();
+    int           n;
+
+    if (path == NULL || (fp = fopen(path, "w")) == NULL) {
+        OHM_ERROR("timestamp: can't open trace file %s: %s",
+                  path ? path : "<none>", path ? strerror(errno) : "");
+        return -1;
+    }
+
+    fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+    pthread_mutex_lock(&lock);
+
+    for (r = rings, n = 0; r != NULL; r = r->next) {
+        fprintf(fp, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+                "\"tid\":%d,\"args\":{\"name\":\"%s %d\"}}", n++ ? "," : "",
+                pid, r->tid, r->tid == pid ? "ohmd" : "thread", r->tid);
+        n = dump_ring(fp, r, pid, n);
+    }
+
+    pthread_mutex_unlock(&lock);
+
+    fprintf(fp, "\n]}\n");
+
+    if (fclose(fp) != 0) {
+        OHM_ERROR("timestamp: failed to write trace file %s", path);
+        return -1;
+    }
+
+    OHM_INFO("timestamp: dumped %d trace events to %s", n, path);
+
+    return n;
+}
+
+
+/********************
+ * plugin_exit
+ ********************/
+static void
+plugin_exit(OhmPlugin *plugin)
+{
+    trace_ring_t *r;
+    uint32_t      i;
+    int           j;
+
+    (void)plugin;
+
+    if (enabled != NULL)
+        *enabled = 0;
+
+    if (trace_file != NULL)
+        trace_dump(trace_file);
+
+    while ((r = rings) != NULL) {
+        rings = r->next;
+        free(r);
+    }
+    ring = NULL;
+
+    for (i = 0; i < nevent; i++)
+        free(events[i].name);
+    nevent = 0;
+
+    /*
+     * The importers may hold on to their providers, even after we have
+     * been unloaded. Leave them disabled and without any pointers into
+     * our code, and let the next incarnation allocate its own.
+     */
+    for (j = 0; j < nprovider; j++) {
+        providers[j].event  = NULL;
+        providers[j].record = NULL;
+    }
+    providers = NULL;
+    enabled   = NULL;
+    nprovider = 0;
+
+    free(enable_spec);
+    free(trace_file);
+    enable_spec = trace_file = NULL;
+}
+
+
 /*****************************************************************************
  *                            *** OHM plugin glue ***                        *
  *****************************************************************************/
@@ -72,8 +545,11 @@ OHM_PLUGIN_DESCRIPTION(PLUGIN_NAME,
                        OHM_LICENSE_LGPL, /* OHM_LICENSE_LGPL */
                        plugin_init, plugin_exit, NULL);
 
-OHM_PLUGIN_PROVIDES_METHODS(PLUGIN_PREFIX, 1,
-                            OHM_EXPORT(timestamp_add, "timestamp"));
+OHM_PLUGIN_PROVIDES_METHODS(PLUGIN_PREFIX, 4,
+                            OHM_EXPORT(timestamp_add, "timestamp"),
+                            OHM_EXPORT(trace_provider, "trace_provider"),
+                            OHM_EXPORT(trace_enable, "trace_enable"),
+                            OHM_EXPORT(trace_dump, "trace_dump"));
 
 /* 
  * Local Variables:
@@ -82,4 +558,3 @@ OHM_PLUGIN_PROVIDES_METHODS(PLUGIN_PREFIX, 1,
  * End:
  * vim:set expandtab shiftwidth=4:
  */
-
@@ -0,0 +1,97 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+#ifndef __OHM_TIMESTAMP_TRACEPOINT_H__
+#define __OHM_TIMESTAMP_TRACEPOINT_H__
+
+#include <stdint.h>
+
+/*
+ * Client side of the tracing backend of the timestamp plugin.
+ *
+ * A plugin looks up the exported timestamp.trace_provider method once,
+ * asks it for the provider of its category and registers its event names
+ * with provider->event(). The tracepoints below cost a load and a test
+ * while the category is disabled; when enabled they append a fixed size
+ * record to the ring of the calling thread, no locks are taken.
+ *
+ *     OHM_IMPORTABLE(tracepoint_provider_t *, trace_provider,
+ *                    (const char *category));
+ *
+ *     tp = trace_provider("resource");
+ *     ev = tp->event(tp, "resolve");
+ *     ...
+ *     TRACEPOINT_BEGIN(tp, ev, manager_id, txid, 0);
+ *     ...
+ *     TRACEPOINT_END(tp, ev, manager_id, txid, status);
+ *
+ * Begin and end of a span must come from the same thread. A provider
+ * stays valid after the timestamp plugin is gone, with its tracepoints
+ * disabled for good; only provider->event() must not be called then.
+ */
+
+#define TRACEPOINT_CATEGORY_MAX 32
+#define TRACEPOINT_EVENT_MAX    1024
+
+typedef enum {
+    tracepoint_begin   = 'B',
+    tracepoint_end     = 'E',
+    tracepoint_instant = 'i',
+    tracepoint_counter = 'C',   /* the value is the first argument */
+} tracepoint_phase_t;
+
+typedef struct tracepoint_provider_s tracepoint_provider_t;
+
+struct tracepoint_provider_s {
+    const char        *category;
+    volatile uint32_t *enabled;   /* mask of the enabled categories */
+    uint32_t           bit;       /* the bit of this category */
+    uint32_t         (*event)(tracepoint_provider_t *, const char *);
+    void             (*record)(uint32_t, int, uint32_t, uint32_t, uint32_t);
+};
+
+#define TRACEPOINT_ON(tp)                                               \
+    ((tp) != NULL && __builtin_expect((*(tp)->enabled & (tp)->bit) != 0, 0))
+
+#define TRACEPOINT_RECORD(tp, ev, ph, a0, a1, a2)                       \
+    do {                                                                \
+        if (TRACEPOINT_ON(tp))                                          \
+            (tp)->record(ev, ph, a0, a1, a2);                           \
+    } while (0)
+
+#define TRACEPOINT_BEGIN(tp, ev, a0, a1, a2)                            \
+    TRACEPOINT_RECORD(tp, ev, tracepoint_begin, a0, a1, a2)
+#define TRACEPOINT_END(tp, ev, a0, a1, a2)                              \
+    TRACEPOINT_RECORD(tp, ev, tracepoint_end, a0, a1, a2)
+#define TRACEPOINT_INSTANT(tp, ev, a0, a1, a2)                          \
+    TRACEPOINT_RECORD(tp, ev, tracepoint_instant, a0, a1, a2)
+#define TRACEPOINT_COUNTER(tp, ev, value)                               \
+    TRACEPOINT_RECORD(tp, ev, tracepoint_counter, value, 0, 0)
+
+
+#endif /* __OHM_TIMESTAMP_TRACEPOINT_H__ */
+
+/* 
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */